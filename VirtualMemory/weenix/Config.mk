@@ -91,11 +91,12 @@
 # go breaking it, which we promise you will happen.
 
          SHADOWD=0 # shadow page cleanup
+            KSMD=0 # merge identical anonymous pages (same-page merging daemon)
         MOUNTING=0 # be able to mount multiple file systems
           GETCWD=0 # getcwd(3) syscall-like functionality
-        UPREEMPT=0 # userland preemption
-             MTP=0 # multiple kernel threads per process
-           PIPES=0 # pipe(2) functionality
+        UPREEMPT=1 # userland preemption
+             MTP=1 # multiple kernel threads per process
+           PIPES=1 # pipe(2) functionality
 
 # Set the number of terminals that we should be launching.
         NTERMS=3
@@ -103,6 +104,11 @@
 # Set the number of disks that we should be launching with
         NDISKS=1
 
+# The timer interrupt rate (in Hz), and how many timer ticks a user thread
+# may run before it is preempted (with UPREEMPT=1)
+        TIMER_HZ=100
+        TIMESLICE=2
+
 # terminal binary to use when opening a second terminal for gdb
         GDB_TERM=xterm
         GDB_PORT=1234
@@ -119,6 +125,6 @@
 
 # Boolean options specified in this specified in this file that should be
 # included as definitions at compile time
-        COMPILE_CONFIG_BOOLS=" DRIVERS VFS S5FS VM FI DYNAMIC MOUNTING MTP SHADOWD GETCWD UPREEMPT PIPES "
+        COMPILE_CONFIG_BOOLS=" DRIVERS VFS S5FS VM FI DYNAMIC MOUNTING MTP SHADOWD KSMD GETCWD UPREEMPT PIPES "
 # As above, but not booleans
-        COMPILE_CONFIG_DEFS=" NTERMS NDISKS DBG DISK_SIZE "
+        COMPILE_CONFIG_DEFS=" NTERMS NDISKS DBG DISK_SIZE TIMER_HZ TIMESLICE "
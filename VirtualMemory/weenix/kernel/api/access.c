@@ -36,22 +36,34 @@
 
 /* copy_to_user and copy_from_user are used to copy to and from the
  * user space of the current process.  They first check that the range
- * of addresses has valid mappings, then call vmmap_read/write.
+ * of addresses has valid mappings, then call vmmap_read/write. The
+ * map is held shared throughout, so another thread can not unmap the
+ * range in between.
  */
 int copy_from_user(void *kaddr, const void *uaddr, size_t nbytes)
 {
-        if (!range_perm(curproc, uaddr, nbytes, PROT_READ)) {
-                return -EFAULT;
+        vmmap_t *map = curproc->p_vmmap;
+        int ret = -EFAULT;
+
+        krwlock_rdlock(&map->vmm_lock);
+        if (range_perm(curproc, uaddr, nbytes, PROT_READ)) {
+                ret = vmmap_read(map, uaddr, kaddr, nbytes);
         }
-        return vmmap_read(curproc->p_vmmap, uaddr, kaddr, nbytes);
+        krwlock_unlock(&map->vmm_lock);
+        return ret;
 }
 
 int copy_to_user(void *uaddr, const void *kaddr, size_t nbytes)
 {
-        if (!range_perm(curproc, uaddr, nbytes, PROT_WRITE)) {
-                return -EFAULT;
+        vmmap_t *map = curproc->p_vmmap;
+        int ret = -EFAULT;
+
+        krwlock_rdlock(&map->vmm_lock);
+        if (range_perm(curproc, uaddr, nbytes, PROT_WRITE)) {
+                ret = vmmap_write(map, uaddr, kaddr, nbytes);
         }
-        return vmmap_write(curproc->p_vmmap, uaddr, kaddr, nbytes);
+        krwlock_unlock(&map->vmm_lock);
+        return ret;
 }
 
 /* Like strndup(), but gets the string from user space, ensuring
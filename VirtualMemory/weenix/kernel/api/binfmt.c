@@ -27,6 +27,7 @@
 #include "util/list.h"
 
 #include "mm/kmalloc.h"
+#include "mm/pframe.h"
 
 #include "api/binfmt.h"
 
@@ -103,3 +104,52 @@ cleanup:
         }
         return err;
 }
+
+execimg_t *binfmt_cache_lookup(vnode_t *vn, binfmt_load_func_t loader)
+{
+        execimg_t *img = vn->vn_execimg;
+        if (NULL == img || img->ei_loader != loader) {
+                return NULL;
+        }
+        img->ei_refcount++;
+        return img;
+}
+
+void binfmt_cache_insert(vnode_t *vn, execimg_t *img, uint32_t gen)
+{
+        if (gen != vn->vn_execgen) {
+                return;
+        }
+        /* A dirty page may be written again through a shared mapping
+         * without faulting (and so without invalidating the image), so only
+         * cache files whose pages all match the disk */
+        pframe_t *pf;
+        list_iterate_begin(&vn->vn_mmobj.mmo_respages, pf, pframe_t, pf_olink) {
+                if (pframe_is_dirty(pf)) {
+                        return;
+                }
+        } list_iterate_end();
+        if (NULL != vn->vn_execimg) {
+                execimg_put(vn->vn_execimg);
+        }
+        img->ei_refcount++;
+        vn->vn_execimg = img;
+}
+
+void binfmt_invalidate(vnode_t *vn)
+{
+        vn->vn_execgen++;
+        if (NULL != vn->vn_execimg) {
+                execimg_t *img = vn->vn_execimg;
+                vn->vn_execimg = NULL;
+                execimg_put(img);
+        }
+}
+
+void execimg_put(execimg_t *img)
+{
+        KASSERT(0 < img->ei_refcount);
+        if (0 == --img->ei_refcount) {
+                img->ei_free(img);
+        }
+}
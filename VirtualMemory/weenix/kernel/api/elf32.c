@@ -26,6 +26,7 @@
 #include "mm/kmalloc.h"
 
 #include "vm/vmmap.h"
+#include "vm/timepage.h"
 
 #include "api/elf.h"
 #include "api/binfmt.h"
@@ -46,28 +47,78 @@ static int _elf32_platform_check(const Elf32_Ehdr *header)
                && (ELFDATA2LSB == header->e_ident[EI_DATA]);
 }
 
-/* Helper function for the ELF loader. Maps the specified segment
- * of the program header from the given file in to the given address
- * space with the given memory offset (in pages). On success returns 0, otherwise
- * returns a negative error code for the ELF loader to return.
- * Note that since any error returned by this function should
- * cause the ELF loader to give up, it is acceptable for the
- * address space to be modified after returning an error.
- * Note that memoff can be negative */
-static int _elf32_map_segment(vmmap_t *map, vnode_t *file, int32_t memoff, const Elf32_Phdr *segment)
+/* One PT_LOAD segment of an ELF file, reduced to the mappings it needs. Page
+ * numbers are those given in the file; the loader adds its memoff to them. */
+typedef struct elf32_seg {
+        uint32_t     es_lopage;     /* first page mapped from the file */
+        uint32_t     es_npages;     /* pages mapped from the file (0 if none) */
+        off_t        es_fileoff;    /* file offset of es_lopage */
+        uint32_t     es_zlopage;    /* first zero-filled (bss) page */
+        uint32_t     es_znpages;    /* zero-filled pages (0 if none) */
+        int          es_perms;      /* PROT_* */
+        /* When the file data ends partway through page es_zlopage, that page
+         * is zero-filled like the rest of the bss, so the file data in it
+         * (es_taillen bytes) is kept here to be copied back in. */
+        char        *es_tail;
+        uint32_t     es_taillen;
+} elf32_seg_t;
+
+/* The load plan for an ELF file: everything _elf32_load needs from the file
+ * other than the page contents themselves. Cached on the file's vnode, so
+ * that repeated execs of a binary only have to rebuild the address space. */
+typedef struct elf32_image {
+        execimg_t    im_execimg;
+        Elf32_Half   im_type;       /* ET_EXEC or ET_DYN */
+        uintptr_t    im_entry;
+        Elf32_Half   im_phentsize;
+        Elf32_Half   im_phnum;
+        char        *im_pht;        /* program header table, for AT_PHDR */
+        size_t       im_phtsize;
+        int          im_nsegs;
+        elf32_seg_t *im_segs;
+        char        *im_interp;     /* interpreter path, or NULL if none */
+        void        *im_low;        /* bounds of the PT_LOAD segments, see */
+        void        *im_high;       /* _elf32_calc_progbounds */
+} elf32_image_t;
+
+static int _elf32_load(const char *filename, int fd, char *const argv[],
+                       char *const envp[], uint32_t *eip, uint32_t *esp);
+
+static void _elf32_image_free(execimg_t *execimg)
 {
-        uintptr_t addr;
-        if (memoff < 0) {
-                KASSERT(ADDR_TO_PN(segment->p_vaddr) > (uint32_t) -memoff);
-                addr = (uintptr_t)segment->p_vaddr - (uintptr_t)PN_TO_ADDR(-memoff);
-        } else {
-                addr = (uintptr_t)segment->p_vaddr + (uintptr_t)PN_TO_ADDR(memoff);
+        elf32_image_t *img = (elf32_image_t *)execimg;
+        int i;
+
+        if (NULL != img->im_segs) {
+                for (i = 0; i < img->im_nsegs; ++i) {
+                        if (NULL != img->im_segs[i].es_tail) {
+                                kfree(img->im_segs[i].es_tail);
+                        }
+                }
+                kfree(img->im_segs);
+        }
+        if (NULL != img->im_pht) {
+                kfree(img->im_pht);
+        }
+        if (NULL != img->im_interp) {
+                kfree(img->im_interp);
         }
+        kfree(img);
+}
+
+/* Helper function for the ELF loader. Checks the given program header of a
+ * PT_LOAD segment and works out the mappings it needs in seg, reading in the
+ * file data which shares a page with the start of the bss (if any).
+ * On success returns 0, otherwise returns a negative error code for the ELF
+ * loader to return. */
+static int _elf32_plan_segment(vnode_t *file, const Elf32_Phdr *segment, elf32_seg_t *seg)
+{
+        uintptr_t addr = (uintptr_t)segment->p_vaddr;
         uint32_t off = segment->p_offset;
         uint32_t memsz = segment->p_memsz;
         uint32_t filesz = segment->p_filesz;
 
-        dbg(DBG_ELF, "Mapping program segment: type %#x, offset %#08x,"
+        dbg(DBG_ELF, "Planning program segment: type %#x, offset %#08x,"
             " vaddr %#08x, filesz %#x, memsz %#x, flags %#x, align %#x\n",
             segment->p_type, segment->p_offset, segment->p_vaddr,
             segment->p_filesz, segment->p_memsz, segment->p_flags,
@@ -85,81 +136,104 @@ static int _elf32_map_segment(vmmap_t *map, vnode_t *file, int32_t memoff, const
                 return -ENOEXEC;
         }
 
-        int perms = 0;
+        memset(seg, 0, sizeof(*seg));
         if (PF_R & segment->p_flags) {
-                perms |= PROT_READ;
+                seg->es_perms |= PROT_READ;
         }
         if (PF_W & segment->p_flags) {
-                perms |= PROT_WRITE;
+                seg->es_perms |= PROT_WRITE;
         }
         if (PF_X & segment->p_flags) {
-                perms |= PROT_EXEC;
+                seg->es_perms |= PROT_EXEC;
         }
 
         if (0 < filesz) {
                 /* something needs to be mapped from the file */
                 /* start from the starting address and include enough pages to
                  * map all filesz bytes of the file */
-                uint32_t lopage = ADDR_TO_PN(addr);
-                uint32_t npages = ADDR_TO_PN(addr + filesz - 1) - lopage + 1;
-                off_t fileoff = (off_t)PAGE_ALIGN_DOWN(off);
-
-                int ret;
-                if (!vmmap_is_range_empty(map, lopage, npages)) {
-                        dbg(DBG_ELF, "ERROR: ELF file contains overlapping segments\n");
-                        return -ENOEXEC;
-                } else if (0 > (ret = vmmap_map(map, file, lopage, npages, perms,
-                                                MAP_PRIVATE | MAP_FIXED, fileoff,
-                                                0, NULL))) {
-                        return ret;
-                }
+                seg->es_lopage = ADDR_TO_PN(addr);
+                seg->es_npages = ADDR_TO_PN(addr + filesz - 1) - seg->es_lopage + 1;
+                seg->es_fileoff = (off_t)PAGE_ALIGN_DOWN(off);
         }
 
         if (memsz > filesz) {
                 /* there is left over memory in the segment which must
                  * be initialized to 0 (anonymously mapped) */
-                uint32_t lopage = ADDR_TO_PN(addr + filesz);
-                uint32_t npages = ADDR_TO_PN(PAGE_ALIGN_UP(addr + memsz)) - lopage;
+                seg->es_zlopage = ADDR_TO_PN(addr + filesz);
+                seg->es_znpages = ADDR_TO_PN(PAGE_ALIGN_UP(addr + memsz)) - seg->es_zlopage;
 
-                int ret;
-                if (npages > 1 && !vmmap_is_range_empty(map, lopage + 1, npages - 1)) {
-                        dbg(DBG_ELF, "ERROR: ELF file contains overlapping segments\n");
-                        return -ENOEXEC;
-                } else if (0 > (ret = vmmap_map(map, NULL, lopage, npages, perms,
-                                                MAP_PRIVATE | MAP_FIXED, 0, 0, NULL))) {
-                        return ret;
-                } else if (!PAGE_ALIGNED(addr + filesz) && filesz > 0) {
-                        /* In this case, we have accidentally zeroed too much of memory, as
-                         * we zeroed all memory in the page containing addr + filesz.
+                if (!PAGE_ALIGNED(addr + filesz) && filesz > 0) {
+                        /* In this case, we will accidentally zero too much of memory, as
+                         * we zero all memory in the page containing addr + filesz.
                          * However, the remaining part of the data is not a full page, so we
                          * should not just map in another page (as there could be garbage
                          * after addr+filesz). For instance, consider the data-bss boundary
                          * (c.f. Intel x86 ELF supplement pp. 82).
-                         * To fix this, we need to read in the contents of the file manually
-                         * and put them at that user space addr in the anon map we just
-                         * added. */
-                        void *buf;
-                        if (NULL == (buf = page_alloc()))
+                         * To fix this, we read in the contents of the file manually
+                         * now, and put them at that user space addr in the anon map
+                         * each time the segment is mapped. */
+                        int ret;
+                        seg->es_taillen = PAGE_OFFSET(addr + filesz);
+                        if (NULL == (seg->es_tail = kmalloc(seg->es_taillen))) {
                                 return -ENOMEM;
-                        if (!(0 > (ret = file->vn_ops->read(file, (off_t) PAGE_ALIGN_DOWN(off + filesz),
-                                                            buf, PAGE_OFFSET(addr + filesz))))) {
-                                ret = vmmap_write(map, PAGE_ALIGN_DOWN(addr + filesz),
-                                                  buf, PAGE_OFFSET(addr + filesz));
                         }
-                        page_free(buf);
+                        if (0 > (ret = file->vn_ops->read(file, (off_t) PAGE_ALIGN_DOWN(off + filesz),
+                                                          seg->es_tail, seg->es_taillen))) {
+                                return ret;
+                        }
+                }
+        }
+        return 0;
+}
+
+/* Helper function for the ELF loader. Maps the given planned segment from the
+ * given file in to the given address space with the given memory offset (in
+ * pages). On success returns 0, otherwise returns a negative error code for
+ * the ELF loader to return.
+ * Note that since any error returned by this function should
+ * cause the ELF loader to give up, it is acceptable for the
+ * address space to be modified after returning an error.
+ * Note that memoff can be negative */
+static int _elf32_map_segment(vmmap_t *map, vnode_t *file, int32_t memoff, const elf32_seg_t *seg)
+{
+        int ret;
+
+        if (0 < seg->es_npages) {
+                uint32_t lopage = seg->es_lopage + memoff;
+                KASSERT((int32_t)lopage > 0);
+                if (!vmmap_is_range_empty(map, lopage, seg->es_npages)) {
+                        dbg(DBG_ELF, "ERROR: ELF file contains overlapping segments\n");
+                        return -ENOEXEC;
+                } else if (0 > (ret = vmmap_map(map, file, lopage, seg->es_npages, seg->es_perms,
+                                                MAP_PRIVATE | MAP_FIXED, seg->es_fileoff,
+                                                0, NULL))) {
                         return ret;
                 }
         }
+
+        if (0 < seg->es_znpages) {
+                uint32_t lopage = seg->es_zlopage + memoff;
+                uint32_t npages = seg->es_znpages;
+                KASSERT((int32_t)lopage > 0);
+                if (npages > 1 && !vmmap_is_range_empty(map, lopage + 1, npages - 1)) {
+                        dbg(DBG_ELF, "ERROR: ELF file contains overlapping segments\n");
+                        return -ENOEXEC;
+                } else if (0 > (ret = vmmap_map(map, NULL, lopage, npages, seg->es_perms,
+                                                MAP_PRIVATE | MAP_FIXED, 0, 0, NULL))) {
+                        return ret;
+                } else if (NULL != seg->es_tail) {
+                        return vmmap_write(map, PN_TO_ADDR(lopage), seg->es_tail, seg->es_taillen);
+                }
+        }
         return 0;
 }
 
 /* Read in the given fd's ELF header into the location pointed to by the given
  * argument and does some basic checks that it is a valid ELF file, is an
- * executable, and is for the correct platform
- * interp is 1 if we are loading an interpreter, 0 otherwise
+ * executable or shared object, and is for the correct platform
  * Returns 0 on success, -errno on failure. Returns the ELF header in the header
  * argument. */
-static int _elf32_load_ehdr(int fd, Elf32_Ehdr *header, int interp)
+static int _elf32_load_ehdr(int fd, Elf32_Ehdr *header)
 {
         int err;
         memset(header, 0, sizeof(*header));
@@ -183,9 +257,10 @@ static int _elf32_load_ehdr(int fd, Elf32_Ehdr *header, int interp)
         dbgq(DBG_ELF, "Type:    %d\n", (int)header->e_type);
         dbgq(DBG_ELF, "Machine: %d\n", (int)header->e_machine);
 
-        /* Check that the ELF file is executable and targets
-         * the correct platform */
-        if (ET_EXEC != header->e_type && !(ET_DYN == header->e_type && interp)) {
+        /* Check that the ELF file is loadable and targets the correct
+         * platform. Whether its type suits the caller is checked in
+         * _elf32_get_image, as the result is cached for every caller */
+        if (ET_EXEC != header->e_type && ET_DYN != header->e_type) {
                 dbg(DBG_ELF, "ELF load failed: not exectuable ELF\n");
                 return -ENOEXEC;
         } else if (!_elf32_platform_check(header)) {
@@ -224,29 +299,21 @@ done:
         return err;
 }
 
-/* Maps the PT_LOAD segments for an ELF file into the given address space.
+/* Plans the PT_LOAD segments of an ELF file into img->im_segs.
  * vnode should be the open vnode of the ELF file.
- * map is the address space to map the ELF file into.
- * header is the ELF file's header.
- * pht is the full program header table.
- * memoff is the difference (in pages) between the desired base address and the
- * base address given in the ELF file (usually 0x8048094)
+ * img holds the ELF file's program header table.
  *
- * Returns the number of segments loaded on success, -errno on failure. */
-static int _elf32_map_progsegs(vnode_t *vnode, vmmap_t *map, Elf32_Ehdr *header, char *pht, int32_t memoff)
+ * Returns the number of segments planned on success, -errno on failure. */
+static int _elf32_plan_progsegs(vnode_t *vnode, elf32_image_t *img)
 {
         int err = 0;
 
         uint32_t i = 0;
         int loadcount = 0;
-        for (i = 0; i < header->e_phnum; ++i) {
-                Elf32_Phdr *phtentry = (Elf32_Phdr *)(pht + (i * header->e_phentsize));
+        for (i = 0; i < img->im_phnum; ++i) {
+                Elf32_Phdr *phtentry = (Elf32_Phdr *)(img->im_pht + (i * img->im_phentsize));
                 if (PT_LOAD == phtentry->p_type) {
-                        if (0 > (err = _elf32_map_segment(map, vnode, memoff, phtentry))) {
-                                goto done;
-                        } else {
-                                ++loadcount;
-                        }
+                        ++loadcount;
                 }
         }
 
@@ -256,11 +323,48 @@ static int _elf32_map_progsegs(vnode_t *vnode, vmmap_t *map, Elf32_Ehdr *header,
                 goto done;
         }
 
+        if (NULL == (img->im_segs = kmalloc(loadcount * sizeof(elf32_seg_t)))) {
+                err = -ENOMEM;
+                goto done;
+        }
+        memset(img->im_segs, 0, loadcount * sizeof(elf32_seg_t));
+        img->im_nsegs = loadcount;
+
+        elf32_seg_t *seg = img->im_segs;
+        for (i = 0; i < img->im_phnum; ++i) {
+                Elf32_Phdr *phtentry = (Elf32_Phdr *)(img->im_pht + (i * img->im_phentsize));
+                if (PT_LOAD == phtentry->p_type) {
+                        if (0 > (err = _elf32_plan_segment(vnode, phtentry, seg++))) {
+                                goto done;
+                        }
+                }
+        }
+
         err = loadcount;
 done:
         return err;
 }
 
+/* Maps the planned PT_LOAD segments of an ELF file into the given address space.
+ * vnode should be the open vnode of the ELF file.
+ * map is the address space to map the ELF file into.
+ * img is the ELF file's load plan.
+ * memoff is the difference (in pages) between the desired base address and the
+ * base address given in the ELF file (usually 0x8048094)
+ *
+ * Returns 0 on success, -errno on failure. */
+static int _elf32_map_progsegs(vnode_t *vnode, vmmap_t *map, elf32_image_t *img, int32_t memoff)
+{
+        int err;
+        int i;
+        for (i = 0; i < img->im_nsegs; ++i) {
+                if (0 > (err = _elf32_map_segment(map, vnode, memoff, &img->im_segs[i]))) {
+                        return err;
+                }
+        }
+        return 0;
+}
+
 /* Locates the program header for the interpreter in the given list of program
  * headers through the phinterp out-argument. Returns 0 on success (even if there
  * is no interpreter) or -errno on error. If there is no interpreter section then
@@ -314,6 +418,111 @@ static void _elf32_calc_progbounds(Elf32_Ehdr *header, char *pht, void **low, vo
                 *high = (void *) curhigh;
 }
 
+/* Parses the ELF file open as fd (positioned at its start) into a new load
+ * plan, returned through imgp with one reference.
+ * Returns 0 on success, -errno on failure. */
+static int _elf32_parse_image(int fd, vnode_t *vnode, elf32_image_t **imgp)
+{
+        int err = 0;
+        Elf32_Ehdr header;
+        elf32_image_t *img = NULL;
+
+        if (0 > (err = _elf32_load_ehdr(fd, &header))) {
+                goto done;
+        }
+
+        if (NULL == (img = kmalloc(sizeof(*img)))) {
+                err = -ENOMEM;
+                goto done;
+        }
+        memset(img, 0, sizeof(*img));
+        img->im_execimg.ei_refcount = 1;
+        img->im_execimg.ei_loader = _elf32_load;
+        img->im_execimg.ei_free = _elf32_image_free;
+        img->im_type = header.e_type;
+        img->im_entry = (uintptr_t) header.e_entry;
+        img->im_phentsize = header.e_phentsize;
+        img->im_phnum = header.e_phnum;
+
+        img->im_phtsize = header.e_phentsize * header.e_phnum;
+        if (NULL == (img->im_pht = kmalloc(img->im_phtsize))) {
+                err = -ENOMEM;
+                goto done;
+        }
+        /* Read in the program header table */
+        if (0 > (err = _elf32_load_phtable(fd, &header, img->im_pht, img->im_phtsize))) {
+                goto done;
+        }
+        /* Work out the mappings for the segments in the program header table */
+        if (0 > (err = _elf32_plan_progsegs(vnode, img))) {
+                goto done;
+        }
+
+        Elf32_Phdr *phinterp = NULL;
+        /* Check if program requires an interpreter */
+        if (0 > (err = _elf32_find_phinterp(&header, img->im_pht, &phinterp))) {
+                goto done;
+        }
+        if (NULL != phinterp) {
+                /* read the file name of the interpreter from the binary */
+                if (0 > (err = do_lseek(fd, phinterp->p_offset, SEEK_SET))) {
+                        goto done;
+                } else if (NULL == (img->im_interp = kmalloc(phinterp->p_filesz + 1))) {
+                        err = -ENOMEM;
+                        goto done;
+                } else if (0 > (err = do_read(fd, img->im_interp, phinterp->p_filesz))) {
+                        goto done;
+                }
+                if (err != (int)phinterp->p_filesz) {
+                        err = -ENOEXEC;
+                        goto done;
+                }
+                img->im_interp[phinterp->p_filesz] = '\0';
+        }
+
+        /* Calculate program bounds for future reference */
+        _elf32_calc_progbounds(&header, img->im_pht, &img->im_low, &img->im_high);
+
+        *imgp = img;
+        img = NULL;
+        err = 0;
+done:
+        if (NULL != img) {
+                _elf32_image_free(&img->im_execimg);
+        }
+        return err;
+}
+
+/* Gets the load plan for the ELF file open as fd, from the cache on its
+ * vnode if possible and otherwise by parsing the file (and caching the
+ * result). interp is 1 if we are loading an interpreter, 0 otherwise.
+ * Returns 0 on success and the plan, with a reference the caller must drop
+ * with execimg_put, through imgp. Returns -errno on failure. */
+static int _elf32_get_image(int fd, vnode_t *vnode, int interp, elf32_image_t **imgp)
+{
+        int err;
+        elf32_image_t *img;
+
+        if (NULL != (img = (elf32_image_t *)binfmt_cache_lookup(vnode, _elf32_load))) {
+                dbg(DBG_ELF, "using cached load plan for vnode 0x%p\n", vnode);
+        } else {
+                uint32_t gen = vnode->vn_execgen;
+                if (0 > (err = _elf32_parse_image(fd, vnode, &img))) {
+                        return err;
+                }
+                binfmt_cache_insert(vnode, &img->im_execimg, gen);
+        }
+
+        /* Check that the ELF file is executable */
+        if (ET_EXEC != img->im_type && !(ET_DYN == img->im_type && interp)) {
+                dbg(DBG_ELF, "ELF load failed: not exectuable ELF\n");
+                execimg_put(&img->im_execimg);
+                return -ENOEXEC;
+        }
+        *imgp = img;
+        return 0;
+}
+
 /* Calculates the total size of all the arguments that need to be placed on the
  * user stack before execution can begin. See Intel i386 ELF supplement pp 54-59
  * Returns total size on success. Returns the number of non-NULL entries in
@@ -460,17 +669,14 @@ static int _elf32_load(const char *filename, int fd, char *const argv[],
                        char *const envp[], uint32_t *eip, uint32_t *esp)
 {
         int err = 0;
-        Elf32_Ehdr header;
-        Elf32_Ehdr interpheader;
 
         /* variables to clean up on failure */
         vmmap_t *map = NULL;
         file_t *file = NULL;
-        char *pht = NULL;
-        char *interpname = NULL;
+        elf32_image_t *img = NULL;
         int interpfd = -1;
         file_t *interpfile = NULL;
-        char *interppht = NULL;
+        elf32_image_t *interpimg = NULL;
         Elf32_auxv_t *auxv = NULL;
         char *argbuf = NULL;
 
@@ -479,8 +685,9 @@ static int _elf32_load(const char *filename, int fd, char *const argv[],
         file = fget(fd);
         KASSERT(NULL != file);
 
-        /* Load and verify the ELF header */
-        if (0 > (err = _elf32_load_ehdr(fd, &header, 0))) {
+        /* Get the load plan, parsing and verifying the file if it is not
+         * cached */
+        if (0 > (err = _elf32_get_image(fd, file->f_vnode, 0, &img))) {
                 goto done;
         }
 
@@ -489,89 +696,50 @@ static int _elf32_load(const char *filename, int fd, char *const argv[],
                 goto done;
         }
 
-        size_t phtsize = header.e_phentsize * header.e_phnum;
-        if (NULL == (pht = kmalloc(phtsize))) {
-                err = -ENOMEM;
-                goto done;
-        }
-        /* Read in the program header table */
-        if (0 > (err = _elf32_load_phtable(fd, &header, pht, phtsize))) {
-                goto done;
-        }
-        /* Load the segments in the program header table */
-        if (0 > (err = _elf32_map_progsegs(file->f_vnode, map, &header, pht, 0))) {
+        /* Map in the time page, so that the time can be read without a
+         * system call. This comes first as it sits at a fixed address
+         * right at the top of user memory, which is where anything placed
+         * with VMMAP_DIR_HILO (the interpreter) would otherwise go */
+        if (0 > (err = timepage_map(map))) {
                 goto done;
         }
 
-        Elf32_Phdr *phinterp = NULL;
-        /* Check if program requires an interpreter */
-        if (0 > (err = _elf32_find_phinterp(&header, pht, &phinterp))) {
+        /* Load the segments in the program header table */
+        if (0 > (err = _elf32_map_progsegs(file->f_vnode, map, img, 0))) {
                 goto done;
         }
 
-        /* Calculate program bounds for future reference */
-        void *proglow;
-        void *proghigh;
-        _elf32_calc_progbounds(&header, pht, &proglow, &proghigh);
+        void *proglow = img->im_low;
+        void *proghigh = img->im_high;
 
-        entry = (uintptr_t) header.e_entry;
+        entry = img->im_entry;
 
         /* if an interpreter was requested load it */
-        if (NULL != phinterp) {
-                /* read the file name of the interpreter from the binary */
-                if (0 > (err = do_lseek(fd, phinterp->p_offset, SEEK_SET))) {
-                        goto done;
-                } else if (NULL == (interpname = kmalloc(phinterp->p_filesz))) {
-                        err = -ENOMEM;
-                        goto done;
-                } else if (0 > (err = do_read(fd, interpname, phinterp->p_filesz))) {
-                        goto done;
-                }
-                if (err != (int)phinterp->p_filesz) {
-                        err = -ENOEXEC;
-                        goto done;
-                }
-
+        if (NULL != img->im_interp) {
                 /* open the interpreter */
-                dbgq(DBG_ELF, "ELF Interpreter: %*s\n", phinterp->p_filesz, interpname);
-                if (0 > (interpfd = do_open(interpname, O_RDONLY))) {
+                dbgq(DBG_ELF, "ELF Interpreter: %s\n", img->im_interp);
+                if (0 > (interpfd = do_open(img->im_interp, O_RDONLY))) {
                         err = interpfd;
                         goto done;
                 }
-                kfree(interpname);
-                interpname = NULL;
 
                 interpfile = fget(interpfd);
                 KASSERT(NULL != interpfile);
 
-                /* Load and verify the interpreter ELF header */
-                if (0 > (err = _elf32_load_ehdr(interpfd, &interpheader, 1))) {
-                        goto done;
-                }
-                size_t interpphtsize = interpheader.e_phentsize * interpheader.e_phnum;
-                if (NULL == (interppht = kmalloc(interpphtsize))) {
-                        err = -ENOMEM;
-                        goto done;
-                }
-                /* Read in the program header table */
-                if (0 > (err = _elf32_load_phtable(interpfd, &interpheader, interppht, interpphtsize))) {
+                /* Get the interpreter's load plan */
+                if (0 > (err = _elf32_get_image(interpfd, interpfile->f_vnode, 1, &interpimg))) {
                         goto done;
                 }
 
                 /* Interpreter shouldn't itself need an interpreter */
-                Elf32_Phdr *interpphinterp;
-                if (0 > (err = _elf32_find_phinterp(&interpheader, interppht, &interpphinterp))) {
-                        goto done;
-                }
-                if (NULL != interpphinterp) {
+                if (NULL != interpimg->im_interp) {
                         err = -EINVAL;
                         goto done;
                 }
 
                 /* Calculate the interpreter program size */
-                void *interplow;
-                void *interphigh;
-                _elf32_calc_progbounds(&interpheader, interppht, &interplow, &interphigh);
+                void *interplow = interpimg->im_low;
+                void *interphigh = interpimg->im_high;
                 uint32_t interpnpages = ADDR_TO_PN(PAGE_ALIGN_UP(interphigh)) - ADDR_TO_PN(interplow);
 
                 /* Find space for the interpreter */
@@ -588,10 +756,10 @@ static int _elf32_load(const char *filename, int fd, char *const argv[],
                 /* Offset from "expected base" in number of pages */
                 int32_t interpoff = (int32_t) interppagebase - (int32_t) ADDR_TO_PN(interplow);
 
-                entry = (uintptr_t) interpbase + ((uintptr_t) interpheader.e_entry - (uintptr_t) interplow);
+                entry = (uintptr_t) interpbase + (interpimg->im_entry - (uintptr_t) interplow);
 
-                /* Load the interpreter program header and map in its segments */
-                if (0 > (err = _elf32_map_progsegs(interpfile->f_vnode, map, &interpheader, interppht, interpoff))) {
+                /* Map in the interpreter's segments */
+                if (0 > (err = _elf32_map_progsegs(interpfile->f_vnode, map, interpimg, interpoff))) {
                         goto done;
                 }
 
@@ -606,19 +774,19 @@ static int _elf32_load(const char *filename, int fd, char *const argv[],
 
                 /* Add all the necessary entries */
                 auxvent->a_type = AT_PHDR;
-                auxvent->a_un.a_ptr = pht;
+                auxvent->a_un.a_ptr = img->im_pht;
                 auxvent++;
 
                 auxvent->a_type = AT_PHENT;
-                auxvent->a_un.a_val = header.e_phentsize;
+                auxvent->a_un.a_val = img->im_phentsize;
                 auxvent++;
 
                 auxvent->a_type = AT_PHNUM;
-                auxvent->a_un.a_val = header.e_phnum;
+                auxvent->a_un.a_val = img->im_phnum;
                 auxvent++;
 
                 auxvent->a_type = AT_ENTRY;
-                auxvent->a_un.a_ptr = (void *) header.e_entry;
+                auxvent->a_un.a_ptr = (void *) img->im_entry;
                 auxvent++;
 
                 auxvent->a_type = AT_BASE;
@@ -653,7 +821,7 @@ static int _elf32_load(const char *filename, int fd, char *const argv[],
 
         /* Copy out arguments onto the user stack */
         int argc, envc, auxc;
-        size_t argsize = _elf32_calc_argsize(argv, envp, auxv, phtsize, &argc, &envc, &auxc);
+        size_t argsize = _elf32_calc_argsize(argv, envp, auxv, img->im_phtsize, &argc, &envc, &auxc);
         /* Make sure it fits on the stack */
         if (argsize >= DEFAULT_STACK_SIZE) {
                 err = -E2BIG;
@@ -668,12 +836,15 @@ static int _elf32_load(const char *filename, int fd, char *const argv[],
         void *arglow = (void *)((uintptr_t)(((char *) proglow) - argsize) & ~PTR_MASK);
         /* Copy everything into the user address space, modifying addresses in
          * argv, envp, and auxv to be user addresses as we go. */
-        _elf32_load_args(map, arglow, argsize, argbuf, argv, envp, auxv, argc, envc, auxc, phtsize);
+        _elf32_load_args(map, arglow, argsize, argbuf, argv, envp, auxv, argc, envc, auxc, img->im_phtsize);
 
         dbg(DBG_ELF, "Past the point of no return. Swapping to map at 0x%p, setting brk to 0x%p\n", map, proghigh);
         /* the final threshold / What warm unspoken secrets will we learn? / Beyond
          * the point of no return ... */
 
+        /* A vfork child stops using its parent's mappings here */
+        vfork_release();
+
         /* Give the process the new mappings. */
         vmmap_t *tempmap = curproc->p_vmmap;
         curproc->p_vmmap = map;
@@ -709,11 +880,8 @@ done:
         if (NULL != file) {
                 fput(file);
         }
-        if (NULL != pht) {
-                kfree(pht);
-        }
-        if (NULL != interpname) {
-                kfree(interpname);
+        if (NULL != img) {
+                execimg_put(&img->im_execimg);
         }
         if (0 <= interpfd) {
                 do_close(interpfd);
@@ -721,8 +889,8 @@ done:
         if (NULL != interpfile) {
                 fput(interpfile);
         }
-        if (NULL != interppht) {
-                kfree(interppht);
+        if (NULL != interpimg) {
+                execimg_put(&interpimg->im_execimg);
         }
         if (NULL != auxv) {
                 kfree(auxv);
@@ -18,6 +18,8 @@
 
 #include "util/debug.h"
 
+#include "proc/proc.h"
+
 #include "main/interrupt.h"
 #include "main/gdt.h"
 
@@ -56,7 +58,14 @@ void userland_entry(const regs_t *regs)
 int do_execve(const char *filename, char *const *argv, char *const *envp, struct regs *regs)
 {
         uint32_t eip, esp;
-        int ret = binfmt_load(filename, argv, envp, &eip, &esp);
+        int ret;
+#ifdef __MTP__
+        /* The other threads would return to the old image */
+        if (0 > (ret = proc_cancel_others(THR_CANCELED))) {
+                return ret;
+        }
+#endif
+        ret = binfmt_load(filename, argv, envp, &eip, &esp);
         if (ret < 0) {
                 return ret;
         }
@@ -72,6 +81,11 @@ void kernel_execve(const char *filename, char *const *argv, char *const *envp)
         int ret = binfmt_load(filename, argv, envp, &eip, &esp);
         KASSERT(0 == ret); /* Should never fail to load the first binary */
 
+        userland_start(eip, esp);
+}
+
+void userland_start(uint32_t eip, uint32_t esp)
+{
         dbg(DBG_EXEC, "Entering userland with eip %#08x, esp %#08x\n", eip, esp);
 
         /* To enter userland, we build a set of saved registers to "trick" the processor
@@ -30,6 +30,7 @@
 #include "util/string.h"
 #include "util/debug.h"
 #include "util/list.h"
+#include "util/time.h"
 
 #include "mm/mman.h"
 #include "mm/mm.h"
@@ -37,19 +38,26 @@
 #include "mm/pframe.h"
 #include "mm/kmalloc.h"
 
+#include "fs/poll.h"
 #include "fs/vfs_syscall.h"
 #include "fs/vnode.h"
 
 #include "test/kshell/kshell.h"
 
 #include "vm/brk.h"
+#include "vm/futex.h"
 #include "vm/mmap.h"
 #include "vm/vmmap.h"
+#include "mm/pagetable.h"
 
 #include "api/syscall.h"
 #include "api/utsname.h"
 #include "api/access.h"
 #include "api/exec.h"
+#include "api/time.h"
+#include "api/resource.h"
+#include "api/uio.h"
+#include "api/poll.h"
 
 static void syscall_handler(regs_t *regs);
 static int syscall_dispatch(uint32_t sysnum, uint32_t args, regs_t *regs);
@@ -148,54 +156,282 @@ sys_write(write_args_t *arg)
         return nbytes_written;
 }
 
+/* The most one readv, writev, pread or pwrite moves; anything beyond is
+ * left for the caller to ask for again, as with a short read or write */
+#define RW_MAX          (16 * PAGE_SIZE)
+
 /*
- * This is another tricly sys_* function that you will need to write.
- * It's pretty similar to sys_read(), but you don't need
- * to allocate a whole page, just a single dirent_t. call do_getdent in a
- * loop until you have read getdent_args_t->count bytes (or an error
- * occurs).  You should note that count is the number of bytes in the
- * buffer, not the number of dirents, which means that you'll need to loop
- * a max of something like count / sizeof(dirent_t) times.
+ * Copies in the caller's iovec array to uiov and fills in kiov with the
+ * same lengths (cut to RW_MAX in all) laid end to end in one kmalloc'ed
+ * buffer, *bufp, so that the whole vector can be handed to the VFS in one
+ * call. Returns the number of entries of kiov, or an error.
  */
 static int
-sys_getdents(getdents_args_t *arg)
+iov_bounce(const struct iovec *uvec, int iovcnt, struct iovec *uiov,
+           struct iovec *kiov, char **bufp)
 {
-        dbg(DBG_PRINT, "(GRADING3D)\n");
-        getdents_args_t kern_args;
-        int err;
-        err = copy_from_user(&kern_args, arg, sizeof(getdents_args_t));
-        if (err < 0) { // Not sure whether whould this part run
-                dbg(DBG_PRINT, "(GRADING3D)\n");
+        size_t total = 0;
+        int i, err;
+
+        if (iovcnt < 0 || iovcnt > IOV_MAX) {
+                return -EINVAL;
+        }
+        if (0 > (err = copy_from_user(uiov, uvec, iovcnt * sizeof(*uiov)))) {
+                return err;
+        }
+        for (i = 0; i < iovcnt && total < RW_MAX; i++) {
+                kiov[i].iov_len = MIN(uiov[i].iov_len, RW_MAX - total);
+                total += kiov[i].iov_len;
+        }
+        iovcnt = i;
+
+        if (NULL == (*bufp = kmalloc(MAX(total, 1)))) {
+                return -ENOMEM;
+        }
+        for (i = 0, total = 0; i < iovcnt; i++) {
+                kiov[i].iov_base = *bufp + total;
+                total += kiov[i].iov_len;
+        }
+        return iovcnt;
+}
+
+static int
+sys_readv(rwv_args_t *args)
+{
+        struct iovec uiov[IOV_MAX], kiov[IOV_MAX];
+        rwv_args_t kargs;
+        size_t n;
+        char *buf;
+        int i, iovcnt, ret, err;
+
+        if (0 > (err = copy_from_user(&kargs, args, sizeof(kargs)))) {
                 curthr->kt_errno = -err;
                 return -1;
         }
+        if (0 > (iovcnt = iov_bounce(kargs.rwv_iov, kargs.rwv_iovcnt, uiov, kiov, &buf))) {
+                curthr->kt_errno = -iovcnt;
+                return -1;
+        }
 
-        dirent_t de;
-        int i = 0; 
-        int times = (int)kern_args.count/sizeof(dirent_t);
-        int result = 0;
+        if (0 > (ret = do_readv(kargs.rwv_fd, kiov, iovcnt))) {
+                kfree(buf);
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        for (i = 0, n = ret; i < iovcnt && n > 0; i++) {
+                size_t len = MIN(kiov[i].iov_len, n);
+                if (0 > (err = copy_to_user(uiov[i].iov_base, kiov[i].iov_base, len))) {
+                        kfree(buf);
+                        curthr->kt_errno = -err;
+                        return -1;
+                }
+                n -= len;
+        }
+
+        kfree(buf);
+        return ret;
+}
 
-        while (i < times) {
-                int ret_val;
-                ret_val = do_getdent(kern_args.fd, &de);
-                if (ret_val < 0) {
-                        dbg(DBG_PRINT, "(GRADING3D)\n");
-                        curthr->kt_errno = -ret_val;
+static int
+sys_writev(rwv_args_t *args)
+{
+        struct iovec uiov[IOV_MAX], kiov[IOV_MAX];
+        rwv_args_t kargs;
+        char *buf;
+        int i, iovcnt, ret, err;
+
+        if (0 > (err = copy_from_user(&kargs, args, sizeof(kargs)))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        if (0 > (iovcnt = iov_bounce(kargs.rwv_iov, kargs.rwv_iovcnt, uiov, kiov, &buf))) {
+                curthr->kt_errno = -iovcnt;
+                return -1;
+        }
+        for (i = 0; i < iovcnt; i++) {
+                if (0 > (err = copy_from_user(kiov[i].iov_base, uiov[i].iov_base, kiov[i].iov_len))) {
+                        kfree(buf);
+                        curthr->kt_errno = -err;
+                        return -1;
+                }
+        }
+
+        ret = do_writev(kargs.rwv_fd, kiov, iovcnt);
+        kfree(buf);
+        if (ret < 0) {
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        return ret;
+}
+
+static int
+sys_pread(prw_args_t *args)
+{
+        prw_args_t kargs;
+        size_t len;
+        void *buf;
+        int ret, err;
+
+        if (0 > (err = copy_from_user(&kargs, args, sizeof(kargs)))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        len = MIN(kargs.prw_nbytes, RW_MAX);
+        if (NULL == (buf = kmalloc(MAX(len, 1)))) {
+                curthr->kt_errno = ENOMEM;
+                return -1;
+        }
+
+        if (0 > (ret = do_pread(kargs.prw_fd, buf, len, kargs.prw_offset))
+            || 0 > (err = copy_to_user(kargs.prw_buf, buf, ret))) {
+                kfree(buf);
+                curthr->kt_errno = ret < 0 ? -ret : -err;
+                return -1;
+        }
+
+        kfree(buf);
+        return ret;
+}
+
+static int
+sys_pwrite(prw_args_t *args)
+{
+        prw_args_t kargs;
+        size_t len;
+        void *buf;
+        int ret, err;
+
+        if (0 > (err = copy_from_user(&kargs, args, sizeof(kargs)))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        len = MIN(kargs.prw_nbytes, RW_MAX);
+        if (NULL == (buf = kmalloc(MAX(len, 1)))) {
+                curthr->kt_errno = ENOMEM;
+                return -1;
+        }
+
+        if (0 > (err = copy_from_user(buf, kargs.prw_buf, len))) {
+                ret = err;
+        } else {
+                ret = do_pwrite(kargs.prw_fd, buf, len, kargs.prw_offset);
+        }
+
+        kfree(buf);
+        if (ret < 0) {
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        return ret;
+}
+
+static int
+sys_splice(splice_args_t *args)
+{
+        splice_args_t kargs;
+        off_t in_off, out_off;
+        int ret, err;
+
+        if (0 > (err = copy_from_user(&kargs, args, sizeof(kargs)))
+            || (NULL != kargs.spa_in_off && 0 > (err = copy_from_user(&in_off, kargs.spa_in_off, sizeof(off_t))))
+            || (NULL != kargs.spa_out_off && 0 > (err = copy_from_user(&out_off, kargs.spa_out_off, sizeof(off_t))))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+
+        ret = do_splice(kargs.spa_in, (NULL != kargs.spa_in_off) ? &in_off : NULL,
+                        kargs.spa_out, (NULL != kargs.spa_out_off) ? &out_off : NULL,
+                        kargs.spa_count);
+        if (ret < 0) {
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+
+        if ((NULL != kargs.spa_in_off && 0 > (err = copy_to_user(kargs.spa_in_off, &in_off, sizeof(off_t))))
+            || (NULL != kargs.spa_out_off && 0 > (err = copy_to_user(kargs.spa_out_off, &out_off, sizeof(off_t))))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return ret;
+}
+
+static int
+sys_poll(poll_args_t *args)
+{
+        poll_args_t kargs;
+        struct pollfd *fds = NULL;
+        size_t len;
+        int ret, err;
+
+        if (0 > (err = copy_from_user(&kargs, args, sizeof(kargs)))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        if (NFILES < kargs.pa_nfds) {
+                curthr->kt_errno = EINVAL;
+                return -1;
+        }
+        len = kargs.pa_nfds * sizeof(struct pollfd);
+        if (0 < len) {
+                if (NULL == (fds = kmalloc(len))) {
+                        curthr->kt_errno = ENOMEM;
                         return -1;
-                } else if (ret_val == 0) {
-                        dbg(DBG_PRINT, "(GRADING3B)\n");
-                        curthr->kt_errno = 0;
-                        break;
                 }
+                if (0 > (err = copy_from_user(fds, kargs.pa_fds, len))) {
+                        kfree(fds);
+                        curthr->kt_errno = -err;
+                        return -1;
+                }
+        }
 
-                dbg(DBG_PRINT, "(GRADING3B)\n");
-                copy_to_user(kern_args.dirp + i, &de, ret_val);
-                result += ret_val;
-                i += 1;
+        if (0 <= (ret = do_poll(fds, kargs.pa_nfds, kargs.pa_timeout)) && 0 < len
+            && 0 > (err = copy_to_user(kargs.pa_fds, fds, len))) {
+                ret = err;
         }
+        if (NULL != fds)
+                kfree(fds);
+        if (ret < 0) {
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        return ret;
+}
+
+/*
+ * Reads as many dirents as fit in the caller's buffer (and in a page)
+ * with one do_getdents() call, and copies them out with one
+ * copy_to_user().
+ */
+static int
+sys_getdents(getdents_args_t *arg)
+{
+        getdents_args_t kern_args;
+        dirent_t *dirents;
+        int count, ret, err;
 
+        dbg(DBG_PRINT, "(GRADING3D)\n");
+        if (0 > (err = copy_from_user(&kern_args, arg, sizeof(getdents_args_t)))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+
+        count = MIN(kern_args.count, PAGE_SIZE) / sizeof(dirent_t);
+        if (NULL == (dirents = page_alloc())) {
+                curthr->kt_errno = ENOMEM;
+                return -1;
+        }
+
+        if (0 > (ret = do_getdents(kern_args.fd, dirents, count))
+            || 0 > (err = copy_to_user(kern_args.dirp, dirents, ret))) {
+                page_free(dirents);
+                curthr->kt_errno = (ret < 0) ? -ret : -err;
+                return -1;
+        }
+
+        page_free(dirents);
         dbg(DBG_PRINT, "(GRADING3B)\n");
-        return result;
+        return ret;
 }
 
 #ifdef __MOUNTING__
@@ -558,6 +794,26 @@ static void *sys_mmap(mmap_args_t *arg)
         return ret;
 }
 
+static void *sys_mremap(mremap_args_t *arg)
+{
+        mremap_args_t           kargs;
+        void                    *ret;
+        int                     err;
+
+        if (copy_from_user(&kargs, arg, sizeof(mremap_args_t)) < 0) {
+                curthr->kt_errno = EFAULT;
+                return MAP_FAILED;
+        }
+
+        err = do_mremap(kargs.mra_addr, kargs.mra_oldlen, kargs.mra_newlen,
+                        kargs.mra_flags, &ret);
+        if (err < 0) {
+                curthr->kt_errno = -err;
+                return MAP_FAILED;
+        }
+        return ret;
+}
+
 
 static pid_t sys_waitpid(waitpid_args_t *args)
 {
@@ -582,6 +838,167 @@ static pid_t sys_waitpid(waitpid_args_t *args)
         return p;
 }
 
+/* Longest sleep, in ticks, so that time_ticks arithmetic can't wrap */
+#define SLEEP_MAX_TICKS 0x7fffffffU
+
+/* Sleeps for the given number of timer ticks. Returns 0 once they have
+ * passed or -EINTR if the thread was cancelled first, in which case the
+ * ticks left to sleep are stored in *left. */
+static int do_sleep_ticks(uint32_t ticks, uint32_t *left)
+{
+        ktqueue_t q;
+        uint32_t start = time_ticks;
+        int err;
+
+        sched_queue_init(&q);
+        err = sched_timed_sleep_on(&q, ticks);
+        if (-EINTR == err) {
+                uint32_t slept = time_ticks - start;
+                *left = slept < ticks ? ticks - slept : 0;
+                return err;
+        }
+        KASSERT(-ETIME == err);
+        return 0;
+}
+
+static int sys_nanosleep(nanosleep_args_t *args)
+{
+        nanosleep_args_t kargs;
+        struct timespec req, rem;
+        uint32_t ticks, left;
+        int err;
+
+        if (0 > (err = copy_from_user(&kargs, args, sizeof(kargs)))
+            || 0 > (err = copy_from_user(&req, kargs.nsa_req, sizeof(req)))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        if (0 > req.tv_sec || 0 > req.tv_nsec || 1000000000 <= req.tv_nsec) {
+                curthr->kt_errno = EINVAL;
+                return -1;
+        }
+
+        /* Round up, and add a tick since we may be part way through
+         * the current one */
+        if ((uint32_t)req.tv_sec >= SLEEP_MAX_TICKS / TIMER_HZ - 1) {
+                ticks = SLEEP_MAX_TICKS;
+        } else {
+                ticks = req.tv_sec * TIMER_HZ
+                        + (req.tv_nsec + NSEC_PER_TICK - 1) / NSEC_PER_TICK + 1;
+        }
+
+        if (0 > (err = do_sleep_ticks(ticks, &left))) {
+                if (NULL != kargs.nsa_rem) {
+                        rem.tv_sec = left / TIMER_HZ;
+                        rem.tv_nsec = (left % TIMER_HZ) * NSEC_PER_TICK;
+                        copy_to_user(kargs.nsa_rem, &rem, sizeof(rem));
+                }
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return 0;
+}
+
+static int sys_clock_gettime(clock_gettime_args_t *args)
+{
+        clock_gettime_args_t kargs;
+        struct timespec ts;
+        int err;
+
+        if (0 > (err = copy_from_user(&kargs, args, sizeof(kargs)))
+            || 0 > (err = time_gettime(kargs.cga_clock, &ts))
+            || 0 > (err = copy_to_user(kargs.cga_tp, &ts, sizeof(ts)))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return 0;
+}
+
+static int sys_getrusage(getrusage_args_t *args)
+{
+        getrusage_args_t kargs;
+        struct rusage ru;
+        proc_usage_t u;
+        uint64_t ns;
+        uint32_t tables;
+        int err;
+
+        if (0 > (err = copy_from_user(&kargs, args, sizeof(kargs)))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+
+        memset(&ru, 0, sizeof(ru));
+        switch (kargs.gra_who) {
+                case RUSAGE_SELF:
+                case RUSAGE_CHILDREN:
+                        proc_usage(curproc, kargs.gra_who, &u);
+                        break;
+                case RUSAGE_THREAD:
+                        memset(&u, 0, sizeof(u));
+                        proc_usage_add_thread(&u, curthr);
+                        break;
+                default:
+                        curthr->kt_errno = EINVAL;
+                        return -1;
+        }
+        /* Pages are shared by every thread, so a thread's resident set is
+         * its process's */
+        if (RUSAGE_CHILDREN != kargs.gra_who) {
+                pt_usage(curproc->p_pagedir, &tables, &ru.ru_rss);
+        }
+
+        ns = time_cycles_ns(u.pu_cycles);
+        ru.ru_time.tv_sec = ns / NSEC_PER_SEC;
+        ru.ru_time.tv_usec = (ns % NSEC_PER_SEC) / 1000;
+        ru.ru_minflt = u.pu_minflt;
+        ru.ru_majflt = u.pu_majflt;
+        ru.ru_inblock = u.pu_inblock;
+        ru.ru_nvcsw = u.pu_nswitch - u.pu_nivcsw;
+        ru.ru_nivcsw = u.pu_nivcsw;
+        ru.ru_rbytes = u.pu_rbytes;
+        ru.ru_wbytes = u.pu_wbytes;
+
+        if (0 > (err = copy_to_user(kargs.gra_usage, &ru, sizeof(ru)))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return 0;
+}
+
+static int sys_gettimeofday(struct timeval *tv)
+{
+        struct timespec ts;
+        struct timeval ktv;
+        int err;
+
+        time_gettime(CLOCK_REALTIME, &ts);
+        ktv.tv_sec = ts.tv_sec;
+        ktv.tv_usec = ts.tv_nsec / 1000;
+        if (0 > (err = copy_to_user(tv, &ktv, sizeof(ktv)))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return 0;
+}
+
+/* Returns the number of seconds left to sleep (0 unless the sleep was
+ * interrupted) */
+static int sys_sleep(uint32_t seconds)
+{
+        uint32_t ticks, left;
+
+        if (seconds >= SLEEP_MAX_TICKS / TIMER_HZ - 1) {
+                ticks = SLEEP_MAX_TICKS;
+        } else {
+                ticks = seconds * TIMER_HZ + 1;
+        }
+        if (0 > do_sleep_ticks(ticks, &left)) {
+                return (left + TIMER_HZ - 1) / TIMER_HZ;
+        }
+        return 0;
+}
+
 static void *sys_brk(void *addr)
 {
         void *ret;
@@ -703,6 +1120,112 @@ static int sys_fork(regs_t *regs)
         return ret;
 }
 
+static int sys_vfork(regs_t *regs)
+{
+        int ret = do_vfork(regs);
+        if (ret < 0) {
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        return ret;
+}
+
+#ifdef __MTP__
+static int sys_thr_create(thr_create_args_t *arg, regs_t *regs)
+{
+        thr_create_args_t kern_args;
+        int ret;
+
+        if (0 > (ret = copy_from_user(&kern_args, arg, sizeof(kern_args)))
+            || 0 > (ret = do_thr_create(regs, (uint32_t) kern_args.tca_eip,
+                                        (uint32_t) kern_args.tca_esp))) {
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        return ret;
+}
+
+static int sys_thr_join(thr_join_args_t *arg)
+{
+        thr_join_args_t kern_args;
+        kthread_t *thr;
+        void *retval;
+        int err;
+
+        if (0 > (err = copy_from_user(&kern_args, arg, sizeof(kern_args)))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        if (NULL == (thr = kthread_lookup(curproc, kern_args.tja_tid))) {
+                curthr->kt_errno = ESRCH;
+                return -1;
+        }
+        if (0 > (err = kthread_join(thr, &retval))
+            || (NULL != kern_args.tja_retval
+                && 0 > (err = copy_to_user(kern_args.tja_retval, &retval, sizeof(retval))))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return 0;
+}
+
+static int sys_thr_cancel(int tid)
+{
+        kthread_t *thr;
+
+        if (NULL == (thr = kthread_lookup(curproc, tid))) {
+                curthr->kt_errno = ESRCH;
+                return -1;
+        }
+        if (KT_EXITED != thr->kt_state) {
+                kthread_cancel(thr, THR_CANCELED);
+        }
+        return 0;
+}
+
+static int sys_thr_detach(int tid)
+{
+        kthread_t *thr;
+        int err;
+
+        if (NULL == (thr = kthread_lookup(curproc, tid))) {
+                curthr->kt_errno = ESRCH;
+                return -1;
+        }
+        if (0 > (err = kthread_detach(thr))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return 0;
+}
+#endif /* __MTP__ */
+
+static int sys_futex(futex_args_t *args)
+{
+        futex_args_t kargs;
+        int ret;
+
+        if (0 > (ret = copy_from_user(&kargs, args, sizeof(kargs)))) {
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        switch (kargs.fa_op) {
+                case FUTEX_WAIT:
+                        ret = futex_wait(kargs.fa_addr, kargs.fa_val);
+                        break;
+                case FUTEX_WAKE:
+                        ret = futex_wake(kargs.fa_addr, kargs.fa_val);
+                        break;
+                default:
+                        ret = -EINVAL;
+        }
+        if (0 > ret) {
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        return ret;
+}
+
 static void free_vector(char **vect)
 {
         char **temp;
@@ -711,6 +1234,95 @@ static void free_vector(char **vect)
         kfree(vect);
 }
 
+static void free_actions(spawn_action_t *actions, int nactions)
+{
+        int i;
+        for (i = 0; i < nactions; i++) {
+                if (SPAWN_FA_OPEN == actions[i].sa_type && actions[i].sa_path.as_str)
+                        kfree((char *) actions[i].sa_path.as_str);
+        }
+        kfree(actions);
+}
+
+static int sys_spawn(spawn_args_t *args)
+{
+        spawn_args_t kern_args;
+        char *kern_filename = NULL;
+        char **kern_argv = NULL;
+        char **kern_envp = NULL;
+        spawn_action_t *kern_actions = NULL;
+        int nactions = 0;
+        int err, i;
+
+        curthr->kt_errno = 0;
+        if ((err = copy_from_user(&kern_args, args, sizeof(kern_args))) < 0) {
+                curthr->kt_errno = -err;
+                goto cleanup;
+        }
+
+        if (kern_args.nactions < 0 || kern_args.nactions > SPAWN_MAX_ACTIONS) {
+                curthr->kt_errno = EINVAL;
+                goto cleanup;
+        }
+
+        /* copy the name of the executable */
+        if ((kern_filename = user_strdup(&kern_args.filename)) == NULL)
+                goto cleanup;
+
+        /* copy the argument list */
+        if (kern_args.argv.av_vec) {
+                if ((kern_argv = user_vecdup(&kern_args.argv)) == NULL)
+                        goto cleanup;
+        }
+
+        /* copy the environment list */
+        if (kern_args.envp.av_vec) {
+                if ((kern_envp = user_vecdup(&kern_args.envp)) == NULL)
+                        goto cleanup;
+        }
+
+        /* copy the file actions, and the paths of the opens */
+        if (kern_args.nactions > 0) {
+                size_t size = kern_args.nactions * sizeof(spawn_action_t);
+                if ((kern_actions = kmalloc(size)) == NULL) {
+                        curthr->kt_errno = ENOMEM;
+                        goto cleanup;
+                }
+                if ((err = copy_from_user(kern_actions, kern_args.actions, size)) < 0) {
+                        kfree(kern_actions);
+                        kern_actions = NULL;
+                        curthr->kt_errno = -err;
+                        goto cleanup;
+                }
+                for (i = 0; i < kern_args.nactions; i++, nactions++) {
+                        if (SPAWN_FA_OPEN != kern_actions[i].sa_type)
+                                continue;
+                        kern_actions[i].sa_path.as_str = user_strdup(&kern_actions[i].sa_path);
+                        if (kern_actions[i].sa_path.as_str == NULL) {
+                                nactions++;
+                                goto cleanup;
+                        }
+                }
+        }
+
+        err = do_spawn(kern_filename, kern_argv, kern_envp, kern_actions, nactions);
+        if (err < 0)
+                curthr->kt_errno = -err;
+
+cleanup:
+        if (kern_filename)
+                kfree(kern_filename);
+        if (kern_argv)
+                free_vector(kern_argv);
+        if (kern_envp)
+                free_vector(kern_envp);
+        if (kern_actions)
+                free_actions(kern_actions, nactions);
+        if (curthr->kt_errno)
+                return -1;
+        return err;
+}
+
 static int sys_execve(execve_args_t *args, regs_t *regs)
 {
         execve_args_t kern_args;
@@ -854,9 +1466,56 @@ static int syscall_dispatch(uint32_t sysnum, uint32_t args, regs_t *regs)
                 case SYS_fork:
                         return sys_fork(regs);
 
+                case SYS_vfork:
+                        return sys_vfork(regs);
+
+                case SYS_spawn:
+                        return sys_spawn((spawn_args_t *)args);
+
                 case SYS_getpid:
                         return curproc->p_pid;
 
+                case SYS_gettid:
+                        return curthr->kt_tid;
+
+                case SYS_futex:
+                        return sys_futex((futex_args_t *) args);
+
+#ifdef __MTP__
+                case SYS_thr_create:
+                        return sys_thr_create((thr_create_args_t *) args, regs);
+
+                case SYS_thr_join:
+                        return sys_thr_join((thr_join_args_t *) args);
+
+                case SYS_thr_cancel:
+                        return sys_thr_cancel((int) args);
+
+                case SYS_thr_detach:
+                        return sys_thr_detach((int) args);
+#endif
+
+                case SYS_sleep:
+                        return sys_sleep(args);
+
+                case SYS_nanosleep:
+                        return sys_nanosleep((nanosleep_args_t *) args);
+
+                case SYS_clock_gettime:
+                        return sys_clock_gettime((clock_gettime_args_t *) args);
+
+                case SYS_gettimeofday:
+                        return sys_gettimeofday((struct timeval *) args);
+
+                case SYS_getrusage:
+                        return sys_getrusage((getrusage_args_t *) args);
+
+                case SYS_get_free_mem:
+                        return page_free_count() * PAGE_SIZE;
+
+                case SYS_nice:
+                        return sched_set_nice(curthr, curthr->kt_nice + (int)args);
+
                 case SYS_sync:
                         sys_sync();
                         return 0;
@@ -875,6 +1534,9 @@ static int syscall_dispatch(uint32_t sysnum, uint32_t args, regs_t *regs)
                 case SYS_munmap:
                         return sys_munmap((munmap_args_t *) args);
 
+                case SYS_mremap:
+                        return (int) sys_mremap((mremap_args_t *) args);
+
                 case SYS_open:
                         return sys_open((open_args_t *) args);
 
@@ -887,6 +1549,24 @@ static int syscall_dispatch(uint32_t sysnum, uint32_t args, regs_t *regs)
                 case SYS_write:
                         return sys_write((write_args_t *)args);
 
+                case SYS_readv:
+                        return sys_readv((rwv_args_t *) args);
+
+                case SYS_writev:
+                        return sys_writev((rwv_args_t *) args);
+
+                case SYS_pread:
+                        return sys_pread((prw_args_t *) args);
+
+                case SYS_pwrite:
+                        return sys_pwrite((prw_args_t *) args);
+
+                case SYS_splice:
+                        return sys_splice((splice_args_t *) args);
+
+                case SYS_poll:
+                        return sys_poll((poll_args_t *) args);
+
                 case SYS_dup:
                         return sys_dup((int)args);
 
@@ -50,18 +50,6 @@ static tty_ldisc_ops_t n_tty_ops = {
         .process_char = n_tty_process_char
 };
 
-struct n_tty {
-        kmutex_t            ntty_rlock;
-        ktqueue_t           ntty_rwaitq;
-        char               *ntty_inbuf;
-        int                 ntty_rhead;
-        int                 ntty_rawtail;
-        int                 ntty_ckdtail;
-
-        tty_ldisc_t         ntty_ldisc;
-};
-
-
 tty_ldisc_t *
 n_tty_create()
 {
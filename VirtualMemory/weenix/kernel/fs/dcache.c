@@ -0,0 +1,261 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+/*
+ *  FILE: dcache.c
+ *  DESC: cache of directory entries for path resolution, see dcache.h
+ */
+
+#include "kernel.h"
+#include "config.h"
+#include "errno.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+#include "util/string.h"
+
+#include "mm/slab.h"
+
+#include "fs/dcache.h"
+#include "fs/vfs.h"
+#include "fs/vnode.h"
+
+#include "test/kshell/kshell.h"
+#include "test/kshell/io.h"
+
+typedef struct dentry {
+        struct fs          *d_fs;
+        ino_t               d_dir;          /* vnode number of the directory */
+        ino_t               d_vno;          /* vnode number of the entry */
+        int                 d_negative;     /* there is no such entry */
+        uint32_t            d_hash;
+        size_t              d_namelen;
+        char                d_name[NAME_LEN];
+        list_link_t         d_hash_link;    /* on its dcache_hash chain */
+        list_link_t         d_lru_link;     /* on dcache_lru_list */
+} dentry_t;
+
+#define DCACHE_HASH_SIZE 256
+static list_t dcache_hash[DCACHE_HASH_SIZE];
+
+/* Most recently used first */
+static list_t dcache_lru_list;
+static int dcache_count = 0;
+
+static slab_allocator_t *dentry_allocator;
+
+/* For the "dcache" kshell command */
+static uint32_t dcache_nhit = 0;
+static uint32_t dcache_nneg = 0;        /* hits on negative entries */
+static uint32_t dcache_nmiss = 0;
+static uint32_t dcache_nrecycle = 0;
+
+static __attribute__((unused)) void
+dcache_init(void)
+{
+        int i;
+
+        for (i = 0; i < DCACHE_HASH_SIZE; i++) {
+                list_init(&dcache_hash[i]);
+        }
+        list_init(&dcache_lru_list);
+        dentry_allocator = slab_allocator_create("dentry", sizeof(dentry_t));
+        KASSERT(NULL != dentry_allocator);
+}
+init_func(dcache_init);
+
+/* FNV-1a over the name, mixed with the directory */
+static uint32_t
+dcache_hashname(vnode_t *dir, const char *name, size_t len)
+{
+        uint32_t h = 2166136261u ^ (uint32_t) dir->vn_vno ^ ((uintptr_t) dir->vn_fs >> 4);
+        size_t i;
+
+        for (i = 0; i < len; i++) {
+                h = (h ^ (unsigned char) name[i]) * 16777619u;
+        }
+        return h;
+}
+
+static dentry_t *
+dcache_find(vnode_t *dir, const char *name, size_t len, uint32_t hash)
+{
+        dentry_t *d;
+
+        list_iterate_begin(&dcache_hash[hash % DCACHE_HASH_SIZE], d, dentry_t, d_hash_link) {
+                if (d->d_hash == hash && d->d_dir == dir->vn_vno
+                    && d->d_fs == dir->vn_fs && d->d_namelen == len
+                    && 0 == memcmp(d->d_name, name, len)) {
+                        return d;
+                }
+        } list_iterate_end();
+        return NULL;
+}
+
+static void
+dcache_free(dentry_t *d)
+{
+        list_remove(&d->d_hash_link);
+        list_remove(&d->d_lru_link);
+        dcache_count--;
+        slab_obj_free(dentry_allocator, d);
+}
+
+int
+dcache_lookup(vnode_t *dir, const char *name, size_t len, vnode_t **result)
+{
+        dentry_t *d;
+
+        if (NULL == (d = dcache_find(dir, name, len, dcache_hashname(dir, name, len)))) {
+                dcache_nmiss++;
+                return 1;
+        }
+
+        list_remove(&d->d_lru_link);
+        list_insert_head(&dcache_lru_list, &d->d_lru_link);
+        if (d->d_negative) {
+                dcache_nneg++;
+                return -ENOENT;
+        }
+        dcache_nhit++;
+        *result = vget(d->d_fs, d->d_vno);
+        return 0;
+}
+
+void
+dcache_enter(vnode_t *dir, const char *name, size_t len, vnode_t *vn)
+{
+        uint32_t hash = dcache_hashname(dir, name, len);
+        dentry_t *d, *fresh = NULL;
+
+        KASSERT(len <= NAME_LEN);
+        /* An entry for another filesystem (a mount point) could not be
+         * found again by vnode number */
+        if (NULL != vn && vn->vn_fs != dir->vn_fs) {
+                return;
+        }
+
+        d = dcache_find(dir, name, len, hash);
+        if (NULL == d && dcache_count < DCACHE_MAX) {
+                /* The allocation may block, and the caller only shares
+                 * the directory's lock, so another thread may enter the
+                 * same name meanwhile */
+                fresh = slab_obj_alloc(dentry_allocator);
+                if (NULL != fresh && NULL != (d = dcache_find(dir, name, len, hash))) {
+                        slab_obj_free(dentry_allocator, fresh);
+                        fresh = NULL;
+                } else if (NULL != fresh) {
+                        dcache_count++;
+                }
+        }
+
+        if (NULL == d) {
+                if (NULL == fresh) {
+                        if (list_empty(&dcache_lru_list)) {
+                                return;
+                        }
+                        /* recycle the least recently used */
+                        fresh = list_tail(&dcache_lru_list, dentry_t, d_lru_link);
+                        list_remove(&fresh->d_hash_link);
+                        list_remove(&fresh->d_lru_link);
+                        dcache_nrecycle++;
+                }
+                d = fresh;
+                d->d_fs = dir->vn_fs;
+                d->d_dir = dir->vn_vno;
+                d->d_hash = hash;
+                d->d_namelen = len;
+                memcpy(d->d_name, name, len);
+                list_insert_head(&dcache_hash[hash % DCACHE_HASH_SIZE], &d->d_hash_link);
+        } else {
+                list_remove(&d->d_lru_link);
+        }
+        list_insert_head(&dcache_lru_list, &d->d_lru_link);
+
+        d->d_negative = (NULL == vn);
+        d->d_vno = (NULL == vn) ? 0 : vn->vn_vno;
+}
+
+void
+dcache_remove(vnode_t *dir, const char *name, size_t len)
+{
+        dentry_t *d;
+
+        if (NULL != (d = dcache_find(dir, name, len, dcache_hashname(dir, name, len)))) {
+                dcache_free(d);
+        }
+}
+
+void
+dcache_purge_dir(vnode_t *dir)
+{
+        dentry_t *d;
+
+        list_iterate_begin(&dcache_lru_list, d, dentry_t, d_lru_link) {
+                if (d->d_fs == dir->vn_fs && d->d_dir == dir->vn_vno) {
+                        dcache_free(d);
+                }
+        } list_iterate_end();
+}
+
+void
+dcache_purge_fs(struct fs *fs)
+{
+        dentry_t *d;
+
+        list_iterate_begin(&dcache_lru_list, d, dentry_t, d_lru_link) {
+                if (d->d_fs == fs) {
+                        dcache_free(d);
+                }
+        } list_iterate_end();
+}
+
+static int
+dcache_kshell(kshell_t *ksh, int argc, char **argv)
+{
+        uint32_t nlookup = dcache_nhit + dcache_nneg + dcache_nmiss;
+
+        if (argc > 2 || (2 == argc && strcmp(argv[1], "reset"))) {
+                kprintf(ksh, "usage: dcache [reset]\n");
+                return 0;
+        }
+
+        kprintf(ksh, "lookups:         %u\n", nlookup);
+        kprintf(ksh, "  hits:          %u (%u%%)\n", dcache_nhit,
+                nlookup ? dcache_nhit * 100 / nlookup : 0);
+        kprintf(ksh, "  negative hits: %u (%u%%)\n", dcache_nneg,
+                nlookup ? dcache_nneg * 100 / nlookup : 0);
+        kprintf(ksh, "  misses:        %u\n", dcache_nmiss);
+        kprintf(ksh, "entries:         %d of at most %d (%u recycled)\n",
+                dcache_count, DCACHE_MAX, dcache_nrecycle);
+
+        if (2 == argc) {
+                dcache_nhit = dcache_nneg = dcache_nmiss = dcache_nrecycle = 0;
+        }
+        return 0;
+}
+
+static __attribute__((unused)) void
+dcache_kshell_init(void)
+{
+        kshell_add_command("dcache", dcache_kshell,
+                           "show directory entry cache hits, \"dcache reset\" to reset them");
+}
+init_func(dcache_kshell_init);
+init_depends(kshell_init);
@@ -0,0 +1,209 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+/*
+ *  FILE: fdtable.c
+ *  DESC: per-process file descriptor tables, see fdtable.h
+ */
+
+#include "kernel.h"
+#include "config.h"
+#include "errno.h"
+
+#include "util/debug.h"
+#include "util/string.h"
+
+#include "mm/kmalloc.h"
+
+#include "fs/fdtable.h"
+#include "fs/file.h"
+
+/* Words of fdt_used, and of fdt_full, for a table of the given size */
+#define FDT_USED_WORDS(size)    ((size) / 32)
+#define FDT_FULL_WORDS(size)    ((FDT_USED_WORDS(size) + 31) / 32)
+
+fdtable_t *
+fdtable_create(void)
+{
+        fdtable_t *t;
+
+        if (NULL == (t = kmalloc(sizeof(*t)))) {
+                return NULL;
+        }
+        t->fdt_size = 0;
+        t->fdt_files = NULL;
+        t->fdt_used = NULL;
+        t->fdt_full = NULL;
+        if (0 > fdtable_grow(t, NFILES_INIT - 1)) {
+                kfree(t);
+                return NULL;
+        }
+        return t;
+}
+
+/* The three arrays are one allocation, starting with fdt_files */
+int
+fdtable_grow(fdtable_t *t, int fd)
+{
+        struct file **files;
+        uint32_t *used, *full;
+        int size;
+
+        if (fd < t->fdt_size) {
+                return 0;
+        }
+        if (fd >= NFILES) {
+                return -EMFILE;
+        }
+
+        size = t->fdt_size ? t->fdt_size : NFILES_INIT;
+        while (size <= fd) {
+                size *= 2;
+        }
+        size = MIN(size, NFILES);
+
+        files = kmalloc(size * sizeof(*files) + (FDT_USED_WORDS(size)
+                        + FDT_FULL_WORDS(size)) * sizeof(uint32_t));
+        if (NULL == files) {
+                return -ENOMEM;
+        }
+        used = (uint32_t *) (files + size);
+        full = used + FDT_USED_WORDS(size);
+        memset(files, 0, size * sizeof(*files));
+        memset(used, 0, (FDT_USED_WORDS(size) + FDT_FULL_WORDS(size)) * sizeof(uint32_t));
+
+        if (NULL != t->fdt_files) {
+                memcpy(files, t->fdt_files, t->fdt_size * sizeof(*files));
+                memcpy(used, t->fdt_used, FDT_USED_WORDS(t->fdt_size) * sizeof(uint32_t));
+                memcpy(full, t->fdt_full, FDT_FULL_WORDS(t->fdt_size) * sizeof(uint32_t));
+                kfree(t->fdt_files);
+        }
+        t->fdt_size = size;
+        t->fdt_files = files;
+        t->fdt_used = used;
+        t->fdt_full = full;
+        return 0;
+}
+
+void
+fd_reserve(fdtable_t *t, int fd)
+{
+        int w = fd / 32;
+
+        KASSERT(!(t->fdt_used[w] & (1U << (fd % 32))));
+        t->fdt_used[w] |= 1U << (fd % 32);
+        if (~0U == t->fdt_used[w]) {
+                t->fdt_full[w / 32] |= 1U << (w % 32);
+        }
+}
+
+int
+fd_alloc(fdtable_t *t)
+{
+        int nwords = FDT_USED_WORDS(t->fdt_size);
+        int i, w, fd, err;
+
+        for (i = 0; i < FDT_FULL_WORDS(t->fdt_size); i++) {
+                if (~0U != t->fdt_full[i]) {
+                        w = i * 32 + __builtin_ctz(~t->fdt_full[i]);
+                        if (w >= nwords) {
+                                break;
+                        }
+                        fd = w * 32 + __builtin_ctz(~t->fdt_used[w]);
+                        fd_reserve(t, fd);
+                        return fd;
+                }
+        }
+
+        /* all taken */
+        fd = t->fdt_size;
+        if (0 > (err = fdtable_grow(t, fd))) {
+                return err;
+        }
+        fd_reserve(t, fd);
+        return fd;
+}
+
+void
+fd_install(fdtable_t *t, int fd, struct file *f)
+{
+        KASSERT(fd_is_used(t, fd));
+        t->fdt_files[fd] = f;
+}
+
+void
+fd_free(fdtable_t *t, int fd)
+{
+        int w = fd / 32;
+
+        KASSERT(fd_is_used(t, fd));
+        t->fdt_files[fd] = NULL;
+        t->fdt_used[w] &= ~(1U << (fd % 32));
+        t->fdt_full[w / 32] &= ~(1U << (w % 32));
+}
+
+int
+fdtable_copy(fdtable_t *dst, fdtable_t *src)
+{
+        uint32_t bits;
+        int w, fd, err, top = -1;
+
+        /* make room for the highest descriptor at once */
+        for (w = FDT_USED_WORDS(src->fdt_size) - 1; w >= 0; w--) {
+                if (0 != src->fdt_used[w]) {
+                        top = w * 32 + 31 - __builtin_clz(src->fdt_used[w]);
+                        break;
+                }
+        }
+        if (0 > (err = fdtable_grow(dst, top))) {
+                return err;
+        }
+
+        for (w = 0; w * 32 <= top; w++) {
+                for (bits = src->fdt_used[w]; 0 != bits; bits &= bits - 1) {
+                        fd = w * 32 + __builtin_ctz(bits);
+                        if (NULL != src->fdt_files[fd]) {
+                                fref(src->fdt_files[fd]);
+                                fd_reserve(dst, fd);
+                                fd_install(dst, fd, src->fdt_files[fd]);
+                        }
+                }
+        }
+        return 0;
+}
+
+void
+fdtable_destroy(fdtable_t *t)
+{
+        struct file *f;
+        uint32_t bits;
+        int w, fd;
+
+        for (w = 0; w < FDT_USED_WORDS(t->fdt_size); w++) {
+                for (bits = t->fdt_used[w]; 0 != bits; bits &= bits - 1) {
+                        fd = w * 32 + __builtin_ctz(bits);
+                        f = t->fdt_files[fd];
+                        fd_free(t, fd);
+                        if (NULL != f) {
+                                fput(f);
+                        }
+                }
+        }
+        kfree(t->fdt_files);
+        kfree(t);
+}
@@ -31,6 +31,7 @@
 #include "globals.h"
 #include "util/list.h"
 #include "fs/file.h"
+#include "fs/fdtable.h"
 #include "fs/vfs.h"
 #include "fs/vnode.h"
 #include "proc/proc.h"
@@ -91,7 +92,7 @@ fget(int fd)
         } else {
                 if (fd < 0 || fd >= NFILES)
                         return NULL;
-                f = curproc->p_files[fd];
+                f = fd_get(curproc->p_fdt, fd);
         }
         if (f) fref(f);
 
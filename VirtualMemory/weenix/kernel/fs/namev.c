@@ -25,6 +25,7 @@
 #include "util/printf.h"
 #include "util/debug.h"
 
+#include "fs/dcache.h"
 #include "fs/dirent.h"
 #include "fs/fcntl.h"
 #include "fs/stat.h"
@@ -37,6 +38,10 @@
  *
  * If dir has no lookup(), return -ENOTDIR.
  *
+ * What the lookup finds, or that the name is not there, is remembered in
+ * the directory entry cache (see fs/dcache.h), which is asked first. The
+ * caller holds dir's vn_rwlock.
+ *
  * Note: returns with the vnode refcount on *result incremented.
  */
 int
@@ -54,7 +59,14 @@ lookup(vnode_t *dir, const char *name, size_t len, vnode_t **result)
 		return -ENOTDIR;
 	}
 
+	if(1 != (ret_val = dcache_lookup(dir, name, len, result))) {
+		return ret_val;
+	}
+
 	ret_val = dir->vn_ops->lookup(dir, name, len, result);
+	if(len <= NAME_LEN && (0 == ret_val || -ENOENT == ret_val)) {
+		dcache_enter(dir, name, len, 0 == ret_val ? *result : NULL);
+	}
 	dbg(DBG_PRINT, "(GRADING2B)\n");
 
         return ret_val;
@@ -142,7 +154,9 @@ dir_namev(const char *pathname, size_t *namelen, const char **name,
 		KASSERT(NULL != dir_vnode);
 		dbg(DBG_PRINT, "(GRADING2A 2.b)\n");
 
+		krwlock_rdlock(&dir_vnode->vn_rwlock);
 		ret_val = lookup(dir_vnode, l, slash - l, &next_dir_vnode);
+		krwlock_unlock(&dir_vnode->vn_rwlock);
 		if(ret_val != 0) {
 			vput(dir_vnode);
 			dbg(DBG_PRINT, "(GRADING2B)\n");
@@ -220,6 +234,13 @@ open_namev(const char *pathname, int flag, vnode_t **res_vnode, vnode_t *base)
 
 	dbg(DBG_PRINT, "(GRADING2B)\n");
 
+	/* With O_CREAT nobody else may add the name between our lookup
+	 * and create */
+	if(flag & O_CREAT) {
+		krwlock_wrlock(&dir_vnode->vn_rwlock);
+	} else {
+		krwlock_rdlock(&dir_vnode->vn_rwlock);
+	}
         ret_val = lookup(dir_vnode, name, namelen, &result);
 	if(ret_val == 0) {
 		*res_vnode = result;
@@ -230,7 +251,9 @@ open_namev(const char *pathname, int flag, vnode_t **res_vnode, vnode_t *base)
 		dbg(DBG_PRINT, "(GRADING2B)\n");
 
 		ret_val = dir_vnode->vn_ops->create(dir_vnode, name, namelen, &result);
+		dcache_remove(dir_vnode, name, namelen);
 		if(ret_val != 0) {
+			krwlock_unlock(&dir_vnode->vn_rwlock);
 			vput(dir_vnode);
 			dbg(DBG_PRINT, "(GRADING2B)\n");
 			return ret_val;
@@ -239,6 +262,7 @@ open_namev(const char *pathname, int flag, vnode_t **res_vnode, vnode_t *base)
 		dbg(DBG_PRINT, "(GRADING2B)\n");
 	}
 
+	krwlock_unlock(&dir_vnode->vn_rwlock);
 	vput(dir_vnode);
 
 	dbg(DBG_PRINT, "(GRADING2B)\n");
@@ -31,25 +31,26 @@
 #include "fs/vfs.h"
 #include "fs/vnode.h"
 #include "fs/file.h"
+#include "fs/fdtable.h"
 #include "fs/vfs_syscall.h"
 #include "fs/open.h"
 #include "fs/stat.h"
 #include "util/debug.h"
 
-/* find empty index in p->p_files[] */
+/* Reserve the lowest free file descriptor in p->p_fdt. Until a file is
+ * installed in it (fd_install) it reads as closed, but is not handed out
+ * again; give it back with fd_free if the open fails. */
 int
 get_empty_fd(proc_t *p)
 {
         int fd;
 
-        for (fd = 0; fd < NFILES; fd++) {
-                if (!p->p_files[fd])
-                        return fd;
-        }
+        if (0 <= (fd = fd_alloc(p->p_fdt)))
+                return fd;
 
         dbg(DBG_ERROR | DBG_VFS, "ERROR: get_empty_fd: out of file descriptors "
             "for pid %d\n", curproc->p_pid);
-        return -EMFILE;
+        return fd;
 }
 
 /*
@@ -92,14 +93,16 @@ int
 do_open(const char *filename, int oflags)
 {
         int fd = get_empty_fd(curproc);
-        if(fd == -EMFILE) {
+        if(fd < 0) {
                 // out of fd
-                return -EMFILE;
+                return fd;
         }
 
         file_t * f = fget(-1);
-
-        curproc->p_files[fd] = f;
+        if(f == NULL) {
+                fd_free(curproc->p_fdt, fd);
+                return -ENOMEM;
+        }
         
         if(oflags == O_RDONLY) {
                 f->f_mode |= FMODE_READ;
@@ -108,7 +111,7 @@ do_open(const char *filename, int oflags)
         if(oflags & O_WRONLY) {
                 if(oflags & O_RDWR) {
                         fput(f);
-                        curproc->p_files[fd] = NULL;
+                        fd_free(curproc->p_fdt, fd);
                         return -EINVAL;
                 }
                 f->f_mode |= FMODE_WRITE;
@@ -133,13 +136,13 @@ do_open(const char *filename, int oflags)
 
         if(ret) {
                 fput(f);
-                curproc->p_files[fd] = NULL;
+                fd_free(curproc->p_fdt, fd);
                 return ret;
         }
 
         if(S_ISDIR(node->vn_mode) && (oflags & (O_RDWR | O_WRONLY))){
                 fput(f);
-                curproc->p_files[fd] = NULL;
+                fd_free(curproc->p_fdt, fd);
                 vput(node);
                 return -EISDIR;
         }
@@ -147,5 +150,7 @@ do_open(const char *filename, int oflags)
         f->f_vnode = node;
         f->f_pos = 0;
 
+        /* only now can other threads find it */
+        fd_install(curproc->p_fdt, fd, f);
         return fd;
 }
@@ -23,12 +23,15 @@
  *  DATE: Thu Dec 26 17:08:34 2013
  */
 
+#include "kernel.h"
 #include "errno.h"
 #include "globals.h"
 
+#include "fs/fdtable.h"
 #include "fs/file.h"
 #include "fs/open.h"
 #include "fs/pipe.h"
+#include "fs/poll.h"
 #include "fs/stat.h"
 #include "fs/vfs_syscall.h"
 #include "fs/vfs.h"
@@ -37,11 +40,14 @@
 #include "mm/slab.h"
 #include "mm/kmalloc.h"
 
+#include "proc/proc.h"
 #include "proc/sched.h"
 
 #include "util/debug.h"
 #include "util/string.h"
 
+#include "api/poll.h"
+
 #define PIPE_BUF_SIZE 4096
 
 static void pipe_read_vnode(vnode_t *vnode);
@@ -69,6 +75,7 @@ static int pipe_write(vnode_t *vnode, off_t offset, const void *buf, size_t len)
 static int pipe_stat(vnode_t *vnode, struct stat *ss);
 static int pipe_acquire(vnode_t *vnode, file_t *file);
 static int pipe_release(vnode_t *vnode, file_t *file);
+static int pipe_poll(vnode_t *vnode, int events, poll_table_t *pt);
 
 static vnode_ops_t pipe_vops = {
         .read = pipe_read,
@@ -87,7 +94,8 @@ static vnode_ops_t pipe_vops = {
         .release = pipe_release,
         .fillpage = NULL,
         .dirtypage = NULL,
-        .cleanpage = NULL
+        .cleanpage = NULL,
+        .poll = pipe_poll
 };
 
 /* struct pipe defines some data specific to pipes. One of these
@@ -121,6 +129,8 @@ typedef struct pipe {
          */
         ktqueue_t  pv_read_waitq;
         ktqueue_t  pv_write_waitq;
+        /* Woken whenever the pipe may have become readable or writable */
+        pollq_t    pv_pollq;
 } pipe_t;
 
 #define VNODE_TO_PIPE(vn) ((pipe_t *)((vn)->vn_i))
@@ -146,8 +156,24 @@ init_depends(vfs_init);
 static pipe_t *
 pipe_create(void)
 {
-        NOT_YET_IMPLEMENTED("PIPES: pipe_create");
-        return NULL;
+        pipe_t *pipe;
+
+        if (NULL == (pipe = slab_obj_alloc(pipe_allocator)))
+                return NULL;
+        if (NULL == (pipe->pv_buf = kmalloc(PIPE_BUF_SIZE))) {
+                slab_obj_free(pipe_allocator, pipe);
+                return NULL;
+        }
+        pipe->pv_head = 0;
+        pipe->pv_size = 0;
+        pipe->pv_readers = 0;
+        pipe->pv_writers = 0;
+        kmutex_init(&pipe->pv_rdlock);
+        kmutex_init(&pipe->pv_wrlock);
+        sched_queue_init(&pipe->pv_read_waitq);
+        sched_queue_init(&pipe->pv_write_waitq);
+        pollq_init(&pipe->pv_pollq);
+        return pipe;
 }
 
 /*
@@ -156,7 +182,11 @@ pipe_create(void)
 static void
 pipe_destroy(pipe_t *pipe)
 {
-        NOT_YET_IMPLEMENTED("PIPES: pipe_destroy");
+        KASSERT(0 == pipe->pv_readers && 0 == pipe->pv_writers);
+        KASSERT(list_empty(&pipe->pv_pollq.pq_entries));
+
+        kfree(pipe->pv_buf);
+        slab_obj_free(pipe_allocator, pipe);
 }
 
 /* pipefs vnode operations */
@@ -182,12 +212,11 @@ static int
 pipe_query_vnode(vnode_t *vnode)
 {
         /*
-         * Since we are not using the VM subsystem for
-         * this type of vnode, there is no reason for
-         * us to return 0 -- there will never be pages
-         * to clean up.
+         * A pipe can never be looked up again once its
+         * files are closed, so it is freed straight away
+         * rather than kept among the unreferenced vnodes.
          */
-        return 1;
+        return 0;
 }
 
 /*
@@ -203,8 +232,17 @@ pipe_query_vnode(vnode_t *vnode)
 static vnode_t *
 pget(void)
 {
-        NOT_YET_IMPLEMENTED("PIPES: pget");
-        return NULL;
+        vnode_t *vn;
+        pipe_t *pipe;
+
+        if (NULL == (vn = vget(&pipe_fs, next_pno++)))
+                return NULL;
+        if (NULL == (pipe = pipe_create())) {
+                vput(vn);
+                return NULL;
+        }
+        vn->vn_i = pipe;
+        return vn;
 }
 
 /*
@@ -221,28 +259,85 @@ pget(void)
 int
 do_pipe(int pipefd[2])
 {
-        NOT_YET_IMPLEMENTED("PIPES: do_pipe");
-        return -ENOTSUP;
+        file_t *rf = NULL, *wf = NULL;
+        vnode_t *vn;
+        int rfd, wfd, err;
+
+        if (NULL == (vn = pget()))
+                return -ENOMEM;
+        if (0 > (err = rfd = get_empty_fd(curproc)))
+                goto put_vnode;
+        if (0 > (err = wfd = get_empty_fd(curproc)))
+                goto free_rfd;
+        if (NULL == (rf = fget(-1)) || NULL == (wf = fget(-1))) {
+                err = -ENOMEM;
+                goto free_files;
+        }
+
+        rf->f_mode = FMODE_READ;
+        wf->f_mode = FMODE_WRITE;
+        /* one reference for each end */
+        vref(vn);
+        facq(rf, vn);
+        facq(wf, vn);
+
+        fd_install(curproc->p_fdt, rfd, rf);
+        fd_install(curproc->p_fdt, wfd, wf);
+        pipefd[0] = rfd;
+        pipefd[1] = wfd;
+        return 0;
+
+free_files:
+        if (NULL != rf)
+                fput(rf);
+        fd_free(curproc->p_fdt, wfd);
+free_rfd:
+        fd_free(curproc->p_fdt, rfd);
+put_vnode:
+        vput(vn);
+        return err;
 }
 
 /*
- * When reading from a pipe, you should make sure there are enough characters in
- * the buffer to read. If there are, grab them and move up the tail by subtracting
- * from size. offset is ignored. Also, remember to take the reader lock to prevent
- * other threads from reading while you are waiting for more characters.
+ * When reading from a pipe, wait until there is something in the buffer, then
+ * take as much of it as was asked for and move up the tail by subtracting from
+ * size. offset is ignored. The reader lock keeps other threads from reading
+ * while we wait.
  *
- * This might block, e.g. if there are no or not enough characters to read.
- * It might be the case that there are no more writers and we aren't done reading.
- * However, in situations like this, there is no way to open the pipe for writing
- * again so no more writers will ever put characters in the pipe. The reader should
- * just take as much as it needs (or barring that, as much as it can get) and
- * return with a partial buffer.
+ * Returning what there is rather than waiting for all of len is what lets a
+ * reader which polled the pipe read without blocking. If there are no more
+ * writers and the buffer is empty, nothing will ever come, so return 0 (end
+ * of file).
  */
 static int
 pipe_read(vnode_t *vnode, off_t offset, void *buf, size_t len)
 {
-        NOT_YET_IMPLEMENTED("PIPES: pipe_read");
-        return -EINVAL;
+        pipe_t *pipe = VNODE_TO_PIPE(vnode);
+        size_t n, tail, first;
+        int err;
+
+        if (0 > (err = kmutex_lock_cancellable(&pipe->pv_rdlock)))
+                return err;
+        while (0 == pipe->pv_size && 0 < pipe->pv_writers) {
+                if (0 > (err = sched_cancellable_sleep_on(&pipe->pv_read_waitq))) {
+                        kmutex_unlock(&pipe->pv_rdlock);
+                        return err;
+                }
+        }
+
+        n = MIN(len, pipe->pv_size);
+        tail = (pipe->pv_head + PIPE_BUF_SIZE - pipe->pv_size) % PIPE_BUF_SIZE;
+        first = MIN(n, PIPE_BUF_SIZE - tail);
+        memcpy(buf, pipe->pv_buf + tail, first);
+        memcpy((char *) buf + first, pipe->pv_buf, n - first);
+        pipe->pv_size -= n;
+        kmutex_unlock(&pipe->pv_rdlock);
+
+        if (0 < n) {
+                sched_broadcast_on(&pipe->pv_write_waitq);
+                pollq_wake(&pipe->pv_pollq);
+        }
+        return n;
 }
 
 /*
@@ -251,14 +346,48 @@ pipe_read(vnode_t *vnode, off_t offset, void *buf, size_t len)
  * any potential readers. Like above, you should take the writer lock to make
  * sure your write is contiguous.
  *
+ * A write of at most PIPE_BUF_SIZE waits for room for all of it, so that a
+ * reader never sees part of one; longer writes go in as room is made.
+ *
  * If there are no more readers, we have a broken pipe, and should fail with
- * the EPIPE error number.
+ * the EPIPE error number (unless some of the data has been written already).
  */
 static int
 pipe_write(vnode_t *vnode, off_t offset, const void *buf, size_t len)
 {
-        NOT_YET_IMPLEMENTED("PIPES: pipe_write");
-        return -EINVAL;
+        pipe_t *pipe = VNODE_TO_PIPE(vnode);
+        size_t done = 0, want, n, first;
+        int err;
+
+        if (0 > (err = kmutex_lock_cancellable(&pipe->pv_wrlock)))
+                return err;
+
+        want = len <= PIPE_BUF_SIZE ? len : 1;
+        while (done < len) {
+                while (0 < pipe->pv_readers && PIPE_BUF_SIZE - pipe->pv_size < want) {
+                        if (0 > (err = sched_cancellable_sleep_on(&pipe->pv_write_waitq)))
+                                goto out;
+                }
+                if (0 == pipe->pv_readers) {
+                        err = -EPIPE;
+                        goto out;
+                }
+
+                n = MIN(len - done, PIPE_BUF_SIZE - pipe->pv_size);
+                first = MIN(n, PIPE_BUF_SIZE - (size_t) pipe->pv_head);
+                memcpy(pipe->pv_buf + pipe->pv_head, (const char *) buf + done, first);
+                memcpy(pipe->pv_buf, (const char *) buf + done + first, n - first);
+                pipe->pv_head = (pipe->pv_head + n) % PIPE_BUF_SIZE;
+                pipe->pv_size += n;
+                done += n;
+
+                sched_broadcast_on(&pipe->pv_read_waitq);
+                pollq_wake(&pipe->pv_pollq);
+        }
+
+out:
+        kmutex_unlock(&pipe->pv_wrlock);
+        return 0 < done ? (int) done : err;
 }
 
 /*
@@ -269,8 +398,12 @@ pipe_write(vnode_t *vnode, off_t offset, const void *buf, size_t len)
 static int
 pipe_stat(vnode_t *vnode, struct stat *ss)
 {
-        NOT_YET_IMPLEMENTED("PIPES: pipe_stat");
-        return -EINVAL;
+        memset(ss, 0, sizeof(*ss));
+        ss->st_mode = vnode->vn_mode;
+        ss->st_ino = vnode->vn_vno;
+        ss->st_size = VNODE_TO_PIPE(vnode)->pv_size;
+        ss->st_blksize = PIPE_BUF_SIZE;
+        return 0;
 }
 
 /*
@@ -282,7 +415,12 @@ pipe_stat(vnode_t *vnode, struct stat *ss)
 static int
 pipe_acquire(vnode_t *vnode, file_t *file)
 {
-        NOT_YET_IMPLEMENTED("PIPES: pipe_acquire");
+        pipe_t *pipe = VNODE_TO_PIPE(vnode);
+
+        if (FMODE_READ & file->f_mode)
+                pipe->pv_readers++;
+        if (FMODE_WRITE & file->f_mode)
+                pipe->pv_writers++;
         return 0;
 }
 
@@ -295,6 +433,38 @@ pipe_acquire(vnode_t *vnode, file_t *file)
 static int
 pipe_release(vnode_t *vnode, file_t *file)
 {
-        NOT_YET_IMPLEMENTED("PIPES: pipe_release");
+        pipe_t *pipe = VNODE_TO_PIPE(vnode);
+
+        if ((FMODE_READ & file->f_mode) && 0 == --pipe->pv_readers) {
+                sched_broadcast_on(&pipe->pv_write_waitq);
+                pollq_wake(&pipe->pv_pollq);
+        }
+        if ((FMODE_WRITE & file->f_mode) && 0 == --pipe->pv_writers) {
+                sched_broadcast_on(&pipe->pv_read_waitq);
+                pollq_wake(&pipe->pv_pollq);
+        }
         return 0;
 }
+
+/*
+ * Readable if there is something in the buffer, writable if there is room.
+ * With no writers left the read end has hung up (reading returns 0), and with
+ * no readers left writing fails with EPIPE, which is an error.
+ */
+static int
+pipe_poll(vnode_t *vnode, int events, poll_table_t *pt)
+{
+        pipe_t *pipe = VNODE_TO_PIPE(vnode);
+        int revents = 0;
+
+        poll_wait(&pipe->pv_pollq, pt);
+        if (0 < pipe->pv_size)
+                revents |= POLLIN | POLLRDNORM;
+        if (0 == pipe->pv_writers)
+                revents |= POLLHUP;
+        if (PIPE_BUF_SIZE > pipe->pv_size)
+                revents |= POLLOUT | POLLWRNORM;
+        if (0 == pipe->pv_readers)
+                revents |= POLLERR;
+        return revents;
+}
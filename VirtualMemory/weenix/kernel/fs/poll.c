@@ -0,0 +1,274 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+/*
+ *  FILE: poll.c
+ *  DESC: poll(2), and the wait queues pipes and ttys wake pollers with,
+ *        see poll.h
+ */
+
+#include "kernel.h"
+#include "config.h"
+#include "errno.h"
+#include "globals.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+#include "util/time.h"
+#include "util/workq.h"
+
+#include "main/interrupt.h"
+
+#include "mm/kmalloc.h"
+
+#include "proc/sched.h"
+
+#include "drivers/bytedev.h"
+#include "drivers/tty/n_tty.h"
+#include "drivers/tty/tty.h"
+
+#include "fs/file.h"
+#include "fs/poll.h"
+#include "fs/stat.h"
+#include "fs/vnode.h"
+
+#include "api/poll.h"
+
+/* Every tty's pollers are on the one queue: keys are few and far between */
+static pollq_t tty_pollq;
+static intr_handler_t tty_keyboard_intr;
+static work_t tty_poll_work;
+
+void
+pollq_init(pollq_t *pq)
+{
+        list_init(&pq->pq_entries);
+}
+
+/* The lists are changed at IPL_HIGH since the keyboard's bottom half
+ * walks tty_pollq, in interrupt context */
+void
+poll_wait(pollq_t *pq, poll_table_t *pt)
+{
+        poll_entry_t *pe;
+        uint8_t ipl;
+
+        if (NULL == pt)
+                return;
+        KASSERT(pt->pt_nentries < pt->pt_max);
+
+        pe = &pt->pt_entries[pt->pt_nentries++];
+        pe->pe_q = pq;
+        pe->pe_table = pt;
+
+        ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+        list_insert_tail(&pq->pq_entries, &pe->pe_link);
+        intr_setipl(ipl);
+}
+
+void
+pollq_wake(pollq_t *pq)
+{
+        poll_entry_t *pe;
+        uint8_t ipl;
+
+        ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+        list_iterate_begin(&pq->pq_entries, pe, poll_entry_t, pe_link) {
+                pe->pe_table->pt_triggered = 1;
+                sched_broadcast_on(&pe->pe_table->pt_waitq);
+        } list_iterate_end();
+        intr_setipl(ipl);
+}
+
+/*
+ * The tty driver knows nothing of poll, so what a tty has to read is
+ * read from its line discipline, and its pollers are woken after each
+ * keyboard interrupt, which is when a line can have been finished.
+ */
+int
+tty_poll(bytedev_t *cdev, int events, poll_table_t *pt)
+{
+        tty_device_t *tty = CONTAINER_OF(cdev, tty_device_t, tty_cdev);
+        n_tty_t *ntty = CONTAINER_OF(tty->tty_ldisc, n_tty_t, ntty_ldisc);
+        int revents = POLLOUT | POLLWRNORM;
+
+        poll_wait(&tty_pollq, pt);
+        if (ntty->ntty_ckdtail != ntty->ntty_rhead)
+                revents |= POLLIN | POLLRDNORM;
+        return revents;
+}
+
+static void
+tty_poll_bottom_half(void *arg)
+{
+        if (!list_empty(&tty_pollq.pq_entries))
+                pollq_wake(&tty_pollq);
+}
+
+/* The key only reaches the tty in the keyboard's bottom half (see
+ * main/drvintr.c), which this handler's top half has queued, so the
+ * pollers are woken from another bottom half, which runs after it */
+static void
+tty_poll_intr(regs_t *regs)
+{
+        tty_keyboard_intr(regs);
+        work_queue(&tty_poll_work);
+}
+
+static __attribute__((unused)) void
+poll_init(void)
+{
+        pollq_init(&tty_pollq);
+#ifdef __DRIVERS__
+        work_init(&tty_poll_work, tty_poll_bottom_half, NULL);
+        /* The keyboard driver has registered its handler by now, in
+         * bytedev_init(), and drvintr_init() has split it */
+        tty_keyboard_intr = intr_register(INTR_KEYBOARD, tty_poll_intr);
+        KASSERT(NULL != tty_keyboard_intr);
+#endif
+}
+init_func(poll_init);
+init_depends(drvintr_init);
+
+/*
+ * Which of events f is ready for. Regular files and directories never
+ * make a reader or writer wait; nor do files whose vnode has no poll
+ * operation. Note that the s5fs vnode operation tables predate the poll
+ * operation, so it must not be looked at for their regular files and
+ * directories.
+ */
+static int
+vfs_poll(file_t *f, int events, poll_table_t *pt)
+{
+        vnode_t *vn = f->f_vnode;
+        int revents;
+
+        if (S_ISREG(vn->vn_mode) || S_ISDIR(vn->vn_mode) || NULL == vn->vn_ops->poll)
+                revents = POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM;
+        else
+                revents = vn->vn_ops->poll(vn, events, pt);
+
+        if (!(f->f_mode & FMODE_READ))
+                revents &= ~(POLLIN | POLLRDNORM | POLLPRI);
+        if (!(f->f_mode & FMODE_WRITE))
+                revents &= ~(POLLOUT | POLLWRNORM);
+        return revents & (events | POLLERR | POLLHUP);
+}
+
+/* Rounded up like nanosleep(2), plus one for the part of the current tick
+ * which has gone */
+static uint32_t
+poll_ticks(int timeout)
+{
+        return ((uint64_t) timeout * 1000000 + NSEC_PER_TICK - 1) / NSEC_PER_TICK + 1;
+}
+
+/*
+ * The files are looked at once with the poll table, which puts it on
+ * their pollqs, and afterwards without it each time the table is woken.
+ * The files are held until the end so that their pollqs stay put.
+ *
+ * Wakers set pt_triggered before broadcasting, and it is checked at
+ * IPL_HIGH just before sleeping, so a wakeup between looking at the
+ * files and sleeping (even from an interrupt handler) is not lost.
+ */
+int
+do_poll(struct pollfd *fds, int nfds, int timeout)
+{
+        poll_table_t pt, *wait = &pt;
+        file_t **files = NULL;
+        uint32_t deadline = 0;
+        int32_t left;
+        uint8_t ipl;
+        int i, n, err = 0;
+
+        if (0 > nfds || NFILES < nfds)
+                return -EINVAL;
+
+        sched_queue_init(&pt.pt_waitq);
+        pt.pt_entries = NULL;
+        pt.pt_nentries = 0;
+        pt.pt_max = nfds;
+        if (0 < nfds) {
+                files = kmalloc(nfds * (sizeof(file_t *) + sizeof(poll_entry_t)));
+                if (NULL == files)
+                        return -ENOMEM;
+                pt.pt_entries = (poll_entry_t *)(files + nfds);
+        }
+        for (i = 0; i < nfds; i++)
+                files[i] = 0 > fds[i].fd ? NULL : fget(fds[i].fd);
+        if (0 < timeout)
+                deadline = time_ticks + poll_ticks(timeout);
+
+        for (;;) {
+                pt.pt_triggered = 0;
+                n = 0;
+                for (i = 0; i < nfds; i++) {
+                        fds[i].revents = 0;
+                        if (0 > fds[i].fd)
+                                continue;
+                        if (NULL == files[i])
+                                fds[i].revents = POLLNVAL;
+                        else
+                                fds[i].revents = vfs_poll(files[i], fds[i].events, wait);
+                        if (0 != fds[i].revents)
+                                n++;
+                }
+                wait = NULL;
+                if (0 != n || 0 == timeout)
+                        break;
+
+                ipl = intr_getipl();
+                intr_setipl(IPL_HIGH);
+                if (!pt.pt_triggered) {
+                        if (0 > timeout) {
+                                err = sched_cancellable_sleep_on(&pt.pt_waitq);
+                        } else if (0 < (left = (int32_t)(deadline - time_ticks))) {
+                                err = sched_timed_sleep_on(&pt.pt_waitq, left);
+                        } else {
+                                err = -ETIME;
+                        }
+                }
+                intr_setipl(ipl);
+
+                if (-ETIME == err) {
+                        err = 0;
+                        break;
+                } else if (0 > err) {
+                        break;
+                }
+        }
+
+        ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+        for (i = 0; i < pt.pt_nentries; i++)
+                list_remove(&pt.pt_entries[i].pe_link);
+        intr_setipl(ipl);
+
+        for (i = 0; i < nfds; i++) {
+                if (NULL != files[i])
+                        fput(files[i]);
+        }
+        if (NULL != files)
+                kfree(files);
+
+        return 0 > err ? err : n;
+}
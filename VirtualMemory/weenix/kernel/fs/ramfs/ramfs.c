@@ -661,6 +661,31 @@ ramfs_readdir(vnode_t *dir, off_t offset, struct dirent *d)
         return ret;
 }
 
+/* ramfs_readdir for as many entries as fit in d */
+int
+ramfs_readdirv(vnode_t *dir, off_t *offset, struct dirent *d, int count)
+{
+        ramfs_dirent_t *entry;
+        off_t i;
+        int n = 0;
+
+        KASSERT(S_ISDIR(dir->vn_mode));
+        KASSERT(0 == *offset % sizeof(ramfs_dirent_t));
+
+        entry = VNODE_TO_DIRENT(dir);
+        for (i = *offset / sizeof(ramfs_dirent_t); i < RAMFS_MAX_DIRENT && n < count; i++) {
+                if (!entry[i].rd_name[0])
+                        continue;
+                d[n].d_ino = entry[i].rd_ino;
+                d[n].d_off = 0; /* unused */
+                strncpy(d[n].d_name, entry[i].rd_name, NAME_LEN - 1);
+                d[n].d_name[NAME_LEN - 1] = '\0';
+                n++;
+        }
+        *offset = i * sizeof(ramfs_dirent_t);
+        return n;
+}
+
 static int
 ramfs_stat(vnode_t *file, struct stat *buf)
 {
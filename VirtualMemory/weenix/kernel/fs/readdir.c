@@ -0,0 +1,106 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+/*
+ *  FILE: readdir.c
+ *  DESC: reading many directory entries at once, for getdents
+ */
+
+#include "kernel.h"
+#include "errno.h"
+
+#include "util/debug.h"
+#include "util/string.h"
+
+#include "proc/kmutex.h"
+
+#include "fs/dirent.h"
+#include "fs/s5fs/s5fs.h"
+#include "fs/s5fs/s5fs_subr.h"
+#include "fs/stat.h"
+#include "fs/vfs.h"
+#include "fs/vnode.h"
+
+/* Directory entries s5fs_readdirv reads from the file at once */
+#define S5FS_READDIRV_BATCH     8
+
+/*
+ * s5fs's fs_readdirv. s5fs itself is built into libs5fs.a, whose vnode
+ * operations can't be added to, so this reads the directory the same
+ * way s5fs_readdir() does, with vn_mutex held and through
+ * s5_read_file() (which reads a missing block as zeroes), but several
+ * entries at a time rather than one.
+ */
+int
+s5fs_readdirv(vnode_t *dir, off_t *offset, struct dirent *d, int count)
+{
+        s5_dirent_t s5d[S5FS_READDIRV_BATCH];
+        off_t off = *offset;
+        int n = 0, i, want, ret = 0;
+
+        KASSERT(S_ISDIR(dir->vn_mode));
+        KASSERT(0 == off % sizeof(s5_dirent_t));
+
+        kmutex_lock(&dir->vn_mutex);
+        while (n < count) {
+                want = MIN(count - n, S5FS_READDIRV_BATCH);
+                ret = s5_read_file(dir, off, (char *) s5d, want * sizeof(s5_dirent_t));
+                if (0 >= ret) {
+                        break;
+                }
+                for (i = 0; i < ret / (int) sizeof(s5_dirent_t); i++, n++) {
+                        d[n].d_ino = s5d[i].s5d_inode;
+                        d[n].d_off = off + sizeof(s5_dirent_t);
+                        strncpy(d[n].d_name, s5d[i].s5d_name, MIN(NAME_LEN, S5_NAME_LEN));
+                        d[n].d_name[MIN(NAME_LEN, S5_NAME_LEN)] = '\0';
+                        off += sizeof(s5_dirent_t);
+                }
+                if (ret < want * (int) sizeof(s5_dirent_t)) {
+                        break;
+                }
+        }
+        kmutex_unlock(&dir->vn_mutex);
+
+        *offset = off;
+        return (0 == n && 0 > ret) ? ret : n;
+}
+
+/*
+ * Reads up to count entries of dir from *offset, with the filesystem's
+ * fs_readdirv if it has one and otherwise with one readdir call per
+ * entry, and advances *offset past them. Returns the number of entries
+ * read or -errno. The caller holds dir's vn_rwlock shared, as for
+ * readdir.
+ */
+int
+vfs_readdirv(vnode_t *dir, off_t *offset, struct dirent *d, int count)
+{
+        int n, ret;
+
+        if (NULL != dir->vn_fs->fs_readdirv) {
+                return dir->vn_fs->fs_readdirv(dir, offset, d, count);
+        }
+
+        for (n = 0; n < count; n++) {
+                if (0 >= (ret = dir->vn_ops->readdir(dir, *offset, &d[n]))) {
+                        return (0 == n) ? ret : n;
+                }
+                *offset += ret;
+        }
+        return n;
+}
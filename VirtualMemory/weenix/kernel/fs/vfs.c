@@ -33,6 +33,7 @@
 #ifdef __S5FS__
 #include "fs/s5fs/s5fs.h"
 #endif
+#include "fs/dcache.h"
 #include "fs/vfs.h"
 #include "fs/file.h"
 #include "fs/vnode.h"
@@ -184,6 +185,10 @@ vfs_shutdown()
                       "filesystem!!! This shouldn't happen!!\n");
         }
 
+        /* vnodes kept after their last vput are not in use either */
+        vnode_cache_purge(fs);
+        dcache_purge_fs(fs);
+
         if (vn->vn_fs->fs_op->umount) {
                 ret = vn->vn_fs->fs_op->umount(fs);
         } else {
@@ -203,7 +208,8 @@ vfs_shutdown()
 
 /*
  * Given an fs_t, we search through the list of known file systems
- * and call the proper mount function.
+ * and call the proper mount function. A successful mount also gets the
+ * filesystem's fs_readdirv, see readdir.c.
  */
 int
 mountfunc(fs_t *fs)
@@ -211,17 +217,23 @@ mountfunc(fs_t *fs)
         static const struct {
                 char *fstype;
                 int (*mountfunc)(fs_t *);
+                int (*readdirv)(vnode_t *, off_t *, struct dirent *, int);
         } types[] = {
 #ifdef __S5FS__
-                { "s5fs", s5fs_mount },
+                { "s5fs", s5fs_mount, s5fs_readdirv },
 #endif
-                { "ramfs", ramfs_mount },
+                { "ramfs", ramfs_mount, ramfs_readdirv },
         };
         unsigned i;
+        int err;
 
-        for (i = 0; i < sizeof(types) / sizeof(types[0]); i++)
-                if (strcmp(fs->fs_type, types[i].fstype) == 0)
-                        return types[i].mountfunc(fs);
+        for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+                if (strcmp(fs->fs_type, types[i].fstype) == 0) {
+                        if (0 == (err = types[i].mountfunc(fs)))
+                                fs->fs_readdirv = types[i].readdirv;
+                        return err;
+                }
+        }
 
         return -EINVAL;
 }
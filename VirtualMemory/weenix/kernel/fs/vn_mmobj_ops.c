@@ -16,8 +16,11 @@
 /*         will be deducted.                                                  */
 /******************************************************************************/
 
+#include "globals.h"
 #include "errno.h"
 #include "fs/vnode.h"
+#include "proc/kthread.h"
+#include "api/binfmt.h"
 #include "util/debug.h"
 /*
  * Related to implementation of vnode vm_object entry points:
@@ -60,6 +63,7 @@ vreadpage(mmobj_t *o, pframe_t *pf)
         KASSERT(NULL != o);
 
         vnode_t *v = mmobj_to_vnode(o);
+        curthr->kt_inblock++;
         return v->vn_ops->fillpage(v, (int)PN_TO_ADDR(pf->pf_pagenum), pf->pf_addr);
 }
 
@@ -71,6 +75,7 @@ vdirtypage(mmobj_t *o, pframe_t *pf)
 
         vnode_t *v = mmobj_to_vnode(o);
         if (!pframe_is_dirty(pf)) {
+                binfmt_invalidate(v);
                 return v->vn_ops->dirtypage(v, (int) PN_TO_ADDR(pf->pf_pagenum));
         } else {
                 return 0;
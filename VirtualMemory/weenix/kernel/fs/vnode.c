@@ -28,6 +28,9 @@
 #include "util/string.h"
 #include "util/printf.h"
 #include "errno.h"
+#include "drivers/dev.h"
+#include "drivers/tty/tty.h"
+#include "fs/poll.h"
 #include "fs/stat.h"
 #include "fs/vfs.h"
 #include "fs/vnode.h"
@@ -35,12 +38,37 @@
 #include "proc/sched.h"
 #include "util/debug.h"
 #include "vm/vmmap.h"
+#include "api/binfmt.h"
+#include "api/poll.h"
 #include "globals.h"
 
+#include "test/kshell/kshell.h"
+#include "test/kshell/io.h"
+
 static slab_allocator_t *vnode_allocator;
 
 static list_t vnode_inuse_list;
 
+/* In-core vnodes by filesystem and vnode number, see vget */
+#define VNODE_HASH_SIZE 256
+#define vnode_hash(fs, vno) \
+        (&vnode_hash_table[(((uintptr_t)(fs) >> 4) ^ (uint32_t)(vno)) & (VNODE_HASH_SIZE - 1)])
+static list_t vnode_hash_table[VNODE_HASH_SIZE];
+
+/* Unreferenced vnodes which are still linked, most recently used first,
+ * see vput */
+static list_t vnode_lru_list;
+static int vnode_nlru = 0;
+
+/* For the "vnodes" kshell command */
+static uint32_t vnode_nget = 0;         /* calls to vget */
+static uint32_t vnode_nhit = 0;         /* ... which found the vnode in core */
+static uint32_t vnode_nlruhit = 0;      /* ... unreferenced, on vnode_lru_list */
+static uint32_t vnode_nread = 0;        /* calls to read_vnode */
+static uint32_t vnode_nevict = 0;       /* unreferenced vnodes evicted */
+
+static void vnode_evict(vnode_t *vn);
+
 /* Related to vnodes representing special files: */
 static void init_special_vnode(vnode_t *vn);
 static int special_file_read(vnode_t *file, off_t offset, void *buf, size_t count);
@@ -50,6 +78,7 @@ static int special_file_stat(vnode_t *vnode, struct stat *ss);
 static int special_file_fillpage(vnode_t *file, off_t offset, void *pagebuf);
 static int special_file_dirtypage(vnode_t *file, off_t offset);
 static int special_file_cleanpage(vnode_t *file, off_t offset, void *pagebuf);
+static int special_file_poll(vnode_t *file, int events, poll_table_t *pt);
 
 /* vnode operations tables for special files: */
 static vnode_ops_t bytedev_spec_vops = {
@@ -67,7 +96,8 @@ static vnode_ops_t bytedev_spec_vops = {
     .stat = special_file_stat,
     .fillpage = special_file_fillpage,
     .dirtypage = special_file_dirtypage,
-    .cleanpage = special_file_cleanpage};
+    .cleanpage = special_file_cleanpage,
+    .poll = special_file_poll};
 
 static mmobj_ops_t vnode_mmobj_ops = {
     .ref = vo_vref,
@@ -100,7 +130,13 @@ static vnode_ops_t blockdev_spec_vops = {
 static __attribute__((unused)) void
 vnode_init(void)
 {
+        int i;
+
         list_init(&vnode_inuse_list);
+        for (i = 0; i < VNODE_HASH_SIZE; i++) {
+                list_init(&vnode_hash_table[i]);
+        }
+        list_init(&vnode_lru_list);
         vnode_allocator = slab_allocator_create("vnode", sizeof(vnode_t));
 }
 init_func(vnode_init);
@@ -124,9 +160,10 @@ vget(struct fs *fs, ino_t vno)
 
         KASSERT(fs);
 
+        vnode_nget++;
         /* look for inuse vnode */
 find:
-        list_iterate_begin(&vnode_inuse_list, vn, vnode_t, vn_link)
+        list_iterate_begin(vnode_hash(fs, vno), vn, vnode_t, vn_hash_link)
         {
                 if ((vn->vn_fs == fs) && (vn->vn_vno == vno))
                 {
@@ -144,6 +181,21 @@ find:
                                 goto find;
                         }
 
+                        vnode_nhit++;
+                        if (0 == vn->vn_refcount) {
+                                /* kept by vput since its last reference
+                                 * went away (so nothing is mounted on it);
+                                 * take it back */
+                                KASSERT(0 == vn->vn_nrespages);
+                                list_remove(&vn->vn_lru_link);
+                                vnode_nlru--;
+                                vnode_nlruhit++;
+                                vn->vn_refcount = 1;
+                                dbg(DBG_VNREF, "vget: 0x%p, 0x%p ino %ld taken back from the cache\n",
+                                    vn, vn->vn_fs, (long)vn->vn_vno);
+                                return vn;
+                        }
+
 #ifndef __MOUNTING__
                         /* If we are implementing mountpoint support
                            then we should get the mounted vnode,
@@ -168,8 +220,11 @@ find:
                 dbg(DBG_VNREF, "vget: kmem has been exhausted. "
                                "will then re-attempt to vget vnode later %d of fs %p\n",
                     vno, fs);
-                sched_make_runnable(curthr);
-                sched_switch();
+                /* give back an unreferenced vnode before waiting */
+                if (!vnode_cache_shrink(1)) {
+                        sched_make_runnable(curthr);
+                        sched_switch();
+                }
                 goto find;
         }
         memset(vn, 0, sizeof(vnode_t));
@@ -178,6 +233,7 @@ find:
         vn->vn_fs = fs;
         vn->vn_vno = vno;
         kmutex_init(&vn->vn_mutex);
+        krwlock_init(&vn->vn_rwlock);
         mmobj_init(&vn->vn_mmobj, &vnode_mmobj_ops);
         sched_queue_init(&vn->vn_waitq);
 
@@ -197,10 +253,13 @@ find:
          */
         vn->vn_flags |= VN_BUSY;
         list_insert_head(&vnode_inuse_list, &vn->vn_link);
+        list_insert_head(vnode_hash(fs, vno), &vn->vn_hash_link);
+        list_link_init(&vn->vn_lru_link);
 
         KASSERT(vn->vn_fs->fs_op && vn->vn_fs->fs_op->read_vnode);
         /*       this is where we might block (depending on the underlying
          *       fs): */
+        vnode_nread++;
         vn->vn_fs->fs_op->read_vnode(vn);
 
         vn->vn_flags &= ~VN_BUSY;
@@ -239,6 +298,10 @@ find:
  *     - (assert: refcount should be 1, nrespages should be zero, linkcount
  *       should be zero)
  *     - free the vnode
+ *
+ * - a vnode whose refcount reaches zero while it is still linked is not
+ *   freed but kept on vnode_lru_list, inode and all, until vget takes it
+ *   back or it is evicted (see vnode_evict)
  */
 void vput(struct vnode *vn)
 {
@@ -290,11 +353,36 @@ void vput(struct vnode *vn)
         KASSERT(vn->vn_mount == vn);
 #endif
 
-        /* no res pages and no more active references; free the vnode */
+        /* no res pages and no more active references */
         KASSERT(0 == vn->vn_refcount);
         KASSERT(0 == vn->vn_nrespages);
 
+        /* keep it if it can be looked up again; the root of a filesystem
+         * is only put by unmounting it */
+        if (vn != vn->vn_fs->fs_root && vn->vn_fs->fs_op->query_vnode(vn)) {
+                list_insert_head(&vnode_lru_list, &vn->vn_lru_link);
+                if (++vnode_nlru > VNODE_CACHE_MAX) {
+                        vnode_cache_shrink(vnode_nlru - VNODE_CACHE_MAX);
+                }
+                return;
+        }
+        vnode_evict(vn);
+}
+
+/*
+ * Frees an unreferenced vnode, which must not be on vnode_lru_list: the
+ * underlying fs's 'delete_vnode' entry point is called first, which may
+ * block, so the vnode is marked busy to make vget wait for it to be gone.
+ */
+static void
+vnode_evict(vnode_t *vn)
+{
+        KASSERT(0 == vn->vn_refcount);
+        KASSERT(0 == vn->vn_nrespages);
+        KASSERT(!list_link_is_linked(&vn->vn_lru_link));
+
         vn->vn_flags |= VN_BUSY;
+        binfmt_invalidate(vn);
         if (vn->vn_fs->fs_op->delete_vnode)
         {
                 vn->vn_fs->fs_op->delete_vnode(vn);
@@ -315,9 +403,45 @@ void vput(struct vnode *vn)
         sched_broadcast_on(&vn->vn_waitq);
 
         list_remove(&vn->vn_link); /* remove from vn_inuse_list */
+        list_remove(&vn->vn_hash_link);
         slab_obj_free(vnode_allocator, vn);
 }
 
+int vnode_cache_shrink(int n)
+{
+        vnode_t *vn;
+        int i;
+
+        for (i = 0; i < n && !list_empty(&vnode_lru_list); i++) {
+                vn = list_tail(&vnode_lru_list, vnode_t, vn_lru_link);
+                list_remove(&vn->vn_lru_link);
+                vnode_nlru--;
+                vnode_nevict++;
+                vnode_evict(vn);
+        }
+        return i;
+}
+
+void vnode_cache_purge(struct fs *fs)
+{
+        vnode_t *vn;
+
+        /* vnode_evict may block, so start over after each */
+again:
+        list_iterate_begin(&vnode_lru_list, vn, vnode_t, vn_lru_link)
+        {
+                if (vn->vn_fs == fs)
+                {
+                        list_remove(&vn->vn_lru_link);
+                        vnode_nlru--;
+                        vnode_nevict++;
+                        vnode_evict(vn);
+                        goto again;
+                }
+        }
+        list_iterate_end();
+}
+
 int vfs_is_in_use(fs_t *fs)
 {
         /* - for each vnode vn that is
@@ -415,6 +539,9 @@ clean:
                 list_iterate_end();
         }
         list_iterate_end();
+
+        /* vnodes whose last pages were just uncached are now unreferenced */
+        vnode_cache_purge(fs);
 }
 
 /*
@@ -560,3 +687,44 @@ special_file_cleanpage(vnode_t *file, off_t offset, void *pagebuf)
         dbg(DBG_PRINT, "(GRADING3B)\n");
         return file->vn_cdev->cd_ops->cleanpage(file, offset, pagebuf);
 }
+
+/* Ttys can have nothing to read; the memory devices are always ready */
+static int
+special_file_poll(vnode_t *file, int events, poll_table_t *pt)
+{
+        if (TTY_MAJOR == MAJOR(file->vn_devid))
+                return tty_poll(file->vn_cdev, events, pt);
+        return POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM;
+}
+
+/* Shows how often vget finds the vnode in core */
+static int
+vnode_kshell(kshell_t *ksh, int argc, char **argv)
+{
+        if (argc > 2 || (2 == argc && strcmp(argv[1], "reset"))) {
+                kprintf(ksh, "usage: vnodes [reset]\n");
+                return 0;
+        }
+
+        kprintf(ksh, "vget calls:           %u\n", vnode_nget);
+        kprintf(ksh, "  found in core:      %u\n", vnode_nhit);
+        kprintf(ksh, "    unreferenced:     %u\n", vnode_nlruhit);
+        kprintf(ksh, "inodes read:          %u\n", vnode_nread);
+        kprintf(ksh, "unreferenced vnodes:  %d of at most %d (%u evicted)\n",
+                vnode_nlru, VNODE_CACHE_MAX, vnode_nevict);
+
+        if (2 == argc) {
+                vnode_nget = vnode_nhit = vnode_nlruhit = 0;
+                vnode_nread = vnode_nevict = 0;
+        }
+        return 0;
+}
+
+static __attribute__((unused)) void
+vnode_kshell_init(void)
+{
+        kshell_add_command("vnodes", vnode_kshell,
+                           "show vnode cache hits, \"vnodes reset\" to reset them");
+}
+init_func(vnode_kshell_init);
+init_depends(kshell_init);
@@ -26,3 +26,26 @@ typedef int(*binfmt_load_func_t)(const char *filename, int fd,
 int  binfmt_add(const char *id, binfmt_load_func_t loadfunc);
 
 int binfmt_load(const char *filename, char *const *argv, char *const *envp, uint32_t *eip, uint32_t *esp);
+
+/* A loader's parsed form of an executable, cached on the executable's vnode
+ * (vn_execimg) so that repeated execs of the same file can skip parsing it.
+ * Loaders embed this as the first member of their own structure. The cache
+ * holds one reference; every user of a cached image holds another. */
+typedef struct execimg {
+        int               ei_refcount;
+        binfmt_load_func_t ei_loader;   /* loader which built this image */
+        void            (*ei_free)(struct execimg *img);
+} execimg_t;
+
+/* Returns the image cached on vn by the given loader with a new reference,
+ * or NULL if there is none. */
+execimg_t *binfmt_cache_lookup(vnode_t *vn, binfmt_load_func_t loader);
+
+/* Caches img on vn, unless vn was written since gen was read from
+ * vn->vn_execgen (the image would then describe stale contents). */
+void binfmt_cache_insert(vnode_t *vn, execimg_t *img, uint32_t gen);
+
+/* Drops the image cached on vn, if any. Called whenever vn is written. */
+void binfmt_invalidate(vnode_t *vn);
+
+void execimg_put(execimg_t *img);
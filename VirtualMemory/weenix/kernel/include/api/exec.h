@@ -26,4 +26,9 @@ int do_execve(const char *filename, char *const *argv, char *const *envp, struct
 
 void kernel_execve(const char *filename, char *const *argv, char *const *envp);
 
+/* Enters userland at eip with the user stack pointer esp from a thread
+ * that has so far only run in the kernel, as kernel_execve() does once
+ * the binary is loaded. Does not return. */
+void userland_start(uint32_t eip, uint32_t esp);
+
 void userland_entry(const struct regs *regs);
@@ -0,0 +1,48 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#pragma once
+
+/* Kernel and user header (via symlink) */
+
+#ifdef __KERNEL__
+#include "types.h"
+#else
+#include "sys/types.h"
+#endif
+
+/* Events for poll(2). POLLERR, POLLHUP and POLLNVAL are reported
+ * whether or not they were asked for. */
+#define POLLIN          0x0001  /* there is data to read */
+#define POLLPRI         0x0002  /* there is urgent data to read */
+#define POLLOUT         0x0004  /* writing will not block */
+#define POLLERR         0x0008  /* error, e.g. a pipe with no readers left */
+#define POLLHUP         0x0010  /* hung up, e.g. a pipe with no writers left */
+#define POLLNVAL        0x0020  /* fd is not open */
+#define POLLRDNORM      0x0040  /* the same as POLLIN */
+#define POLLWRNORM      0x0100  /* the same as POLLOUT */
+
+typedef unsigned int nfds_t;
+
+struct pollfd {
+        int             fd;             /* ignored if negative */
+        short           events;         /* what to wait for */
+        short           revents;        /* what happened */
+};
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout);
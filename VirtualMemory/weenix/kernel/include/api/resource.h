@@ -0,0 +1,47 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#pragma once
+
+/* Kernel and user header (via symlink) */
+
+#ifdef __KERNEL__
+#include "types.h"
+#include "api/time.h"
+#else
+#include "sys/types.h"
+#include "time.h"
+#endif
+
+#define RUSAGE_SELF     0       /* the calling process */
+#define RUSAGE_CHILDREN (-1)    /* its children which have been waited for */
+#define RUSAGE_THREAD   1       /* the calling thread */
+
+struct rusage {
+        struct timeval  ru_time;        /* CPU time used */
+        uint32_t        ru_rss;         /* pages resident now, 0 for children */
+        uint32_t        ru_minflt;      /* page faults which needed no I/O */
+        uint32_t        ru_majflt;      /* page faults which read the page in */
+        uint32_t        ru_inblock;     /* pages read in from files and devices */
+        uint32_t        ru_nvcsw;       /* times gave up the CPU */
+        uint32_t        ru_nivcsw;      /* times preempted */
+        uint64_t        ru_rbytes;      /* bytes read with read(2) */
+        uint64_t        ru_wbytes;      /* bytes written with write(2) */
+};
+
+int getrusage(int who, struct rusage *usage);
@@ -43,7 +43,7 @@
 #define SYS_unlink              9
 #define SYS_execve              10
 #define SYS_chdir               11
-#define SYS_sleep               12 /* NYI */
+#define SYS_sleep               12
 #define SYS_lseek               14
 #define SYS_sync                15
 #define SYS_nuke                16 /* NYI */
@@ -58,22 +58,38 @@
 #define SYS_munmap              26
 #define SYS_rename              27 /* NYI */
 #define SYS_uname               28
-#define SYS_thr_create          29 /* NYI */
+#define SYS_thr_create          29
 #define SYS_thr_cancel          30
 #define SYS_thr_exit            31
 #define SYS_thr_yield           32
-#define SYS_thr_join            33 /* NYI */
-#define SYS_gettid              34 /* NYI */
+#define SYS_thr_join            33
+#define SYS_gettid              34
 #define SYS_getpid              35
 #define SYS_errno               39
 #define SYS_halt                40
-#define SYS_get_free_mem        41 /* NYI */
+#define SYS_get_free_mem        41
 #define SYS_set_errno           42
 #define SYS_dup2                43
 #define SYS_brk                 44
 #define SYS_mount               45
 #define SYS_umount              46
 #define SYS_stat                47
+#define SYS_mremap              48
+#define SYS_vfork               49
+#define SYS_spawn               50
+#define SYS_nice                51
+#define SYS_nanosleep           52
+#define SYS_clock_gettime       53
+#define SYS_gettimeofday        54
+#define SYS_thr_detach          55
+#define SYS_futex               56
+#define SYS_getrusage           57
+#define SYS_readv               58
+#define SYS_writev              59
+#define SYS_pread               60
+#define SYS_pwrite              61
+#define SYS_splice              62
+#define SYS_poll                63
 
 /*
  * ... what does the scouter say about his syscall?
@@ -85,6 +101,10 @@
 
 struct regs;
 struct stat;
+struct timespec;
+struct rusage;
+struct iovec;
+struct pollfd;
 
 typedef struct argstr {
         const char *as_str;
@@ -116,6 +136,51 @@ typedef struct munmap_args {
         size_t  len;
 } munmap_args_t;
 
+typedef struct mremap_args {
+        void   *mra_addr;
+        size_t  mra_oldlen;
+        size_t  mra_newlen;
+        int     mra_flags;
+} mremap_args_t;
+
+typedef struct nanosleep_args {
+        const struct timespec *nsa_req;
+        struct timespec       *nsa_rem;
+} nanosleep_args_t;
+
+typedef struct clock_gettime_args {
+        int              cga_clock;
+        struct timespec *cga_tp;
+} clock_gettime_args_t;
+
+typedef struct getrusage_args {
+        int            gra_who;
+        struct rusage *gra_usage;
+} getrusage_args_t;
+
+/* The return value of a thread cancelled by thr_cancel */
+#define THR_CANCELED ((void *) -1)
+
+typedef struct thr_create_args {
+        void   *tca_eip;        /* where the new thread starts */
+        void   *tca_esp;        /* and its stack pointer */
+} thr_create_args_t;
+
+typedef struct thr_join_args {
+        int     tja_tid;
+        void  **tja_retval;
+} thr_join_args_t;
+
+/* futex operations, see vm/futex.h */
+#define FUTEX_WAIT      0
+#define FUTEX_WAKE      1
+
+typedef struct futex_args {
+        int    *fa_addr;
+        int     fa_op;          /* FUTEX_WAIT or FUTEX_WAKE */
+        int     fa_val;         /* the value expected, or how many to wake */
+} futex_args_t;
+
 typedef struct open_args {
         argstr_t filename;
         int      flags;
@@ -134,6 +199,34 @@ typedef struct write_args {
         size_t  nbytes;
 } write_args_t;
 
+typedef struct rwv_args {
+        int                 rwv_fd;
+        const struct iovec *rwv_iov;
+        int                 rwv_iovcnt;
+} rwv_args_t;
+
+/* For pread and pwrite, which leave the file position alone */
+typedef struct prw_args {
+        int     prw_fd;
+        void   *prw_buf;
+        size_t  prw_nbytes;
+        off_t   prw_offset;
+} prw_args_t;
+
+typedef struct splice_args {
+        int     spa_in;
+        off_t  *spa_in_off;     /* NULL for the file position */
+        int     spa_out;
+        off_t  *spa_out_off;
+        size_t  spa_count;
+} splice_args_t;
+
+typedef struct poll_args {
+        struct pollfd  *pa_fds;
+        unsigned int    pa_nfds;
+        int             pa_timeout;     /* milliseconds, negative for none */
+} poll_args_t;
+
 typedef struct mkdir_args {
         argstr_t path;
         int      mode;
@@ -144,6 +237,30 @@ typedef struct link_args {
         argstr_t from;
 } link_args_t;
 
+/* File actions for spawn, applied in order in the child */
+#define SPAWN_FA_OPEN   1       /* open sa_path with sa_flags as sa_fd */
+#define SPAWN_FA_CLOSE  2       /* close sa_fd */
+#define SPAWN_FA_DUP2   3       /* dup2 sa_fd onto sa_newfd */
+
+/* Most file actions a single spawn may ask for */
+#define SPAWN_MAX_ACTIONS 64
+
+typedef struct spawn_action {
+        int      sa_type;
+        int      sa_fd;
+        int      sa_newfd;
+        int      sa_flags;
+        argstr_t sa_path;
+} spawn_action_t;
+
+typedef struct spawn_args {
+        argstr_t        filename;
+        argvec_t        argv;
+        argvec_t        envp;
+        spawn_action_t *actions;
+        int             nactions;
+} spawn_args_t;
+
 typedef struct execve_args {
         argstr_t filename;
         argvec_t argv;
@@ -0,0 +1,73 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#pragma once
+
+/* Kernel and user header (via symlink) */
+
+#ifdef __KERNEL__
+#include "types.h"
+#else
+#include "sys/types.h"
+#endif
+
+typedef int32_t time_t;
+
+struct timespec {
+        time_t  tv_sec;         /* seconds */
+        long    tv_nsec;        /* nanoseconds, 0 to 999999999 */
+};
+
+struct timeval {
+        time_t  tv_sec;         /* seconds */
+        long    tv_usec;        /* microseconds, 0 to 999999 */
+};
+
+typedef int clockid_t;
+
+#define CLOCK_REALTIME  0       /* wall clock time, since the Unix epoch */
+#define CLOCK_MONOTONIC 1       /* time since boot */
+
+/*
+ * The kernel maps this page read-only into every process at
+ * TIME_PAGE_ADDR, so that the time can be read without a system call.
+ * It is filled in once at boot. A time stamp counter reading is turned
+ * into nanoseconds since boot by time_page_ns(). If tp_mult is 0 the
+ * page can't be used and the system calls have to be used instead.
+ */
+#define TIME_PAGE_ADDR  0xbffff000
+#define TIME_PAGE_SHIFT 24
+
+struct time_page {
+        uint64_t        tp_tsc_base;    /* time stamp counter at boot */
+        uint32_t        tp_mult;        /* ns per cycle << TIME_PAGE_SHIFT */
+        uint32_t        tp_boot_sec;    /* wall clock time at boot */
+};
+
+static inline uint64_t
+time_page_ns(const volatile struct time_page *tp, uint64_t tsc)
+{
+        uint64_t d = tsc - tp->tp_tsc_base;
+        /* In two halves, so that the products can't overflow */
+        return (((d >> 32) * tp->tp_mult) << (32 - TIME_PAGE_SHIFT))
+               + (((d & 0xffffffff) * tp->tp_mult) >> TIME_PAGE_SHIFT);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int clock_gettime(clockid_t clock, struct timespec *tp);
+int gettimeofday(struct timeval *tv, void *tz);
@@ -57,8 +57,14 @@
 #define MAX_FILES               1024    /* max number of files */
 #define MAX_VFS                 8       /* max # of vfses */
 #define MAX_VNODES              1024    /* max number of in-core vnodes */
+#define VNODE_CACHE_MAX         256     /* max number of unreferenced vnodes
+                                           kept in core */
+#define DCACHE_MAX              512     /* max number of cached directory
+                                           entries */
 #define NAME_LEN                28      /* maximum directory entry length */
-#define NFILES                  32      /* maximum number of open files */
+#define NFILES                  4096    /* maximum number of open files */
+#define NFILES_INIT             32      /* open files a new process has room
+                                           for before its table grows */
 
 /* Note: if rootfs is ramfs, this is completely ignored */
 #define VFS_ROOTFS_DEV  "disk0" /* device containing root filesystem */
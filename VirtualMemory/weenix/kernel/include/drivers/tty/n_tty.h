@@ -25,7 +25,18 @@
  * The default line discipline.
  */
 
-typedef struct n_tty n_tty_t;
+/* Here rather than in n_tty.c so that tty_poll() (fs/poll.c) can tell
+ * whether a cooked line is waiting to be read: ntty_ckdtail != ntty_rhead */
+typedef struct n_tty {
+        kmutex_t            ntty_rlock;
+        ktqueue_t           ntty_rwaitq;
+        char               *ntty_inbuf;
+        int                 ntty_rhead;
+        int                 ntty_rawtail;
+        int                 ntty_ckdtail;
+
+        tty_ldisc_t         ntty_ldisc;
+} n_tty_t;
 
 /**
  * Allocate and initialize an n_tty line discipline, which is not yet
@@ -0,0 +1,72 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+/*
+ *  FILE: dcache.h
+ *  DESC: cache of directory entries for path resolution
+ */
+
+#pragma once
+
+#include "types.h"
+
+struct fs;
+struct vnode;
+
+/*
+ * The directory entry cache remembers what the filesystems' lookup
+ * operations found, by directory and name: the vnode number of the entry,
+ * or that there is no such entry. It holds at most DCACHE_MAX entries and
+ * recycles the least recently used.
+ *
+ * An entry stays valid as long as the directory does not change, so the
+ * callers of the vnode operations which change directories remove the
+ * names they change, with the directory's vn_rwlock held for writing.
+ * Lookups are done with it held for reading.
+ */
+
+/*
+ * Looks up name in dir. Returns 0 with a new reference in *result if it
+ * is cached as there, -ENOENT if it is cached as not there, and 1 if it
+ * is not cached.
+ */
+int dcache_lookup(struct vnode *dir, const char *name, size_t len,
+                  struct vnode **result);
+
+/*
+ * Remembers that name in dir is vn, or that there is no such entry if vn
+ * is NULL.
+ */
+void dcache_enter(struct vnode *dir, const char *name, size_t len,
+                  struct vnode *vn);
+
+/*
+ * Forgets what name in dir is. Called after adding or removing the name.
+ */
+void dcache_remove(struct vnode *dir, const char *name, size_t len);
+
+/*
+ * Forgets all the entries in the directory dir, which has been removed,
+ * so that they do not show up in a new directory given its vnode number.
+ */
+void dcache_purge_dir(struct vnode *dir);
+
+/*
+ * Forgets all the entries of a filesystem which is being unmounted.
+ */
+void dcache_purge_fs(struct fs *fs);
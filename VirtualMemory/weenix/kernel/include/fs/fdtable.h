@@ -0,0 +1,96 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+/*
+ *  FILE: fdtable.h
+ *  DESC: per-process file descriptor tables
+ */
+
+#pragma once
+
+#include "types.h"
+
+struct file;
+
+/*
+ * A process's file descriptors. The table starts with room for NFILES_INIT
+ * and doubles as needed up to NFILES. All the threads of a process use
+ * its table.
+ *
+ * fdt_used has a bit set for each descriptor which is taken, and fdt_full
+ * a bit set for each word of fdt_used with every bit set, so the lowest
+ * free descriptor is found by looking at a word or two of each rather
+ * than at every slot.
+ */
+typedef struct fdtable {
+        int              fdt_size;      /* slots, a multiple of 32 */
+        struct file    **fdt_files;     /* file of each descriptor, or NULL */
+        uint32_t        *fdt_used;      /* bit set for each descriptor taken,
+                                           including those only reserved */
+        uint32_t        *fdt_full;      /* bit set for each full word of
+                                           fdt_used */
+} fdtable_t;
+
+/* Returns a new, empty table, or NULL if out of memory */
+fdtable_t *fdtable_create(void);
+
+/* Closes every descriptor in t and frees it. MAY BLOCK. */
+void fdtable_destroy(fdtable_t *t);
+
+/*
+ * Gives the empty table dst each file open in src, at the same descriptor,
+ * and takes a reference to each. Descriptors which are only reserved are
+ * not copied. Returns 0, or -ENOMEM.
+ */
+int fdtable_copy(fdtable_t *dst, fdtable_t *src);
+
+/* Makes room in t for descriptor fd. Returns 0, -EMFILE or -ENOMEM. */
+int fdtable_grow(fdtable_t *t, int fd);
+
+/*
+ * Reserves the lowest free descriptor of t, growing t if they are all
+ * taken, and returns it. Its file is NULL until fd_install(). Returns
+ * -EMFILE if NFILES are taken, or -ENOMEM.
+ */
+int fd_alloc(fdtable_t *t);
+
+/* Takes descriptor fd, which must be free and fit in t (see fdtable_grow) */
+void fd_reserve(fdtable_t *t, int fd);
+
+/*
+ * Makes f the file of descriptor fd, which is taken (see fd_alloc and
+ * fd_reserve). Does not touch f's reference count.
+ */
+void fd_install(fdtable_t *t, int fd, struct file *f);
+
+/* Makes descriptor fd free again, whether it had a file or was reserved */
+void fd_free(fdtable_t *t, int fd);
+
+/* Returns the file of descriptor fd, or NULL if it has none */
+static inline struct file *
+fd_get(fdtable_t *t, int fd)
+{
+        return (0 <= fd && fd < t->fdt_size) ? t->fdt_files[fd] : NULL;
+}
+
+/* Whether descriptor fd is taken */
+static inline int
+fd_is_used(fdtable_t *t, int fd)
+{
+        return 0 <= fd && fd < t->fdt_size && (t->fdt_used[fd / 32] & (1U << (fd % 32)));
+}
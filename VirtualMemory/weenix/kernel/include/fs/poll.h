@@ -0,0 +1,94 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+/*
+ *  FILE: poll.h
+ *  DESC: waiting for any of several files to become ready, for poll(2)
+ */
+
+#pragma once
+
+#include "types.h"
+
+#include "proc/sched.h"
+#include "util/list.h"
+
+struct bytedev;
+struct pollfd;
+
+/*
+ * A file which can make a poller wait (a pipe, a tty) has a pollq, and
+ * its poll operation calls poll_wait() on it before looking at whether
+ * it is ready. Whatever makes it ready calls pollq_wake(), which wakes
+ * every thread polling it with one broadcast per poll table, however
+ * many files that thread is polling.
+ */
+
+typedef struct pollq {
+        list_t          pq_entries;     /* poll_entry_t's on this queue */
+} pollq_t;
+
+typedef struct poll_table poll_table_t;
+
+typedef struct poll_entry {
+        list_link_t     pe_link;        /* on pe_q->pq_entries */
+        pollq_t        *pe_q;
+        poll_table_t   *pe_table;
+} poll_entry_t;
+
+/* One per call to poll(). A poll operation registers on at most one
+ * pollq, so there are as many entries as descriptors. */
+struct poll_table {
+        ktqueue_t       pt_waitq;       /* the polling thread sleeps here */
+        int             pt_triggered;   /* a pollq was woken since the last look */
+        poll_entry_t   *pt_entries;
+        int             pt_nentries;
+        int             pt_max;
+};
+
+void pollq_init(pollq_t *pq);
+
+/*
+ * Puts the table on pq, so that pollq_wake(pq) wakes its thread. Does
+ * nothing if pt is NULL, which is how poll operations are called after
+ * the first look at each file.
+ */
+void poll_wait(pollq_t *pq, poll_table_t *pt);
+
+/* Wakes everything polling pq. May be called from interrupt context. */
+void pollq_wake(pollq_t *pq);
+
+/*
+ * The readiness of a tty, for its special file's poll operation:
+ * POLLIN once a whole line has been typed, and always POLLOUT.
+ */
+int tty_poll(struct bytedev *cdev, int events, poll_table_t *pt);
+
+/*
+ * Waits until one of the nfds files in fds is ready for the events asked
+ * for, or timeout milliseconds have passed (forever if it is negative).
+ * Fills in each revents and returns the number of descriptors with any,
+ * 0 on timeout, or:
+ *      o EINVAL
+ *        nfds is more than NFILES.
+ *      o ENOMEM
+ *        Insufficient kernel memory was available.
+ *      o EINTR
+ *        The thread was cancelled while waiting.
+ */
+int do_poll(struct pollfd *fds, int nfds, int timeout);
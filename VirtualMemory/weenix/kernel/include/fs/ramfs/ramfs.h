@@ -22,3 +22,4 @@
 #include "fs/vfs.h"
 
 int ramfs_mount(struct fs *fs);
+int ramfs_readdirv(struct vnode *dir, off_t *offset, struct dirent *d, int count);
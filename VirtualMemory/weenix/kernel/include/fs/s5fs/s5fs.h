@@ -131,4 +131,5 @@ typedef struct s5fs {
 } s5fs_t;
 
 int s5fs_mount(struct fs *fs);
+int s5fs_readdirv(struct vnode *dir, off_t *offset, struct dirent *d, int count);
 #endif
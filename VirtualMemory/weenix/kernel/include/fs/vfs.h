@@ -27,6 +27,7 @@ struct vnode;
 struct file;
 struct vfs;
 struct fs;
+struct dirent;
 
 /* name_match: fname should be null-terminated, name is namelen long */
 #define name_match(fname, name, namelen) \
@@ -133,6 +134,17 @@ typedef struct fs {
 
         /* Filesystem-specific data. */
         void            *fs_i;
+
+        /*
+         * Reads directory entries from dir into d[0..count-1] in one pass
+         * over the directory, starting at *offset, and leaves *offset
+         * just past the last entry read. Returns the number of entries
+         * read (0 at the end of the directory), or -errno. Set by
+         * mountfunc() for the filesystems which have one, and used by
+         * vfs_readdirv(); otherwise NULL.
+         */
+        int            (*fs_readdirv)(struct vnode *dir, off_t *offset,
+                                      struct dirent *d, int count);
 } fs_t;
 
 /* - this is the vnode on which we will mount the vfsroot fs.
@@ -159,6 +171,8 @@ extern struct vnode *vfs_root_vn;
  */
 int vfs_shutdown();
 
+int vfs_readdirv(struct vnode *dir, off_t *offset, struct dirent *d, int count);
+
 /* Pathname resolution: */
 /* (the corresponding definitions live in namev.c) */
 int lookup(struct vnode *dir, const char *name, size_t len,
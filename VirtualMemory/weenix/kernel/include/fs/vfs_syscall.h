@@ -26,9 +26,16 @@
 #include "fs/pipe.h"
 #include "fs/stat.h"
 
+struct iovec;
+
 int do_close(int fd);
 int do_read(int fd, void *buf, size_t nbytes);
 int do_write(int fd, const void *buf, size_t nbytes);
+int do_readv(int fd, const struct iovec *iov, int iovcnt);
+int do_writev(int fd, const struct iovec *iov, int iovcnt);
+int do_pread(int fd, void *buf, size_t nbytes, off_t offset);
+int do_pwrite(int fd, const void *buf, size_t nbytes, off_t offset);
+int do_splice(int in_fd, off_t *in_off, int out_fd, off_t *out_off, size_t count);
 int do_dup(int fd);
 int do_dup2(int ofd, int nfd);
 int do_mknod(const char *path, int mode, unsigned devid);
@@ -39,6 +46,7 @@ int do_link(const char *from, const char *to);
 int do_rename(const char *oldname, const char *newname);
 int do_chdir(const char *path);
 int do_getdent(int fd, struct dirent *dirp);
+int do_getdents(int fd, struct dirent *dirp, int count);
 int do_lseek(int fd, int offset, int whence);
 int do_stat(const char *path, struct stat *uf);
 
@@ -31,6 +31,7 @@
 #include "drivers/bytedev.h"
 #include "util/list.h"
 #include "proc/kmutex.h"
+#include "proc/krwlock.h"
 #include "mm/mmobj.h"
 #include "mm/pframe.h"
 
@@ -40,6 +41,8 @@ struct stat;
 struct file;
 struct vnode;
 struct vmarea;
+struct execimg;
+struct poll_table;
 
 typedef struct vnode_ops {
         /* The following functions map directly to their corresponding
@@ -176,6 +179,15 @@ typedef struct vnode_ops {
          * containing 'offset'.
          */
         int (*cleanpage)(struct vnode *vnode, off_t offset, void *pagebuf);
+
+        /*
+         * Returns which POLL* events (see api/poll.h) 'vnode' is ready
+         * for, having first called poll_wait() with 'pt' on whatever is
+         * woken when that changes (see fs/poll.h). Only called for pipes
+         * and special files: regular files and directories are always
+         * ready, and NULL means the same.
+         */
+        int (*poll)(struct vnode *vnode, int events, struct poll_table *pt);
 } vnode_ops_t;
 
 
@@ -295,6 +307,25 @@ typedef struct vnode {
         int                vn_flags;       /* VN_BUSY */
         ktqueue_t          vn_waitq;       /* queue of threads waiting for vnode
                                               to become not busy */
+
+        /* Used (only) by the binary loaders (api/binfmt.c): */
+        struct execimg    *vn_execimg;     /* cached parse of this executable */
+        uint32_t           vn_execgen;     /* bumped whenever vn_execimg is
+                                              invalidated */
+
+        /*
+         * Used (only) at the VFS level (fs/namev.c, fs/vfs_syscall.c):
+         * held shared by lookups in a directory and reads of a regular
+         * file, and exclusive by changes to a directory's entries and
+         * writes to a regular file. The filesystem still takes vn_mutex
+         * inside each operation.
+         */
+        krwlock_t          vn_rwlock;
+
+        /* Used (only) by the v{get,ref,put} facilities (vfs/vnode.c): */
+        list_link_t        vn_hash_link;   /* link on its vnode hash chain */
+        list_link_t        vn_lru_link;    /* link on the list of unreferenced
+                                              vnodes, see vput */
 } vnode_t;
 
 /* Core vnode management routines: */
@@ -352,9 +383,14 @@ void vref(vnode_t *vn);
 /*
  *     This function decrements the reference count on this vnode.
  *
- *     If, as a result of this, vn_refcount reaches zero, the underlying
- *     fs's 'delete_vnode' entry point will be called and the vnode will be
- *     freed.
+ *     If, as a result of this, vn_refcount reaches zero and the file is
+ *     still linked, the vnode is kept in core with its inode on a list of
+ *     at most VNODE_CACHE_MAX unreferenced vnodes, so that the next vget
+ *     of it need not read the inode again. The least recently used of them
+ *     is evicted when the list is full or memory runs short: the
+ *     underlying fs's 'delete_vnode' entry point is called and the vnode
+ *     is freed. Unlinked files and the root of a filesystem are evicted
+ *     straight away.
  *
  *     If, as a result of this, vn_refcount reaches vn_respages and
  *     vn_nrespages is > 0 (meaning only passive references exist) and
@@ -387,7 +423,8 @@ int vfs_is_in_use(struct fs *fs);
 
 /*
  *         Clean and uncache all resident pages of all vnodes belonging to
- *         the specified fs.
+ *         the specified fs, then evict those of its vnodes which are left
+ *         unreferenced (see vnode_cache_purge).
  */
 void vnode_flush_all(struct fs *fs);
 
@@ -397,6 +434,19 @@ void vnode_flush_all(struct fs *fs);
  */
 int vnode_inuse(struct fs *fs);
 
+/*
+ *         Evicts all the unreferenced vnodes of the specified filesystem
+ *         which are kept in core. Called by unmounting, before the check
+ *         that no vnodes are left.
+ */
+void vnode_cache_purge(struct fs *fs);
+
+/*
+ *         Evicts up to n of the least recently used unreferenced vnodes,
+ *         which unpins their inodes. Returns the number evicted. MAY BLOCK.
+ */
+int vnode_cache_shrink(int n);
+
 
 /* Diagnostic: */
 /*
@@ -25,12 +25,34 @@
  * function. */
 void apic_init();
 
+/* The most processors Weenix keeps track of */
+#define APIC_MAX_CPUS 8
+
+/* Returns the number of enabled processors listed in the ACPI tables
+ * (up to APIC_MAX_CPUS). */
+uint32_t apic_cpu_count();
+
+/* Returns the index, from 0 to apic_cpu_count() - 1, of the processor
+ * we are running on. The boot processor is 0. */
+uint32_t apic_cpu_index();
+
 /* Maps the given IRQ to the given interrupt number. */
 void apic_setredir(uint32_t irq, uint8_t intr);
 
-/* Starts the APIC timer */
+/* Measures the APIC timer and the time stamp counter against the PIT
+ * (once; later calls return the saved result). Returns the number of
+ * time stamp counter cycles in 10 ms. */
+uint64_t apic_calibrate_timer(void);
+
+/* Starts the APIC timer raising INTR_APICTIMER freq times a second,
+ * calibrating it first if need be. */
 void apic_enable_periodic_timer(uint32_t freq);
 
+/* Switches the APIC timer to one-shot mode, raising INTR_APICTIMER once
+ * after the given number of microseconds (or as long as the timer can
+ * count, if that is less). The timer must have been calibrated. */
+void apic_oneshot_timer(uint32_t usecs);
+
 /* Stops the APIC timer */
 void apic_disable_periodic_timer();
 
@@ -41,3 +41,7 @@
 */
 #define MAP_FIXED       4
 #define MAP_ANON        8
+
+/* Flags for mremap.
+*/
+#define MREMAP_MAYMOVE  1
@@ -68,14 +68,24 @@ uintptr_t pt_virt_to_phys(uintptr_t vaddr);
 int pt_map(pagedir_t *pd, uintptr_t vaddr, uintptr_t paddr, uint32_t pdflags, uint32_t ptflags);
 
 /* Unmaps the page for the given virtual page from the given page
- * directory. vaddr must be in the user address space. vaddr must
- * be page aligned. Note that the TLB is not flushed by this function. */
+ * directory, freeing its page table if no other entries remain in it.
+ * vaddr must be in the user address space. vaddr must be page
+ * aligned. Note that the TLB is not flushed by this function. */
 void pt_unmap(pagedir_t *pd, uintptr_t vaddr);
 
 /* Unmaps the given range of addresses [low, high). As with pt_unmap,
  * the addresses must be page aligned in the user address space */
 void pt_unmap_range(pagedir_t *pd, uintptr_t vlow, uintptr_t vhigh);
 
+/* Moves the present entries for the npages pages starting at vfrom so
+ * that they map the same physical pages (with the same flags) starting
+ * at vto, clearing the old entries. Pages which are not present are
+ * left to be faulted in later. The ranges must not overlap. Returns 0
+ * on success, -ENOMEM if a new page table could not be allocated, in
+ * which case some entries may already have been moved. Note that the
+ * TLB is not flushed by this function. */
+int pt_move_range(pagedir_t *pd, uintptr_t vfrom, uintptr_t vto, uint32_t npages);
+
 /* Creates a new page directory which is initialized to contain
  * mappings for all kernel memory. If there is not enough memory
  * to allocate the directory NULL is returned. Note that destroying
@@ -94,3 +104,7 @@ void pt_set(pagedir_t *pd);
 
 /* Retreives the virtual address of the page directory currently in cr3. */
 pagedir_t *pt_get();
+
+/* Reports the number of user page tables in the given page directory
+ * and the number of entries in use across them. */
+void pt_usage(pagedir_t *pd, uint32_t *tables, uint32_t *entries);
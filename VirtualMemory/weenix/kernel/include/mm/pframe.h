@@ -62,6 +62,9 @@ typedef struct pframe {
         list_link_t         pf_link;     /* link on {free,allocated,pinned}_list */
         list_link_t         pf_hlink;    /* link on hash chain of resident page hash */
         list_link_t         pf_olink;    /* link on object's list of resident pages */
+#ifdef __KSMD__
+        uint32_t            pf_checksum; /* contents when ksmd last looked */
+#endif
 } pframe_t;
 
 void pframe_init(void);
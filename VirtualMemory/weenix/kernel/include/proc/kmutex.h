@@ -35,6 +35,11 @@ void kmutex_init(kmutex_t *mtx);
 /**
  * Locks the specified mutex.
  *
+ * If the mutex is held, its holder (and the holder of any mutex that
+ * one waits for, and so on) runs at the current thread's priority until
+ * it lets go. A holder which is runnable is yielded to a few times
+ * before the current thread goes to sleep.
+ *
  * Note: This function may block.
  *
  * Note: These locks are not re-entrant
@@ -57,6 +62,17 @@ void kmutex_lock(kmutex_t *mtx);
  */
 int  kmutex_lock_cancellable(kmutex_t *mtx);
 
+/**
+ * Locks the specified mutex if it is free.
+ *
+ * Note: This function never blocks.
+ *
+ * @param mtx the mutex to lock
+ * @return 0 if the current thread now holds the mutex and -EBUSY if
+ * another thread holds it
+ */
+int  kmutex_trylock(kmutex_t *mtx);
+
 /**
  * Unlocks the specified mutex.
  *
@@ -0,0 +1,101 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#pragma once
+
+#include "util/list.h"
+
+#include "proc/sched.h"
+
+/*
+ * A sleeping lock which many threads can hold at once for reading
+ * (shared) or one thread can hold for writing (exclusive), for kernel
+ * data which is mostly read.
+ *
+ * Writers are preferred: once a writer waits, new readers wait behind
+ * it, so a steady stream of readers can not keep it out forever. When a
+ * writer lets go, every reader waiting gets the lock before the next
+ * writer does, so writers can not keep readers out either. Waiting
+ * threads are handed the lock directly rather than woken to race for
+ * it.
+ */
+typedef struct krwlock {
+        list_t          krw_waiters;    /* waiting threads, oldest first */
+        int             krw_readers;    /* threads holding it shared */
+        struct kthread *krw_writer;     /* thread holding it exclusive */
+        int             krw_nwwait;     /* writers among krw_waiters */
+} krwlock_t;
+
+/**
+ * Initializes the fields of the specified krwlock_t.
+ *
+ * @param lock the lock to initialize
+ */
+void krwlock_init(krwlock_t *lock);
+
+/**
+ * Takes the specified lock shared.
+ *
+ * Note: This function may block.
+ *
+ * Note: A thread must not take a lock it already holds, even shared,
+ * since a writer may be waiting in between.
+ *
+ * @param lock the lock to take
+ */
+void krwlock_rdlock(krwlock_t *lock);
+
+/**
+ * Like krwlock_rdlock, but puts the current thread into a cancellable
+ * sleep if the function blocks.
+ *
+ * @param lock the lock to take
+ * @return 0 if the current thread now holds the lock and -EINTR if the
+ * sleep was cancelled and this thread does not hold the lock
+ */
+int  krwlock_rdlock_cancellable(krwlock_t *lock);
+
+/**
+ * Takes the specified lock exclusive.
+ *
+ * Note: This function may block.
+ *
+ * @param lock the lock to take
+ */
+void krwlock_wrlock(krwlock_t *lock);
+
+/**
+ * Like krwlock_wrlock, but puts the current thread into a cancellable
+ * sleep if the function blocks.
+ *
+ * @param lock the lock to take
+ * @return 0 if the current thread now holds the lock and -EINTR if the
+ * sleep was cancelled and this thread does not hold the lock
+ */
+int  krwlock_wrlock_cancellable(krwlock_t *lock);
+
+/**
+ * Lets go of the specified lock, whether the current thread holds it
+ * shared or exclusive, handing it to waiting threads if it is now
+ * free for them.
+ *
+ * Note: This function never blocks.
+ *
+ * @param lock the lock to release
+ */
+void krwlock_unlock(krwlock_t *lock);
@@ -30,6 +30,9 @@
 
 typedef context_func_t kthread_func_t;
 
+/* The most mutexes a thread keeps track of holding, see kmutex.c */
+#define KTHREAD_NHELD   8
+
 /* thread states */
 typedef enum
 {
@@ -63,6 +66,33 @@ typedef struct kthread {
         int             kt_detached;    /* if the thread has been detached */
         ktqueue_t       kt_joinq;       /* thread waiting to join with this thread */
 #endif
+
+        /* Scheduling, see sched.c */
+        int             kt_nice;        /* SCHED_NICE_MIN..SCHED_NICE_MAX, lower runs first */
+        int             kt_level;       /* feedback level, 0..SCHED_NLEVELS-1 */
+        uint64_t        kt_slice;       /* nanoseconds run at the current level */
+        uint64_t        kt_runtime;     /* cycles run in total */
+        uint64_t        kt_lastrun;     /* time stamp counter when last switched to */
+        uint32_t        kt_nswitch;     /* number of times switched to */
+        uint32_t        kt_ticks;       /* timer ticks since last switched to */
+
+        int             kt_tid;         /* thread id, see gettid(2) */
+
+        /* Priority inheritance, see kmutex.c */
+        struct kmutex  *kt_blocked_on;  /* the mutex this thread sleeps on */
+        struct kmutex  *kt_held[KTHREAD_NHELD]; /* mutexes held, NULL for a free slot */
+        int             kt_nheld;       /* mutexes held, even ones not in kt_held */
+        int             kt_inherited;   /* run queue lent by waiters, SCHED_NQUEUES if none */
+
+        int             kt_exclusive;   /* asleep as an exclusive waiter, see sched_wake_on */
+
+        /* Resource usage, see getrusage(2), besides kt_runtime and kt_nswitch */
+        uint32_t        kt_minflt;      /* page faults which needed no I/O */
+        uint32_t        kt_majflt;      /* page faults which read the page in */
+        uint32_t        kt_nivcsw;      /* times preempted */
+        uint32_t        kt_inblock;     /* pages read in from files and devices */
+        uint64_t        kt_rbytes;      /* bytes read with read(2) */
+        uint64_t        kt_wbytes;      /* bytes written with write(2) */
 } kthread_t;
 
 void kthread_init(void);
@@ -110,26 +140,40 @@ void kthread_exit(void *retval);
 kthread_t *kthread_clone(kthread_t *thr);
 
 #ifdef __MTP__
+/**
+ * Finds a thread of a process by its thread id.
+ *
+ * @param p the process to look in
+ * @param tid the thread id
+ * @return the thread, or NULL if p has no thread with that id
+ */
+kthread_t *kthread_lookup(struct proc *p, int tid);
+
 /**
  * Shuts down the reaper daemon.
  */
 void kthread_reapd_shutdown(void);
 
 /**
- * Put a thread in the detached state.
+ * Put a thread in the detached state. It is destroyed by the reaper
+ * daemon once it exits, and can no longer be joined.
  *
  * @param kthr the thread to put in the detached state
- * @return 0 on sucess and <0 on error
+ * @return 0 on sucess, -EINVAL if kthr is already detached or another
+ * thread is joining it
  */
 int kthread_detach(kthread_t *kthr);
 
 /**
- * Wait for the termination of another thread.
+ * Wait for the termination of another thread of the current process,
+ * then destroy it.
  *
  * @param kthr the thread to wait for
  * @param retval if retval is not NULL, the return value for kthr is
  * stored in the location pointed to by retval
- * @return 0 on sucess and <0 on error
+ * @return 0 on sucess, -EDEADLK if kthr is the current thread, -EINVAL
+ * if kthr is detached or another thread is joining it, or -EINTR if
+ * the current thread was cancelled while waiting
  */
 int kthread_join(kthread_t *kthr, void **retval);
 #endif
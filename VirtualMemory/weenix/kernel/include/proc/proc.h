@@ -40,6 +40,18 @@ typedef enum
         PROC_DEAD       /* has already exited, hasn't been wait'ed */
 } proc_state_t;
 
+/* Resource usage added up from a process's threads, see proc_usage */
+typedef struct proc_usage {
+        uint64_t        pu_cycles;      /* CPU time */
+        uint64_t        pu_rbytes;
+        uint64_t        pu_wbytes;
+        uint32_t        pu_minflt;
+        uint32_t        pu_majflt;
+        uint32_t        pu_inblock;
+        uint32_t        pu_nswitch;
+        uint32_t        pu_nivcsw;
+} proc_usage_t;
+
 typedef struct proc {
         pid_t           p_pid;                 /* our pid */
         char            p_comm[PROC_NAME_LEN]; /* process name */
@@ -66,7 +78,7 @@ typedef struct proc {
         list_link_t     p_child_link;    /* link on parent process' p_children list */
 
         /* VFS-related: */
-        struct file    *p_files[NFILES]; /* open files */
+        struct fdtable *p_fdt;           /* open files, see fs/fdtable.h */
         struct vnode   *p_cwd;           /* current working dir */
 
         /* VM */
@@ -75,6 +87,19 @@ typedef struct proc {
         struct vmmap   *p_vmmap;         /* list of areas mapped into
                                           * process' user address
                                           * space */
+
+        /* While a vfork(2) child runs in its parent's address space
+         * these hold its own, see vfork_release() in fork.c */
+        struct vmmap   *p_vfork_vmmap;
+        pagedir_t      *p_vfork_pagedir;
+
+        list_link_t     p_hash_link;     /* link on the PID hash chain, see proc_lookup */
+        list_t          p_zombies;       /* exited children not yet waited for */
+        list_link_t     p_zombie_link;   /* link on parent process' p_zombies list */
+
+        proc_usage_t    p_usage_exited;   /* of its threads which have exited */
+        proc_usage_t    p_usage_children; /* of its children (and theirs) which
+                                           * have been waited for */
 } proc_t;
 
 /* Special PIDs for Kernel Deamons */
@@ -107,6 +132,24 @@ proc_t *proc_lookup(int pid);
  */
 list_t *proc_list(void);
 
+/**
+ * Adds a thread's resource usage to the given totals.
+ *
+ * @param u the totals
+ * @param thr the thread
+ */
+void proc_usage_add_thread(proc_usage_t *u, struct kthread *thr);
+
+/**
+ * Adds up a process's resource usage, see getrusage(2).
+ *
+ * @param p the process
+ * @param who RUSAGE_SELF for the process itself or RUSAGE_CHILDREN for
+ * its children which have been waited for
+ * @param u where to put the totals
+ */
+void proc_usage(proc_t *p, int who, proc_usage_t *u);
+
 /**
  * Stops another process from running again by cancelling all its
  * threads.
@@ -156,6 +199,67 @@ pid_t do_waitpid(pid_t pid, int options, int *status);
  */
 int do_fork(struct regs *regs);
 
+/**
+ * This function implements the vfork(2) system call. The child runs
+ * in the parent's address space, and the parent is suspended until the
+ * child calls vfork_release() by exec'ing or exiting.
+ *
+ * @param regs the register state at the time of the system call
+ */
+int do_vfork(struct regs *regs);
+
+#ifdef __MTP__
+/**
+ * This function implements the thr_create system call. The new thread
+ * runs in the current process, and starts in userland at eip with its
+ * stack pointer at esp and the rest of the caller's registers.
+ *
+ * @param regs the register state at the time of the system call
+ * @param eip where the new thread starts
+ * @param esp the new thread's (user) stack pointer
+ * @return the thread id of the new thread, -EINVAL if eip or esp are
+ * not user addresses, or -ENOMEM
+ */
+int do_thr_create(struct regs *regs, uint32_t eip, uint32_t esp);
+
+/**
+ * Cancels every other thread of the current process, waits for them to
+ * exit and destroys them (detached ones are left to the reaper). Used
+ * by exit and exec.
+ *
+ * @param retval the return value for the cancelled threads
+ * @return 0 on success, or -EINTR if the current thread was cancelled
+ * meanwhile, e.g. because another thread is exiting the process
+ */
+int proc_cancel_others(void *retval);
+#endif
+
+/**
+ * Gives a vfork(2) child its own (empty) address space back and lets
+ * its parent continue. Does nothing if the current process was not
+ * created by vfork(2) or has already done this.
+ */
+void vfork_release(void);
+
+struct spawn_action;
+
+/**
+ * This function implements the spawn system call, a posix_spawn(3)
+ * that creates the child straight from a binary instead of copying
+ * the current process first. The child starts with the parent's open
+ * files, applies the file actions in order and then loads filename.
+ *
+ * @param filename the binary to run
+ * @param argv the arguments, as for do_execve()
+ * @param envp the environment, as for do_execve()
+ * @param actions file actions with kernel path strings
+ * @param nactions the number of file actions
+ * @return the pid of the child, or -errno if the file actions or
+ * loading the binary failed (the child is reaped in that case)
+ */
+int do_spawn(const char *filename, char *const *argv, char *const *envp,
+             const struct spawn_action *actions, int nactions);
+
 /**
  * Provides detailed debug information about a given process.
  *
@@ -20,17 +20,49 @@
 
 #include "util/list.h"
 
+#include "proc/spinlock.h"
+
 struct kthread;
 typedef struct ktqueue {
         list_t          tq_list;
         int             tq_size;
 } ktqueue_t;
 
+/* Runnable threads are kept on one queue for each combination of
+ * feedback level and nice value; lower queues are always run first.
+ * A thread starts at level 0, moves down a level each time it runs for
+ * its level's quantum and moves back up a level when it wakes from a
+ * sleep. */
+#define SCHED_NLEVELS   8
+#define SCHED_NICE_MIN  (-4)
+#define SCHED_NICE_MAX  4
+#define SCHED_NQUEUES   (SCHED_NLEVELS + SCHED_NICE_MAX - SCHED_NICE_MIN)
+
+/* Timer ticks a thread may run in user mode before it is preempted (with
+ * UPREEMPT), set with TIMESLICE in Config.mk */
+#ifdef __TIMESLICE__
+#define SCHED_TIMESLICE __TIMESLICE__
+#else
+#define SCHED_TIMESLICE 2
+#endif
+
+/* Protects the run queues and every ktqueue, and so the state of every
+ * thread which is runnable or asleep. A thread switching away holds it
+ * across the context switch, and the thread switched to releases it. */
+extern spinlock_t sched_lock;
+
 /**
  * Switches execution between kernel threads.
  */
 void sched_switch(void);
 
+/**
+ * Like sched_switch, for a caller which holds sched_lock (and so has
+ * the IPL at IPL_HIGH), for instance after putting curthr on a queue.
+ * Returns with sched_lock released, but with the IPL still high.
+ */
+void sched_switch_locked(void);
+
 /**
  * Marks the given thread as runnable, and adds it to the run queue.
  *
@@ -38,6 +70,59 @@ void sched_switch(void);
  */
 void sched_make_runnable(struct kthread *kt);
 
+/**
+ * Like sched_make_runnable, for a caller which holds sched_lock.
+ *
+ * @param thr the thread to make runnable
+ */
+void sched_make_runnable_locked(struct kthread *kt);
+
+/**
+ * Charges a timer tick to the current thread, noting that it should be
+ * preempted once it has used up its time slice. Called from the timer
+ * interrupt handler.
+ */
+void sched_tick(void);
+
+/**
+ * If the current thread has used up its time slice, or a thread ahead
+ * of it in the run queues has become runnable, puts it back on the run
+ * queue and switches to another thread. Called on the way back to user
+ * mode from an interrupt.
+ */
+void sched_preempt(void);
+
+/**
+ * Sets a thread's nice value, clamping it to the range
+ * [SCHED_NICE_MIN, SCHED_NICE_MAX].
+ *
+ * @param thr the thread
+ * @param nice the new nice value
+ * @return the nice value actually set
+ */
+int sched_set_nice(struct kthread *thr, int nice);
+
+/**
+ * Returns a thread's priority: the index of the run queue it goes on,
+ * lower running first. This counts any priority it has inherited. Must
+ * be called with sched_lock held.
+ *
+ * @param thr the thread
+ * @return its priority, 0..SCHED_NQUEUES-1
+ */
+int sched_priority_locked(struct kthread *thr);
+
+/**
+ * Lends a thread a priority, for as long as a thread waits on a mutex it
+ * holds (see kmutex.c), moving it to another run queue if it is on
+ * one. It runs at whichever is higher of this and its own priority.
+ * Must be called with sched_lock held.
+ *
+ * @param thr the thread
+ * @param prio the priority lent, SCHED_NQUEUES to take it back
+ */
+void sched_inherit_locked(struct kthread *thr, int prio);
+
 /**
  * Initializes a queue.
  *
@@ -70,6 +155,17 @@ void sched_sleep_on(ktqueue_t *q);
  */
 int sched_cancellable_sleep_on(ktqueue_t *q);
 
+/**
+ * Like sched_cancellable_sleep_on, but also wakes the thread (taking it
+ * off the queue) once the given number of timer ticks have passed.
+ *
+ * @param q the queue to sleep on
+ * @param ticks the most timer ticks to sleep for
+ * @return 0 if the thread was woken from the queue, -ETIME if the time
+ * ran out and -EINTR if the thread was cancelled
+ */
+int sched_timed_sleep_on(ktqueue_t *q, uint32_t ticks);
+
 /**
  * Wakes a single thread from sleep if there are any waiting on the
  * queue.
@@ -86,6 +182,26 @@ struct kthread *sched_wakeup_on(ktqueue_t *q);
  */
 void sched_broadcast_on(ktqueue_t *q);
 
+/**
+ * Like sched_sleep_on, but as an exclusive waiter: one waiting for a
+ * resource which only one thread can have, such as a free page, so that
+ * sched_wake_on need not wake every waiter when one is freed.
+ *
+ * @param q the queue to sleep on
+ */
+void sched_sleep_on_exclusive(ktqueue_t *q);
+
+/**
+ * Wakes every thread which is not an exclusive waiter on the queue,
+ * and at most the given number of exclusive waiters, longest waiting
+ * first. sched_broadcast_on wakes every waiter regardless.
+ *
+ * @param q the queue to wake up threads from
+ * @param nexclusive the most exclusive waiters to wake
+ * @return the number of exclusive waiters woken
+ */
+int sched_wake_on(ktqueue_t *q, int nexclusive);
+
 /**
  * Cancel the given thread from the queue it sleeps on.
  *
@@ -0,0 +1,75 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#pragma once
+
+#include "types.h"
+
+#include "main/interrupt.h"
+
+/*
+ * Spinlocks, for data which is also used from interrupt handlers (or,
+ * with more than one CPU, by other CPUs). A spinlock is held with the
+ * IPL raised to IPL_HIGH, so an interrupt handler on this CPU can never
+ * spin on a lock its own CPU holds. Spinlocks must not be held while
+ * blocking; kmutex_t is for that.
+ */
+
+typedef struct spinlock {
+        volatile uint32_t sl_locked;
+} spinlock_t;
+
+#define SPINLOCK_INITIALIZER { 0 }
+
+static inline void spinlock_init(spinlock_t *l)
+{
+        l->sl_locked = 0;
+}
+
+/* Takes the lock. The IPL must already be IPL_HIGH. */
+static inline void spinlock_acquire(spinlock_t *l)
+{
+        while (__sync_lock_test_and_set(&l->sl_locked, 1)) {
+                while (l->sl_locked) {
+                        __asm__ volatile("pause");
+                }
+        }
+}
+
+/* Drops the lock, leaving the IPL alone */
+static inline void spinlock_release(spinlock_t *l)
+{
+        __sync_lock_release(&l->sl_locked);
+}
+
+/* Raises the IPL to IPL_HIGH and takes the lock. Returns the old IPL,
+ * to be passed to spinlock_unlock(). */
+static inline uint8_t spinlock_lock(spinlock_t *l)
+{
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+        spinlock_acquire(l);
+        return ipl;
+}
+
+/* Drops the lock and restores the IPL from before spinlock_lock() */
+static inline void spinlock_unlock(spinlock_t *l, uint8_t ipl)
+{
+        spinlock_release(l);
+        intr_setipl(ipl);
+}
@@ -0,0 +1,57 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#pragma once
+
+#include "types.h"
+
+#include "api/time.h"
+
+/* Timer interrupts per second, set with TIMER_HZ in Config.mk */
+#ifdef __TIMER_HZ__
+#define TIMER_HZ __TIMER_HZ__
+#else
+#define TIMER_HZ 100
+#endif
+
+#define NSEC_PER_SEC    1000000000
+#define NSEC_PER_TICK   (NSEC_PER_SEC / TIMER_HZ)
+
+/* The number of timer ticks since boot. This follows the time stamp
+ * counter, so it may go up by more than one at once (in particular
+ * after the CPU has been idle). */
+extern volatile uint32_t time_ticks;
+
+/* Returns the number of nanoseconds since boot, read from the time stamp
+ * counter. */
+uint64_t time_ns(void);
+
+/* Converts a number of time stamp counter cycles to nanoseconds */
+uint64_t time_cycles_ns(uint64_t cycles);
+
+/* Reads the given clock into ts. Returns 0 on success or -EINVAL if the
+ * clock is unknown. */
+int time_gettime(clockid_t clock, struct timespec *ts);
+
+/* While the CPU is idle the periodic timer tick is stopped, and the APIC
+ * timer set to go off once, when the next kernel timer is due.
+ * time_idle_enter() is called with interrupts masked before waiting for
+ * an interrupt, and time_idle_exit() when the CPU has work again, which
+ * brings time_ticks up to date and restarts the tick. */
+void time_idle_enter(void);
+void time_idle_exit(void);
@@ -0,0 +1,88 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#pragma once
+
+#include "types.h"
+
+#include "util/list.h"
+
+/*
+ * Kernel timers. A timer calls its function once, from the timer
+ * interrupt's bottom half (see util/workq.h), on the first tick at or
+ * after the one it was set for.
+ * Timers are kept in a hierarchical timer wheel, so adding, cancelling
+ * and expiring a timer all take constant time.
+ *
+ * Timer functions run in interrupt context: they must not block.
+ */
+
+typedef void (*ktimer_func_t)(void *arg);
+
+typedef struct ktimer {
+        uint32_t        tm_expires;     /* the tick at which the timer fires */
+        ktimer_func_t   tm_func;
+        void           *tm_arg;
+        list_link_t     tm_link;        /* link on a timer wheel slot */
+} ktimer_t;
+
+/**
+ * Initializes a timer, which is not pending.
+ *
+ * @param t the timer
+ * @param func the function to call when the timer fires
+ * @param arg the argument to pass to func
+ */
+void ktimer_init(ktimer_t *t, ktimer_func_t func, void *arg);
+
+/**
+ * Sets a timer which is not pending to fire after the given number of
+ * timer ticks.
+ *
+ * @param t the timer
+ * @param ticks how many ticks from now the timer should fire
+ */
+void ktimer_add(ktimer_t *t, uint32_t ticks);
+
+/**
+ * Cancels a timer if it is pending.
+ *
+ * @param t the timer
+ * @return 1 if the timer was pending, 0 if it had already fired (or was
+ * never set)
+ */
+int ktimer_cancel(ktimer_t *t);
+
+/**
+ * Returns true if the timer is set and has not fired yet.
+ *
+ * @param t the timer
+ */
+int ktimer_pending(ktimer_t *t);
+
+/**
+ * Fires every timer which has expired. Called from the timer interrupt's
+ * bottom half after time_ticks has been advanced.
+ */
+void ktimer_run(void);
+
+/**
+ * Returns how many ticks from now the next timer might fire. It may be
+ * sooner than any timer is due, but never later.
+ */
+uint32_t ktimer_next(void);
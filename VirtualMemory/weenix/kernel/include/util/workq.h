@@ -0,0 +1,88 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#pragma once
+
+#include "types.h"
+
+#include "util/list.h"
+
+/*
+ * Deferred work, for the "bottom half" of an interrupt handler: whatever
+ * need not be done with interrupts disabled. The handler itself (the
+ * "top half") does only what the device needs straight away and queues
+ * a work item for the rest. Pending work runs once the handler has
+ * returned and the interrupt has been acknowledged, on the way out of
+ * an interrupt which was taken at IPL_LOW, with interrupts enabled, or
+ * else from the idle loop.
+ *
+ * Work runs in interrupt context, in whichever thread was interrupted:
+ * it must not block.
+ */
+
+typedef void (*work_func_t)(void *arg);
+
+typedef struct work {
+        work_func_t     w_func;
+        void           *w_arg;
+        list_link_t     w_link;         /* link on the pending list */
+        uint64_t        w_queued;       /* time stamp counter when queued */
+} work_t;
+
+/**
+ * Initializes a work item, which is not pending.
+ *
+ * @param w the work item
+ * @param func the function to call when the work runs
+ * @param arg the argument to pass to func
+ */
+void work_init(work_t *w, work_func_t func, void *arg);
+
+/**
+ * Queues a work item to run, unless it is already pending. Safe to call
+ * from an interrupt handler.
+ *
+ * @param w the work item
+ * @return 1 if the work was queued, 0 if it was already pending
+ */
+int work_queue(work_t *w);
+
+/**
+ * Returns whether any work is waiting to run. The idle loop drains it
+ * before halting: work queued by an interrupt taken at a raised IPL has
+ * not run yet, and the next interrupt may be a long way off.
+ */
+int work_pending(void);
+
+/**
+ * Runs all the pending work, unless another CPU (or an interrupt this
+ * one is returning to) is already doing so. Called from the interrupt
+ * handler with interrupts disabled, which it enables around each work
+ * item.
+ */
+void work_run(void);
+
+/**
+ * Reports how much work has run and the longest any of it waited
+ * between being queued and running, in cycles.
+ *
+ * @param nrun the number of work items run
+ * @param maxdelay the longest delay
+ * @param reset if true, start counting again afterwards
+ */
+void work_stats(uint32_t *nrun, uint32_t *maxdelay, int reset);
@@ -0,0 +1,37 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#pragma once
+
+/*
+ * Fast userspace mutexes: user locks only enter the kernel to sleep when
+ * they are contended, and to wake sleepers. Waiters are keyed by the page
+ * frame behind the address, so a lock in a MAP_SHARED page works between
+ * processes too.
+ */
+
+/* Puts the current thread to sleep if the int at the user address uaddr
+ * holds val, until futex_wake() is called on it (in any address space
+ * mapping the same page). Returns 0 once woken, -EAGAIN if *uaddr was not
+ * val, -EINTR if the thread was cancelled, -EINVAL if uaddr is not
+ * aligned or -EFAULT if it is not mapped writable. */
+int futex_wait(int *uaddr, int val);
+
+/* Wakes up to n threads sleeping in futex_wait() on uaddr. Returns the
+ * number woken, or -errno as for futex_wait(). */
+int futex_wake(int *uaddr, int n);
@@ -22,6 +22,8 @@
 
 #include "util/list.h"
 
+#include "proc/krwlock.h"
+
 #define VMMAP_DIR_LOHI 1
 #define VMMAP_DIR_HILO 2
 
@@ -29,9 +31,14 @@ struct mmobj;
 struct proc;
 struct vnode;
 
+/* The vmmap_* functions do not lock the map themselves. Threads using
+ * their process' map hold vmm_lock shared to look up areas and read or
+ * write through them (page faults, copy_{from,to}_user, futexes) and
+ * exclusive to change the areas (mmap, munmap, mremap, brk, fork). */
 typedef struct vmmap {
         list_t       vmm_list;
         struct proc *vmm_proc;
+        krwlock_t    vmm_lock;
 } vmmap_t;
 
 /* make sure you understand why mapping boundaries are in terms of frame
@@ -59,7 +66,9 @@ void vmmap_destroy(vmmap_t *map);
 
 vmarea_t *vmmap_lookup(vmmap_t *map, uint32_t vfn);
 int vmmap_map(vmmap_t *map, struct vnode *file, uint32_t lopage, uint32_t npages, int prot, int flags, off_t off, int dir, vmarea_t **new);
+int vmmap_map_obj(vmmap_t *map, struct mmobj *obj, uint32_t lopage, uint32_t npages, int prot, uint32_t off);
 int vmmap_remove(vmmap_t *map, uint32_t lopage, uint32_t npages);
+int vmmap_remap(vmmap_t *map, uint32_t lopage, uint32_t npages, uint32_t newnpages, int maymove, uint32_t *newlopage);
 int vmmap_is_range_empty(vmmap_t *map, uint32_t startvfn, uint32_t npages);
 int vmmap_find_range(vmmap_t *map, uint32_t npages, int dir);
 
@@ -21,6 +21,7 @@
 #include "main/io.h"
 #include "main/acpi.h"
 #include "main/cpuid.h"
+#include "main/interrupt.h"
 
 #include "mm/page.h"
 #include "mm/pagetable.h"
@@ -151,6 +152,12 @@ static struct apic_table *apic = NULL;
 static struct lapic_table *lapic = NULL;
 static struct ioapic_table *ioapic = NULL;
 
+/* The local APIC ids of the enabled processors, the boot processor first */
+static uint8_t apic_cpu_ids[APIC_MAX_CPUS];
+static uint32_t apic_ncpus = 0;
+/* The index in apic_cpu_ids of each local APIC id */
+static uint8_t apic_cpu_index_of[16];
+
 
 static uint32_t __lapic_getid(void)
 {
@@ -267,15 +274,24 @@ void apic_disable_periodic_timer() {
         *(uint32_t*)(apic->at_addr + LOCAL_APIC_TASKPRIOR) = 0;
 }
 
-void apic_enable_periodic_timer(uint32_t freq) {
+/* APIC timer counts (and time stamp counter cycles) in 10 ms, measured
+ * against the PIT by apic_calibrate_timer */
+static uint32_t apic_timer_per10ms = 0;
+static uint64_t apic_tsc_per10ms = 0;
+
+uint64_t apic_calibrate_timer(void) {
         uint32_t tmp;
-        uint32_t cpubusfreq;
+        uint64_t tsc;
 
-        dbgq(DBG_CORE, "--- Enabling APIC Timer ---\n");
+        if (0 != apic_timer_per10ms) {
+                return apic_tsc_per10ms;
+        }
+        dbgq(DBG_CORE, "--- Calibrating APIC Timer ---\n");
 
+        /* The timer counts down at the bus frequency divided by 16 */
         *(uint32_t*)(apic->at_addr + LOCAL_APIC_TMRDIV) = 0x03;
-        /* Initialize PIT Ch 2 in one-shot mode */
-        /* Some crazy magic numbers here */
+        /* Initialize PIT Ch 2 in one-shot mode, counting down from
+         * 0x2e9b (11931 ticks of its 1193182 Hz clock, i.e. 10 ms) */
         outb(0x61, (inb(0x61) & 0xfd) | 1);
         outb(0x43, 0xb2);
         outb(0x42, 0x9b);
@@ -288,19 +304,43 @@ void apic_enable_periodic_timer(uint32_t freq) {
         outb(0x61, (uint8_t)tmp | 1);
         /* reset APIC timer (set counter to -1) */
         *(uint32_t*)(apic->at_addr + LOCAL_APIC_TMRINITCNT) = 0xffffffff;
+        tsc = rdtsc();
         /* wait until the PIT reaches zero */
         while(!(inb(0x61) & 0x20));
-        /* Stop the APIC timer */
+        /* Stop the APIC timer, and see how far it (and the TSC) counted
+         * in 10 ms */
+        apic_tsc_per10ms = rdtsc() - tsc;
         *(uint32_t*)(apic->at_addr + LOCAL_APIC_LVT_TMR) = LOCAL_APIC_DISABLE;
-        /* some math */
-        cpubusfreq = ((0xffffffff - *(uint32_t*)(apic->at_addr + LOCAL_APIC_TMRINITCNT)) + 1) * 16 * 100;
-        tmp = (cpubusfreq / freq / 16) * 10000;
-        dbgq(DBG_CORE, "CPU Bus Freq: %u\n", cpubusfreq);
-        dbgq(DBG_CORE, "APIC Timer initial count %u\n", tmp);
+        apic_timer_per10ms = 0xffffffff - *(uint32_t*)(apic->at_addr + LOCAL_APIC_TMRCURRCNT);
+        dbgq(DBG_CORE, "CPU Bus Freq: %u\n", apic_timer_per10ms * 16 * 100);
+        dbgq(DBG_CORE, "TSC Freq: %u kHz\n", (uint32_t)(apic_tsc_per10ms / 10));
+        return apic_tsc_per10ms;
+}
+
+void apic_enable_periodic_timer(uint32_t freq) {
+        uint32_t tmp;
+
+        KASSERT(0 < freq);
+        apic_calibrate_timer();
+        tmp = apic_timer_per10ms * 100 / freq;
+        dbgq(DBG_CORE, "APIC Timer initial count %u (%u Hz)\n", tmp, freq);
         /* Set up the APIC timer for periodic mode */
+        *(uint32_t*)(apic->at_addr + LOCAL_APIC_TMRDIV) = 0x03;
+        *(uint32_t*)(apic->at_addr + LOCAL_APIC_LVT_TMR) = INTR_APICTIMER | LOCAL_APIC_TMR_PERIODIC;
         *(uint32_t*)(apic->at_addr + LOCAL_APIC_TMRINITCNT) = (tmp < 16 ? 16 : tmp);
-        *(uint32_t*)(apic->at_addr + LOCAL_APIC_LVT_TMR) = 32 | LOCAL_APIC_TMR_PERIODIC;
+}
+
+void apic_oneshot_timer(uint32_t usecs) {
+        uint64_t count;
+
+        KASSERT(0 != apic_timer_per10ms);
+        count = (uint64_t)apic_timer_per10ms * usecs / 10000;
+        if (count > 0xffffffff) {
+                count = 0xffffffff;
+        }
         *(uint32_t*)(apic->at_addr + LOCAL_APIC_TMRDIV) = 0x03;
+        *(uint32_t*)(apic->at_addr + LOCAL_APIC_LVT_TMR) = INTR_APICTIMER;
+        *(uint32_t*)(apic->at_addr + LOCAL_APIC_TMRINITCNT) = (count < 16 ? 16 : (uint32_t)count);
 }
 
 static void apic_disable_8259() {
@@ -342,10 +382,11 @@ void apic_init()
         KASSERT(PAGE_ALIGNED(apic->at_addr));
         apic->at_addr = pt_phys_perm_map(apic->at_addr, 1);
 
-        /* Get the tables for the local APIC and IO APICS,
-         * Weenix currently only supports one of each, in order
-         * to enforce this a KASSERT will fail this if more than one
-         * of each type is found */
+        /* Get the tables for the local APICs and IO APICS. There is a
+         * local APIC for each processor; lapic is the one for the
+         * processor we are running on. Weenix currently only supports
+         * one IO APIC, in order to enforce this a KASSERT will fail
+         * if more than one is found */
         uint8_t off = sizeof(*apic);
         while (off < apic->at_header.ah_size) {
                 uint8_t type = *(ptr + off);
@@ -353,13 +394,19 @@ void apic_init()
                 if (TYPE_LAPIC == type) {
                         KASSERT(apic_exists() && "Local APIC does not exist");
                         KASSERT(sizeof(struct lapic_table) == size);
-                        KASSERT(NULL == lapic && "Weenix only supports a single local APIC");
-                        lapic = (struct lapic_table *)(ptr + off);
+                        struct lapic_table *l = (struct lapic_table *)(ptr + off);
                         dbgq(DBG_CORE, "LAPIC:\n");
-                        dbgq(DBG_CORE, "   id:         0x%.2x\n", (uint32_t)lapic->at_apicid);
-                        dbgq(DBG_CORE, "   processor:  0x%.3x\n", (uint32_t)lapic->at_procid);
-                        dbgq(DBG_CORE, "   enabled:    %i\n", lapic->at_flags & 0x1);
-                        KASSERT(lapic->at_flags & 0x1 && "The local APIC is disabled");
+                        dbgq(DBG_CORE, "   id:         0x%.2x\n", (uint32_t)l->at_apicid);
+                        dbgq(DBG_CORE, "   processor:  0x%.3x\n", (uint32_t)l->at_procid);
+                        dbgq(DBG_CORE, "   enabled:    %i\n", l->at_flags & 0x1);
+                        if (l->at_apicid == __lapic_getid()) {
+                                KASSERT(l->at_flags & 0x1 && "The local APIC is disabled");
+                                KASSERT(NULL == lapic && "Two local APICs with our id");
+                                lapic = l;
+                        }
+                        if ((l->at_flags & 0x1) && apic_ncpus < APIC_MAX_CPUS) {
+                                apic_cpu_ids[apic_ncpus++] = l->at_apicid;
+                        }
                 } else if (TYPE_IOAPIC == type) {
                         KASSERT(apic_exists() && "IO APIC does not exist");
                         KASSERT(sizeof(struct ioapic_table) == size);
@@ -377,6 +424,19 @@ void apic_init()
                 off += size;
         }
         KASSERT(NULL != lapic && "Could not find a local APIC device");
+
+        /* Put the boot processor first */
+        uint32_t i;
+        for (i = 0; i < apic_ncpus; i++) {
+                if (apic_cpu_ids[i] == lapic->at_apicid) {
+                        apic_cpu_ids[i] = apic_cpu_ids[0];
+                        apic_cpu_ids[0] = lapic->at_apicid;
+                }
+        }
+        for (i = 0; i < apic_ncpus; i++) {
+                apic_cpu_index_of[apic_cpu_ids[i] & 0x0f] = i;
+        }
+        dbgq(DBG_CORE, "%u processors\n", apic_ncpus);
         KASSERT(NULL != ioapic && "Could not find an IO APIC");
 
         dbgq(DBG_CORE, "--- Enabling APIC ---\n");
@@ -392,6 +452,16 @@ void apic_init()
 
 }
 
+uint32_t apic_cpu_count()
+{
+        return apic_ncpus;
+}
+
+uint32_t apic_cpu_index()
+{
+        return apic_cpu_index_of[__lapic_getid()];
+}
+
 uint8_t apic_getipl()
 {
         return LAPICTPR & 0xff;
@@ -0,0 +1,123 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+/*
+ *  FILE: drvintr.c
+ *  DESC: Splits the interrupt handlers of the prebuilt drivers into a top
+ *        and a bottom half, see util/workq.h
+ */
+
+#include "types.h"
+#include "kernel.h"
+
+#include "main/interrupt.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/workq.h"
+
+/*
+ * The drivers come prebuilt in libdrivers.a and do all of their work in
+ * the interrupt handlers they register. Here each of those handlers is
+ * replaced by a top half of our own, which only queues the driver's
+ * handler to run as a bottom half. The EOI is all that is left in the
+ * interrupt itself.
+ */
+
+/*
+ * The keyboard handler reads the scancode, decodes it and hands the
+ * character to the tty, whose line discipline (n_tty_receive_char())
+ * buffers it and echoes it to the screen through the vt. The scancode
+ * is not lost by reading it later: the controller holds it until then,
+ * and raises no further keyboard interrupt, so there is one run of the
+ * bottom half for each interrupt.
+ */
+static intr_handler_t kbd_driver_intr;
+static work_t kbd_work;
+
+static void
+kbd_bottom_half(void *arg)
+{
+        /* The registers are long gone by now. The prebuilt keyboard
+         * handler never reads its regs argument (as its disassembly
+         * shows), so it is given none; this must be looked at again if
+         * libdrivers.a is ever rebuilt from different sources. */
+        kbd_driver_intr(NULL);
+}
+
+static void
+kbd_top_half(regs_t *regs)
+{
+        work_queue(&kbd_work);
+}
+
+/*
+ * The ATA handler works out the channel from regs->r_intr, wakes the
+ * thread waiting for the transfer, and then acknowledges the drive by
+ * reading its status register. The disk IRQs are edge triggered, and
+ * the drive raises no new interrupt before it is given a new command,
+ * which only the woken thread can do, so the acknowledgement can wait
+ * for the bottom half too. Each channel keeps a copy of the registers
+ * its handler is given.
+ */
+#define ATA_NCHANNELS 2
+
+static const uint8_t ata_intrs[ATA_NCHANNELS] = { INTR_DISK_PRIMARY, INTR_DISK_SECONDARY };
+static intr_handler_t ata_driver_intr[ATA_NCHANNELS];
+static regs_t ata_regs[ATA_NCHANNELS];
+static work_t ata_work[ATA_NCHANNELS];
+
+static void
+ata_bottom_half(void *arg)
+{
+        int channel = (int) arg;
+        ata_driver_intr[channel](&ata_regs[channel]);
+}
+
+static void
+ata_top_half(regs_t *regs)
+{
+        int channel = INTR_DISK_PRIMARY == regs->r_intr ? 0 : 1;
+
+        ata_regs[channel] = *regs;
+        work_queue(&ata_work[channel]);
+}
+
+static __attribute__((unused)) void
+drvintr_init(void)
+{
+#ifdef __DRIVERS__
+        int i;
+
+        /* The drivers have registered their handlers by now, in
+         * bytedev_init() and blockdev_init() */
+        work_init(&kbd_work, kbd_bottom_half, NULL);
+        kbd_driver_intr = intr_register(INTR_KEYBOARD, kbd_top_half);
+        KASSERT(NULL != kbd_driver_intr);
+
+        /* Only the channels with a disk on them have a handler */
+        for (i = 0; i < ATA_NCHANNELS; i++) {
+                work_init(&ata_work[i], ata_bottom_half, (void *) i);
+                ata_driver_intr[i] = intr_register(ata_intrs[i], ata_top_half);
+                if (NULL == ata_driver_intr[i]) {
+                        intr_register(ata_intrs[i], NULL);
+                }
+        }
+#endif
+}
+init_func(drvintr_init);
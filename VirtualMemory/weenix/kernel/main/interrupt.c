@@ -17,19 +17,32 @@
 /******************************************************************************/
 
 #include "types.h"
+#include "globals.h"
 
 #include "util/debug.h"
+#include "util/init.h"
 #include "util/string.h"
+#include "util/workq.h"
 
 #include "main/io.h"
 #include "main/apic.h"
+#include "main/cpuid.h"
 #include "main/interrupt.h"
 #include "main/gdt.h"
 
+#include "proc/kthread.h"
+#include "proc/sched.h"
+
+#include "test/kshell/kshell.h"
+#include "test/kshell/io.h"
+
 #define MAX_INTERRUPTS          256
 
 #define INTR_SPURIOUS      0xef
 
+/* The interrupt flag in eflags */
+#define EFLAGS_IF               0x200
+
 /* Convenient definitions for intr_desc.attr */
 
 #define IDT_DESC_TRAP           0x01
@@ -370,6 +383,15 @@ intr_info_t intr_data = {
  * debuggers. */
 static regs_t *_intr_regs = NULL;
 
+/* How long each interrupt's handler takes, see the intr kshell command */
+typedef struct intr_stat {
+        uint32_t        is_count;
+        uint32_t        is_max;         /* cycles */
+        uint64_t        is_cycles;      /* in total */
+} intr_stat_t;
+
+static intr_stat_t intr_stats[MAX_INTERRUPTS];
+
 intr_handler_t intr_register(uint8_t intr, intr_handler_t handler)
 {
         intr_handler_t old = intr_handlers[intr];
@@ -390,6 +412,12 @@ int32_t intr_map(uint16_t irq, uint8_t intr)
 static __attribute__((used)) void __intr_handler(regs_t regs)
 {
         intr_handler_t handler = intr_handlers[regs.r_intr];
+        intr_stat_t *stat = &intr_stats[regs.r_intr];
+        /* The IPL of the code we interrupted */
+        uint8_t ipl = intr_getipl();
+        uint64_t start = rdtsc();
+        uint32_t cycles;
+
         _intr_regs = &regs;
         if (NULL != handler) {
                 handler(&regs);
@@ -402,7 +430,70 @@ static __attribute__((used)) void __intr_handler(regs_t regs)
         }
 
         _intr_regs = NULL;
+
+        cycles = (uint32_t)(rdtsc() - start);
+        stat->is_count++;
+        stat->is_cycles += cycles;
+        if (cycles > stat->is_max) {
+                stat->is_max = cycles;
+        }
+
+        /* Bottom halves run with interrupts enabled, so not if we broke
+         * into code which had them disabled or was at a raised IPL */
+        if (IPL_LOW == ipl && (regs.r_eflags & EFLAGS_IF)) {
+                work_run();
+        }
+
+#ifdef __UPREEMPT__
+        /* Only user mode is ever preempted, the kernel itself is not
+         * preemptible */
+        if (3 == (regs.r_cs & 0x3)) {
+                sched_preempt();
+                /* A thread cancelled while in userland would otherwise
+                 * run until its next system call */
+                if (curthr->kt_cancelled) {
+                        kthread_exit(curthr->kt_retval);
+                }
+        }
+#endif
+}
+
+static int
+intr_kshell(kshell_t *ksh, int argc, char **argv)
+{
+        uint32_t i, nrun, maxdelay;
+        int reset = 0;
+
+        if (argc > 2 || (2 == argc && strcmp(argv[1], "reset"))) {
+                kprintf(ksh, "usage: intr [reset]\n");
+                return 0;
+        }
+        reset = (2 == argc);
+
+        kprintf(ksh, "%6s %10s %12s %12s\n", "VECTOR", "COUNT", "AVG(cycles)", "MAX(cycles)");
+        for (i = 0; i < MAX_INTERRUPTS; i++) {
+                intr_stat_t *stat = &intr_stats[i];
+                if (0 != stat->is_count) {
+                        kprintf(ksh, "  0x%02x %10u %12u %12u\n", i, stat->is_count,
+                                (uint32_t)(stat->is_cycles / stat->is_count), stat->is_max);
+                }
+        }
+        work_stats(&nrun, &maxdelay, reset);
+        kprintf(ksh, "bottom halves run:    %u, longest wait %u cycles\n", nrun, maxdelay);
+        if (reset) {
+                memset(intr_stats, 0, sizeof(intr_stats));
+        }
+        return 0;
+}
+
+static __attribute__((unused)) void
+intr_kshell_init(void)
+{
+        kshell_add_command("intr", intr_kshell,
+                           "show how long each interrupt's handler takes");
 }
+init_func(intr_kshell_init);
+init_depends(kshell_init);
 
 static void __intr_divide_by_zero_handler(regs_t *regs)
 {
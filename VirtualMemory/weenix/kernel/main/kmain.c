@@ -34,6 +34,7 @@
 
 #include "vm/vmmap.h"
 #include "vm/shadowd.h"
+#include "vm/ksmd.h"
 #include "vm/shadow.h"
 #include "vm/anon.h"
 
@@ -149,6 +150,9 @@ void kmain()
         while (gdb_wait)
                 ;
         context_setup(&bootstrap_context, bootstrap, 0, NULL, bstack, PAGE_SIZE, bpdir);
+        /* Threads start out holding sched_lock, as if switched to by
+         * sched_switch */
+        spinlock_lock(&sched_lock);
         context_make_active(&bootstrap_context);
 
         panic("\nReturned to kmain()!!!\n");
@@ -199,6 +203,7 @@ bootstrap(int arg1, void *arg2)
         KASSERT(NULL != curthr);
         dbg(DBG_PRINT, "(GRADING1A 1.a)\n");
 
+        spinlock_lock(&sched_lock);
         context_make_active(&thread_0->kt_ctx);
 
         panic("weenix returned to bootstrap()!!! BAD!!!\n");
@@ -268,6 +273,11 @@ idleproc_run(int arg1, void *arg2)
         shadowd_shutdown();
 #endif
 
+#ifdef __KSMD__
+        /* wait for ksmd to shutdown */
+        ksmd_shutdown();
+#endif
+
 #ifdef __VFS__
         /* Shutdown the vfs: */
         dbg_print("weenix: vfs shutdown...\n");
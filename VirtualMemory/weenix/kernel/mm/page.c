@@ -38,6 +38,10 @@ GDB_DEFINE_HOOK(page_free, void *addr, int npages)
 
 static list_t pagegroup_list;
 static uintptr_t page_freecount;
+/* Protects the page groups; page_lock_ipl is the IPL to return to when
+ * it is released, and is only used by its holder. */
+static spinlock_t page_lock = SPINLOCK_INITIALIZER;
+static uint8_t page_lock_ipl;
 
 struct pagegroup {
         list_t       pg_freelist[PAGE_NSIZES];
@@ -229,7 +233,9 @@ _page_split(int order)
 
                 dbg(DBG_PAGEALLOC, "WARNING, cannot allocate order=%u\n", order);
                 /* We have run out of kernel memory. Lets try and collapse some
-                   shadow trees, and then retry */
+                   shadow trees, and then retry. Both of these free pages, so
+                   page_lock is dropped meanwhile. */
+                spinlock_unlock(&page_lock, page_lock_ipl);
 #ifdef __SHADOWD__
                 dbg(DBG_PAGEALLOC, "waking up shadowd\n");
                 shadowd_wakeup();
@@ -237,6 +243,7 @@ _page_split(int order)
 #endif
                 int num_freed = slab_allocators_reclaim(0);
                 dbg(DBG_MM, "reclaimed %d pages from slab allocator.\n", num_freed);
+                page_lock_ipl = spinlock_lock(&page_lock);
         } while (num_retrys-- > 0);
 
         /* We are out of memory, and not even the shadow deamon could free some */
@@ -353,7 +360,9 @@ _page_free_order(void *addr, int order)
 void *
 page_alloc(void)
 {
+        page_lock_ipl = spinlock_lock(&page_lock);
         void *addr =  _page_alloc_order(0);
+        spinlock_unlock(&page_lock, page_lock_ipl);
         GDB_CALL_HOOK(page_alloc, addr, 1);
         return addr;
 }
@@ -366,7 +375,9 @@ void
 page_free(void *addr)
 {
         GDB_CALL_HOOK(page_free, addr, 1);
+        page_lock_ipl = spinlock_lock(&page_lock);
         _page_free_order(addr, 0);
+        spinlock_unlock(&page_lock, page_lock_ipl);
 }
 
 /*
@@ -385,7 +396,9 @@ page_alloc_n(uint32_t npages)
         if (order == PAGE_NSIZES)
                 panic("Implementation does not permit allocating %u pages!\n", npages);
 
+        page_lock_ipl = spinlock_lock(&page_lock);
         void *addr = _page_alloc_order(order);
+        spinlock_unlock(&page_lock, page_lock_ipl);
         GDB_CALL_HOOK(page_alloc, addr, npages);
         return addr;
 }
@@ -406,7 +419,9 @@ page_free_n(void *start, uint32_t npages)
                 panic("Implementation does not permit allocating %u pages!\n", npages);
 
         GDB_CALL_HOOK(page_free, start, npages);
+        page_lock_ipl = spinlock_lock(&page_lock);
         _page_free_order(start, order);
+        spinlock_unlock(&page_lock, page_lock_ipl);
 }
 
 /*
@@ -43,6 +43,9 @@
 #define PT_ENTRY_COUNT    (PAGE_SIZE / sizeof (uint32_t))
 #define PT_VADDR_SIZE     (PAGE_SIZE * PT_ENTRY_COUNT)
 
+/* pd_virtual holds the (page aligned) virtual address of each page
+ * table; for user page tables the low bits hold the number of non-zero
+ * entries in that table, so it can be freed once it becomes empty. */
 struct pagedir {
         pde_t      pd_physical[PT_ENTRY_COUNT];
         uintptr_t *pd_virtual[PT_ENTRY_COUNT];
@@ -59,6 +62,22 @@ struct pagedir {
 #define vaddr_to_offset(vaddr) \
         (((uint32_t)(vaddr)) & (~PAGE_MASK))
 
+#define pd_table(pd, index) \
+        ((pte_t *)((uintptr_t)(pd)->pd_virtual[index] & PAGE_MASK))
+#define pd_count(pd, index) \
+        ((uint32_t)(pd)->pd_virtual[index] & ~PAGE_MASK)
+#define pd_count_add(pd, index, n) \
+        ((pd)->pd_virtual[index] = (uintptr_t *)((uintptr_t)(pd)->pd_virtual[index] + (n)))
+
+/* Empty page tables are kept zeroed on a short free list (linked through
+ * their first entry) instead of going back to the page allocator, so
+ * processes which repeatedly map and unmap memory do not pay for a
+ * buddy allocation and a fresh zeroing each time. */
+#define PT_POOL_MAX       16
+
+static pte_t *pt_pool = NULL;
+static uint32_t pt_pool_count = 0;
+
 /* the virtual address of the page directory in cr3 */
 static pagedir_t *current_pagedir = NULL;
 static pagedir_t *template_pagedir = NULL;
@@ -122,6 +141,63 @@ pt_get(void)
         return current_pagedir;
 }
 
+static pte_t *
+_pt_table_alloc(void)
+{
+        pte_t *pt;
+        if (NULL != (pt = pt_pool)) {
+                pt_pool = (pte_t *)pt[0];
+                pt[0] = 0;
+                --pt_pool_count;
+        } else if (NULL != (pt = page_alloc())) {
+                memset(pt, 0, PAGE_SIZE);
+        }
+        return pt;
+}
+
+/* Frees a page table whose entries are all zero */
+static void
+_pt_table_free(pte_t *pt)
+{
+        if (pt_pool_count < PT_POOL_MAX) {
+                pt[0] = (pte_t)pt_pool;
+                pt_pool = pt;
+                ++pt_pool_count;
+        } else {
+                page_free(pt);
+        }
+}
+
+/* Removes the empty user page table at the given directory index */
+static void
+_pt_release(pagedir_t *pd, uint32_t index)
+{
+        KASSERT(0 == pd_count(pd, index));
+        _pt_table_free(pd_table(pd, index));
+        pd->pd_virtual[index] = NULL;
+        pd->pd_physical[index] = 0;
+}
+
+/* Zeroes entries [from, to) of the page table at the given directory
+ * index, freeing the table if nothing is left in it */
+static void
+_pt_clear(pagedir_t *pd, uint32_t index, uint32_t from, uint32_t to)
+{
+        pte_t *pt = pd_table(pd, index);
+        uint32_t cleared = 0;
+
+        for (; from < to; ++from) {
+                if (0 != pt[from]) {
+                        pt[from] = 0;
+                        ++cleared;
+                }
+        }
+        pd_count_add(pd, index, -cleared);
+        if (0 == pd_count(pd, index)) {
+                _pt_release(pd, index);
+        }
+}
+
 int
 pt_map(pagedir_t *pd, uintptr_t vaddr, uintptr_t paddr, uint32_t pdflags, uint32_t ptflags)
 {
@@ -132,24 +208,26 @@ pt_map(pagedir_t *pd, uintptr_t vaddr, uintptr_t paddr, uint32_t pdflags, uint32
 
         pte_t *pt;
         if (!(PT_PRESENT & pd->pd_physical[index])) {
-                if (NULL == (pt = page_alloc())) {
+                if (NULL == (pt = _pt_table_alloc())) {
                         return -ENOMEM;
                 } else {
                         KASSERT((pdflags & ~PAGE_MASK) == pdflags);
-                        memset(pt, 0, PAGE_SIZE);
                         pd->pd_physical[index] = pt_virt_to_phys((uintptr_t)pt) | pdflags;
                         pd->pd_virtual[index] = pt;
                 }
         } else {
                 /* Be sure to add additional pagedir flags if necessary */
                 pd->pd_physical[index] = pd->pd_physical[index] | pdflags;
-                pt = (pte_t *)pd->pd_virtual[index];
+                pt = pd_table(pd, index);
         }
 
-        index = vaddr_to_ptindex(vaddr);
+        uint32_t ptindex = vaddr_to_ptindex(vaddr);
 
         KASSERT((ptflags & ~PAGE_MASK) == ptflags);
-        pt[index] = paddr | ptflags;
+        if (0 == pt[ptindex]) {
+                pd_count_add(pd, index, 1);
+        }
+        pt[ptindex] = paddr | ptflags;
 
         return 0;
 }
@@ -163,10 +241,16 @@ pt_unmap(pagedir_t *pd, uintptr_t vaddr)
         int index = vaddr_to_pdindex(vaddr);
 
         if (PT_PRESENT & pd->pd_physical[index]) {
-                pte_t *pt = (pte_t *)pd->pd_virtual[index];
-
-                index = vaddr_to_ptindex(vaddr);
-                pt[index] = 0;
+                pte_t *pt = pd_table(pd, index);
+                uint32_t ptindex = vaddr_to_ptindex(vaddr);
+
+                if (0 != pt[ptindex]) {
+                        pt[ptindex] = 0;
+                        pd_count_add(pd, index, -1);
+                        if (0 == pd_count(pd, index)) {
+                                _pt_release(pd, index);
+                        }
+                }
         }
 }
 
@@ -179,33 +263,81 @@ pt_unmap_range(pagedir_t *pd, uintptr_t vlow, uintptr_t vhigh)
         KASSERT(PAGE_ALIGNED(vlow) && PAGE_ALIGNED(vhigh));
         KASSERT(USER_MEM_LOW <= vlow && USER_MEM_HIGH >= vhigh);
 
+        /* Both ends inside the same page table */
+        if (vaddr_to_pdindex(vlow) == vaddr_to_pdindex(vhigh)) {
+                if (PT_PRESENT & pd->pd_physical[vaddr_to_pdindex(vlow)]) {
+                        _pt_clear(pd, vaddr_to_pdindex(vlow),
+                                  vaddr_to_ptindex(vlow), vaddr_to_ptindex(vhigh));
+                }
+                return;
+        }
+
         index = vaddr_to_ptindex(vlow);
         if (PT_PRESENT & pd->pd_physical[vaddr_to_pdindex(vlow)] && index != 0) {
-                pte_t *pt = (pte_t *)pd->pd_virtual[vaddr_to_pdindex(vlow)];
-                size_t size = (PT_ENTRY_COUNT - index) * sizeof(*pt);
-                memset(&pt[index], 0, size);
+                _pt_clear(pd, vaddr_to_pdindex(vlow), index, PT_ENTRY_COUNT);
         }
         vlow += PAGE_SIZE * ((PT_ENTRY_COUNT - index) % PT_ENTRY_COUNT);
 
         index = vaddr_to_ptindex(vhigh);
         if (PT_PRESENT & pd->pd_physical[vaddr_to_pdindex(vhigh)] && index != 0) {
-                pte_t *pt = (pte_t *)pd->pd_virtual[vaddr_to_pdindex(vhigh)];
-                size_t size = index * sizeof(*pt);
-                memset(&pt[0], 0, size);
+                _pt_clear(pd, vaddr_to_pdindex(vhigh), 0, index);
         }
         vhigh -= PAGE_SIZE * index;
 
         uint32_t i;
         for (i = vaddr_to_pdindex(vlow); i < vaddr_to_pdindex(vhigh); ++i) {
                 if (PT_PRESENT & pd->pd_physical[i]) {
-                        page_free(pd->pd_virtual[i]);
-                        pd->pd_virtual[i] = NULL;
-                        pd->pd_physical[i] = 0;
+                        _pt_clear(pd, i, 0, PT_ENTRY_COUNT);
                 }
         }
 }
 
 
+int
+pt_move_range(pagedir_t *pd, uintptr_t vfrom, uintptr_t vto, uint32_t npages)
+{
+        KASSERT(PAGE_ALIGNED(vfrom) && PAGE_ALIGNED(vto));
+        KASSERT(USER_MEM_LOW <= vfrom && USER_MEM_HIGH >= vfrom + npages * PAGE_SIZE);
+        KASSERT(USER_MEM_LOW <= vto && USER_MEM_HIGH >= vto + npages * PAGE_SIZE);
+
+        while (npages > 0) {
+                uint32_t index = vaddr_to_pdindex(vfrom);
+                uint32_t count = PT_ENTRY_COUNT - vaddr_to_ptindex(vfrom);
+                if (count > npages) {
+                        count = npages;
+                }
+
+                /* Skip page tables which were never allocated */
+                if (PT_PRESENT & pd->pd_physical[index]) {
+                        pte_t *pt = pd_table(pd, index);
+                        pde_t pdflags = pd->pd_physical[index] & (PD_PRESENT | PD_WRITE | PD_USER);
+
+                        uint32_t i;
+                        for (i = 0; i < count; ++i) {
+                                pte_t *pte = &pt[vaddr_to_ptindex(vfrom) + i];
+                                if (PT_PRESENT & *pte) {
+                                        int err = pt_map(pd, vto + i * PAGE_SIZE, *pte & PAGE_MASK,
+                                                         pdflags, *pte & ~PAGE_MASK);
+                                        if (0 > err) {
+                                                return err;
+                                        }
+                                        *pte = 0;
+                                        pd_count_add(pd, index, -1);
+                                }
+                        }
+                        if (0 == pd_count(pd, index)) {
+                                _pt_release(pd, index);
+                        }
+                }
+
+                vfrom += count * PAGE_SIZE;
+                vto += count * PAGE_SIZE;
+                npages -= count;
+        }
+        return 0;
+}
+
+
 pagedir_t *
 pt_create_pagedir()
 {
@@ -232,7 +364,13 @@ pt_destroy_pagedir(pagedir_t *pdir)
         uint32_t i;
         for (i = begin; i <= end; ++i) {
                 if (PT_PRESENT & pdir->pd_physical[i]) {
-                        page_free(pdir->pd_virtual[i]);
+                        pte_t *pt = pd_table(pdir, i);
+                        if (pt_pool_count < PT_POOL_MAX) {
+                                memset(pt, 0, PAGE_SIZE);
+                                _pt_table_free(pt);
+                        } else {
+                                page_free(pt);
+                        }
                 }
         }
         page_free_n(pdir, 2);
@@ -396,8 +534,8 @@ pt_mapping_info(const void *pt, char *buf, size_t osize)
         while (PT_ENTRY_COUNT > pdi) {
                 pte_t *entry = NULL;
                 if (PD_PRESENT & pagedir->pd_physical[pdi]) {
-                        if (PT_PRESENT & pagedir->pd_virtual[pdi][pti]) {
-                                entry = &pagedir->pd_virtual[pdi][pti];
+                        if (PT_PRESENT & pd_table(pagedir, pdi)[pti]) {
+                                entry = &pd_table(pagedir, pdi)[pti];
                         }
                 } else {
                         ++pdi;
@@ -429,3 +567,21 @@ pt_mapping_info(const void *pt, char *buf, size_t osize)
 
         return osize - size;
 }
+
+void
+pt_usage(pagedir_t *pd, uint32_t *tables, uint32_t *entries)
+{
+        uint32_t begin = USER_MEM_LOW / PT_VADDR_SIZE;
+        uint32_t end = (USER_MEM_HIGH - 1) / PT_VADDR_SIZE;
+
+        *tables = 0;
+        *entries = 0;
+
+        uint32_t i;
+        for (i = begin; i <= end; ++i) {
+                if (PT_PRESENT & pd->pd_physical[i]) {
+                        ++*tables;
+                        *entries += pd_count(pd, i);
+                }
+        }
+}
@@ -19,11 +19,13 @@
 #include "globals.h"
 #include "config.h"
 #include "errno.h"
+#include "limits.h"
 
 #include "proc/proc.h"
 
 #include "util/debug.h"
 #include "util/string.h"
+#include "util/time.h"
 
 #include "mm/mmobj.h"
 #include "mm/page.h"
@@ -34,6 +36,8 @@
 #include "mm/pagetable.h"
 
 #include "vm/vmmap.h"
+#include "fs/vnode.h"
+#include "vm/ksmd.h"
 
 /*
  * In this file, physical pages (as represented by pframes) will be
@@ -119,7 +123,9 @@ static proc_t *pageoutd = NULL;
 static kthread_t *pageoutd_thr = NULL;
 static ktqueue_t pageoutd_waitq;
 
-/* threads waiting for pageoutd to run sleep on this queue */
+/* threads waiting for pageoutd to run sleep on this queue, as exclusive
+ * waiters: each wants one page, so pageoutd wakes only as many of them
+ * as there are pages free */
 static ktqueue_t alloc_waitq;
 
 /* Pageout daemon functions */
@@ -130,6 +136,15 @@ static void pageoutd_exit(void);
         ((page_free_count() <= nfreepages_min) && (!list_empty(&alloc_list)))
 #define pageoutd_target_met()    (page_free_count() >= nfreepages_target)
 
+/* How often pageoutd wakes up by itself to write back dirty pages, and
+ * the most pages it cleans each time */
+#define PAGEOUTD_INTERVAL        (5 * TIMER_HZ)
+#define PAGEOUTD_WRITEBACK_MAX   32
+
+/* How many times pframe_get waits for pageoutd to free a page before
+ * giving up */
+#define PFRAME_ALLOC_TRIES       3
+
 
 /*
  * Initialize the pinned and allocated counts and lists. Then, make a pframe
@@ -270,6 +285,10 @@ pframe_alloc(mmobj_t *o, uint32_t pagenum)
         o->mmo_nrespages++;
         list_insert_head(&o->mmo_respages, &pf->pf_olink);
 
+#ifdef __KSMD__
+        pf->pf_checksum = 0;
+        ksmd_page_alloced();
+#endif
         return pf;
 }
 
@@ -359,6 +378,7 @@ pframe_get(struct mmobj *o, uint32_t pagenum, pframe_t **result)
         // NOT_YET_IMPLEMENTED("VM: pframe_get");
         dbg(DBG_PRINT, "(GRADING3B)\n");
         pframe_t *frame = pframe_get_resident(o, pagenum);
+        int tries = 0;
         *result = NULL;
         while(1) {
                 if(frame == NULL) {
@@ -371,6 +391,15 @@ pframe_get(struct mmobj *o, uint32_t pagenum, pframe_t **result)
                         frame = pframe_alloc(o, pagenum);
                         
                         if(frame == NULL) {
+                                /* Wait for pageoutd if it has anything to
+                                 * reclaim; the page may have been brought
+                                 * in meanwhile, so look it up again */
+                                if (tries++ < PFRAME_ALLOC_TRIES && !list_empty(&alloc_list)) {
+                                        pageoutd_wakeup();
+                                        sched_sleep_on_exclusive(&alloc_waitq);
+                                        frame = pframe_get_resident(o, pagenum);
+                                        continue;
+                                }
                                 dbg(DBG_PRINT, "(GRADING3B)\n");
                                 return -1;
                         }
@@ -657,6 +686,8 @@ pageoutd_init(void)
         KASSERT(NULL != pageoutd);
         pageoutd_thr = kthread_create(pageoutd, pageoutd_run, 0, NULL);
         KASSERT(NULL != pageoutd_thr);
+        /* Run ahead of the threads waiting on it for memory */
+        sched_set_nice(pageoutd_thr, SCHED_NICE_MIN);
 
         sched_make_runnable(pageoutd_thr);
 }
@@ -674,6 +705,30 @@ pageoutd_exit()
         pageoutd_thr = NULL;
 }
 
+/*
+ * Writes back up to PAGEOUTD_WRITEBACK_MAX dirty pages, starting with the
+ * least recently requested, so that a later sync or reclaim has less to do.
+ * Busy pages are skipped. As in pframe_clean_all, the iteration restarts
+ * after each clean because we may have blocked.
+ */
+static void
+pageoutd_writeback(void)
+{
+        pframe_t *pf;
+        int n = 0;
+
+list_start:
+        if (n >= PAGEOUTD_WRITEBACK_MAX)
+                return;
+        list_iterate_begin(&alloc_list, pf, pframe_t, pf_link) {
+                if (!pframe_is_busy(pf) && pframe_is_dirty(pf)) {
+                        pframe_clean(pf);
+                        n++;
+                        goto list_start;
+                }
+        } list_iterate_end();
+}
+
 /*
  * The pageout daemon, when run, gets the least-recently-requested page from the
  * list of pages which are available to be paged out. Make sure to check if the
@@ -687,6 +742,11 @@ pageoutd_run(int arg1, void *arg2)
 {
         while (1) {
                 KASSERT(nallocated >= 0);
+                /* Unreferenced vnodes pin their inodes' pages; let some
+                 * of them go so that those pages can be reclaimed below */
+                if (!pageoutd_target_met()) {
+                        vnode_cache_shrink(VNODE_CACHE_MAX / 4);
+                }
                 while ((!pageoutd_target_met()) && (!list_empty(&alloc_list))) {
                         pframe_t *pf;
 
@@ -704,16 +764,25 @@ pageoutd_run(int arg1, void *arg2)
                         }
                 }
 
-                /*   release the thundering herd... */
-                sched_broadcast_on(&alloc_waitq);
+                /* Wake a waiter for each free page, or all of them if
+                 * there is nothing left to reclaim so they can give up */
+                sched_wake_on(&alloc_waitq, list_empty(&alloc_list)
+                              ? INT_MAX : (int) page_free_count());
 
                 dbg(DBG_PFRAME, "PAGEOUT DEMAON: Falling asleep\n");
                 dbg(DBG_PFRAME, "PAGEOUT DEMAON: "
                     "nfreepages_target=|%d| "
                     "nfreepages_min=|%d| "
                     "page_free_count=|%d|\n", nfreepages_target, nfreepages_min, page_free_count());
-                if (sched_cancellable_sleep_on(&pageoutd_waitq))
-                        kthread_exit((void *)0);
+                /* Wake up every so often to write back dirty pages */
+                switch (sched_timed_sleep_on(&pageoutd_waitq, PAGEOUTD_INTERVAL)) {
+                        case -EINTR:
+                                kthread_exit((void *)0);
+                                break;
+                        case -ETIME:
+                                pageoutd_writeback();
+                                break;
+                }
                 dbg(DBG_PFRAME, "PAGEOUT DEMAON: Waking up\n");
                 dbg(DBG_PFRAME, "PAGEOUT DEMAON: "
                     "nfreepages_target=|%d| "
@@ -24,9 +24,9 @@
  * (used in Solaris and Linux) from UNIX Internals: The New Frontiers,
  * by Uresh Vahalia.
  *
- * Note that there is no need for locking in allocation and deallocation because
- * it never blocks nor is used by an interrupt handler. Hurray for non preemptible
- * kernels!
+ * Allocation and deallocation never block, so each allocator is protected
+ * by a spinlock (which only matters with more than one CPU, as the kernel is
+ * not preemptible and no interrupt handler allocates).
  */
 
 #include "types.h"
@@ -35,6 +35,8 @@
 #include "mm/slab.h"
 #include "mm/page.h"
 
+#include "proc/spinlock.h"
+
 #include "util/gdb.h"
 #include "util/string.h"
 #include "util/debug.h"
@@ -69,6 +71,7 @@ struct slab_allocator {
         struct slab             *sa_slabs;      /* head of slab list */
         int                      sa_order;      /* npages = (1 << order) */
         int                      sa_slab_nobjs; /* number of objs per slab */
+        spinlock_t               sa_lock;       /* protects the slabs */
 };
 
 struct slab_bufctl {
@@ -191,6 +194,7 @@ _allocator_init(struct slab_allocator *allocator, const char *name, size_t size)
         allocator->sa_name = name;
         allocator->sa_objsize = size;
         allocator->sa_slabs = NULL;
+        spinlock_init(&allocator->sa_lock);
         _calc_slab_size(allocator);
 
         /* Add cache to global cache list. */
@@ -271,8 +275,10 @@ _slab_allocator_grow(struct slab_allocator *allocator)
             1 << allocator->sa_order);
 
         /* Place this slab into the cache. */
+        uint8_t ipl = spinlock_lock(&allocator->sa_lock);
         slab->s_next = allocator->sa_slabs;
         allocator->sa_slabs = slab;
+        spinlock_unlock(&allocator->sa_lock, ipl);
 
         return 1;
 }
@@ -282,6 +288,7 @@ slab_obj_alloc(struct slab_allocator *allocator)
 {
         struct slab *slab;
         void *obj;
+        uint8_t ipl = spinlock_lock(&allocator->sa_lock);
 
         /* Find a slab with a free object. */
         for (;;) {
@@ -290,8 +297,12 @@ slab_obj_alloc(struct slab_allocator *allocator)
                         slab = slab->s_next;
                 if (slab && (slab->s_inuse < allocator->sa_slab_nobjs))
                         break;
+                /* Growing may reclaim from this allocator when memory
+                 * is low, so it is done unlocked */
+                spinlock_unlock(&allocator->sa_lock, ipl);
                 if (!_slab_allocator_grow(allocator))
                         return NULL;
+                ipl = spinlock_lock(&allocator->sa_lock);
         }
 
         /*
@@ -311,6 +322,7 @@ slab_obj_alloc(struct slab_allocator *allocator)
         dbg(DBG_MM, "Allocated object 0x%p from \"%s\" (0x%p), "
             "slab 0x%p, inuse %d\n", obj, allocator->sa_name,
             allocator, allocator, slab->s_inuse);
+        spinlock_unlock(&allocator->sa_lock, ipl);
 
 #ifdef SLAB_REDZONE
         VERIFY_REDZONES(allocator, obj);
@@ -343,6 +355,7 @@ slab_obj_free(struct slab_allocator *allocator, void *obj)
         obj_bufctl(allocator, obj)->sb_free = 1;
 #endif
 
+        uint8_t ipl = spinlock_lock(&allocator->sa_lock);
         slab = obj_bufctl(allocator, obj)->sb_slab;
 
         /* Place this object back on the slab's free list. */
@@ -350,6 +363,7 @@ slab_obj_free(struct slab_allocator *allocator, void *obj)
         slab->s_free = obj;
 
         slab->s_inuse--;
+        spinlock_unlock(&allocator->sa_lock, ipl);
 
         dbg(DBG_MM, "Freed object 0x%p from \"%s\" (0x%p), slab 0x%p, inuse %d\n",
             obj, allocator->sa_name, allocator, slab, slab->s_inuse);
@@ -372,6 +386,7 @@ slab_allocators_reclaim(int target)
 
         /* Go through all caches */
         for (a = slab_allocators; NULL != a; a = a->sa_next) {
+                uint8_t ipl = spinlock_lock(&a->sa_lock);
                 prev = &(a->sa_slabs);
                 s = a->sa_slabs;
                 while (NULL != s) {
@@ -388,10 +403,12 @@ slab_allocators_reclaim(int target)
                         }
                         /* Check if target was met */
                         if ((target > 0) && (npages_freed >= target)) {
+                                spinlock_unlock(&a->sa_lock, ipl);
                                 return npages_freed;
                         }
                         s = next;
                 }
+                spinlock_unlock(&a->sa_lock, ipl);
         }
         return npages_freed;
 }
@@ -20,6 +20,7 @@
 
 #include "proc/context.h"
 #include "proc/kthread.h"
+#include "proc/sched.h"
 
 #include "main/apic.h"
 #include "main/interrupt.h"
@@ -33,6 +34,9 @@
 static void
 __context_initial_func(context_func_t func, int arg1, void *arg2)
 {
+        /* We were switched to by a thread holding sched_lock (see
+         * sched_switch_locked) */
+        spinlock_release(&sched_lock);
         apic_setipl(IPL_LOW);
         intr_enable();
 
@@ -25,6 +25,7 @@
 
 #include "proc/proc.h"
 #include "proc/kthread.h"
+#include "proc/sched.h"
 
 #include "mm/mm.h"
 #include "mm/mman.h"
@@ -35,17 +36,21 @@
 #include "mm/tlb.h"
 
 #include "fs/file.h"
+#include "fs/fdtable.h"
 #include "fs/vnode.h"
+#include "fs/vfs_syscall.h"
 
 #include "vm/shadow.h"
 #include "vm/vmmap.h"
 
 #include "api/exec.h"
+#include "api/binfmt.h"
+#include "api/syscall.h"
 
 #include "main/interrupt.h"
 
 /* Pushes the appropriate things onto the kernel stack of a newly forked thread
- * so that it can begin execution in userland_entry.
+ * so that it can begin execution in fork_entry.
  * regs: registers the new thread should have on execution
  * kstack: location of the new thread's kernel stack
  * Returns the new stack pointer on success. */
@@ -60,6 +65,15 @@ fork_setup_stack(const regs_t *regs, void *kstack)
         return esp;
 }
 
+/* Where the threads made here start: we are switched to by a thread
+ * which still holds sched_lock (see sched_switch_locked), which
+ * userland_entry knows nothing of, so drop it on the way */
+static void
+fork_entry(const regs_t *regs)
+{
+        spinlock_release(&sched_lock);
+        userland_entry(regs);
+}
 
 /*
  * The implementation of fork(2). Once this works,
@@ -84,13 +98,27 @@ do_fork(struct regs *regs)
 		return -ENOMEM;
 	}
 
+	// setup newproc open files, only the slots in use are copied
+	if(0 > fdtable_copy(newproc->p_fdt, curproc->p_fdt)) {
+		/* Leave do_waitpid() to free what proc_create() set up */
+		vmmap_destroy(newproc->p_vmmap);
+		newproc->p_vmmap = NULL;
+		vput(newproc->p_cwd);
+		newproc->p_state = PROC_DEAD;
+		do_waitpid(newproc->p_pid, 0, NULL);
+		curthr->kt_errno = ENOMEM;
+		return -ENOMEM;
+	}
+
 	// create newthr and link with newproc
         kthread_t *newthr = kthread_clone(curthr);
 	if(!newthr) {
-		pt_destroy_pagedir(newproc->p_pagedir);
-                list_remove(&curproc->p_list_link);
-                list_remove(&curproc->p_child_link);
-                vput(curproc->p_cwd);
+		/* Leave do_waitpid() to free what proc_create() set up */
+		vmmap_destroy(newproc->p_vmmap);
+		newproc->p_vmmap = NULL;
+		vput(newproc->p_cwd);
+		newproc->p_state = PROC_DEAD;
+		do_waitpid(newproc->p_pid, 0, NULL);
 		curthr->kt_errno = ENOMEM;
 		return -ENOMEM;
 	}
@@ -101,13 +129,15 @@ do_fork(struct regs *regs)
 	newproc->p_brk = curproc->p_brk;
         newproc->p_start_brk = curproc-> p_start_brk;
 
-	// create newproc vmmap and vmarea
+	// create newproc vmmap and vmarea; the parent's areas get new
+	// shadow objects, so keep its other threads out until it is done
+	krwlock_wrlock(&curproc->p_vmmap->vmm_lock);
 	newproc->p_vmmap = vmmap_clone(curproc->p_vmmap);
 	if(!newproc->p_vmmap) {
-		pt_destroy_pagedir(newproc->p_pagedir);
-		list_remove(&curproc->p_list_link);
-		list_remove(&curproc->p_child_link);
-		vput(curproc->p_cwd);
+		krwlock_unlock(&curproc->p_vmmap->vmm_lock);
+		vput(newproc->p_cwd);
+		newproc->p_state = PROC_DEAD;
+		do_waitpid(newproc->p_pid, 0, NULL);
 		curthr->kt_errno = ENOMEM;
 		return -ENOMEM;
 	}
@@ -146,18 +176,9 @@ do_fork(struct regs *regs)
     dbg(DBG_PRINT, "(GRADING3A 7.a)\n");
 
 
-	// setup newproc p_files
-	int f;
-        for(f = 0; f < NFILES; ++f) {
-                newproc->p_files[f] = curproc->p_files[f];
-                if(newproc->p_files[f]) {
-                        fref(newproc->p_files[f]); // ref count +1
-                }
-	}
-
 	// setup newthr kt_ctx
 	regs->r_eax = 0; // return 0 to child proc
-	(newthr->kt_ctx).c_eip = (uint32_t) userland_entry;
+	(newthr->kt_ctx).c_eip = (uint32_t) fork_entry;
 	(newthr->kt_ctx).c_esp = fork_setup_stack(regs, newthr->kt_kstack);
 	(newthr->kt_ctx).c_pdptr = newproc->p_pagedir;
 	(newthr->kt_ctx).c_kstack = (uintptr_t) newthr->kt_kstack;
@@ -166,6 +187,7 @@ do_fork(struct regs *regs)
 	// update pagetable and tlb
 	pt_unmap_range(curproc->p_pagedir, USER_MEM_LOW, USER_MEM_HIGH);
 	tlb_flush_all();
+	krwlock_unlock(&curproc->p_vmmap->vmm_lock);
 
 	// put into runq
 	sched_make_runnable(newthr);
@@ -176,3 +198,247 @@ do_fork(struct regs *regs)
 
         return newproc->p_pid;
 }
+
+/*
+ * The implementation of vfork(2). Instead of copying the address space,
+ * the child borrows the parent's vmmap and page directory; its own
+ * (empty) ones are parked until vfork_release(). The parent sleeps
+ * until then, so nothing else uses the address space meanwhile. The
+ * child does get its own copy of the file table, as with fork(2).
+ */
+int
+do_vfork(struct regs *regs)
+{
+        KASSERT(regs != NULL);
+        KASSERT(curproc != NULL);
+        KASSERT(curproc->p_state == PROC_RUNNING);
+
+        kthread_t *newthr = kthread_clone(curthr);
+        if (NULL == newthr) {
+                return -ENOMEM;
+        }
+
+        proc_t *newproc = proc_create(curproc->p_comm);
+        if (NULL == newproc) {
+                kthread_destroy(newthr);
+                return -ENOMEM;
+        }
+        list_insert_tail(&newproc->p_threads, &newthr->kt_plink);
+        newthr->kt_proc = newproc;
+
+        if (0 > fdtable_copy(newproc->p_fdt, curproc->p_fdt)) {
+                vmmap_destroy(newproc->p_vmmap);
+                newproc->p_vmmap = NULL;
+                vput(newproc->p_cwd);
+                newproc->p_state = PROC_DEAD;
+                do_waitpid(newproc->p_pid, 0, NULL);
+                return -ENOMEM;
+        }
+
+        newproc->p_brk = curproc->p_brk;
+        newproc->p_start_brk = curproc->p_start_brk;
+
+        newproc->p_vfork_vmmap = newproc->p_vmmap;
+        newproc->p_vfork_pagedir = newproc->p_pagedir;
+        newproc->p_vmmap = curproc->p_vmmap;
+        newproc->p_pagedir = curproc->p_pagedir;
+
+        regs->r_eax = 0;
+        newthr->kt_ctx.c_eip = (uint32_t) fork_entry;
+        newthr->kt_ctx.c_esp = fork_setup_stack(regs, newthr->kt_kstack);
+        newthr->kt_ctx.c_pdptr = curproc->p_pagedir;
+        newthr->kt_ctx.c_kstack = (uintptr_t) newthr->kt_kstack;
+        newthr->kt_ctx.c_kstacksz = DEFAULT_STACK_SIZE;
+
+        sched_make_runnable(newthr);
+
+        /* The child wakes us from vfork_release(). Other children
+         * exiting meanwhile may wake us early. */
+        while (NULL != newproc->p_vfork_vmmap) {
+                sched_sleep_on(&curproc->p_wait);
+        }
+
+        regs->r_eax = newproc->p_pid;
+        return newproc->p_pid;
+}
+
+#ifdef __MTP__
+int
+do_thr_create(struct regs *regs, uint32_t eip, uint32_t esp)
+{
+        KASSERT(regs != NULL);
+        KASSERT(curproc->p_state == PROC_RUNNING);
+
+        if (USER_MEM_LOW > eip || USER_MEM_HIGH <= eip
+            || USER_MEM_LOW > esp || USER_MEM_HIGH < esp) {
+                return -EINVAL;
+        }
+
+        kthread_t *newthr = kthread_clone(curthr);
+        if (NULL == newthr) {
+                return -ENOMEM;
+        }
+        list_insert_tail(&curproc->p_threads, &newthr->kt_plink);
+        newthr->kt_proc = curproc;
+
+        regs_t newregs = *regs;
+        newregs.r_eip = eip;
+        newregs.r_useresp = esp;
+        newregs.r_ebp = 0;
+        newregs.r_eax = 0;
+
+        newthr->kt_ctx.c_eip = (uint32_t) fork_entry;
+        newthr->kt_ctx.c_esp = fork_setup_stack(&newregs, newthr->kt_kstack);
+        newthr->kt_ctx.c_pdptr = curproc->p_pagedir;
+        newthr->kt_ctx.c_kstack = (uintptr_t) newthr->kt_kstack;
+        newthr->kt_ctx.c_kstacksz = DEFAULT_STACK_SIZE;
+
+        sched_make_runnable(newthr);
+        return newthr->kt_tid;
+}
+#endif
+
+void
+vfork_release(void)
+{
+        if (NULL == curproc->p_vfork_vmmap) {
+                return;
+        }
+
+        curproc->p_vmmap = curproc->p_vfork_vmmap;
+        curproc->p_pagedir = curproc->p_vfork_pagedir;
+        curproc->p_vfork_vmmap = NULL;
+        curproc->p_vfork_pagedir = NULL;
+
+        curthr->kt_ctx.c_pdptr = curproc->p_pagedir;
+        pt_set(curproc->p_pagedir);
+
+        sched_broadcast_on(&curproc->p_pproc->p_wait);
+}
+
+/* What a spawn's parent hands to the child's first thread, on the
+ * parent's stack. The parent sleeps on sr_waitq until sr_done. */
+typedef struct spawn_req {
+        const char             *sr_filename;
+        char *const            *sr_argv;
+        char *const            *sr_envp;
+        const spawn_action_t   *sr_actions;
+        int                     sr_nactions;
+
+        int                     sr_err;
+        int                     sr_done;
+        ktqueue_t               sr_waitq;
+} spawn_req_t;
+
+static int
+spawn_file_actions(const spawn_action_t *actions, int nactions)
+{
+        int i, fd, err;
+
+        for (i = 0; i < nactions; ++i) {
+                const spawn_action_t *sa = &actions[i];
+                switch (sa->sa_type) {
+                        case SPAWN_FA_OPEN:
+                                if (0 > (fd = do_open(sa->sa_path.as_str, sa->sa_flags))) {
+                                        return fd;
+                                }
+                                if (fd != sa->sa_fd) {
+                                        err = do_dup2(fd, sa->sa_fd);
+                                        do_close(fd);
+                                        if (0 > err) {
+                                                return err;
+                                        }
+                                }
+                                break;
+                        case SPAWN_FA_CLOSE:
+                                if (0 > (err = do_close(sa->sa_fd))) {
+                                        return err;
+                                }
+                                break;
+                        case SPAWN_FA_DUP2:
+                                if (0 > (err = do_dup2(sa->sa_fd, sa->sa_newfd))) {
+                                        return err;
+                                }
+                                break;
+                        default:
+                                return -EINVAL;
+                }
+        }
+        return 0;
+}
+
+/* First thread of a spawned process. Everything happens in the child
+ * so that the file actions and the loader see its file table and its
+ * (empty) address space. */
+static void *
+spawn_run(int arg1, void *arg2)
+{
+        spawn_req_t *req = (spawn_req_t *) arg2;
+        uint32_t eip, esp;
+        int err;
+
+        if (0 == (err = spawn_file_actions(req->sr_actions, req->sr_nactions))) {
+                err = binfmt_load(req->sr_filename, req->sr_argv, req->sr_envp, &eip, &esp);
+        }
+
+        /* req is gone as soon as the parent runs again */
+        req->sr_err = err;
+        req->sr_done = 1;
+        sched_broadcast_on(&req->sr_waitq);
+
+        if (0 > err) {
+                do_exit(127);
+        }
+        userland_start(eip, esp);
+
+        panic("returned from userland_start\n");
+        return NULL;
+}
+
+int
+do_spawn(const char *filename, char *const *argv, char *const *envp,
+         const spawn_action_t *actions, int nactions)
+{
+        spawn_req_t req;
+
+        KASSERT(NULL != filename);
+        KASSERT(0 <= nactions && (0 == nactions || NULL != actions));
+
+        req.sr_filename = filename;
+        req.sr_argv = argv;
+        req.sr_envp = envp;
+        req.sr_actions = actions;
+        req.sr_nactions = nactions;
+        req.sr_err = 0;
+        req.sr_done = 0;
+        sched_queue_init(&req.sr_waitq);
+
+        proc_t *newproc = proc_create((char *) filename);
+        if (NULL == newproc) {
+                return -ENOMEM;
+        }
+
+        kthread_t *newthr = NULL;
+        if (0 > fdtable_copy(newproc->p_fdt, curproc->p_fdt)
+            || NULL == (newthr = kthread_create(newproc, spawn_run, 0, &req))) {
+                /* Leave do_waitpid() to free what proc_create() set up */
+                vmmap_destroy(newproc->p_vmmap);
+                newproc->p_vmmap = NULL;
+                vput(newproc->p_cwd);
+                newproc->p_state = PROC_DEAD;
+                do_waitpid(newproc->p_pid, 0, NULL);
+                return -ENOMEM;
+        }
+
+        sched_make_runnable(newthr);
+        while (!req.sr_done) {
+                sched_sleep_on(&req.sr_waitq);
+        }
+
+        pid_t pid = newproc->p_pid;
+        if (0 > req.sr_err) {
+                do_waitpid(pid, 0, NULL);
+                return req.sr_err;
+        }
+        return pid;
+}
@@ -0,0 +1,230 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#include "globals.h"
+#include "errno.h"
+
+#include "util/debug.h"
+
+#include "proc/kthread.h"
+#include "proc/krwlock.h"
+
+/*
+ * Like mutexes, these locks are _ONLY_ taken and released from a
+ * thread context. Their fields are protected by sched_lock.
+ *
+ * Each waiting thread has a krwlock_waiter_t on its stack, on the
+ * lock's list of waiters, and sleeps on the queue in it. Whoever
+ * releases the lock takes the waiters it can now go to off the list and
+ * wakes them already holding it. A waiter whose sleep is cancelled is
+ * taken off its queue by sched_cancel but stays on the list until it
+ * runs again or the lock is next handed over, whichever is first.
+ */
+
+void ktqueue_enqueue(ktqueue_t *q, kthread_t *thr);
+kthread_t *ktqueue_dequeue(ktqueue_t *q);
+
+#define KW_WAITING      0
+#define KW_GRANTED      1       /* holds the lock */
+#define KW_DROPPED      2       /* cancelled, and off the list */
+
+typedef struct krwlock_waiter {
+        list_link_t     kw_link;        /* on krw_waiters */
+        ktqueue_t       kw_q;           /* the waiting thread sleeps here */
+        int             kw_write;       /* wants the lock exclusive */
+        int             kw_state;       /* KW_* */
+} krwlock_waiter_t;
+
+void krwlock_init(krwlock_t *lock)
+{
+        list_init(&lock->krw_waiters);
+        lock->krw_readers = 0;
+        lock->krw_writer = NULL;
+        lock->krw_nwwait = 0;
+}
+
+/*** These must be called with sched_lock held ***/
+
+static void
+krwlock_remove(krwlock_t *lock, krwlock_waiter_t *w, int state)
+{
+        list_remove(&w->kw_link);
+        if (w->kw_write) {
+                lock->krw_nwwait--;
+        }
+        w->kw_state = state;
+}
+
+/* Hands the lock to a waiter, which must still be asleep */
+static void
+krwlock_wake(krwlock_t *lock, krwlock_waiter_t *w)
+{
+        kthread_t *thr = ktqueue_dequeue(&w->kw_q);
+
+        krwlock_remove(lock, w, KW_GRANTED);
+        if (w->kw_write) {
+                lock->krw_writer = thr;
+        } else {
+                lock->krw_readers++;
+        }
+        sched_make_runnable_locked(thr);
+}
+
+/*
+ * Hands the lock to whichever waiters can have it now. Ordinarily that
+ * is the oldest waiter if it is a writer and the lock is free, or else
+ * the readers ahead of the oldest writer. With readers_first, as when a
+ * writer lets go, it is every waiting reader, or the oldest writer if
+ * there are none.
+ */
+static void
+krwlock_grant(krwlock_t *lock, int readers_first)
+{
+        krwlock_waiter_t *w;
+        int writer_seen = 0, nreaders = 0;
+
+        list_iterate_begin(&lock->krw_waiters, w, krwlock_waiter_t, kw_link) {
+                if (sched_queue_empty(&w->kw_q)) {
+                        krwlock_remove(lock, w, KW_DROPPED);
+                } else if (w->kw_write) {
+                        if (!writer_seen && !readers_first && NULL == lock->krw_writer
+                            && 0 == lock->krw_readers) {
+                                krwlock_wake(lock, w);
+                        }
+                        writer_seen = 1;
+                } else if (NULL == lock->krw_writer && (readers_first || !writer_seen)) {
+                        krwlock_wake(lock, w);
+                        nreaders++;
+                }
+        } list_iterate_end();
+
+        if (readers_first && 0 == nreaders) {
+                krwlock_grant(lock, 0);
+        }
+}
+
+/* Sleeps until the lock is handed over. Returns 0, or -EINTR if the
+ * sleep was cancellable and was cancelled first. */
+static int
+krwlock_wait(krwlock_t *lock, int write, int cancellable)
+{
+        krwlock_waiter_t w;
+
+        if (cancellable && curthr->kt_cancelled) {
+                return -EINTR;
+        }
+
+        sched_queue_init(&w.kw_q);
+        w.kw_write = write;
+        w.kw_state = KW_WAITING;
+        list_insert_tail(&lock->krw_waiters, &w.kw_link);
+        if (write) {
+                lock->krw_nwwait++;
+        }
+
+        curthr->kt_state = cancellable ? KT_SLEEP_CANCELLABLE : KT_SLEEP;
+        ktqueue_enqueue(&w.kw_q, curthr);
+        sched_switch_locked();
+        spinlock_acquire(&sched_lock);
+
+        if (KW_GRANTED == w.kw_state) {
+                return 0;
+        }
+        if (KW_WAITING == w.kw_state) {
+                krwlock_remove(lock, &w, KW_DROPPED);
+        }
+        /* Readers may have been waiting only because we were */
+        if (write) {
+                krwlock_grant(lock, 0);
+        }
+        return -EINTR;
+}
+
+/*** ***/
+
+static int
+krwlock_rdlock_common(krwlock_t *lock, int cancellable)
+{
+        int ret = 0;
+
+        KASSERT(curthr && curthr != lock->krw_writer);
+
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
+        if (NULL == lock->krw_writer && 0 == lock->krw_nwwait) {
+                lock->krw_readers++;
+        } else {
+                ret = krwlock_wait(lock, 0, cancellable);
+        }
+        spinlock_unlock(&sched_lock, oldIPL);
+        return ret;
+}
+
+static int
+krwlock_wrlock_common(krwlock_t *lock, int cancellable)
+{
+        int ret = 0;
+
+        KASSERT(curthr && curthr != lock->krw_writer);
+
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
+        if (NULL == lock->krw_writer && 0 == lock->krw_readers
+            && 0 == lock->krw_nwwait) {
+                lock->krw_writer = curthr;
+        } else {
+                ret = krwlock_wait(lock, 1, cancellable);
+        }
+        spinlock_unlock(&sched_lock, oldIPL);
+        return ret;
+}
+
+void krwlock_rdlock(krwlock_t *lock)
+{
+        krwlock_rdlock_common(lock, 0);
+}
+
+int krwlock_rdlock_cancellable(krwlock_t *lock)
+{
+        return krwlock_rdlock_common(lock, 1);
+}
+
+void krwlock_wrlock(krwlock_t *lock)
+{
+        krwlock_wrlock_common(lock, 0);
+}
+
+int krwlock_wrlock_cancellable(krwlock_t *lock)
+{
+        return krwlock_wrlock_common(lock, 1);
+}
+
+void krwlock_unlock(krwlock_t *lock)
+{
+        KASSERT(curthr);
+
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
+        if (curthr == lock->krw_writer) {
+                lock->krw_writer = NULL;
+                krwlock_grant(lock, 1);
+        } else {
+                KASSERT(0 < lock->krw_readers);
+                if (0 == --lock->krw_readers) {
+                        krwlock_grant(lock, 0);
+                }
+        }
+        spinlock_unlock(&sched_lock, oldIPL);
+}
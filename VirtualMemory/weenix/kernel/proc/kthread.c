@@ -21,6 +21,8 @@
 
 #include "errno.h"
 
+#include "main/cpuid.h"
+
 #include "util/init.h"
 #include "util/debug.h"
 #include "util/list.h"
@@ -35,6 +37,7 @@
 
 kthread_t *curthr; /* global */
 static slab_allocator_t *kthread_allocator = NULL;
+static int next_tid = 1;
 
 #ifdef __MTP__
 /* Stuff for the reaper daemon, which cleans up dead detached threads */
@@ -128,6 +131,31 @@ kthread_create(struct proc *p, kthread_func_t func, long arg1, void *arg2)
         list_insert_tail(&p->p_threads, &kt->kt_plink);
         kt->kt_state = KT_RUN;
 
+        kt->kt_nice = 0;
+        kt->kt_level = 0;
+        kt->kt_slice = 0;
+        kt->kt_runtime = 0;
+        kt->kt_lastrun = rdtsc();
+        kt->kt_nswitch = 0;
+        kt->kt_ticks = 0;
+
+        kt->kt_tid = next_tid++;
+        kt->kt_blocked_on = NULL;
+        memset(kt->kt_held, 0, sizeof(kt->kt_held));
+        kt->kt_nheld = 0;
+        kt->kt_inherited = SCHED_NQUEUES;
+        kt->kt_exclusive = 0;
+        kt->kt_minflt = 0;
+        kt->kt_majflt = 0;
+        kt->kt_nivcsw = 0;
+        kt->kt_inblock = 0;
+        kt->kt_rbytes = 0;
+        kt->kt_wbytes = 0;
+#ifdef __MTP__
+        kt->kt_detached = 0;
+        sched_queue_init(&kt->kt_joinq);
+#endif
+
         dbg(DBG_PRINT, "(GRADING1A)\n");
         return kt;
 }
@@ -189,7 +217,28 @@ void kthread_exit(void *retval)
         dbg(DBG_PRINT, "(GRADING1A 3.c)\n");
 
         curthr->kt_retval = retval;
+        /* From now on proc_usage() finds it in p_usage_exited */
+        proc_usage_add_thread(&curproc->p_usage_exited, curthr);
         curthr->kt_state = KT_EXITED;
+#ifdef __MTP__
+        sched_broadcast_on(&curthr->kt_joinq);
+
+        kthread_t *thr;
+        list_iterate_begin(&curproc->p_threads, thr, kthread_t, kt_plink) {
+                if (KT_EXITED != thr->kt_state) {
+                        /* Not the last thread, the process lives on. A
+                         * detached thread is handed to the reaper, which
+                         * cannot run before we switch away. */
+                        if (curthr->kt_detached) {
+                                list_remove(&curthr->kt_plink);
+                                list_insert_tail(&kthread_reapd_deadlist, &curthr->kt_qlink);
+                                sched_wakeup_on(&reapd_waitq);
+                        }
+                        sched_switch();
+                        panic("exited thread %p was scheduled\n", curthr);
+                }
+        } list_iterate_end();
+#endif
         proc_thread_exited(curthr->kt_retval);
         sched_switch();
 }
@@ -231,6 +280,32 @@ kthread_clone(kthread_t *thr)
         list_link_init(&newthr ->kt_plink);
         list_link_init(&newthr ->kt_qlink);
 
+        /* The child keeps its parent's place in the scheduler */
+        newthr->kt_nice = thr->kt_nice;
+        newthr->kt_level = thr->kt_level;
+        newthr->kt_slice = 0;
+        newthr->kt_runtime = 0;
+        newthr->kt_lastrun = rdtsc();
+        newthr->kt_nswitch = 0;
+        newthr->kt_ticks = 0;
+
+        newthr->kt_tid = next_tid++;
+        newthr->kt_blocked_on = NULL;
+        memset(newthr->kt_held, 0, sizeof(newthr->kt_held));
+        newthr->kt_nheld = 0;
+        newthr->kt_inherited = SCHED_NQUEUES;
+        newthr->kt_exclusive = 0;
+        newthr->kt_minflt = 0;
+        newthr->kt_majflt = 0;
+        newthr->kt_nivcsw = 0;
+        newthr->kt_inblock = 0;
+        newthr->kt_rbytes = 0;
+        newthr->kt_wbytes = 0;
+#ifdef __MTP__
+        newthr->kt_detached = 0;
+        sched_queue_init(&newthr->kt_joinq);
+#endif
+
         KASSERT(KT_RUN == newthr->kt_state);
         dbg(DBG_PRINT, "(GRADING3A 8.a)\n");
         return newthr;;
@@ -242,15 +317,51 @@ kthread_clone(kthread_t *thr)
  * unless your weenix is perfect.
  */
 #ifdef __MTP__
+kthread_t *
+kthread_lookup(struct proc *p, int tid)
+{
+        kthread_t *thr;
+        list_iterate_begin(&p->p_threads, thr, kthread_t, kt_plink) {
+                if (thr->kt_tid == tid)
+                        return thr;
+        } list_iterate_end();
+        return NULL;
+}
+
 int kthread_detach(kthread_t *kthr)
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_detach");
+        KASSERT(NULL != kthr && curproc == kthr->kt_proc);
+
+        if (kthr->kt_detached || !sched_queue_empty(&kthr->kt_joinq))
+                return -EINVAL;
+        kthr->kt_detached = 1;
+
+        /* Nobody will join it now */
+        if (KT_EXITED == kthr->kt_state) {
+                list_remove(&kthr->kt_plink);
+                list_insert_tail(&kthread_reapd_deadlist, &kthr->kt_qlink);
+                sched_wakeup_on(&reapd_waitq);
+        }
         return 0;
 }
 
 int kthread_join(kthread_t *kthr, void **retval)
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_join");
+        KASSERT(NULL != kthr && curproc == kthr->kt_proc);
+
+        if (kthr == curthr)
+                return -EDEADLK;
+        if (kthr->kt_detached || !sched_queue_empty(&kthr->kt_joinq))
+                return -EINVAL;
+
+        while (KT_EXITED != kthr->kt_state) {
+                if (0 > sched_cancellable_sleep_on(&kthr->kt_joinq))
+                        return -EINTR;
+        }
+
+        if (NULL != retval)
+                *retval = kthr->kt_retval;
+        kthread_destroy(kthr);
         return 0;
 }
 
@@ -260,20 +371,49 @@ int kthread_join(kthread_t *kthr, void **retval)
 static __attribute__((unused)) void
 kthread_reapd_init()
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_reapd_init");
+        sched_queue_init(&reapd_waitq);
+        list_init(&kthread_reapd_deadlist);
+
+        KASSERT(NULL != curproc && (PID_IDLE == curproc->p_pid));
+        reapd = proc_create("reapd");
+        KASSERT(NULL != reapd);
+        reapd_thr = kthread_create(reapd, kthread_reapd_run, 0, NULL);
+        KASSERT(NULL != reapd_thr);
+
+        sched_make_runnable(reapd_thr);
 }
 init_func(kthread_reapd_init);
 init_depends(sched_init);
 
 void kthread_reapd_shutdown()
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_reapd_shutdown");
+        KASSERT(NULL != reapd_thr);
+        KASSERT(PID_IDLE == curproc->p_pid);
+        kthread_cancel(reapd_thr, (void *)0);
+        reapd_thr = NULL;
+        int reapd_pid = reapd->p_pid;
+        int child = do_waitpid(-1, 0, NULL);
+        KASSERT(child == reapd_pid && "waited on process other than reapd");
 }
 
+/*
+ * Destroys the detached threads which have exited. They are put on
+ * kthread_reapd_deadlist (by their kt_qlink) by kthread_exit and
+ * kthread_detach, already taken off their process' thread list.
+ */
 static void *
 kthread_reapd_run(int arg1, void *arg2)
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_reapd_run");
-        return (void *)0;
+        kthread_t *thr;
+
+        while (1) {
+                while (!list_empty(&kthread_reapd_deadlist)) {
+                        thr = list_head(&kthread_reapd_deadlist, kthread_t, kt_qlink);
+                        list_remove(&thr->kt_qlink);
+                        kthread_destroy(thr);
+                }
+                if (0 > sched_cancellable_sleep_on(&reapd_waitq))
+                        return (void *)0;
+        }
 }
 #endif
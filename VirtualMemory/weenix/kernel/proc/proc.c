@@ -36,6 +36,7 @@
 #include "mm/mmobj.h"
 #include "mm/mm.h"
 #include "mm/mman.h"
+#include "mm/pagetable.h"
 
 #include "vm/vmmap.h"
 
@@ -43,6 +44,15 @@
 #include "fs/vfs_syscall.h"
 #include "fs/vnode.h"
 #include "fs/file.h"
+#include "fs/fdtable.h"
+
+#include "api/resource.h"
+
+#include "util/init.h"
+#include "util/time.h"
+
+#include "test/kshell/kshell.h"
+#include "test/kshell/io.h"
 
 proc_t *curproc = NULL; /* global */
 static slab_allocator_t *proc_allocator = NULL;
@@ -50,9 +60,19 @@ static slab_allocator_t *proc_allocator = NULL;
 static list_t _proc_list;
 static proc_t *proc_initproc = NULL; /* Pointer to the init process (PID 1) */
 
+/* Processes by PID, see proc_lookup */
+#define PROC_HASH_SIZE  256
+#define proc_hash(pid)  (&_proc_hash[(pid) & (PROC_HASH_SIZE - 1)])
+static list_t _proc_hash[PROC_HASH_SIZE];
+
 void proc_init()
 {
+        int i;
+
         list_init(&_proc_list);
+        for (i = 0; i < PROC_HASH_SIZE; i++) {
+                list_init(&_proc_hash[i]);
+        }
         proc_allocator = slab_allocator_create("proc", sizeof(proc_t));
         KASSERT(proc_allocator != NULL);
 }
@@ -61,7 +81,7 @@ proc_t *
 proc_lookup(int pid)
 {
         proc_t *p;
-        list_iterate_begin(&_proc_list, p, proc_t, p_list_link)
+        list_iterate_begin(proc_hash(pid), p, proc_t, p_hash_link)
         {
                 if (p->p_pid == pid)
                 {
@@ -101,14 +121,14 @@ proc_info(const void *arg, char *buf, size_t osize)
         }
 
 #ifdef __MTP__
-        int count = 0;
         kthread_t *kthr;
+        iprintf(&buf, &size, "threads:\n");
         list_iterate_begin(&p->p_threads, kthr, kthread_t, kt_plink)
         {
-                ++count;
+                iprintf(&buf, &size, "     %i (state %i)\n",
+                        kthr->kt_tid, kthr->kt_state);
         }
         list_iterate_end();
-        iprintf(&buf, &size, "thread count: %i\n", count);
 #endif
 
         if (list_empty(&p->p_children))
@@ -148,6 +168,14 @@ proc_info(const void *arg, char *buf, size_t osize)
         iprintf(&buf, &size, "brk:          0x%p\n", p->p_brk);
 #endif
 
+        if (NULL != p->p_pagedir)
+        {
+                uint32_t tables, entries;
+                pt_usage(p->p_pagedir, &tables, &entries);
+                iprintf(&buf, &size, "page tables:  %u (%u KiB, %u entries)\n",
+                        tables, tables * PAGE_SIZE / 1024, entries);
+        }
+
         return size;
 }
 
@@ -201,42 +229,102 @@ proc_list_info(const void *arg, char *buf, size_t osize)
         return size;
 }
 
+/* One bit for each PID in use, see _proc_getid */
+static uint32_t _proc_pidmap[PROC_MAX_COUNT / 32];
 static pid_t next_pid = 0;
 
 /**
- * Returns the next available PID.
+ * Returns the next available PID: the first PID at or after next_pid
+ * (wrapping around) whose bit in _proc_pidmap is clear, and sets it.
+ * Each word of the bitmap covers 32 PIDs, so this only takes long when
+ * nearly every PID is in use.
  *
- * Note: Where n is the number of running processes, this algorithm is
- * worst case O(n^2). As long as PIDs never wrap around it is O(n).
- *
- * @return the next available PID
+ * @return the next available PID, or -1 if there are none
  */
 static int
 _proc_getid()
 {
-        proc_t *p;
-        pid_t pid = next_pid;
-        while (1)
-        {
-        failed:
-                list_iterate_begin(&_proc_list, p, proc_t, p_list_link)
-                {
-                        if (p->p_pid == pid)
-                        {
-                                if ((pid = (pid + 1) % PROC_MAX_COUNT) == next_pid)
-                                {
-                                        return -1;
-                                }
-                                else
-                                {
-                                        goto failed;
-                                }
-                        }
+        uint32_t i, word, free;
+        uint32_t start = next_pid / 32;
+
+        /* The last pass looks at the first word again, for the PIDs
+         * below next_pid */
+        for (i = 0; i <= PROC_MAX_COUNT / 32; i++) {
+                word = (start + i) % (PROC_MAX_COUNT / 32);
+                free = ~_proc_pidmap[word];
+                if (0 == i) {
+                        free &= ~0U << (next_pid % 32);
+                }
+                if (0 != free) {
+                        pid_t pid = word * 32 + __builtin_ctz(free);
+                        _proc_pidmap[word] |= 1U << (pid % 32);
+                        next_pid = (pid + 1) % PROC_MAX_COUNT;
+                        return pid;
                 }
-                list_iterate_end();
-                next_pid = (pid + 1) % PROC_MAX_COUNT;
-                return pid;
         }
+        return -1;
+}
+
+void
+proc_usage_add_thread(proc_usage_t *u, kthread_t *thr)
+{
+        u->pu_cycles += thr->kt_runtime;
+        u->pu_rbytes += thr->kt_rbytes;
+        u->pu_wbytes += thr->kt_wbytes;
+        u->pu_minflt += thr->kt_minflt;
+        u->pu_majflt += thr->kt_majflt;
+        u->pu_inblock += thr->kt_inblock;
+        u->pu_nswitch += thr->kt_nswitch;
+        u->pu_nivcsw += thr->kt_nivcsw;
+}
+
+static void
+proc_usage_add(proc_usage_t *u, const proc_usage_t *v)
+{
+        u->pu_cycles += v->pu_cycles;
+        u->pu_rbytes += v->pu_rbytes;
+        u->pu_wbytes += v->pu_wbytes;
+        u->pu_minflt += v->pu_minflt;
+        u->pu_majflt += v->pu_majflt;
+        u->pu_inblock += v->pu_inblock;
+        u->pu_nswitch += v->pu_nswitch;
+        u->pu_nivcsw += v->pu_nivcsw;
+}
+
+void
+proc_usage(proc_t *p, int who, proc_usage_t *u)
+{
+        kthread_t *thr;
+
+        if (RUSAGE_CHILDREN == who) {
+                *u = p->p_usage_children;
+                return;
+        }
+        *u = p->p_usage_exited;
+        list_iterate_begin(&p->p_threads, thr, kthread_t, kt_plink) {
+                if (KT_EXITED != thr->kt_state) {
+                        proc_usage_add_thread(u, thr);
+                }
+        } list_iterate_end();
+}
+
+/* Frees a process which has been waited for, and its PID */
+static void
+_proc_free(proc_t *p)
+{
+        list_remove(&p->p_list_link);
+        list_remove(&p->p_child_link);
+        list_remove(&p->p_hash_link);
+        if (list_link_is_linked(&p->p_zombie_link)) {
+                list_remove(&p->p_zombie_link);
+        }
+        _proc_pidmap[p->p_pid / 32] &= ~(1U << (p->p_pid % 32));
+        /* Left if it never ran, e.g. when fork failed */
+        if (NULL != p->p_fdt) {
+                fdtable_destroy(p->p_fdt);
+        }
+        pt_destroy_pagedir(p->p_pagedir);
+        slab_obj_free(proc_allocator, p);
 }
 
 /*
@@ -259,15 +347,24 @@ proc_create(char *name)
         }
 
         p->p_pid = _proc_getid();
+        if (p->p_pid < 0)
+        {
+                slab_obj_free(proc_allocator, p);
+                return NULL;
+        }
         strncpy(p->p_comm, name, PROC_NAME_LEN);
         list_init(&p->p_threads);
         list_init(&p->p_children);
+        list_init(&p->p_zombies);
         p->p_state = PROC_RUNNING;
         p->p_status = 0;
         sched_queue_init(&p->p_wait);
         p->p_pagedir = pt_create_pagedir();
         list_link_init(&p->p_list_link);
         list_link_init(&p->p_child_link);
+        list_link_init(&p->p_zombie_link);
+        memset(&p->p_usage_exited, 0, sizeof(p->p_usage_exited));
+        memset(&p->p_usage_children, 0, sizeof(p->p_usage_children));
 
         int pid = p->p_pid;
         KASSERT(PID_IDLE != pid || list_empty(&_proc_list));
@@ -275,6 +372,7 @@ proc_create(char *name)
         dbg(DBG_PRINT, "(GRADING1A 2.a)\n");
 
         list_insert_tail(&_proc_list, &p->p_list_link);
+        list_insert_head(proc_hash(p->p_pid), &p->p_hash_link);
         if (p->p_pid != 0)
         {
                 list_insert_tail(&curproc->p_children, &p->p_child_link);
@@ -289,9 +387,10 @@ proc_create(char *name)
                 dbg(DBG_PRINT, "(GRADING1C)\n");
         }
 
-        for (int i = 0; i < NFILES; i++)
+        if (NULL == (p->p_fdt = fdtable_create()))
         {
-                p->p_files[i] = NULL;
+                _proc_free(p);
+                return NULL;
         }
 
 #ifdef __VFS__
@@ -314,6 +413,8 @@ proc_create(char *name)
 #ifdef __VM__
         p->p_vmmap = vmmap_create();
         p->p_vmmap->vmm_proc = p;
+        p->p_vfork_vmmap = NULL;
+        p->p_vfork_pagedir = NULL;
 #endif        
         return p;
 }
@@ -358,6 +459,16 @@ void proc_cleanup(int status)
                 dbg(DBG_PRINT, "(GRADING1C)\n");
         }
         list_iterate_end();
+        if (!list_empty(&curproc->p_zombies))
+        {
+                list_iterate_begin(&curproc->p_zombies, proc, proc_t, p_zombie_link)
+                {
+                        list_insert_tail(&proc_initproc->p_zombies, &proc->p_zombie_link);
+                }
+                list_iterate_end();
+                list_init(&curproc->p_zombies);
+                sched_broadcast_on(&proc_initproc->p_wait);
+        }
 
         curproc->p_status = status;
         curproc->p_state = PROC_DEAD;
@@ -365,11 +476,10 @@ void proc_cleanup(int status)
 
 #ifdef __VFS__
         
-        for (int fd = 0; fd < NFILES; fd++){
-                if (curproc->p_files[fd] != NULL){
-                        do_close(fd);
-                }
-        }
+        /* Our parent may reap us while we block in here */
+        fdtable_t *fdt = curproc->p_fdt;
+        curproc->p_fdt = NULL;
+        fdtable_destroy(fdt);
 
         if(curproc->p_pid!=2){
                 vput(curproc->p_cwd);
@@ -378,10 +488,15 @@ void proc_cleanup(int status)
 #endif
 
 #ifdef __VM__
+        vfork_release();
         vmmap_destroy(curproc->p_vmmap);
         curproc->p_vmmap = NULL;
 #endif
 
+        /* Not until now, as the parent may reap us as soon as we are
+         * on its p_zombies list */
+        list_insert_tail(&curproc->p_pproc->p_zombies, &curproc->p_zombie_link);
+
         if(curproc->p_pproc->p_wait.tq_size>0){
             sched_wakeup_on(&curproc->p_pproc->p_wait);
         }
@@ -489,85 +604,102 @@ pid_t do_waitpid(pid_t pid, int options, int *status)
         if (pid == -1)
         {
                 dbg(DBG_PRINT, "(GRADING1C)\n");
-                while (1)
+                /* Children go on p_zombies as they exit, so the oldest
+                 * is at the head */
+                while (list_empty(&curproc->p_zombies))
                 {
-                        list_iterate_begin(&curproc->p_children, p, proc_t, p_child_link)
-                        {
-                                if (p->p_state == PROC_DEAD)
-                                {
-                                        int pid_ = p->p_pid;
-                                        if(status!=NULL){
-                                                *status = p->p_status;
-                                        }
-                                        list_iterate_begin(&p->p_threads, kt, kthread_t, kt_plink)
-                                        {
-                                                kthread_destroy(kt);
-                                        }
-                                        list_iterate_end();
-
-                                        list_remove(&p->p_list_link);
-                                        list_remove(&p->p_child_link);
-                                        KASSERT(NULL != p);
-                                        KASSERT(-1 == pid || p->p_pid == pid);
-                                        KASSERT(NULL != p->p_pagedir);
-                                        dbg(DBG_PRINT, "(GRADING1A 2.c)\n");
-                                        pt_destroy_pagedir(p->p_pagedir);
-                                        slab_obj_free(proc_allocator, p);
-
-                                        dbg(DBG_PRINT, "(GRADING1C)\n");
-                                        return pid_;
-                                }
-                        }
-                        list_iterate_end();
-
                         dbg(DBG_PRINT, "(GRADING1C)\n");
                         sched_sleep_on(&curproc->p_wait);
                 }
+                p = list_head(&curproc->p_zombies, proc_t, p_zombie_link);
         }
         else if (pid > 0)
         {
                 dbg(DBG_PRINT, "(GRADING1C)\n");
-                list_iterate_begin(&curproc->p_children, p, proc_t, p_child_link)
+                /* Look again after each sleep, as another thread of
+                 * ours may have reaped it */
+                while (NULL != (p = proc_lookup(pid)) && curproc == p->p_pproc
+                       && p->p_state != PROC_DEAD)
                 {
-                        if (p->p_pid == pid)
-                        {
-                                dbg(DBG_PRINT, "(GRADING1C)\n");
-                                p = proc_lookup(pid);
-                                while (p->p_state != PROC_DEAD)
-                                {
-                                        sched_sleep_on(&curproc->p_wait);
-                                        dbg(DBG_PRINT, "(GRADING1C)\n");
-                                }
-                                if(status!=NULL){
-					*status = p->p_status;
-				}
-
-                                list_iterate_begin(&p->p_threads, kt, kthread_t, kt_plink)
-                                {
-                                        kthread_destroy(kt);
-                                }
-                                list_iterate_end();
-
-                                list_remove(&p->p_child_link);
-                                list_remove(&p->p_list_link);
-                                KASSERT(NULL != p);
-                                KASSERT(-1 == pid || p->p_pid == pid);
-                                KASSERT(NULL != p->p_pagedir);
-                                dbg(DBG_PRINT, "(GRADING1A 2.c)\n");
-                                pt_destroy_pagedir(p->p_pagedir);
-                                slab_obj_free(proc_allocator, p);
-
-                                dbg(DBG_PRINT, "(GRADING1C)\n");
-                                return pid;
-                        }
+                        sched_sleep_on(&curproc->p_wait);
+                        dbg(DBG_PRINT, "(GRADING1C)\n");
+                }
+                if (NULL == p || curproc != p->p_pproc)
+                {
+                        dbg(DBG_PRINT, "(GRADING1C)\n");
+                        return -ECHILD;
                 }
-                list_iterate_end();
-                dbg(DBG_PRINT, "(GRADING1C)\n");
-                return -ECHILD;
         }
+        else
+        {
+                return 0;
+        }
+
+        if(status!=NULL){
+                *status = p->p_status;
+        }
+        list_iterate_begin(&p->p_threads, kt, kthread_t, kt_plink)
+        {
+                kthread_destroy(kt);
+        }
+        list_iterate_end();
 
+        KASSERT(NULL != p);
+        KASSERT(-1 == pid || p->p_pid == pid);
+        KASSERT(NULL != p->p_pagedir);
+        dbg(DBG_PRINT, "(GRADING1A 2.c)\n");
+        proc_usage_add(&curproc->p_usage_children, &p->p_usage_exited);
+        proc_usage_add(&curproc->p_usage_children, &p->p_usage_children);
+        pid = p->p_pid;
+        _proc_free(p);
+
+        dbg(DBG_PRINT, "(GRADING1C)\n");
+        return pid;
+}
+
+#ifdef __MTP__
+/* Returns a thread of the current process, other than the current
+ * one, which has not exited, or NULL if there are none */
+static kthread_t *
+proc_live_other(void)
+{
+        kthread_t *thr;
+        list_iterate_begin(&curproc->p_threads, thr, kthread_t, kt_plink) {
+                if (thr != curthr && KT_EXITED != thr->kt_state) {
+                        return thr;
+                }
+        } list_iterate_end();
+        return NULL;
+}
+
+int proc_cancel_others(void *retval)
+{
+        kthread_t *thr;
+
+        /* Cancel everything first, so that threads joining the others
+         * give up rather than look at them after they are destroyed */
+        list_iterate_begin(&curproc->p_threads, thr, kthread_t, kt_plink) {
+                if (thr != curthr && KT_EXITED != thr->kt_state) {
+                        kthread_cancel(thr, retval);
+                }
+        } list_iterate_end();
+
+        /* A detached thread is gone (to the reaper) once it exits, so
+         * look again each time rather than hold on to it */
+        while (NULL != (thr = proc_live_other())) {
+                if (0 > sched_cancellable_sleep_on(&thr->kt_joinq)) {
+                        return -EINTR;
+                }
+        }
+
+        list_iterate_begin(&curproc->p_threads, thr, kthread_t, kt_plink) {
+                if (thr != curthr) {
+                        kthread_destroy(thr);
+                }
+        } list_iterate_end();
         return 0;
 }
+#endif
 
 /*
  * Cancel all threads and join with them (if supporting MTP), and exit from the current
@@ -577,6 +709,53 @@ pid_t do_waitpid(pid_t pid, int options, int *status)
  */
 void do_exit(int status)
 {
+#ifdef __MTP__
+        /* If another thread is exiting the process too it has cancelled
+         * us, and is left to finish */
+        if (0 > proc_cancel_others((void *)status)) {
+                kthread_exit(curthr->kt_retval);
+        }
+#endif
         kthread_exit((void *)status);
         dbg(DBG_PRINT, "(GRADING1C)\n");
 }
+
+/* Shows what each process has used, like top(1) */
+static int
+proc_top_kshell(kshell_t *ksh, int argc, char **argv)
+{
+        proc_t *p;
+        proc_usage_t u;
+        uint32_t tables, rss;
+
+        if (argc > 1) {
+                kprintf(ksh, "usage: top\n");
+                return 0;
+        }
+
+        kprintf(ksh, "free memory: %u KiB\n", page_free_count() * (PAGE_SIZE / 1024));
+        kprintf(ksh, "%5s %-16s %8s %6s %7s %7s %8s %8s %8s\n", "PID", "NAME",
+                "CPU(ms)", "RSS", "MINFLT", "MAJFLT", "SWITCHES", "READ(K)", "WRITE(K)");
+        list_iterate_begin(&_proc_list, p, proc_t, p_list_link) {
+                proc_usage(p, RUSAGE_SELF, &u);
+                rss = 0;
+                if (PROC_RUNNING == p->p_state) {
+                        pt_usage(p->p_pagedir, &tables, &rss);
+                }
+                kprintf(ksh, "%5d %-16s %8u %6u %7u %7u %8u %8u %8u\n",
+                        p->p_pid, p->p_comm,
+                        (uint32_t)(time_cycles_ns(u.pu_cycles) / 1000000), rss,
+                        u.pu_minflt, u.pu_majflt, u.pu_nswitch,
+                        (uint32_t)(u.pu_rbytes >> 10), (uint32_t)(u.pu_wbytes >> 10));
+        } list_iterate_end();
+        return 0;
+}
+
+static __attribute__((unused)) void
+proc_kshell_init(void)
+{
+        kshell_add_command("top", proc_top_kshell,
+                           "show each process's CPU time, memory, faults and I/O");
+}
+init_func(proc_kshell_init);
+init_depends(kshell_init);
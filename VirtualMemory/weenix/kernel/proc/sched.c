@@ -20,23 +20,66 @@
 #include "errno.h"
 
 #include "main/interrupt.h"
+#include "main/cpuid.h"
 
 #include "proc/sched.h"
 #include "proc/kthread.h"
+#include "proc/proc.h"
 
 #include "util/init.h"
 #include "util/debug.h"
-
-static ktqueue_t kt_runq;
+#include "util/bits.h"
+#include "util/string.h"
+#include "util/time.h"
+#include "util/timer.h"
+#include "util/workq.h"
+
+#include "test/kshell/kshell.h"
+#include "test/kshell/io.h"
+
+/* Nanoseconds a thread may run at level 0 before it moves down a level,
+ * one round robin time slice; each level below doubles this */
+#define SCHED_QUANTUM           ((uint64_t) SCHED_TIMESLICE * NSEC_PER_TICK)
+/* Every this many timer ticks (a fifth of a second) all runnable threads
+ * are moved back to level 0, so that threads at low levels can not be
+ * starved forever */
+#define SCHED_BOOST_PERIOD      (TIMER_HZ / 5)
+
+spinlock_t sched_lock = SPINLOCK_INITIALIZER;
+
+static ktqueue_t sched_runq[SCHED_NQUEUES];
+static uint32_t sched_runq_map;         /* bit i set if sched_runq[i] is non-empty */
+static uint32_t sched_last_boost;     /* time_ticks at the last boost */
+static int sched_need_resched;          /* preempt curthr on return to user mode */
+static uint32_t sched_npreempt;         /* involuntary switches so far */
+static uint32_t sched_nswitch;          /* context switches so far */
+static uint32_t sched_nexclusive;       /* exclusive waiters woken so far */
+static uint32_t sched_nleft;            /* ... and left asleep by sched_wake_on */
+
+/* A thread goes on the queue for its own level and nice value, or the
+ * one lent to it by a thread waiting on a mutex it holds if that is
+ * higher */
+#define sched_runq_index(thr) \
+        MIN((thr)->kt_level + (thr)->kt_nice - SCHED_NICE_MIN, \
+            (thr)->kt_inherited)
+#define sched_on_runq(thr) \
+        ((ktqueue_t *)(thr)->kt_wchan >= &sched_runq[0] \
+         && (ktqueue_t *)(thr)->kt_wchan < &sched_runq[SCHED_NQUEUES])
 
 static __attribute__((unused)) void
 sched_init(void)
 {
-        sched_queue_init(&kt_runq);
+        int i;
+        for (i = 0; i < SCHED_NQUEUES; i++) {
+                sched_queue_init(&sched_runq[i]);
+        }
+        sched_runq_map = 0;
+        sched_last_boost = time_ticks;
 }
 init_func(sched_init);
 
 /*** PRIVATE KTQUEUE MANIPULATION FUNCTIONS ***/
+/* These must be called with sched_lock held */
 /**
  * Enqueues a thread onto a queue.
  *
@@ -91,6 +134,146 @@ ktqueue_remove(ktqueue_t *q, kthread_t *thr)
         q->tq_size--;
 }
 
+/*** RUN QUEUE MANIPULATION FUNCTIONS ***/
+/* These must be called with sched_lock held */
+static void
+sched_runq_add(kthread_t *thr)
+{
+        int index = sched_runq_index(thr);
+        ktqueue_enqueue(&sched_runq[index], thr);
+        sched_runq_map |= BIT(index);
+}
+
+static void
+sched_runq_remove(kthread_t *thr)
+{
+        ktqueue_t *q = thr->kt_wchan;
+        ktqueue_remove(q, thr);
+        if (sched_queue_empty(q)) {
+                sched_runq_map &= ~BIT(q - sched_runq);
+        }
+}
+
+/* Takes a thread from the highest priority non-empty run queue. Returns
+ * NULL if there is nothing to run. */
+static kthread_t *
+sched_runq_take(void)
+{
+        kthread_t *thr;
+        int index;
+
+        if (0 == sched_runq_map) {
+                return NULL;
+        }
+        index = __builtin_ctz(sched_runq_map);
+        thr = ktqueue_dequeue(&sched_runq[index]);
+        if (sched_queue_empty(&sched_runq[index])) {
+                sched_runq_map &= ~BIT(index);
+        }
+        return thr;
+}
+
+/* Charges the time since the thread was switched to against its
+ * quantum, moving it down a level once the quantum is used up */
+static void
+sched_charge(kthread_t *thr, uint64_t now)
+{
+        uint64_t ran = now - thr->kt_lastrun;
+
+        thr->kt_runtime += ran;
+        thr->kt_slice += time_cycles_ns(ran);
+        if (thr->kt_slice >= SCHED_QUANTUM << thr->kt_level) {
+                if (thr->kt_level < SCHED_NLEVELS - 1) {
+                        thr->kt_level++;
+                }
+                thr->kt_slice = 0;
+        }
+}
+
+/* Moves every runnable thread (and the current one) back to level 0 */
+static void
+sched_boost(void)
+{
+        kthread_t *thr;
+        int i;
+
+        for (i = SCHED_NQUEUES - 1; i > 0; i--) {
+                list_iterate_reverse(&sched_runq[i].tq_list, thr, kthread_t, kt_qlink) {
+                        if (thr->kt_level > 0) {
+                                sched_runq_remove(thr);
+                                thr->kt_level = 0;
+                                thr->kt_slice = 0;
+                                sched_runq_add(thr);
+                        }
+                } list_iterate_end();
+        }
+        curthr->kt_level = 0;
+        curthr->kt_slice = 0;
+}
+
+int
+sched_set_nice(kthread_t *thr, int nice)
+{
+        if (nice < SCHED_NICE_MIN) {
+                nice = SCHED_NICE_MIN;
+        } else if (nice > SCHED_NICE_MAX) {
+                nice = SCHED_NICE_MAX;
+        }
+
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
+        if (KT_RUN == thr->kt_state && sched_on_runq(thr)) {
+                sched_runq_remove(thr);
+                thr->kt_nice = nice;
+                sched_runq_add(thr);
+        } else {
+                thr->kt_nice = nice;
+        }
+        spinlock_unlock(&sched_lock, oldIPL);
+        return nice;
+}
+
+int
+sched_priority_locked(kthread_t *thr)
+{
+        return sched_runq_index(thr);
+}
+
+void
+sched_inherit_locked(kthread_t *thr, int prio)
+{
+        if (KT_RUN == thr->kt_state && sched_on_runq(thr)) {
+                sched_runq_remove(thr);
+                thr->kt_inherited = prio;
+                sched_runq_add(thr);
+        } else {
+                thr->kt_inherited = prio;
+        }
+}
+
+void
+sched_tick(void)
+{
+        if (NULL != curthr && ++curthr->kt_ticks >= SCHED_TIMESLICE) {
+                sched_need_resched = 1;
+        }
+}
+
+void
+sched_preempt(void)
+{
+        if (!sched_need_resched) {
+                return;
+        }
+        sched_need_resched = 0;
+        sched_npreempt++;
+        curthr->kt_nivcsw++;
+
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
+        sched_make_runnable_locked(curthr);
+        sched_switch_locked();
+        intr_setipl(oldIPL);
+}
+
 /*** PUBLIC KTQUEUE MANIPULATION FUNCTIONS ***/
 void sched_queue_init(ktqueue_t *q)
 {
@@ -118,10 +301,12 @@ int sched_cancellable_sleep_on(ktqueue_t *q)
                 return -EINTR;
         }
 
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
         ktqueue_enqueue(q, curthr);
         curthr->kt_state = KT_SLEEP_CANCELLABLE;
 
-        sched_switch();
+        sched_switch_locked();
+        intr_setipl(oldIPL);
 
         dbg(DBG_PRINT, "(GRADING1C)\n");
 
@@ -135,6 +320,96 @@ int sched_cancellable_sleep_on(ktqueue_t *q)
         return 0;
 }
 
+/* A timed sleep in progress, see sched_timed_sleep_on */
+typedef struct sched_timeout {
+        ktimer_t        st_timer;
+        kthread_t      *st_thr;
+        ktqueue_t      *st_q;
+        int             st_expired;
+} sched_timeout_t;
+
+/* Runs from the timer interrupt: wakes the thread if it is still asleep */
+static void
+sched_timeout(void *arg)
+{
+        sched_timeout_t *st = arg;
+        kthread_t *thr = st->st_thr;
+
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
+        if (KT_SLEEP_CANCELLABLE == thr->kt_state && st->st_q == thr->kt_wchan) {
+                ktqueue_remove(st->st_q, thr);
+                st->st_expired = 1;
+                sched_make_runnable_locked(thr);
+        }
+        spinlock_unlock(&sched_lock, oldIPL);
+}
+
+int sched_timed_sleep_on(ktqueue_t *q, uint32_t ticks)
+{
+        sched_timeout_t st;
+
+        if (curthr->kt_cancelled) {
+                return -EINTR;
+        }
+
+        st.st_thr = curthr;
+        st.st_q = q;
+        st.st_expired = 0;
+        ktimer_init(&st.st_timer, sched_timeout, &st);
+
+        /* The timer can't fire until we are on the queue */
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
+        ktqueue_enqueue(q, curthr);
+        curthr->kt_state = KT_SLEEP_CANCELLABLE;
+        ktimer_add(&st.st_timer, ticks);
+
+        sched_switch_locked();
+
+        ktimer_cancel(&st.st_timer);
+        intr_setipl(oldIPL);
+
+        if (curthr->kt_cancelled) {
+                return -EINTR;
+        }
+        return st.st_expired ? -ETIME : 0;
+}
+
+void sched_sleep_on_exclusive(ktqueue_t *q)
+{
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
+        curthr->kt_state = KT_SLEEP;
+        curthr->kt_exclusive = 1;
+        ktqueue_enqueue(q, curthr);
+        sched_switch_locked();
+        /* Off the queue now, so nobody else looks at it */
+        curthr->kt_exclusive = 0;
+        intr_setipl(oldIPL);
+}
+
+/* Oldest waiters first, which are at the tail (see ktqueue_dequeue) */
+int sched_wake_on(ktqueue_t *q, int nexclusive)
+{
+        kthread_t *thr;
+        int woken = 0;
+
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
+        list_iterate_reverse(&q->tq_list, thr, kthread_t, kt_qlink) {
+                if (!thr->kt_exclusive || woken < nexclusive) {
+                        if (thr->kt_exclusive) {
+                                woken++;
+                        }
+                        ktqueue_remove(q, thr);
+                        sched_make_runnable_locked(thr);
+                } else {
+                        sched_nleft++;
+                }
+        } list_iterate_end();
+        sched_nexclusive += woken;
+        spinlock_unlock(&sched_lock, oldIPL);
+
+        return woken;
+}
+
 /*
  * If the thread's sleep is cancellable, we set the kt_cancelled
  * flag and remove it from the queue. Otherwise, we just set the
@@ -146,13 +421,15 @@ int sched_cancellable_sleep_on(ktqueue_t *q)
  */
 void sched_cancel(struct kthread *kthr)
 {
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
         kthr->kt_cancelled = 1;
         if (kthr->kt_state == KT_SLEEP_CANCELLABLE)
         {
                 ktqueue_remove(kthr->kt_wchan, kthr);
-                sched_make_runnable(kthr);
+                sched_make_runnable_locked(kthr);
                 dbg(DBG_PRINT, "(GRADING1C)\n");
         }
+        spinlock_unlock(&sched_lock, oldIPL);
 
         dbg(DBG_PRINT, "(GRADING1C)\n");
 }
@@ -193,27 +470,60 @@ void sched_cancel(struct kthread *kthr)
  *
  * Note: The IPL is process specific.
  */
-void sched_switch(void)
+void sched_switch_locked(void)
 {
-        kthread_t *OldThread;
-        int oldIPL = intr_getipl();
-
-        dbg(DBG_PRINT, "(GRADING1C)\n");
+        kthread_t *OldThread, *next;
+        uint64_t now;
+
+        now = rdtsc();
+        sched_charge(curthr, now);
+        if (time_ticks - sched_last_boost >= SCHED_BOOST_PERIOD) {
+                sched_boost();
+                sched_last_boost = time_ticks;
+        }
 
-        while (sched_queue_empty(&kt_runq))
+        while (NULL == (next = sched_runq_take()))
         {
+                /* Let interrupt handlers make a thread runnable */
+                spinlock_release(&sched_lock);
                 intr_disable();
+                /* Stop the tick until the next timer is due */
+                time_idle_enter();
                 intr_setipl(IPL_LOW);
-                intr_wait();
+                /* Bottom halves which could not run when they were
+                 * queued may be what makes a thread runnable */
+                if (work_pending()) {
+                        work_run();
+                } else {
+                        intr_wait();
+                }
                 intr_setipl(IPL_HIGH);
+                time_idle_exit();
+                spinlock_acquire(&sched_lock);
                 dbg(DBG_PRINT, "(GRADING1C)\n");
         }
 
         OldThread = curthr;
-        curthr = ktqueue_dequeue(&kt_runq);
+        curthr = next;
         curproc = curthr->kt_proc;
+        curthr->kt_lastrun = rdtsc();
+        curthr->kt_nswitch++;
+        curthr->kt_ticks = 0;
+        sched_nswitch++;
+        sched_need_resched = 0;
 
         context_switch(&OldThread->kt_ctx, &curthr->kt_ctx);
+
+        /* The thread which switched back to us still holds the lock */
+        spinlock_release(&sched_lock);
+}
+
+void sched_switch(void)
+{
+        dbg(DBG_PRINT, "(GRADING1C)\n");
+
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
+        sched_switch_locked();
         intr_setipl(oldIPL);
 
         dbg(DBG_PRINT, "(GRADING1C)\n");
@@ -232,16 +542,74 @@ void sched_switch(void)
  * more fine grained control, making modifying the IPL more
  * suitable. We modify the IPL here for consistency.
  */
-void sched_make_runnable(kthread_t *thr)
+void sched_make_runnable_locked(kthread_t *thr)
 {
-        KASSERT(&kt_runq != thr->kt_wchan);
+        KASSERT(!sched_on_runq(thr));
         dbg(DBG_PRINT, "(GRADING1A 5.a)\n");
 
-        int oldIPL = intr_getipl();
-        intr_setipl(IPL_HIGH);
+        /* Threads waking from a sleep move up a level */
+        if ((KT_SLEEP == thr->kt_state || KT_SLEEP_CANCELLABLE == thr->kt_state)
+            && thr->kt_level > 0) {
+                thr->kt_level--;
+                thr->kt_slice = 0;
+        }
         thr->kt_state = KT_RUN;
-        ktqueue_enqueue(&kt_runq, thr);
-        intr_setipl(oldIPL);
+        sched_runq_add(thr);
+        if (NULL != curthr && thr != curthr
+            && sched_runq_index(thr) < sched_runq_index(curthr)) {
+                sched_need_resched = 1;
+        }
 
         dbg(DBG_PRINT, "(GRADING1C)\n");
 }
+
+void sched_make_runnable(kthread_t *thr)
+{
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
+        sched_make_runnable_locked(thr);
+        spinlock_unlock(&sched_lock, oldIPL);
+}
+
+static const char *sched_state_names[] = {
+        "none", "run", "sleep", "sleep-c", "exited"
+};
+
+static int
+sched_kshell(kshell_t *ksh, int argc, char **argv)
+{
+        proc_t *p;
+        kthread_t *thr;
+
+        if (argc > 1) {
+                kprintf(ksh, "usage: sched\n");
+                return 0;
+        }
+
+        kprintf(ksh, "%5s %-16s %-8s %4s %5s %12s %8s\n", "PID", "NAME",
+                "STATE", "NICE", "LEVEL", "RUN(Kcycles)", "SWITCHES");
+        list_iterate_begin(proc_list(), p, proc_t, p_list_link) {
+                list_iterate_begin(&p->p_threads, thr, kthread_t, kt_plink) {
+                        kprintf(ksh, "%5d %-16s %-8s %4d %5d %12u %8u\n",
+                                p->p_pid, p->p_comm,
+                                sched_state_names[thr->kt_state],
+                                thr->kt_nice, thr->kt_level,
+                                (uint32_t)(thr->kt_runtime >> 10),
+                                thr->kt_nswitch);
+                } list_iterate_end();
+        } list_iterate_end();
+        kprintf(ksh, "non-empty run queues: %#x\n", sched_runq_map);
+        kprintf(ksh, "context switches:     %u\n", sched_nswitch);
+        kprintf(ksh, "preemptions:          %u\n", sched_npreempt);
+        kprintf(ksh, "exclusive wakeups:    %u (%u waiters left asleep)\n",
+                sched_nexclusive, sched_nleft);
+        return 0;
+}
+
+static __attribute__((unused)) void
+sched_kshell_init(void)
+{
+        kshell_add_command("sched", sched_kshell,
+                           "show each thread's scheduling level and run time");
+}
+init_func(sched_kshell_init);
+init_depends(kshell_init);
@@ -39,9 +39,11 @@ kthread_t *ktqueue_dequeue(ktqueue_t *q);
  */
 void sched_sleep_on(ktqueue_t *q)
 {
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
         curthr->kt_state = KT_SLEEP;
         ktqueue_enqueue(q, curthr);
-        sched_switch();
+        sched_switch_locked();
+        intr_setipl(oldIPL);
 
         dbg(DBG_PRINT, "(GRADING1C)\n");
 }
@@ -51,6 +53,7 @@ sched_wakeup_on(ktqueue_t *q)
 {
         dbg(DBG_PRINT, "(GRADING1C)\n");
 
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
         if (!list_empty(&q->tq_list))
         {
                 kthread_t *thr = ktqueue_dequeue(q);
@@ -58,11 +61,13 @@ sched_wakeup_on(ktqueue_t *q)
                 KASSERT((thr->kt_state == KT_SLEEP) || (thr->kt_state == KT_SLEEP_CANCELLABLE));
                 dbg(DBG_PRINT, "(GRADING1A 4.a)\n");
 
-                sched_make_runnable(thr);
+                sched_make_runnable_locked(thr);
+                spinlock_unlock(&sched_lock, oldIPL);
 
                 dbg(DBG_PRINT, "(GRADING1A 4.a)\n");
                 return thr;
         }
+        spinlock_unlock(&sched_lock, oldIPL);
 
         dbg(DBG_PRINT, "(GRADING1C)\n");
         return NULL;
@@ -70,11 +75,12 @@ sched_wakeup_on(ktqueue_t *q)
 
 void sched_broadcast_on(ktqueue_t *q)
 {
-
+        uint8_t oldIPL = spinlock_lock(&sched_lock);
         while (!sched_queue_empty(q))
         {
-                sched_wakeup_on(q);
+                sched_make_runnable_locked(ktqueue_dequeue(q));
                 dbg(DBG_PRINT, "(GRADING1C)\n");
         }
+        spinlock_unlock(&sched_lock, oldIPL);
         dbg(DBG_PRINT, "(GRADING1C)\n");
 }
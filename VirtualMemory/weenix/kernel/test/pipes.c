@@ -20,6 +20,7 @@
 #include "globals.h"
 
 #include "fs/file.h"
+#include "fs/fdtable.h"
 #include "fs/pipe.h"
 #include "fs/vfs_syscall.h"
 
@@ -47,10 +48,8 @@ make_proc_and_thread(char *name, kthread_func_t func, int arg1, void *arg2)
                 return NULL;
         }
 
-        int i;
-        for (i = 0; i < NFILES; ++i) {
-                proc->p_files[i] = curproc->p_files[i];
-                if (proc->p_files[i]) fref(proc->p_files[i]);
+        if (0 > fdtable_copy(proc->p_fdt, curproc->p_fdt)) {
+                return NULL;
         }
         return kthread_create(proc, func, arg1, arg2);
 }
@@ -17,38 +17,243 @@
 /******************************************************************************/
 
 #include "globals.h"
+#include "errno.h"
 
+#include "main/io.h"
+#include "main/cpuid.h"
 #include "main/interrupt.h"
 #include "main/apic.h"
-#include "main/pit.h"
 
 #include "util/debug.h"
 #include "util/init.h"
+#include "util/string.h"
+#include "util/time.h"
+#include "util/timer.h"
+#include "util/workq.h"
 
 #include "proc/sched.h"
 #include "proc/kthread.h"
 
-#define APIC_TIMER_IRQ 32 /* Map interrupt 32 */
+#include "vm/timepage.h"
 
-#ifdef __UPREEMPT__
-static unsigned int ms = 0;
+/* The longest the CPU stays idle without a tick, even with no timers */
+#define TIME_IDLE_MAX_TICKS     (10 * TIMER_HZ)
 
-static void pit_handler(regs_t *regs)
+/* CMOS real time clock registers */
+#define CMOS_ADDR               0x70
+#define CMOS_DATA               0x71
+#define RTC_SECONDS             0x00
+#define RTC_MINUTES             0x02
+#define RTC_HOURS               0x04
+#define RTC_DAY                 0x07
+#define RTC_MONTH               0x08
+#define RTC_YEAR                0x09
+#define RTC_STATUS_A            0x0a
+#define RTC_STATUS_B            0x0b
+#define RTC_UPDATING            0x80    /* in status A */
+#define RTC_24HOUR              0x02    /* in status B */
+#define RTC_BINARY              0x04    /* in status B */
+#define RTC_PM                  0x80    /* in the hours */
+
+volatile uint32_t time_ticks = 0;
+
+/* The kernel's copy of the time page, which it reads itself */
+static struct time_page time_clock;
+
+/* Set while the periodic tick is stopped */
+static int time_idle = 0;
+
+uint64_t
+time_ns(void)
 {
-  dbg(DBG_CORE, "PIT HANDLER FIRED\n");
+        return time_page_ns(&time_clock, rdtsc());
 }
 
-/* Uncomment this to enable the apic timer to
- * call the pit_handler for userland preemption
- */
+uint64_t
+time_cycles_ns(uint64_t cycles)
+{
+        struct time_page tp = time_clock;
+
+        tp.tp_tsc_base = 0;
+        return time_page_ns(&tp, cycles);
+}
 
-static __attribute__((unused)) void time_init(void)
+int
+time_gettime(clockid_t clock, struct timespec *ts)
 {
-  intr_map(APIC_TIMER_IRQ, APIC_TIMER_IRQ);
-  intr_register(APIC_TIMER_IRQ, pit_handler);
-  /* TODO: figure out how this argument converts to hertz */
-  apic_enable_periodic_timer(8);
+        uint64_t ns = time_ns();
+
+        switch (clock) {
+                case CLOCK_MONOTONIC:
+                        ts->tv_sec = ns / NSEC_PER_SEC;
+                        break;
+                case CLOCK_REALTIME:
+                        ts->tv_sec = time_clock.tp_boot_sec + ns / NSEC_PER_SEC;
+                        break;
+                default:
+                        return -EINVAL;
+        }
+        ts->tv_nsec = ns % NSEC_PER_SEC;
+        return 0;
 }
-init_func(time_init);
 
-#endif
+/* Runs the timers from the timer interrupt's bottom half */
+static work_t time_work;
+
+/* Brings time_ticks up to date with the time stamp counter. Called with
+ * the timer interrupt masked. */
+static void
+time_advance(void)
+{
+        uint32_t now = (uint32_t)(time_ns() / NSEC_PER_TICK);
+
+        if ((int32_t)(now - time_ticks) > 0) {
+                time_ticks = now;
+        }
+}
+
+/* As time_advance, and runs the timers which have become due */
+static void
+time_update(void)
+{
+        time_advance();
+        ktimer_run();
+}
+
+static void
+time_run_timers(void *arg)
+{
+        ktimer_run();
+}
+
+static void
+time_tick(regs_t *regs)
+{
+        /* The local APIC timer does not go through the IO APIC (so
+         * intr_map() is not used for it), acknowledge it here */
+        apic_eoi();
+
+        time_advance();
+        sched_tick();
+        /* Timer functions wake threads and so on, which can wait until
+         * interrupts are enabled again */
+        work_queue(&time_work);
+}
+
+void
+time_idle_enter(void)
+{
+        uint32_t ticks;
+        uint64_t deadline, now;
+
+        /* Before time_init there is no tick to stop */
+        if (0 == time_clock.tp_mult) {
+                return;
+        }
+        ticks = ktimer_next();
+        if (ticks > TIME_IDLE_MAX_TICKS) {
+                ticks = TIME_IDLE_MAX_TICKS;
+        }
+        deadline = (uint64_t)(time_ticks + ticks) * NSEC_PER_TICK;
+        now = time_ns();
+        apic_oneshot_timer(deadline > now ? (uint32_t)((deadline - now) / 1000) + 1 : 1);
+        time_idle = 1;
+}
+
+void
+time_idle_exit(void)
+{
+        if (time_idle) {
+                time_idle = 0;
+                time_update();
+                apic_enable_periodic_timer(TIMER_HZ);
+        }
+}
+
+static uint8_t
+rtc_read(uint8_t reg)
+{
+        outb(CMOS_ADDR, reg);
+        return inb(CMOS_DATA);
+}
+
+/* Reads the date and time from the real time clock, as seconds since the
+ * Unix epoch. The clock is assumed to keep UTC, in the years 2000-2099. */
+static uint32_t
+rtc_read_time(void)
+{
+        uint8_t regs[6], last[6], status;
+        int32_t year, month, day, hour, i;
+        int32_t era, yoe, doy, doe;
+
+        /* Read until we get the same thing twice without an update
+         * happening in between */
+        do {
+                while (rtc_read(RTC_STATUS_A) & RTC_UPDATING)
+                        ;
+                last[0] = rtc_read(RTC_SECONDS);
+                last[1] = rtc_read(RTC_MINUTES);
+                last[2] = rtc_read(RTC_HOURS);
+                last[3] = rtc_read(RTC_DAY);
+                last[4] = rtc_read(RTC_MONTH);
+                last[5] = rtc_read(RTC_YEAR);
+                while (rtc_read(RTC_STATUS_A) & RTC_UPDATING)
+                        ;
+                regs[0] = rtc_read(RTC_SECONDS);
+                regs[1] = rtc_read(RTC_MINUTES);
+                regs[2] = rtc_read(RTC_HOURS);
+                regs[3] = rtc_read(RTC_DAY);
+                regs[4] = rtc_read(RTC_MONTH);
+                regs[5] = rtc_read(RTC_YEAR);
+        } while (0 != memcmp(regs, last, sizeof(regs)));
+
+        status = rtc_read(RTC_STATUS_B);
+        hour = regs[2] & ~RTC_PM;
+        if (!(status & RTC_BINARY)) {
+                for (i = 0; i < 6; i++) {
+                        regs[i] = (regs[i] & 0x0f) + (regs[i] >> 4) * 10;
+                }
+                hour = (hour & 0x0f) + (hour >> 4) * 10;
+        }
+        if (!(status & RTC_24HOUR)) {
+                hour %= 12;
+                if (regs[2] & RTC_PM) {
+                        hour += 12;
+                }
+        }
+        year = 2000 + regs[5];
+        month = regs[4];
+        day = regs[3];
+
+        /* Days since the epoch of a date in the proleptic Gregorian
+         * calendar, counting years from March */
+        year -= month <= 2;
+        era = year / 400;
+        yoe = year - era * 400;
+        doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return (uint32_t)(era * 146097 + doe - 719468) * 86400
+               + hour * 3600 + regs[1] * 60 + regs[0];
+}
+
+static __attribute__((unused)) void
+time_init(void)
+{
+        uint64_t tsc_per10ms = apic_calibrate_timer();
+
+        /* Nanoseconds per cycle, in fixed point */
+        time_clock.tp_mult = (uint32_t)(((uint64_t)10000000 << TIME_PAGE_SHIFT) / tsc_per10ms);
+        time_clock.tp_boot_sec = rtc_read_time();
+        time_clock.tp_tsc_base = rdtsc();
+        *timepage = time_clock;
+        dbgq(DBG_CORE, "Clock: %u ns/cycle << %u, booted at %u\n",
+             time_clock.tp_mult, TIME_PAGE_SHIFT, time_clock.tp_boot_sec);
+
+        work_init(&time_work, time_run_timers, NULL);
+        intr_register(INTR_APICTIMER, time_tick);
+        apic_enable_periodic_timer(TIMER_HZ);
+}
+init_func(time_init);
+init_depends(sched_init);
+init_depends(ktimer_init_wheel);
+init_depends(timepage_init);
@@ -0,0 +1,204 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#include "types.h"
+#include "globals.h"
+#include "kernel.h"
+
+#include "main/interrupt.h"
+
+#include "proc/spinlock.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+#include "util/time.h"
+#include "util/timer.h"
+
+/*
+ * The timer wheel has a root wheel of 256 slots, one per tick, and four
+ * wheels of 64 slots above it, where each slot covers a whole turn of
+ * the wheel below it. A timer goes into the lowest wheel whose range
+ * covers its expiry time. Each time the root wheel comes back round to
+ * slot 0, the next slot of the wheel above is emptied and its timers
+ * are put back into the wheels (most of them into the root wheel), and
+ * so on up.
+ */
+#define TW_ROOT_BITS    8
+#define TW_LEVEL_BITS   6
+#define TW_NLEVELS      4       /* 8 + 4 * 6 = 32 bits of ticks */
+#define TW_ROOT_SIZE    (1 << TW_ROOT_BITS)
+#define TW_LEVEL_SIZE   (1 << TW_LEVEL_BITS)
+#define TW_ROOT_MASK    (TW_ROOT_SIZE - 1)
+#define TW_LEVEL_MASK   (TW_LEVEL_SIZE - 1)
+
+/* The index into wheel `level' (above the root) of a tick */
+#define tw_index(tick, level) \
+        (((tick) >> (TW_ROOT_BITS + (level) * TW_LEVEL_BITS)) & TW_LEVEL_MASK)
+
+static list_t tw_root[TW_ROOT_SIZE];
+static list_t tw_levels[TW_NLEVELS][TW_LEVEL_SIZE];
+
+/* The next tick whose timers have to be run */
+static uint32_t tw_next;
+
+/* Protects the wheels (but not the timers' functions) */
+static spinlock_t tw_lock = SPINLOCK_INITIALIZER;
+
+static __attribute__((unused)) void
+ktimer_init_wheel(void)
+{
+        int i, j;
+        for (i = 0; i < TW_ROOT_SIZE; i++) {
+                list_init(&tw_root[i]);
+        }
+        for (i = 0; i < TW_NLEVELS; i++) {
+                for (j = 0; j < TW_LEVEL_SIZE; j++) {
+                        list_init(&tw_levels[i][j]);
+                }
+        }
+        tw_next = time_ticks;
+}
+init_func(ktimer_init_wheel);
+
+/* Puts a timer into the wheel slot for its expiry time. Must be called
+ * with tw_lock held. */
+static void
+tw_insert(ktimer_t *t)
+{
+        uint32_t expires = t->tm_expires;
+        uint32_t delta = expires - tw_next;
+        list_t *slot;
+
+        if ((int32_t)delta < 0) {
+                /* Already due, run it on the next tick */
+                slot = &tw_root[tw_next & TW_ROOT_MASK];
+        } else if (delta < TW_ROOT_SIZE) {
+                slot = &tw_root[expires & TW_ROOT_MASK];
+        } else {
+                int level = 0;
+                while (level < TW_NLEVELS - 1
+                       && delta >= 1U << (TW_ROOT_BITS + (level + 1) * TW_LEVEL_BITS)) {
+                        level++;
+                }
+                slot = &tw_levels[level][tw_index(expires, level)];
+        }
+        list_insert_tail(slot, &t->tm_link);
+}
+
+/* Redistributes the timers in one slot of the given wheel, returning
+ * the slot's index */
+static uint32_t
+tw_cascade(int level, uint32_t index)
+{
+        list_t *slot = &tw_levels[level][index];
+        while (!list_empty(slot)) {
+                ktimer_t *t = list_head(slot, ktimer_t, tm_link);
+                list_remove(&t->tm_link);
+                tw_insert(t);
+        }
+        return index;
+}
+
+void
+ktimer_init(ktimer_t *t, ktimer_func_t func, void *arg)
+{
+        t->tm_expires = 0;
+        t->tm_func = func;
+        t->tm_arg = arg;
+        list_link_init(&t->tm_link);
+}
+
+void
+ktimer_add(ktimer_t *t, uint32_t ticks)
+{
+        KASSERT(!ktimer_pending(t));
+
+        uint8_t oldipl = spinlock_lock(&tw_lock);
+        t->tm_expires = time_ticks + ticks;
+        tw_insert(t);
+        spinlock_unlock(&tw_lock, oldipl);
+}
+
+int
+ktimer_cancel(ktimer_t *t)
+{
+        int pending;
+
+        uint8_t oldipl = spinlock_lock(&tw_lock);
+        if ((pending = ktimer_pending(t))) {
+                list_remove(&t->tm_link);
+        }
+        spinlock_unlock(&tw_lock, oldipl);
+        return pending;
+}
+
+int
+ktimer_pending(ktimer_t *t)
+{
+        return list_link_is_linked(&t->tm_link);
+}
+
+void
+ktimer_run(void)
+{
+        uint8_t oldipl = spinlock_lock(&tw_lock);
+
+        while ((int32_t)(time_ticks - tw_next) >= 0) {
+                uint32_t index = tw_next & TW_ROOT_MASK;
+                int level;
+
+                /* At the start of each turn of a wheel, bring down the
+                 * timers from the next slot of the wheel above */
+                for (level = 0; 0 == index && level < TW_NLEVELS; level++) {
+                        index = tw_cascade(level, tw_index(tw_next, level));
+                }
+                index = tw_next & TW_ROOT_MASK;
+                tw_next++;
+
+                list_t *slot = &tw_root[index];
+                while (!list_empty(slot)) {
+                        ktimer_t *t = list_head(slot, ktimer_t, tm_link);
+                        list_remove(&t->tm_link);
+                        /* The function may take other locks, or set
+                         * timers itself */
+                        spinlock_release(&tw_lock);
+                        t->tm_func(t->tm_arg);
+                        spinlock_acquire(&tw_lock);
+                }
+        }
+        spinlock_unlock(&tw_lock, oldipl);
+}
+
+uint32_t
+ktimer_next(void)
+{
+        uint8_t oldipl = spinlock_lock(&tw_lock);
+        uint32_t tick = tw_next;
+
+        /* Timers above the root wheel can't be due before it next comes
+         * round to slot 0, so that is as far as we need to look */
+        do {
+                if (!list_empty(&tw_root[tick & TW_ROOT_MASK])) {
+                        break;
+                }
+                tick++;
+        } while (0 != (tick & TW_ROOT_MASK));
+        spinlock_unlock(&tw_lock, oldipl);
+        return tick - time_ticks;
+}
@@ -0,0 +1,116 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#include "types.h"
+#include "globals.h"
+#include "kernel.h"
+
+#include "main/cpuid.h"
+#include "main/interrupt.h"
+
+#include "proc/spinlock.h"
+
+#include "util/debug.h"
+#include "util/list.h"
+#include "util/workq.h"
+
+/* Work which has been queued and not yet run, oldest first */
+static list_t work_list = { &work_list, &work_list };
+static spinlock_t work_lock = SPINLOCK_INITIALIZER;
+static int work_running;                /* some CPU is in work_run */
+
+static uint32_t work_nrun;
+static uint32_t work_maxdelay;
+
+void
+work_init(work_t *w, work_func_t func, void *arg)
+{
+        w->w_func = func;
+        w->w_arg = arg;
+        list_link_init(&w->w_link);
+}
+
+int
+work_queue(work_t *w)
+{
+        int queued = 0;
+
+        uint8_t oldipl = spinlock_lock(&work_lock);
+        if (!list_link_is_linked(&w->w_link)) {
+                w->w_queued = rdtsc();
+                list_insert_tail(&work_list, &w->w_link);
+                queued = 1;
+        }
+        spinlock_unlock(&work_lock, oldipl);
+        return queued;
+}
+
+int
+work_pending(void)
+{
+        return !list_empty(&work_list);
+}
+
+void
+work_run(void)
+{
+        work_t *w;
+        uint32_t delay;
+
+        /* Most interrupts find nothing to do */
+        if (list_empty(&work_list)) {
+                return;
+        }
+
+        uint8_t oldipl = spinlock_lock(&work_lock);
+        if (work_running) {
+                spinlock_unlock(&work_lock, oldipl);
+                return;
+        }
+        work_running = 1;
+        while (!list_empty(&work_list)) {
+                w = list_head(&work_list, work_t, w_link);
+                list_remove(&w->w_link);
+                delay = (uint32_t)(rdtsc() - w->w_queued);
+                if (delay > work_maxdelay) {
+                        work_maxdelay = delay;
+                }
+                work_nrun++;
+                spinlock_unlock(&work_lock, oldipl);
+
+                /* It may be queued again (even by itself) from now on */
+                intr_enable();
+                w->w_func(w->w_arg);
+                intr_disable();
+
+                oldipl = spinlock_lock(&work_lock);
+        }
+        work_running = 0;
+        spinlock_unlock(&work_lock, oldipl);
+}
+
+void
+work_stats(uint32_t *nrun, uint32_t *maxdelay, int reset)
+{
+        *nrun = work_nrun;
+        *maxdelay = work_maxdelay;
+        if (reset) {
+                work_nrun = 0;
+                work_maxdelay = 0;
+        }
+}
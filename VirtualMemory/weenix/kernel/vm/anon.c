@@ -81,6 +81,16 @@ anon_create()
         return mmobj;
 }
 
+/*
+ * Whether o is an anonymous object (used by ksmd, which may drop zero-filled
+ * pages from these).
+ */
+int
+mmobj_is_anon(mmobj_t *o)
+{
+        return &anon_mmobj_ops == o->mmo_ops;
+}
+
 /* Implementation of mmobj entry points: */
 
 /*
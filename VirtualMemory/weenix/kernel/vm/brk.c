@@ -70,8 +70,8 @@
  * Note that this function "returns" the new break through the "ret" argument.
  * Return 0 on success, -errno on failure.
  */
-int
-do_brk(void *addr, void **ret)
+static int
+do_brk_locked(void *addr, void **ret)
 {
         if (addr == NULL){
                 dbg(DBG_PRINT, "(GRADING3B)\n");
@@ -143,3 +143,17 @@ do_brk(void *addr, void **ret)
         *ret = addr;
         return 0;
 }
+
+/* The above, with the process' map held exclusive, since its other
+ * threads may be mapping or faulting next to the heap */
+int
+do_brk(void *addr, void **ret)
+{
+        vmmap_t *map = curproc->p_vmmap;
+        int err;
+
+        krwlock_wrlock(&map->vmm_lock);
+        err = do_brk_locked(addr, ret);
+        krwlock_unlock(&map->vmm_lock);
+        return err;
+}
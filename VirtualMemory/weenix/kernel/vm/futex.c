@@ -0,0 +1,174 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#include "globals.h"
+#include "errno.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+
+#include "proc/sched.h"
+
+#include "mm/mm.h"
+#include "mm/mman.h"
+#include "mm/page.h"
+#include "mm/pagetable.h"
+#include "mm/pframe.h"
+#include "mm/tlb.h"
+
+#include "vm/vmmap.h"
+#include "vm/futex.h"
+
+#define FUTEX_NBUCKETS 64
+
+/* A thread in futex_wait(), on its stack */
+typedef struct futex_waiter {
+        uintptr_t       fw_key;         /* kernel address of the int */
+        list_link_t     fw_link;        /* on its bucket, until woken */
+        ktqueue_t       fw_waitq;       /* just this thread */
+} futex_waiter_t;
+
+static list_t futex_buckets[FUTEX_NBUCKETS];
+
+static __attribute__((unused)) void
+futex_init(void)
+{
+        int i;
+        for (i = 0; i < FUTEX_NBUCKETS; i++) {
+                list_init(&futex_buckets[i]);
+        }
+}
+init_func(futex_init);
+
+static list_t *
+futex_bucket(uintptr_t key)
+{
+        return &futex_buckets[((key >> 2) ^ (key >> PAGE_SHIFT)) % FUTEX_NBUCKETS];
+}
+
+/*
+ * Finds the page frame behind uaddr as a write to it would, so that for
+ * a private mapping it is the process' own copy, and maps it writable
+ * the same way the page fault handler would. This keeps the user's
+ * mapping and the frame the key comes from the same.
+ */
+static int
+futex_frame(int *uaddr, pframe_t **pfp)
+{
+        uint32_t vfn = ADDR_TO_PN(uaddr);
+        vmmap_t *map = curproc->p_vmmap;
+        vmarea_t *vma;
+        pframe_t *pf;
+        int err;
+
+        if (0 != ((uintptr_t) uaddr & (sizeof(int) - 1))) {
+                return -EINVAL;
+        }
+        if (USER_MEM_LOW > (uintptr_t) uaddr || USER_MEM_HIGH <= (uintptr_t) uaddr) {
+                return -EFAULT;
+        }
+
+        krwlock_rdlock(&map->vmm_lock);
+        if (NULL == (vma = vmmap_lookup(map, vfn)) || !(vma->vma_prot & PROT_WRITE)) {
+                err = -EFAULT;
+                goto out;
+        }
+
+        if (0 > (err = pframe_lookup(vma->vma_obj, vma->vma_off + vfn - vma->vma_start, 1, &pf))) {
+                goto out;
+        }
+        pframe_pin(pf);
+        err = pframe_dirty(pf);
+        pframe_unpin(pf);
+        if (0 > err) {
+                goto out;
+        }
+        if (0 > (err = pt_map(curproc->p_pagedir, (uintptr_t) PAGE_ALIGN_DOWN(uaddr),
+                              pt_virt_to_phys((uintptr_t) pf->pf_addr),
+                              PD_PRESENT | PD_WRITE | PD_USER, PT_PRESENT | PT_WRITE | PT_USER))) {
+                goto out;
+        }
+        tlb_flush((uintptr_t) PAGE_ALIGN_DOWN(uaddr));
+        *pfp = pf;
+
+out:
+        krwlock_unlock(&map->vmm_lock);
+        return err;
+}
+
+int
+futex_wait(int *uaddr, int val)
+{
+        futex_waiter_t w;
+        pframe_t *pf;
+        mmobj_t *o;
+        int err;
+
+        if (0 > (err = futex_frame(uaddr, &pf))) {
+                return err;
+        }
+        w.fw_key = (uintptr_t) pf->pf_addr + PAGE_OFFSET(uaddr);
+
+        /* Nothing below blocks before we are on the bucket, so a waker
+         * which changes the value after we look at it will find us */
+        if (*(int *) w.fw_key != val) {
+                return -EAGAIN;
+        }
+
+        /* Keep the frame (and so the key) where it is while we sleep,
+         * even if the area is unmapped meanwhile */
+        o = pf->pf_obj;
+        o->mmo_ops->ref(o);
+        pframe_pin(pf);
+
+        sched_queue_init(&w.fw_waitq);
+        list_insert_tail(futex_bucket(w.fw_key), &w.fw_link);
+        err = sched_cancellable_sleep_on(&w.fw_waitq);
+        if (list_link_is_linked(&w.fw_link)) {
+                list_remove(&w.fw_link);
+        }
+
+        pframe_unpin(pf);
+        o->mmo_ops->put(o);
+        return err;
+}
+
+int
+futex_wake(int *uaddr, int n)
+{
+        futex_waiter_t *w;
+        pframe_t *pf;
+        uintptr_t key;
+        int err, woken = 0;
+
+        if (0 > (err = futex_frame(uaddr, &pf))) {
+                return err;
+        }
+        key = (uintptr_t) pf->pf_addr + PAGE_OFFSET(uaddr);
+
+        list_iterate_begin(futex_bucket(key), w, futex_waiter_t, fw_link) {
+                if (woken < n && w->fw_key == key) {
+                        list_remove(&w->fw_link);
+                        sched_wakeup_on(&w->fw_waitq);
+                        woken++;
+                }
+        } list_iterate_end();
+
+        return woken;
+}
@@ -0,0 +1,527 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#include "types.h"
+#include "globals.h"
+#include "errno.h"
+
+#include "mm/mm.h"
+#include "mm/page.h"
+#include "mm/mmobj.h"
+#include "mm/pframe.h"
+#include "mm/kmalloc.h"
+#include "mm/tlb.h"
+
+#include "util/debug.h"
+#include "util/string.h"
+#include "util/init.h"
+
+#include "proc/proc.h"
+#include "proc/sched.h"
+#include "proc/kthread.h"
+
+#include "vm/vmmap.h"
+#include "vm/anon.h"
+#include "vm/ksmd.h"
+
+#include "test/kshell/kshell.h"
+#include "test/kshell/io.h"
+
+#ifdef __KSMD__
+/*
+ * The same-page merging daemon. Forked processes tend to end up with many
+ * private pages holding the same data: pages rewritten with what they
+ * already held, zeroed heap and stack, tables each copy computed the same
+ * way. ksmd looks for such pages in anonymous and shadow objects and gets
+ * rid of the copies, leaving a single frame lower in the shadow tree which
+ * every process maps read-only; a later write breaks the sharing again
+ * through the usual copy-on-write fault.
+ *
+ * A page frame belongs to exactly one object, so identical pages are merged
+ * by where they sit in the shadow tree:
+ *
+ *  - A page identical to the page a read would find below it (further down
+ *    its shadow chain, or a fresh zero page for an anonymous object) is
+ *    freed, and reads fall through to that page again.
+ *
+ *  - When every object shadowing some object A has its own copy of a page,
+ *    A's copy of it can never be seen. If two or more of those copies are
+ *    identical, one is moved down into A instead, and the rest are then
+ *    freed by the first rule.
+ *
+ * Only pages whose checksum has not changed since the previous pass are
+ * merged, so that pages being written to are left alone.
+ */
+
+/* ksmd runs a pass after this many page frames have been allocated */
+#define KSMD_ALLOC_INTERVAL     256
+/* Most passes run back to back (yielding in between) for one wakeup, as long
+ * as each pass finds pages that changed since the last */
+#define KSMD_MAX_ROUNDS         4
+/* Most objects looked at in one pass */
+#define KSMD_MAX_OBJS           4096
+
+typedef struct ksm_obj {
+        mmobj_t *ko_obj;
+        int      ko_nparents;   /* number of objects found shadowing ko_obj */
+} ksm_obj_t;
+
+static ktqueue_t ksmd_waitq;
+static int ksmd_initialized = 0;
+static int ksmd_allocs = 0;
+
+static proc_t *ksmd_proc;
+static kthread_t *ksmd_thr;
+
+/* Open-addressed set of the objects reachable from some process's vmmap in
+ * the current pass, ksm_nslots (a power of two) entries long */
+static ksm_obj_t *ksm_objs;
+static uint32_t ksm_nslots;
+
+/* Statistics, shown by the "ksm" kshell command */
+static int ksm_passes = 0;
+static int ksm_scanned = 0;     /* pages looked at in the last pass */
+static int ksm_changed = 0;     /* ... of which changed since the pass before */
+static int ksm_merged = 0;      /* pages freed as copies of a page below them */
+static int ksm_zero = 0;        /* zero-filled anonymous pages freed */
+static int ksm_hoisted = 0;     /* pages moved below identical siblings */
+static int ksm_hidden = 0;      /* pages no process could see, freed to make
+                                   room for those */
+
+static uint32_t
+ksm_checksum(const void *page)
+{
+        const uint32_t *w = page;
+        uint32_t sum = 2166136261u;
+        uint32_t i;
+        for (i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+                sum = (sum ^ w[i]) * 16777619u;
+        }
+        return sum;
+}
+
+static int
+ksm_is_zero(const void *page)
+{
+        const uint32_t *w = page;
+        uint32_t i;
+        for (i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+                if (0 != w[i]) {
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+/* Returns the set entry for o, adding it if insert is set (there must be a
+ * free slot), or NULL if o is not in the set. */
+static ksm_obj_t *
+ksm_obj_find(mmobj_t *o, int insert)
+{
+        uint32_t i = ((uint32_t)o >> 4) & (ksm_nslots - 1);
+        while (NULL != ksm_objs[i].ko_obj) {
+                if (o == ksm_objs[i].ko_obj) {
+                        return &ksm_objs[i];
+                }
+                i = (i + 1) & (ksm_nslots - 1);
+        }
+        if (!insert) {
+                return NULL;
+        }
+        ksm_objs[i].ko_obj = o;
+        ksm_objs[i].ko_nparents = 0;
+        return &ksm_objs[i];
+}
+
+/* Builds ksm_objs from the vmmaps of all running processes. Returns 0 on
+ * success or -ENOMEM. */
+static int
+ksm_collect(void)
+{
+        proc_t *p;
+        vmarea_t *vma;
+        mmobj_t *o;
+        uint32_t n = 0, nobjs = 0, i;
+
+        list_iterate_begin(proc_list(), p, proc_t, p_list_link) {
+                if (PROC_RUNNING == p->p_state && NULL != p->p_vmmap) {
+                        list_iterate_begin(&p->p_vmmap->vmm_list, vma, vmarea_t, vma_plink) {
+                                for (o = vma->vma_obj; NULL != o; o = o->mmo_shadowed) {
+                                        n++;
+                                }
+                        } list_iterate_end();
+                }
+        } list_iterate_end();
+        if (n > KSMD_MAX_OBJS) {
+                n = KSMD_MAX_OBJS;
+        }
+
+        for (ksm_nslots = 1; ksm_nslots < 2 * n; ksm_nslots <<= 1)
+                ;
+        if (NULL == (ksm_objs = kmalloc(ksm_nslots * sizeof(ksm_obj_t)))) {
+                return -ENOMEM;
+        }
+        memset(ksm_objs, 0, ksm_nslots * sizeof(ksm_obj_t));
+
+        list_iterate_begin(proc_list(), p, proc_t, p_list_link) {
+                if (PROC_RUNNING == p->p_state && NULL != p->p_vmmap) {
+                        list_iterate_begin(&p->p_vmmap->vmm_list, vma, vmarea_t, vma_plink) {
+                                for (o = vma->vma_obj; NULL != o && nobjs < n; o = o->mmo_shadowed) {
+                                        if (NULL == ksm_obj_find(o, 0)) {
+                                                ksm_obj_find(o, 1);
+                                                nobjs++;
+                                        }
+                                }
+                        } list_iterate_end();
+                }
+        } list_iterate_end();
+
+        /* Each object was added once, so this counts each parent once */
+        for (i = 0; i < ksm_nslots; i++) {
+                ksm_obj_t *ko;
+                o = ksm_objs[i].ko_obj;
+                if (NULL != o && NULL != o->mmo_shadowed
+                    && NULL != (ko = ksm_obj_find(o->mmo_shadowed, 0))) {
+                        ko->ko_nparents++;
+                }
+        }
+        return 0;
+}
+
+/* Whether ksmd may free or move pf: pf must be a page of an anonymous or
+ * shadow object which nobody else is holding on to. Shadow object pages keep
+ * the pin they are given when filled; anonymous object pages are unpinned. */
+static int
+ksm_page_movable(pframe_t *pf)
+{
+        mmobj_t *o = pf->pf_obj;
+        if (pframe_is_busy(pf)) {
+                return 0;
+        } else if (NULL != o->mmo_shadowed) {
+                return 1 == pf->pf_pincount;
+        } else {
+                return mmobj_is_anon(o) && 0 == pf->pf_pincount;
+        }
+}
+
+/* Whether pf is movable and has not changed since the last pass */
+static int
+ksm_page_stable(pframe_t *pf)
+{
+        return ksm_page_movable(pf) && pf->pf_checksum == ksm_checksum(pf->pf_addr);
+}
+
+static void
+ksm_page_free(pframe_t *pf)
+{
+        if (pframe_is_pinned(pf)) {
+                pframe_unpin(pf);
+        }
+        pframe_free(pf);
+}
+
+/* Finds the page a read of page pagenum of o would see if o did not have the
+ * page itself, without doing any I/O. Returns that page, or NULL if it is not
+ * resident; *zero is then set if the read would get a fresh zero-filled
+ * anonymous page. */
+static pframe_t *
+ksm_page_below(mmobj_t *o, uint32_t pagenum, int *zero)
+{
+        pframe_t *pf;
+        *zero = 0;
+        while (NULL != o->mmo_shadowed) {
+                o = o->mmo_shadowed;
+                if (NULL != (pf = pframe_get_resident(o, pagenum))) {
+                        return pframe_is_busy(pf) ? NULL : pf;
+                }
+        }
+        *zero = mmobj_is_anon(o);
+        return NULL;
+}
+
+/* Looks for pages which every object shadowing a has its own copy of, and
+ * moves one of the largest set of identical copies down into a. */
+static void
+ksm_merge_siblings(mmobj_t *a, int nparents)
+{
+        mmobj_t **parents;
+        pframe_t **pages;
+        pframe_t *pf;
+        uint32_t slot;
+        int n = 0;
+
+        parents = kmalloc(nparents * sizeof(mmobj_t *));
+        pages = kmalloc(nparents * sizeof(pframe_t *));
+        if (NULL == parents || NULL == pages) {
+                goto done;
+        }
+        for (slot = 0; slot < ksm_nslots; slot++) {
+                mmobj_t *o = ksm_objs[slot].ko_obj;
+                if (NULL != o && a == o->mmo_shadowed) {
+                        parents[n++] = o;
+                }
+        }
+        KASSERT(n == nparents);
+
+        list_iterate_begin(&parents[0]->mmo_respages, pf, pframe_t, pf_olink) {
+                pframe_t *best = NULL, *old;
+                int bestcount = 1;
+                int i, j;
+
+                /* Every parent must have the page for a's copy to be unused */
+                for (i = 0; i < n; i++) {
+                        pages[i] = (0 == i) ? pf : pframe_get_resident(parents[i], pf->pf_pagenum);
+                        if (NULL == pages[i]) {
+                                break;
+                        }
+                }
+                if (i < n) {
+                        continue;
+                }
+
+                for (i = 0; i < n; i++) {
+                        if (!ksm_page_stable(pages[i])) {
+                                pages[i] = NULL;
+                        }
+                }
+                for (i = 0; i < n; i++) {
+                        int count = 1;
+                        if (NULL == pages[i]) {
+                                continue;
+                        }
+                        for (j = i + 1; j < n; j++) {
+                                if (NULL != pages[j] && pages[i]->pf_checksum == pages[j]->pf_checksum
+                                    && 0 == memcmp(pages[i]->pf_addr, pages[j]->pf_addr, PAGE_SIZE)) {
+                                        count++;
+                                }
+                        }
+                        if (count > bestcount) {
+                                best = pages[i];
+                                bestcount = count;
+                        }
+                }
+                if (NULL == best) {
+                        continue;
+                }
+
+                if (NULL != (old = pframe_get_resident(a, best->pf_pagenum))) {
+                        if (!ksm_page_movable(old)) {
+                                continue;
+                        }
+                        ksm_page_free(old);
+                        ksm_hidden++;
+                }
+                /* The processes which had best mapped may have it writable */
+                pframe_remove_from_pts(best);
+                if (NULL == a->mmo_shadowed) {
+                        pframe_unpin(best);
+                }
+                pframe_migrate(best, a);
+                ksm_hoisted++;
+        } list_iterate_end();
+
+done:
+        if (NULL != parents) {
+                kfree(parents);
+        }
+        if (NULL != pages) {
+                kfree(pages);
+        }
+}
+
+/* Runs one merging pass over all processes. This does not block, so the
+ * shadow trees cannot change under it. Returns the number of pages which
+ * changed since the previous pass. */
+static int
+ksm_pass(void)
+{
+        uint32_t slot;
+        int saved = ksm_merged + ksm_zero + ksm_hidden;
+        int hoisted = ksm_hoisted;
+
+        if (0 > ksm_collect()) {
+                return 0;
+        }
+
+        /* Moving sibling pages down first lets the loop below free the
+         * remaining copies right away */
+        for (slot = 0; slot < ksm_nslots; slot++) {
+                ksm_obj_t *ko = &ksm_objs[slot];
+                mmobj_t *a = ko->ko_obj;
+                if (NULL != a && 2 <= ko->ko_nparents
+                    && (NULL != a->mmo_shadowed || mmobj_is_anon(a))
+                    && ko->ko_nparents == a->mmo_refcount - a->mmo_nrespages) {
+                        ksm_merge_siblings(a, ko->ko_nparents);
+                }
+        }
+
+        ksm_scanned = 0;
+        ksm_changed = 0;
+        for (slot = 0; slot < ksm_nslots; slot++) {
+                mmobj_t *o = ksm_objs[slot].ko_obj;
+                pframe_t *pf;
+                if (NULL == o) {
+                        continue;
+                }
+                list_iterate_begin(&o->mmo_respages, pf, pframe_t, pf_olink) {
+                        pframe_t *below;
+                        uint32_t sum;
+                        int zerofill;
+
+                        if (!ksm_page_movable(pf)) {
+                                continue;
+                        }
+                        ksm_scanned++;
+                        if (pf->pf_checksum != (sum = ksm_checksum(pf->pf_addr))) {
+                                pf->pf_checksum = sum;
+                                ksm_changed++;
+                                continue;
+                        }
+
+                        below = ksm_page_below(o, pf->pf_pagenum, &zerofill);
+                        if (NULL != below) {
+                                if (0 == memcmp(pf->pf_addr, below->pf_addr, PAGE_SIZE)) {
+                                        ksm_page_free(pf);
+                                        ksm_merged++;
+                                }
+                        } else if (zerofill && ksm_is_zero(pf->pf_addr)) {
+                                ksm_page_free(pf);
+                                ksm_zero++;
+                        }
+                } list_iterate_end();
+        }
+
+        kfree(ksm_objs);
+        ksm_objs = NULL;
+
+        /* Pages freed or moved may still be in the current address space's
+         * TLB entries (the others are flushed when switched to) */
+        tlb_flush_all();
+
+        ksm_passes++;
+        saved = ksm_merged + ksm_zero + ksm_hidden - saved;
+        if (0 != saved || ksm_hoisted != hoisted) {
+                dbg(DBG_VM, "ksmd: pass %d: scanned %d pages, saved %d pages,"
+                    " moved %d pages under their siblings\n", ksm_passes, ksm_scanned,
+                    saved, ksm_hoisted - hoisted);
+        }
+        return ksm_changed;
+}
+
+void
+ksmd_wakeup()
+{
+        if (ksmd_initialized) {
+                sched_broadcast_on(&ksmd_waitq);
+        }
+}
+
+/* Called by the pframe module for every page frame it allocates */
+void
+ksmd_page_alloced()
+{
+        if (0 == (++ksmd_allocs % KSMD_ALLOC_INTERVAL)) {
+                ksmd_wakeup();
+        }
+}
+
+static void *
+ksmd(int arg1, void *arg2)
+{
+        while (1) {
+                int round;
+                for (round = 0; round < KSMD_MAX_ROUNDS; round++) {
+                        if (0 == ksm_pass()) {
+                                break;
+                        }
+                        /* Give the pages that changed a chance to settle */
+                        sched_make_runnable(curthr);
+                        sched_switch();
+                }
+
+                if (sched_cancellable_sleep_on(&ksmd_waitq) < 0) {
+                        return (void *)0;
+                }
+        }
+}
+
+static __attribute__((unused)) void
+ksmd_init()
+{
+        sched_queue_init(&ksmd_waitq);
+
+        KASSERT(NULL != curproc && (PID_IDLE == curproc->p_pid));
+        ksmd_proc = proc_create("ksmd");
+        KASSERT(NULL != ksmd_proc);
+        ksmd_thr = kthread_create(ksmd_proc, ksmd, 0, NULL);
+        KASSERT(NULL != ksmd_thr);
+
+        sched_make_runnable(ksmd_thr);
+
+        ksmd_initialized = 1;
+}
+init_func(ksmd_init);
+init_depends(sched_init);
+
+/*
+ * Cancel ksmd
+ */
+void
+ksmd_shutdown()
+{
+        KASSERT(NULL != ksmd_thr);
+        KASSERT(PID_IDLE == curproc->p_pid);
+        ksmd_initialized = 0;
+        kthread_cancel(ksmd_thr, (void *)0);
+        ksmd_thr = NULL;
+        int ksmd_pid = ksmd_proc->p_pid;
+        int child = do_waitpid(ksmd_pid, 0, NULL);
+        KASSERT(child == ksmd_pid && "waited on process other than ksmd");
+}
+
+static int
+ksm_kshell(kshell_t *ksh, int argc, char **argv)
+{
+        if (argc > 1 && 0 == strcmp(argv[1], "scan")) {
+                ksm_pass();
+        } else if (argc > 1) {
+                kprintf(ksh, "usage: ksm [scan]\n");
+                return 0;
+        }
+
+        kprintf(ksh, "passes:             %d\n", ksm_passes);
+        kprintf(ksh, "pages scanned:      %d (%d changed since the pass before)\n",
+                ksm_scanned, ksm_changed);
+        kprintf(ksh, "copies freed:       %d\n", ksm_merged);
+        kprintf(ksh, "zero pages freed:   %d\n", ksm_zero);
+        kprintf(ksh, "pages moved down:   %d (freeing %d hidden pages)\n",
+                ksm_hoisted, ksm_hidden);
+        kprintf(ksh, "pages saved:        %d (%d KB)\n", ksm_merged + ksm_zero + ksm_hidden,
+                (ksm_merged + ksm_zero + ksm_hidden) * (PAGE_SIZE / 1024));
+        return 0;
+}
+
+static __attribute__((unused)) void
+ksmd_kshell_init()
+{
+        kshell_add_command("ksm", ksm_kshell,
+                           "show same-page merging statistics (\"ksm scan\" runs a pass)");
+}
+init_func(ksmd_kshell_init);
+init_depends(kshell_init);
+#endif /* __KSMD__ */
@@ -33,6 +33,7 @@
 #include "fs/vnode.h"
 #include "fs/vfs.h"
 #include "fs/file.h"
+#include "fs/fdtable.h"
 
 #include "vm/vmmap.h"
 #include "vm/mmap.h"
@@ -100,12 +101,12 @@ do_mmap(void *addr, size_t len, int prot, int flags,
         // if not from anonymous obj -> check file object
         if (!(flags & MAP_ANON)){
 
-                if ( !is_valid_fd(fd) || curproc->p_files[fd] == NULL) {
+                if ( !is_valid_fd(fd) || fd_get(curproc->p_fdt, fd) == NULL) {
                         dbg(DBG_PRINT, "(GRADING3D)\n");
                         return -EBADF;
                 }
 
-                file_t *f = curproc->p_files[fd];
+                file_t *f = fd_get(curproc->p_fdt, fd);
                 vnode = f->f_vnode;
                 if ((flags & MAP_SHARED) && (prot & PROT_WRITE)) {
                         if ( !((f->f_mode & FMODE_READ) && (f->f_mode & FMODE_WRITE) )) {
@@ -122,6 +123,7 @@ do_mmap(void *addr, size_t len, int prot, int flags,
         } 
 
         vmarea_t *vm_area;
+        krwlock_wrlock(&curproc->p_vmmap->vmm_lock);
         int ret_code = vmmap_map(curproc->p_vmmap, vnode, ADDR_TO_PN(addr),
                 (uint32_t)PAGE_ALIGN_UP(len) / PAGE_SIZE, prot, flags, off, VMMAP_DIR_HILO, &vm_area);
 
@@ -133,6 +135,7 @@ do_mmap(void *addr, size_t len, int prot, int flags,
                 KASSERT(NULL != curproc->p_pagedir); /* page table must be valid after a memory segment is mapped into the address space */
                 dbg(DBG_PRINT, "(GRADING3A 2.a)\n");
         }
+        krwlock_unlock(&curproc->p_vmmap->vmm_lock);
         dbg(DBG_PRINT, "(GRADING3B)\n");
         return ret_code;
 }
@@ -166,8 +169,52 @@ do_munmap(void *addr, size_t len)
                 return -EINVAL;
         }
         
+        krwlock_wrlock(&curproc->p_vmmap->vmm_lock);
         int ret = vmmap_remove(curproc->p_vmmap, ADDR_TO_PN(addr), (uint32_t)PAGE_ALIGN_UP(len) / PAGE_SIZE);
+        krwlock_unlock(&curproc->p_vmmap->vmm_lock);
         dbg(DBG_PRINT, "(GRADING3B)\n");
         return ret;
 }
 
+/*
+ * This function implements the mremap(2) syscall, but only
+ * supports the MREMAP_MAYMOVE flag.
+ *
+ * Resize the mapping at addr, which must be page aligned and lie in a
+ * single vmarea, from oldlen to newlen bytes. The contents are never
+ * copied; see vmmap_remap() for how this is done. The TLB is flushed by vmmap_remove() whenever pages are
+ * unmapped or moved.
+ */
+int
+do_mremap(void *addr, size_t oldlen, size_t newlen, int flags, void **ret)
+{
+        if (oldlen == 0 || newlen == 0) {
+                return -EINVAL;
+        }
+        if (flags & ~MREMAP_MAYMOVE) {
+                return -EINVAL;
+        }
+        if (!PAGE_ALIGNED(addr)) {
+                return -EINVAL;
+        }
+        if ((uintptr_t)addr < USER_MEM_LOW) {
+                return -EINVAL;
+        }
+        if (USER_MEM_HIGH - (uint32_t)addr < oldlen || newlen > USER_MEM_HIGH - USER_MEM_LOW) {
+                return -EINVAL;
+        }
+
+        uint32_t newpage;
+        krwlock_wrlock(&curproc->p_vmmap->vmm_lock);
+        int err = vmmap_remap(curproc->p_vmmap, ADDR_TO_PN(addr),
+                              (uint32_t)PAGE_ALIGN_UP(oldlen) / PAGE_SIZE,
+                              (uint32_t)PAGE_ALIGN_UP(newlen) / PAGE_SIZE,
+                              flags & MREMAP_MAYMOVE, &newpage);
+        krwlock_unlock(&curproc->p_vmmap->vmm_lock);
+        if (err < 0) {
+                return err;
+        }
+
+        *ret = PN_TO_ADDR(newpage);
+        return 0;
+}
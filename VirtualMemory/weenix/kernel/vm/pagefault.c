@@ -24,6 +24,7 @@
 #include "util/debug.h"
 
 #include "proc/proc.h"
+#include "proc/kthread.h"
 
 #include "mm/mm.h"
 #include "mm/mman.h"
@@ -80,12 +81,16 @@ handle_pagefault(uintptr_t vaddr, uint32_t cause)
 	int forwrite = 0;
 	int ret = 0;
 	mmobj_t *curr_mmobj = NULL;
+	/* A fault which reads a page in is a major one */
+	uint32_t inblock = curthr->kt_inblock;
 
 	// find VM area
 	pn = ADDR_TO_PN(vaddr);
+	krwlock_rdlock(&curproc->p_vmmap->vmm_lock);
 	flt_vmarea = vmmap_lookup(curproc->p_vmmap, pn);
 	if(!flt_vmarea) {
 		dbg(DBG_PRINT, "(GRADING3D)\n");
+		krwlock_unlock(&curproc->p_vmmap->vmm_lock);
 		do_exit(EFAULT);
 	}
 
@@ -93,6 +98,7 @@ handle_pagefault(uintptr_t vaddr, uint32_t cause)
 	if((cause & FAULT_WRITE && !(flt_vmarea->vma_prot & PROT_WRITE))
 	   || (!((cause & FAULT_WRITE) || (cause & FAULT_EXEC)) && !(flt_vmarea->vma_prot & PROT_READ))) {
 	   	dbg(DBG_PRINT, "(GRADING3D)\n");
+		krwlock_unlock(&curproc->p_vmmap->vmm_lock);
 		do_exit(EFAULT);
 	}
 
@@ -103,6 +109,7 @@ handle_pagefault(uintptr_t vaddr, uint32_t cause)
 	ret = pframe_lookup(curr_mmobj, pagenum, forwrite, &pf);
 	if(ret) {
 		dbg(DBG_PRINT, "(GRADING3D)\n");
+		krwlock_unlock(&curproc->p_vmmap->vmm_lock);
 		do_exit(EFAULT);
 	}
 
@@ -125,8 +132,16 @@ handle_pagefault(uintptr_t vaddr, uint32_t cause)
 	ret = pt_map(curproc->p_pagedir, (uintptr_t)PAGE_ALIGN_DOWN(vaddr), pt_virt_to_phys((uintptr_t)pf->pf_addr), pdflags, ptflags);
 	if(ret) {
 		dbg(DBG_PRINT, "(GRADING3D)\n");
+		krwlock_unlock(&curproc->p_vmmap->vmm_lock);
 		do_exit(EFAULT);
 	}
 
 	tlb_flush((uintptr_t)PAGE_ALIGN_DOWN(vaddr));
+	krwlock_unlock(&curproc->p_vmmap->vmm_lock);
+
+	if (curthr->kt_inblock != inblock) {
+		curthr->kt_majflt++;
+	} else {
+		curthr->kt_minflt++;
+	}
 }
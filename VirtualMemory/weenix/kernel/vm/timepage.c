@@ -0,0 +1,133 @@
+/******************************************************************************/
+/* Important Spring 2023 CSCI 402 usage information:                          */
+/*                                                                            */
+/* This fils is part of CSCI 402 kernel programming assignments at USC.       */
+/*         53616c7465645f5fd1e93dbf35cbffa3aef28f8c01d8cf2ffc51ef62b26a       */
+/*         f9bda5a68e5ed8c972b17bab0f42e24b19daa7bd408305b1f7bd6c7208c1       */
+/*         0e36230e913039b3046dd5fd0ba706a624d33dbaa4d6aab02c82fe09f561       */
+/*         01b0fd977b0051f0b0ce0c69f7db857b1b5e007be2db6d42894bf93de848       */
+/*         806d9152bd5715e9                                                   */
+/* Please understand that you are NOT permitted to distribute or publically   */
+/*         display a copy of this file (or ANY PART of it) for any reason.    */
+/* If anyone (including your prospective employer) asks you to post the code, */
+/*         you must inform them that you do NOT have permissions to do so.    */
+/* You are also NOT permitted to remove or alter this comment block.          */
+/* If this comment block is removed or altered in a submitted file, 20 points */
+/*         will be deducted.                                                  */
+/******************************************************************************/
+
+#include "globals.h"
+#include "errno.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/string.h"
+
+#include "mm/mm.h"
+#include "mm/mman.h"
+#include "mm/mmobj.h"
+#include "mm/pframe.h"
+
+#include "vm/vmmap.h"
+#include "vm/timepage.h"
+
+#include "api/time.h"
+
+/*
+ * The time page is the one page of a static object which is never freed:
+ * the kernel holds a reference to it and keeps its page pinned, so every
+ * process which maps it sees the same physical page.
+ */
+
+static void timepage_ref(mmobj_t *o);
+static void timepage_put(mmobj_t *o);
+static int  timepage_lookuppage(mmobj_t *o, uint32_t pagenum, int forwrite, pframe_t **pf);
+static int  timepage_fillpage(mmobj_t *o, pframe_t *pf);
+static int  timepage_dirtypage(mmobj_t *o, pframe_t *pf);
+static int  timepage_cleanpage(mmobj_t *o, pframe_t *pf);
+
+static mmobj_ops_t timepage_mmobj_ops = {
+        .ref = timepage_ref,
+        .put = timepage_put,
+        .lookuppage = timepage_lookuppage,
+        .fillpage  = timepage_fillpage,
+        .dirtypage = timepage_dirtypage,
+        .cleanpage = timepage_cleanpage
+};
+
+static mmobj_t timepage_obj;
+
+struct time_page *timepage = NULL;
+
+static __attribute__((unused)) void
+timepage_init(void)
+{
+        pframe_t *pf;
+
+        mmobj_init(&timepage_obj, &timepage_mmobj_ops);
+        timepage_obj.mmo_refcount = 1;
+
+        if (0 != pframe_get(&timepage_obj, 0, &pf)) {
+                panic("could not allocate the time page\n");
+        }
+        pframe_pin(pf);
+        timepage = pf->pf_addr;
+}
+init_func(timepage_init);
+
+int
+timepage_map(vmmap_t *map)
+{
+        uint32_t pn = ADDR_TO_PN(TIME_PAGE_ADDR);
+
+        if (!vmmap_is_range_empty(map, pn, 1)) {
+                return -EEXIST;
+        }
+        return vmmap_map_obj(map, &timepage_obj, pn, 1, PROT_READ, 0);
+}
+
+static void
+timepage_ref(mmobj_t *o)
+{
+        KASSERT(&timepage_obj == o && 0 < o->mmo_refcount);
+        o->mmo_refcount++;
+}
+
+static void
+timepage_put(mmobj_t *o)
+{
+        /* The kernel's own reference is never dropped */
+        KASSERT(&timepage_obj == o && 1 < o->mmo_refcount);
+        o->mmo_refcount--;
+}
+
+static int
+timepage_lookuppage(mmobj_t *o, uint32_t pagenum, int forwrite, pframe_t **pf)
+{
+        if (forwrite) {
+                return -EACCES;
+        }
+        if (0 != pagenum) {
+                return -EFAULT;
+        }
+        return pframe_get(o, pagenum, pf);
+}
+
+static int
+timepage_fillpage(mmobj_t *o, pframe_t *pf)
+{
+        memset(pf->pf_addr, 0, PAGE_SIZE);
+        return 0;
+}
+
+static int
+timepage_dirtypage(mmobj_t *o, pframe_t *pf)
+{
+        return -EACCES;
+}
+
+static int
+timepage_cleanpage(mmobj_t *o, pframe_t *pf)
+{
+        return 0;
+}
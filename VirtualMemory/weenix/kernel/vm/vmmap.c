@@ -133,6 +133,7 @@ vmmap_create(void)
 
 	list_init(&newmap->vmm_list);
 	newmap->vmm_proc = NULL;
+	krwlock_init(&newmap->vmm_lock);
 	
 	return newmap;
 }
@@ -496,6 +497,39 @@ vmmap_map(vmmap_t *map, vnode_t *file, uint32_t lopage, uint32_t npages,
         return 0;
 }
 
+/* Maps npages pages of an existing object, starting at its page off,
+ * into the empty range starting at lopage. The mapping is shared and
+ * takes a reference to obj, which must not be a shadow object. Returns
+ * 0 on success or -ENOMEM. */
+int
+vmmap_map_obj(vmmap_t *map, mmobj_t *obj, uint32_t lopage, uint32_t npages,
+              int prot, uint32_t off)
+{
+        vmarea_t *newvma;
+
+        KASSERT(NULL != map && NULL != obj && NULL == obj->mmo_shadowed);
+        KASSERT(ADDR_TO_PN(USER_MEM_LOW) <= lopage);
+        KASSERT(ADDR_TO_PN(USER_MEM_HIGH) >= lopage + npages);
+        KASSERT(vmmap_is_range_empty(map, lopage, npages));
+
+        if (NULL == (newvma = vmarea_alloc())) {
+                return -ENOMEM;
+        }
+        newvma->vma_start = lopage;
+        newvma->vma_end = lopage + npages;
+        newvma->vma_off = off;
+        newvma->vma_prot = prot;
+        newvma->vma_flags = MAP_SHARED;
+        list_link_init(&newvma->vma_plink);
+        list_link_init(&newvma->vma_olink);
+
+        obj->mmo_ops->ref(obj);
+        newvma->vma_obj = obj;
+        list_insert_head(mmobj_bottom_vmas(obj), &newvma->vma_olink);
+        vmmap_insert(map, newvma);
+        return 0;
+}
+
 /*
  * We have no guarantee that the region of the address space being
  * unmapped will play nicely with our list of vmareas.
@@ -623,6 +657,154 @@ vmmap_remove(vmmap_t *map, uint32_t lopage, uint32_t npages)
         return 0;
 }
 
+/*
+ * Makes the npages pages from pagenum of obj read as zeros (or as the
+ * file, for a file mapping), as they must when a mapping grows over
+ * them: an earlier munmap or shrink of the mapping leaves its pages
+ * behind in the shadow and anonymous objects under it. The objects are
+ * walked from the top of the chain; as long as nothing but the one
+ * reference from above reaches an object (no fork has shared it) its
+ * pages there are freed. Below that, and in the shared objects after a
+ * fork, a page there could belong to another process, so there must be
+ * none. The bottom object of a file mapping is the file itself, whose
+ * pages are never left over. Nothing is freed unless the whole range
+ * can be cleared.
+ *
+ * Returns 0 on success, -ENOMEM if the range can not be cleared.
+ */
+static int
+vmmap_clear_range(mmobj_t *obj, int anon, uint32_t pagenum, uint32_t npages)
+{
+	mmobj_t *o;
+	pframe_t *pf;
+	int exclusive = 1;
+
+	for(o = obj; NULL != o; o = o->mmo_shadowed) {
+		if(NULL == o->mmo_shadowed && !anon) {
+			break;
+		}
+		exclusive = exclusive && 1 == o->mmo_refcount - o->mmo_nrespages;
+		list_iterate_begin(&o->mmo_respages, pf, pframe_t, pf_olink) {
+			if(pf->pf_pagenum >= pagenum && pf->pf_pagenum < pagenum + npages
+			   && (!exclusive || pframe_is_pinned(pf) || pframe_is_busy(pf))) {
+				return -ENOMEM;
+			}
+		} list_iterate_end();
+	}
+
+	/* Freeing may block, which may change the list, so start it over
+	 * after each page */
+	for(o = obj; NULL != o && 1 == o->mmo_refcount - o->mmo_nrespages; o = o->mmo_shadowed) {
+again:
+		list_iterate_begin(&o->mmo_respages, pf, pframe_t, pf_olink) {
+			if(pf->pf_pagenum >= pagenum && pf->pf_pagenum < pagenum + npages) {
+				if(pframe_is_pinned(pf) || pframe_is_busy(pf)) {
+					return -ENOMEM;
+				}
+				pframe_free(pf);
+				goto again;
+			}
+		} list_iterate_end();
+	}
+	return 0;
+}
+
+/*
+ * Resize the mapping of the npages pages at lopage, which must all lie in
+ * one vmarea, to newnpages pages; to grow, they must also run to its
+ * end. The new starting vfn is stored in newlopage. Pages are never copied, and the mapping always stays one
+ * vmarea over the same mmobj:
+ *
+ * Shrinking just removes the tail of the range.
+ *
+ * Growing first clears whatever the objects under the vmarea still
+ * hold past its end (see vmmap_clear_range()), then extends the vmarea
+ * in place if the pages right after the range are free. Otherwise, if
+ * maymove is set, the range is moved to a free gap: a new vmarea of the
+ * new size takes over the same mmobj (and so all of its resident
+ * pframes) at the same offset, the present page table entries are moved
+ * over, and the old range is removed.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int
+vmmap_remap(vmmap_t *map, uint32_t lopage, uint32_t npages,
+            uint32_t newnpages, int maymove, uint32_t *newlopage)
+{
+	KASSERT(NULL != map && NULL != newlopage);
+	KASSERT(0 < npages && 0 < newnpages);
+
+	vmarea_t *vma = vmmap_lookup(map, lopage);
+	if(NULL == vma || lopage + npages > vma->vma_end) {
+		return -EFAULT;
+	}
+
+	*newlopage = lopage;
+	if(newnpages <= npages) {
+		if(newnpages < npages && 0 > vmmap_remove(map, lopage + newnpages, npages - newnpages)) {
+			return -ENOMEM;
+		}
+		return 0;
+	}
+
+	/* The pages the range would grow over in its objects are the ones
+	 * the rest of the vmarea maps */
+	uint32_t end = lopage + npages;
+	if(end != vma->vma_end) {
+		return -EINVAL;
+	}
+
+	uint32_t grow = newnpages - npages;
+	uint32_t off = vma->vma_off + (lopage - vma->vma_start);
+	int inplace = end + grow <= ADDR_TO_PN(USER_MEM_HIGH) && vmmap_is_range_empty(map, end, grow);
+	if(!inplace && !maymove) {
+		return -ENOMEM;
+	}
+	if(0 > vmmap_clear_range(vma->vma_obj, vma->vma_flags & MAP_ANON, off + npages, grow)) {
+		return -ENOMEM;
+	}
+
+	if(inplace) {
+		vma->vma_end += grow;
+		return 0;
+	}
+
+	int ret = vmmap_find_range(map, newnpages, VMMAP_DIR_HILO);
+	if(0 > ret) {
+		return -ENOMEM;
+	}
+	uint32_t start = ret;
+
+	vmarea_t *newvma = vmarea_alloc();
+	if(NULL == newvma) {
+		return -ENOMEM;
+	}
+	newvma->vma_start = start;
+	newvma->vma_end = start + newnpages;
+	newvma->vma_off = off;
+	newvma->vma_prot = vma->vma_prot;
+	newvma->vma_flags = vma->vma_flags;
+	newvma->vma_obj = vma->vma_obj;
+	newvma->vma_obj->mmo_ops->ref(newvma->vma_obj);
+	list_link_init(&newvma->vma_plink);
+	list_link_init(&newvma->vma_olink);
+	list_insert_tail(mmobj_bottom_vmas(newvma->vma_obj), &newvma->vma_olink);
+	vmmap_insert(map, newvma);
+
+	/* If a page table for the new range can not be had, the entries
+	 * moved so far are dropped with the new range: the pages are all
+	 * still in the mmobj, so the old range just faults them in again */
+	if(0 > pt_move_range(curproc->p_pagedir, (uintptr_t)PN_TO_ADDR(lopage),
+	                     (uintptr_t)PN_TO_ADDR(start), npages)
+	   || 0 > vmmap_remove(map, lopage, npages)) {
+		vmmap_remove(map, start, newnpages);
+		return -ENOMEM;
+	}
+
+	*newlopage = start;
+	return 0;
+}
+
 /*
  * Returns 1 if the given address space has no mappings for the
  * given range, 0 otherwise.
@@ -14,6 +14,7 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <stdio.h>
+#include <spawn.h>
 
 #define ROOT            "/"
 
@@ -784,6 +785,19 @@ static int do_cp(ioenv_t *io, const char *cmd,
         if (is_std_stream(out_fd))
                 out_fd = io->io_map_fd[out_fd];
 
+        /* Have the kernel move the data without it passing through here,
+         * unless it refuses to (copying a file onto itself) */
+        while ((nbytes_in = sendfile(out_fd, in_fd, NULL, 16 * buffer_sz)) > 0)
+                ;
+        if (nbytes_in < 0 && EINVAL != errno) {
+                fprintf(stderr,
+                        "%s: unable to copy %s to %s: %s\n",
+                        cmd, in_file, out_file, strerror(errno));
+                return 0;
+        } else if (nbytes_in == 0) {
+                return 1;
+        }
+
         while ((nbytes_in = read(in_fd, buffer, buffer_sz)) > 0) {
                 if ((nbytes_out = write(out_fd, buffer, nbytes_in)) < 0) {
                         fprintf(stderr,
@@ -1156,9 +1170,9 @@ DECL_CMD(parallel)
         return status;
 }
 
-static int do_redirect(redirect_map_t *map)
+static int do_redirect(redirect_map_t *map, posix_spawn_file_actions_t *fa)
 {
-        int             ii;
+        int             ii, err;
         int             newfd, oldfd;
 
         for (ii = 0; ii < map->rm_nfds; ii++) {
@@ -1167,12 +1181,11 @@ static int do_redirect(redirect_map_t *map)
 
                 dbg((stderr, "do_redirect: dup2(%d,%d)\n", oldfd, newfd));
 
-                if (dup2(oldfd, newfd) < 0) {
-                        fprintf(stderr, "do_redirect: dup2() failed: "
-                                "%s\n", strerror(errno));
+                if ((err = posix_spawn_file_actions_adddup2(fa, oldfd, newfd)) ||
+                    (err = posix_spawn_file_actions_addclose(fa, oldfd))) {
+                        fprintf(stderr, "do_redirect: %s\n", strerror(err));
                         return -1;
                 }
-                close(oldfd);
         }
         return 0;
 }
@@ -1231,27 +1244,35 @@ static int execute(int argc, char *argv[], redirect_map_t *map)
                 return 0;
         }
 
-        if (!(pid = fork())) {
-                if (do_redirect(map) < 0)
-                        exit(1);
+        /* Build the child straight from the binary, the redirections
+         * are done in the child by the kernel */
+        posix_spawn_file_actions_t fa;
+        int err;
 
-                execve(argv[0], argv, my_envp);
-                if (errno == ENOENT) {
-                        char buf[256];
-                        snprintf(buf, 255, "/usr/bin/%s", argv[0]);
-                        execve(buf, argv, my_envp);
+        posix_spawn_file_actions_init(&fa);
+        if (do_redirect(map, &fa) < 0) {
+                posix_spawn_file_actions_destroy(&fa);
+                cleanup_redirects(map);
+                return 1;
+        }
+
+        err = posix_spawn(&pid, argv[0], &fa, NULL, argv, my_envp);
+        if (err == ENOENT) {
+                char buf[256];
+                snprintf(buf, 255, "/usr/bin/%s", argv[0]);
+                err = posix_spawn(&pid, buf, &fa, NULL, argv, my_envp);
+                if (err == ENOENT)
                         fprintf(stderr, "sh: command not found: %s\n", argv[0]);
-                } else
-                        fprintf(stderr, "sh: exec failed for %s: %s\n",
-                                argv[0], strerror(errno));
-                exit(1);
-        } else {
-                if (0 > pid) {
-                        fprintf(stderr, "sh: fork failed errno = %d\n", errno);
-                }
         }
+        if (err && err != ENOENT)
+                fprintf(stderr, "sh: exec failed for %s: %s\n",
+                        argv[0], strerror(err));
+        posix_spawn_file_actions_destroy(&fa);
 
         cleanup_redirects(map);
+        if (err)
+                return 1;
+
         int ret = wait(&status);
         if (status == EFAULT) {
                 fprintf(stderr, "sh: child process accessed invalid memory\n");
@@ -0,0 +1 @@
+../../kernel/include/api/poll.h
\ No newline at end of file
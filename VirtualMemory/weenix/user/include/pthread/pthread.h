@@ -1,5 +1,10 @@
 #pragma once
 
+/* Threads are kernel threads (MTP=1 in Config.mk); without them
+ * pthread_create() fails with ENOSYS. Mutexes and condition variables
+ * only enter the kernel (with futex) when they have to wait or wake a
+ * waiter. */
+
 struct pthread;
 struct pthread_cond;
 struct pthread_mutex;
@@ -13,6 +18,12 @@ typedef int pthread_attr_t;
 typedef int pthread_mutexattr_t;
 typedef int pthread_condattr_t;
 
+/* The return value of a thread cancelled by pthread_cancel() */
+#define PTHREAD_CANCELED ((void *) -1)
+
+/* The size of each thread's stack */
+#define PTHREAD_STACK_SIZE (64 * 1024)
+
 void            pthread_cleanup_pop(int);
 void            pthread_cleanup_push(void (*)(void *), void *routine_arg);
 
@@ -33,8 +44,10 @@ int             pthread_mutex_init(pthread_mutex_t *mtx,
 int             pthread_mutex_lock(pthread_mutex_t *mtx);
 int             pthread_mutex_trylock(pthread_mutex_t *mtx);
 int             pthread_mutex_unlock(pthread_mutex_t *mtx);
+int             pthread_mutex_destroy(pthread_mutex_t *mtx);
 void            pthread_yield(void);
 int             pthread_cancel(pthread_t thr);
+pthread_t       pthread_self(void);
 
 /* Everything below NYI */
 #if 0
@@ -57,7 +70,6 @@ int             pthread_mutexattr_init(pthread_mutexattr_t *);
 int             pthread_mutexattr_destroy(pthread_mutexattr_t *);
 int             pthread_mutexattr_gettype(pthread_mutexattr_t *, int *);
 int             pthread_mutexattr_settype(pthread_mutexattr_t *, int);
-int             pthread_mutex_destroy(pthread_mutex_t *);
 int             pthread_attr_getstacksize(const pthread_attr_t *, size_t *);
 int             pthread_attr_getstackaddr(const pthread_attr_t *, void **);
 int             pthread_attr_getguardsize(const pthread_attr_t *, size_t *);
@@ -87,7 +99,6 @@ int             pthread_rwlockattr_getpshared(const pthread_rwlockattr_t *,
                 int *);
 int             pthread_rwlockattr_setpshared(pthread_rwlockattr_t *, int);
 int             pthread_rwlockattr_destroy(pthread_rwlockattr_t *);
-pthread_t       pthread_self(void);
 int             pthread_setspecific(pthread_key_t, const void *);
 int             pthread_sigmask(int, const sigset_t *, sigset_t *);
 
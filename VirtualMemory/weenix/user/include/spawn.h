@@ -0,0 +1,29 @@
+/*
+ *  spawn.h - posix_spawn(3), backed by the spawn system call
+ */
+#pragma once
+
+#include "sys/types.h"
+#include "weenix/syscall.h"
+
+typedef struct posix_spawn_file_actions {
+        int              fa_count;
+        int              fa_size;
+        spawn_action_t  *fa_actions;
+} posix_spawn_file_actions_t;
+
+/* No spawn attributes are supported; attrp must be NULL */
+typedef struct posix_spawnattr posix_spawnattr_t;
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *fa);
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *fa);
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *fa, int fd,
+                                     const char *path, int oflag, int mode);
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *fa, int fd);
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *fa, int fd,
+                                     int newfd);
+
+int posix_spawn(pid_t *pid, const char *path,
+                const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp,
+                char *const argv[], char *const envp[]);
@@ -0,0 +1 @@
+../../../kernel/include/api/resource.h
\ No newline at end of file
@@ -0,0 +1,23 @@
+/*
+ *  select.h - select(2), which libc implements with poll(2)
+ */
+#pragma once
+
+#include "sys/types.h"
+#include "string.h"
+#include "time.h"
+
+/* Higher descriptors can only be waited for with poll() */
+#define FD_SETSIZE      1024
+
+typedef struct fd_set {
+        uint32_t        fds_bits[FD_SETSIZE / 32];
+} fd_set;
+
+#define FD_ZERO(set)    memset((set), 0, sizeof(fd_set))
+#define FD_SET(fd, set) ((set)->fds_bits[(fd) / 32] |= 1U << ((fd) % 32))
+#define FD_CLR(fd, set) ((set)->fds_bits[(fd) / 32] &= ~(1U << ((fd) % 32)))
+#define FD_ISSET(fd, set) (0 != ((set)->fds_bits[(fd) / 32] & (1U << ((fd) % 32))))
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+           struct timeval *timeout);
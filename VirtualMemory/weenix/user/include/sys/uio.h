@@ -0,0 +1 @@
+../../../kernel/include/api/uio.h
\ No newline at end of file
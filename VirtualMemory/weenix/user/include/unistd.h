@@ -17,6 +17,7 @@ struct dirent;
 
 /* User exec-related */
 int     fork(void);
+int     vfork(void);
 int     execl(const char *filename, const char *arg, ...); /* NYI */
 int     execle(const char *filename, const char *arg, ...); /* NYI */
 int     execv(const char *filename, char *const argv[]); /* NYI */
@@ -30,7 +31,12 @@ void    thr_exit(int status);
 int     thr_errno(void);
 void    thr_set_errno(int n);
 void    yield(void);
+void    thr_yield(void);
+int     gettid(void);
+int     futex(int *addr, int op, int val);
+unsigned int sleep(unsigned int seconds);
 pid_t   getpid(void);
+int     nice(int incr);
 int     halt(void);
 void    sync(void);
 
@@ -42,6 +48,10 @@ int     close(int fd);
 int     read(int fd, void *buf, size_t nbytes);
 int     write(int fd, const void *buf, size_t nbytes);
 off_t   lseek(int fd, off_t offset, int whence);
+int     pread(int fd, void *buf, size_t nbytes, off_t offset);
+int     pwrite(int fd, const void *buf, size_t nbytes, off_t offset);
+int     splice(int in_fd, off_t *in_off, int out_fd, off_t *out_off, size_t count);
+int     sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
 int     dup(int fd);
 int     dup2(int ofd, int nfd);
 int     mkdir(const char *path, int mode);
@@ -57,6 +67,7 @@ int     pipe(int pipefd[2]);
 /* VM-related */
 void    *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off);
 int     munmap(void *addr, size_t len);
+void    *mremap(void *addr, size_t oldlen, size_t newlen, int flags);
 int     brk(void *addr);
 void    *sbrk(int incr);
 
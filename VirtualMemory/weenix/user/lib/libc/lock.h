@@ -0,0 +1,42 @@
+/*
+ *  lock.h - locks for libc's own data and pthread mutexes
+ *
+ *  A lock is 0 when free, 1 when held and 2 when held and there may be
+ *  threads sleeping on it, so the kernel is only entered (with futex) to
+ *  sleep on a lock which is taken and to wake a sleeper.
+ */
+#pragma once
+
+#include "unistd.h"
+#include "weenix/syscall.h"
+
+typedef volatile int libc_lock_t;
+
+#define LIBC_LOCK_INITIALIZER 0
+
+static inline void libc_lock(libc_lock_t *l)
+{
+        int c;
+
+        if (0 == (c = __sync_val_compare_and_swap(l, 0, 1)))
+                return;
+        if (2 != c)
+                c = __sync_lock_test_and_set(l, 2);
+        while (0 != c) {
+                futex((int *) l, FUTEX_WAIT, 2);
+                c = __sync_lock_test_and_set(l, 2);
+        }
+}
+
+static inline int libc_trylock(libc_lock_t *l)
+{
+        return 0 == __sync_val_compare_and_swap(l, 0, 1);
+}
+
+static inline void libc_unlock(libc_lock_t *l)
+{
+        if (1 != __sync_fetch_and_sub(l, 1)) {
+                __sync_lock_release(l);
+                futex((int *) l, FUTEX_WAKE, 1);
+        }
+}
@@ -101,6 +101,15 @@ struct pgfree {
         size_t              size;   /* number of bytes free */
 };
 
+/*
+ * This structure sits at the start of a huge allocation.
+ */
+
+struct pghuge {
+        size_t              size;   /* bytes mapped, including this header */
+        u_int               magic;  /* MALLOC_HUGE_MAGIC */
+};
+
 /*
  * How many bits per u_int in the bitmap.
  * Change only if not 8 bits/byte
@@ -116,6 +125,11 @@ struct pgfree {
 #define MALLOC_FOLLOW   ((struct pginfo*) 3)
 #define MALLOC_MAGIC    ((struct pginfo*) 4)
 
+/*
+ * Magic value at the start of a huge allocation
+ */
+#define MALLOC_HUGE_MAGIC       0x48756765
+
 #ifndef malloc_pageshift
 #define malloc_pageshift                12U
 #endif
@@ -136,12 +150,28 @@ struct pgfree {
 #define malloc_maxsize                  ((malloc_pagesize)>>1)
 #endif
 
+/*
+ * Allocations of at least this many bytes get their own anonymous
+ * mapping instead of pages from the brk heap, so that realloc() can
+ * resize them with mremap() rather than copying.  The pghuge header
+ * takes up the first malloc_minsize bytes of the mapping.
+ */
+#ifndef malloc_hugesize
+#define malloc_hugesize                 ((malloc_pagesize)<<6)
+#endif
+
 /* A mask for the offset inside a page.  */
 #define malloc_pagemask ((malloc_pagesize)-1)
 
 #define pageround(foo) (((foo) + (malloc_pagemask))&(~(malloc_pagemask)))
 #define ptr2index(foo) (((u_long)(foo) >> malloc_pageshift)-malloc_origo)
 
+/* Threads share the heap, see lock.h */
+#include "lock.h"
+static libc_lock_t malloc_lock = LIBC_LOCK_INITIALIZER;
+#define THREAD_LOCK()   libc_lock(&malloc_lock)
+#define THREAD_UNLOCK() libc_unlock(&malloc_lock)
+
 #ifndef THREAD_LOCK
 #define THREAD_LOCK()
 #endif
@@ -694,6 +724,90 @@ malloc_bytes(size_t size)
         return (u_char *)bp->page + k;
 }
 
+/*
+ * Allocate a huge chunk in its own mapping
+ */
+static void *
+malloc_huge(size_t size)
+{
+        struct pghuge *hp;
+        size_t len;
+
+        len = pageround(size + malloc_minsize);
+        if (len < size)                             /* Check for overflow */
+                return 0;
+
+        hp = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (hp == MAP_FAILED)
+                return 0;
+
+        hp->size = len;
+        hp->magic = MALLOC_HUGE_MAGIC;
+
+        if (malloc_junk)
+                memset((u_char *)hp + malloc_minsize, SOME_JUNK, size);
+
+        return (u_char *)hp + malloc_minsize;
+}
+
+/*
+ * Find the header of a huge chunk, or return 0 if ptr isn't one.
+ * Huge chunks are mapped above the brk heap.
+ */
+static struct pghuge *
+huge_header(void *ptr)
+{
+        struct pghuge *hp;
+
+        if ((void *)ptr < malloc_brk)
+                return 0;
+
+        if (((u_long)ptr & malloc_pagemask) != malloc_minsize)
+                return 0;
+
+        hp = (struct pghuge *)((u_char *)ptr - malloc_minsize);
+        if (hp->magic != MALLOC_HUGE_MAGIC)
+                return 0;
+
+        return hp;
+}
+
+/*
+ * Resize a huge chunk, letting the kernel move its pages if it can't
+ * grow it where it is.
+ */
+static void *
+realloc_huge(struct pghuge *hp, size_t size)
+{
+        struct pghuge *nhp;
+        void *p;
+        size_t len;
+
+        len = pageround(size + malloc_minsize);
+        if (len < size)                             /* Check for overflow */
+                return 0;
+
+        if (len != hp->size) {
+                nhp = mremap(hp, hp->size, len, MREMAP_MAYMOVE);
+                if (nhp == MAP_FAILED) {
+                        /*
+                         * The kernel won't grow a mapping over pages it
+                         * still shares with a child since fork(), so
+                         * copy it instead.
+                         */
+                        if (len < hp->size || (p = malloc_huge(size)) == 0)
+                                return 0;
+                        memcpy(p, (u_char *)hp + malloc_minsize, hp->size - malloc_minsize);
+                        munmap(hp, hp->size);
+                        return p;
+                }
+                hp = nhp;
+                hp->size = len;
+        }
+
+        return (u_char *)hp + malloc_minsize;
+}
+
 /*
  * Allocate a piece of memory
  */
@@ -709,8 +823,10 @@ imalloc(size_t size)
                 result = 0;
         else if (size <= malloc_maxsize)
                 result =  malloc_bytes(size);
-        else
+        else if (size < malloc_hugesize)
                 result =  malloc_pages(size);
+        else
+                result =  malloc_huge(size);
 
         if (malloc_abort && !result)
                 wrterror("allocation failed.\n");
@@ -730,11 +846,25 @@ irealloc(void *ptr, size_t size)
         void *p;
         u_long osize, index;
         struct pginfo **mp;
+        struct pghuge *hp;
         int i;
 
         if (suicide)
                 abort();
 
+        if ((hp = huge_header(ptr)) != 0) {         /* Huge allocation */
+                if (size >= malloc_hugesize)
+                        return realloc_huge(hp, size);
+
+                /* It got small, move it back onto the heap */
+                p = imalloc(size);
+                if (p) {
+                        memcpy(p, ptr, size);
+                        ifree(ptr);
+                }
+                return p;
+        }
+
         index = ptr2index(ptr);
 
         if (index < malloc_pageshift) {
@@ -1015,6 +1145,7 @@ static void
 ifree(void *ptr)
 {
         struct pginfo *info;
+        struct pghuge *hp;
         unsigned int index;
 
         /* This is legal */
@@ -1030,6 +1161,12 @@ ifree(void *ptr)
         if (suicide)
                 return;
 
+        if ((hp = huge_header(ptr)) != 0) {
+                hp->magic = 0;
+                munmap(hp, hp->size);
+                return;
+        }
+
         index = ptr2index(ptr);
 
         if (index < malloc_pageshift) {
@@ -1066,6 +1203,7 @@ malloc(size_t size)
         if (malloc_active++) {
                 wrtwarning("recursive call.\n");
                 malloc_active--;
+                THREAD_UNLOCK();
                 return (0);
         }
         if (!malloc_started) {
@@ -1091,6 +1229,7 @@ free(void *ptr)
         if (malloc_active++) {
                 wrtwarning("recursive call.\n");
                 malloc_active--;
+                THREAD_UNLOCK();
                 return;
         } else {
                 ifree(ptr);
@@ -1111,6 +1250,7 @@ realloc(void *ptr, size_t size)
         if (malloc_active++) {
                 wrtwarning("recursive call.\n");
                 malloc_active--;
+                THREAD_UNLOCK();
                 return (0);
         }
         if (ptr && !malloc_started) {
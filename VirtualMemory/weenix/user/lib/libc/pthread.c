@@ -0,0 +1,313 @@
+#include "sys/types.h"
+#include "sys/mman.h"
+#include "errno.h"
+#include "stdlib.h"
+#include "unistd.h"
+
+#include "pthread/pthread.h"
+#include "weenix/trap.h"
+
+#include "lock.h"
+
+struct pthread_cleanup {
+        void                  (*pc_routine)(void *);
+        void                   *pc_arg;
+        struct pthread_cleanup *pc_next;
+};
+
+struct pthread {
+        int                     pt_tid;
+        void                 *(*pt_func)(void *);
+        void                   *pt_arg;
+        void                   *pt_stack;
+        int                     pt_detached;
+        volatile int            pt_dead;        /* done with its stack */
+        struct pthread_cleanup *pt_cleanup;
+        struct pthread         *pt_next;        /* on pthread_list */
+};
+
+struct pthread_mutex {
+        libc_lock_t             pm_lock;
+};
+
+struct pthread_cond {
+        volatile int            pc_seq;         /* bumped by every signal */
+        volatile int            pc_nwaiters;
+};
+
+/* The threads made by pthread_create() which have not been joined */
+static libc_lock_t pthread_list_lock = LIBC_LOCK_INITIALIZER;
+static struct pthread *pthread_list;
+
+/* Stands for the thread the process started with */
+static struct pthread pthread_main;
+
+/* Unmaps the stacks of detached threads which have exited. Called with
+ * pthread_list_lock held. */
+static void pthread_reap(void)
+{
+        struct pthread **pp = &pthread_list, *t;
+
+        while (NULL != (t = *pp)) {
+                if (t->pt_detached && t->pt_dead) {
+                        *pp = t->pt_next;
+                        munmap(t->pt_stack, PTHREAD_STACK_SIZE);
+                        free(t);
+                } else {
+                        pp = &t->pt_next;
+                }
+        }
+}
+
+/* Where new threads start, see pthread_create() */
+static void pthread_start(struct pthread *self)
+{
+        pthread_exit(self->pt_func(self->pt_arg));
+}
+
+int pthread_create(pthread_t *thr, const pthread_attr_t *attr,
+                   void *(*func)(void *), void *arg)
+{
+        thr_create_args_t args;
+        struct pthread *t;
+        uint32_t *sp;
+        int tid, err;
+
+        libc_lock(&pthread_list_lock);
+        pthread_reap();
+        libc_unlock(&pthread_list_lock);
+
+        if (NULL == (t = malloc(sizeof(*t))))
+                return EAGAIN;
+        t->pt_stack = mmap(NULL, PTHREAD_STACK_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (MAP_FAILED == t->pt_stack) {
+                free(t);
+                return EAGAIN;
+        }
+        t->pt_func = func;
+        t->pt_arg = arg;
+        t->pt_detached = 0;
+        t->pt_dead = 0;
+        t->pt_cleanup = NULL;
+
+        /* The new thread "calls" pthread_start(t), from nowhere */
+        sp = (uint32_t *)((char *) t->pt_stack + PTHREAD_STACK_SIZE);
+        *--sp = (uint32_t) t;
+        *--sp = 0;
+        args.tca_eip = (void *) pthread_start;
+        args.tca_esp = sp;
+
+        /* Held until t is on the list, in case the thread looks for
+         * itself with pthread_self() */
+        libc_lock(&pthread_list_lock);
+        if (0 > (tid = trap(SYS_thr_create, (uint32_t) &args))) {
+                err = errno;
+                libc_unlock(&pthread_list_lock);
+                munmap(t->pt_stack, PTHREAD_STACK_SIZE);
+                free(t);
+                return err;
+        }
+        t->pt_tid = tid;
+        t->pt_next = pthread_list;
+        pthread_list = t;
+        libc_unlock(&pthread_list_lock);
+
+        *thr = t;
+        return 0;
+}
+
+pthread_t pthread_self(void)
+{
+        struct pthread *t;
+        int tid = gettid();
+
+        libc_lock(&pthread_list_lock);
+        for (t = pthread_list; NULL != t; t = t->pt_next) {
+                if (t->pt_tid == tid)
+                        break;
+        }
+        libc_unlock(&pthread_list_lock);
+
+        if (NULL == t) {
+                t = &pthread_main;
+                t->pt_tid = tid;
+        }
+        return t;
+}
+
+int pthread_equal(pthread_t t1, pthread_t t2)
+{
+        return t1 == t2;
+}
+
+void pthread_exit(void *retval)
+{
+        pthread_t self = pthread_self();
+
+        while (NULL != self->pt_cleanup)
+                pthread_cleanup_pop(1);
+
+        /* Once pt_dead is set a detached thread's stack may be unmapped
+         * by pthread_create(), so nothing may go on it from then on */
+        __asm__ volatile(
+                "movl $1, %0\n\t"
+                "int $" TRAP_INTR_STRING
+                : "=m"(self->pt_dead)
+                : "a"(SYS_thr_exit), "d"(retval)
+                : "memory"
+        );
+        for (;;)
+                ;
+}
+
+int pthread_join(pthread_t thr, void **retval)
+{
+        thr_join_args_t args;
+        struct pthread **pp;
+
+        args.tja_tid = thr->pt_tid;
+        args.tja_retval = retval;
+        if (0 > trap(SYS_thr_join, (uint32_t) &args))
+                return errno;
+
+        if (&pthread_main != thr) {
+                libc_lock(&pthread_list_lock);
+                for (pp = &pthread_list; *pp != thr; pp = &(*pp)->pt_next)
+                        ;
+                *pp = thr->pt_next;
+                libc_unlock(&pthread_list_lock);
+
+                munmap(thr->pt_stack, PTHREAD_STACK_SIZE);
+                free(thr);
+        }
+        return 0;
+}
+
+int pthread_detach(pthread_t thr)
+{
+        if (0 > trap(SYS_thr_detach, (uint32_t) thr->pt_tid))
+                return errno;
+        thr->pt_detached = 1;
+        return 0;
+}
+
+int pthread_cancel(pthread_t thr)
+{
+        if (0 > trap(SYS_thr_cancel, (uint32_t) thr->pt_tid))
+                return errno;
+        return 0;
+}
+
+void pthread_yield(void)
+{
+        thr_yield();
+}
+
+void pthread_cleanup_push(void (*routine)(void *), void *arg)
+{
+        pthread_t self = pthread_self();
+        struct pthread_cleanup *c;
+
+        if (NULL == (c = malloc(sizeof(*c))))
+                return;
+        c->pc_routine = routine;
+        c->pc_arg = arg;
+        c->pc_next = self->pt_cleanup;
+        self->pt_cleanup = c;
+}
+
+void pthread_cleanup_pop(int execute)
+{
+        pthread_t self = pthread_self();
+        struct pthread_cleanup *c = self->pt_cleanup;
+
+        if (NULL == c)
+                return;
+        self->pt_cleanup = c->pc_next;
+        if (execute)
+                c->pc_routine(c->pc_arg);
+        free(c);
+}
+
+int pthread_mutex_init(pthread_mutex_t *mtx, const pthread_mutexattr_t *attr)
+{
+        if (NULL == (*mtx = malloc(sizeof(**mtx))))
+                return ENOMEM;
+        (*mtx)->pm_lock = LIBC_LOCK_INITIALIZER;
+        return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mtx)
+{
+        free(*mtx);
+        *mtx = NULL;
+        return 0;
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mtx)
+{
+        libc_lock(&(*mtx)->pm_lock);
+        return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mtx)
+{
+        return libc_trylock(&(*mtx)->pm_lock) ? 0 : EBUSY;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mtx)
+{
+        libc_unlock(&(*mtx)->pm_lock);
+        return 0;
+}
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr)
+{
+        if (NULL == (*cond = malloc(sizeof(**cond))))
+                return ENOMEM;
+        (*cond)->pc_seq = 0;
+        (*cond)->pc_nwaiters = 0;
+        return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond)
+{
+        free(*cond);
+        *cond = NULL;
+        return 0;
+}
+
+/* A signal between reading pc_seq and sleeping changes it, so the
+ * futex wait returns straight away rather than miss it */
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mtx)
+{
+        struct pthread_cond *c = *cond;
+        int seq = c->pc_seq;
+
+        __sync_fetch_and_add(&c->pc_nwaiters, 1);
+        pthread_mutex_unlock(mtx);
+        futex((int *) &c->pc_seq, FUTEX_WAIT, seq);
+        __sync_fetch_and_sub(&c->pc_nwaiters, 1);
+        pthread_mutex_lock(mtx);
+        return 0;
+}
+
+static void pthread_cond_wake(struct pthread_cond *c, int n)
+{
+        __sync_fetch_and_add(&c->pc_seq, 1);
+        if (0 != c->pc_nwaiters)
+                futex((int *) &c->pc_seq, FUTEX_WAKE, n);
+}
+
+int pthread_cond_signal(pthread_cond_t *cond)
+{
+        pthread_cond_wake(*cond, 1);
+        return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond)
+{
+        pthread_cond_wake(*cond, 0x7fffffff);
+        return 0;
+}
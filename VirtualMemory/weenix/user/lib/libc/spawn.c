@@ -0,0 +1,161 @@
+#include "sys/types.h"
+#include "errno.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "spawn.h"
+#include "weenix/trap.h"
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *fa)
+{
+        fa->fa_count = 0;
+        fa->fa_size = 0;
+        fa->fa_actions = NULL;
+        return 0;
+}
+
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *fa)
+{
+        int i;
+
+        for (i = 0; i < fa->fa_count; i++) {
+                if (SPAWN_FA_OPEN == fa->fa_actions[i].sa_type)
+                        free((char *) fa->fa_actions[i].sa_path.as_str);
+        }
+        free(fa->fa_actions);
+        return posix_spawn_file_actions_init(fa);
+}
+
+static spawn_action_t *add_action(posix_spawn_file_actions_t *fa, int type)
+{
+        spawn_action_t *sa;
+
+        if (fa->fa_count >= SPAWN_MAX_ACTIONS)
+                return NULL;
+        if (fa->fa_count == fa->fa_size) {
+                int size = fa->fa_size ? fa->fa_size * 2 : 4;
+                if (NULL == (sa = realloc(fa->fa_actions, size * sizeof(spawn_action_t))))
+                        return NULL;
+                fa->fa_actions = sa;
+                fa->fa_size = size;
+        }
+
+        sa = &fa->fa_actions[fa->fa_count++];
+        memset(sa, 0, sizeof(*sa));
+        sa->sa_type = type;
+        return sa;
+}
+
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *fa, int fd,
+                                     const char *path, int oflag, int mode)
+{
+        spawn_action_t *sa;
+        char *copy;
+
+        if (fd < 0)
+                return EBADF;
+        if (NULL == (copy = malloc(strlen(path) + 1)))
+                return ENOMEM;
+        strcpy(copy, path);
+        if (NULL == (sa = add_action(fa, SPAWN_FA_OPEN))) {
+                free(copy);
+                return ENOMEM;
+        }
+
+        sa->sa_fd = fd;
+        sa->sa_flags = oflag;
+        sa->sa_path.as_str = copy;
+        sa->sa_path.as_len = strlen(copy);
+        return 0;
+}
+
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *fa, int fd)
+{
+        spawn_action_t *sa;
+
+        if (fd < 0)
+                return EBADF;
+        if (NULL == (sa = add_action(fa, SPAWN_FA_CLOSE)))
+                return ENOMEM;
+
+        sa->sa_fd = fd;
+        return 0;
+}
+
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *fa, int fd,
+                                     int newfd)
+{
+        spawn_action_t *sa;
+
+        if (fd < 0 || newfd < 0)
+                return EBADF;
+        if (NULL == (sa = add_action(fa, SPAWN_FA_DUP2)))
+                return ENOMEM;
+
+        sa->sa_fd = fd;
+        sa->sa_newfd = newfd;
+        return 0;
+}
+
+/* Builds the argvec for a NULL terminated vector, which may itself be
+ * NULL. The caller frees av_vec. */
+static int build_argvec(argvec_t *vec, char *const strs[])
+{
+        size_t i, n = 0;
+
+        if (NULL != strs) {
+                while (NULL != strs[n])
+                        n++;
+        }
+        if (NULL == (vec->av_vec = malloc((n + 1) * sizeof(argstr_t))))
+                return ENOMEM;
+        vec->av_len = n;
+        for (i = 0; i < n; i++) {
+                vec->av_vec[i].as_len = strlen(strs[i]);
+                vec->av_vec[i].as_str = strs[i];
+        }
+        vec->av_vec[n].as_len = 0;
+        vec->av_vec[n].as_str = NULL;
+        return 0;
+}
+
+int posix_spawn(pid_t *pid, const char *path,
+                const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp,
+                char *const argv[], char *const envp[])
+{
+        spawn_args_t args;
+        int ret;
+
+        if (NULL != attrp)
+                return EINVAL;
+
+        args.filename.as_len = strlen(path);
+        args.filename.as_str = path;
+        args.envp.av_vec = NULL;
+        if (0 != (ret = build_argvec(&args.argv, argv)))
+                return ret;
+        if (0 != (ret = build_argvec(&args.envp, envp)))
+                goto done;
+
+        if (NULL != file_actions) {
+                args.actions = file_actions->fa_actions;
+                args.nactions = file_actions->fa_count;
+        } else {
+                args.actions = NULL;
+                args.nactions = 0;
+        }
+
+        if (0 > (ret = trap(SYS_spawn, (uint32_t) &args))) {
+                ret = errno;
+        } else {
+                if (NULL != pid)
+                        *pid = ret;
+                ret = 0;
+        }
+
+done:
+        free(args.argv.av_vec);
+        free(args.envp.av_vec);
+        return ret;
+}
@@ -1,6 +1,7 @@
 #include "sys/types.h"
 #include "stdarg.h"
 
+#include "errno.h"
 #include "string.h"
 #include "stdlib.h"
 
@@ -8,6 +9,11 @@
 #include "weenix/trap.h"
 
 #include "dirent.h"
+#include "time.h"
+#include "sys/resource.h"
+#include "sys/uio.h"
+#include "sys/select.h"
+#include "poll.h"
 
 static void *__curbrk = NULL;
 #define MAX_EXIT_HANDLERS 32
@@ -61,6 +67,33 @@ int fork(void)
         return trap(SYS_fork, 0);
 }
 
+/* vfork() can't be an ordinary function: the child runs on our stack
+ * and will have reused this function's frame by the time the parent
+ * returns from the trap. So the return address is kept in %ecx, which
+ * the kernel hands back unchanged to both processes, and is only pushed
+ * back once the trap has returned, to tail-call vfork_errno(). */
+static int __attribute__((used, noinline, regparm(1))) vfork_errno(int ret)
+{
+        /* Copy in errno, as trap() does */
+        __asm__ volatile(
+                "int $" TRAP_INTR_STRING
+                : "=a"(errno)
+                : "a"(SYS_errno)
+        );
+        return ret;
+}
+
+__asm__(
+        ".globl vfork\n"
+        ".type vfork, @function\n"
+        "vfork:\n\t"
+        "popl %ecx\n\t"
+        "movl $" QUOTE(SYS_vfork) ", %eax\n\t"
+        "int $" TRAP_INTR_STRING "\n\t"
+        "pushl %ecx\n\t"
+        "jmp vfork_errno\n"
+);
+
 int atexit(void (*func)(void))
 {
         if (atexit_handlers < MAX_EXIT_HANDLERS) {
@@ -130,6 +163,106 @@ pid_t getpid(void)
         return trap(SYS_getpid, 0);
 }
 
+int gettid(void)
+{
+        return trap(SYS_gettid, 0);
+}
+
+/* op is FUTEX_WAIT or FUTEX_WAKE, from weenix/syscall.h */
+int futex(int *addr, int op, int val)
+{
+        futex_args_t args;
+
+        args.fa_addr = addr;
+        args.fa_op = op;
+        args.fa_val = val;
+        return trap(SYS_futex, (uint32_t) &args);
+}
+
+/* Unlike yield(), just gives up the processor */
+void thr_yield(void)
+{
+        trap(SYS_thr_yield, 0);
+}
+
+/* Adds incr to the calling thread's nice value and returns the new value.
+ * Lower values are scheduled first; the kernel clamps the result. */
+int nice(int incr)
+{
+        return trap(SYS_nice, (uint32_t) incr);
+}
+
+unsigned int sleep(unsigned int seconds)
+{
+        return trap(SYS_sleep, seconds);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem)
+{
+        nanosleep_args_t args;
+
+        args.nsa_req = req;
+        args.nsa_rem = rem;
+
+        return trap(SYS_nanosleep, (uint32_t) &args);
+}
+
+/* The kernel's time page, see time.h */
+static const volatile struct time_page *time_page =
+        (const volatile struct time_page *) TIME_PAGE_ADDR;
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+int clock_gettime(clockid_t clock, struct timespec *tp)
+{
+        clock_gettime_args_t args;
+        uint64_t ns;
+
+        /* Read the clock ourselves if we can */
+        if (0 != time_page->tp_mult
+            && (CLOCK_MONOTONIC == clock || CLOCK_REALTIME == clock)) {
+                ns = time_page_ns(time_page, rdtsc());
+                tp->tv_sec = ns / 1000000000;
+                tp->tv_nsec = ns % 1000000000;
+                if (CLOCK_REALTIME == clock)
+                        tp->tv_sec += time_page->tp_boot_sec;
+                return 0;
+        }
+
+        args.cga_clock = clock;
+        args.cga_tp = tp;
+
+        return trap(SYS_clock_gettime, (uint32_t) &args);
+}
+
+int gettimeofday(struct timeval *tv, void *tz)
+{
+        struct timespec ts;
+
+        if (0 != time_page->tp_mult) {
+                clock_gettime(CLOCK_REALTIME, &ts);
+                tv->tv_sec = ts.tv_sec;
+                tv->tv_usec = ts.tv_nsec / 1000;
+                return 0;
+        }
+        return trap(SYS_gettimeofday, (uint32_t) tv);
+}
+
+int getrusage(int who, struct rusage *usage)
+{
+        getrusage_args_t args;
+
+        args.gra_who = who;
+        args.gra_usage = usage;
+
+        return trap(SYS_getrusage, (uint32_t) &args);
+}
+
 int halt(void)
 {
         return trap(SYS_halt, 0);
@@ -159,6 +292,18 @@ int munmap(void *addr, size_t len)
         return trap(SYS_munmap, (uint32_t) &args);
 }
 
+void *mremap(void *addr, size_t oldlen, size_t newlen, int flags)
+{
+        mremap_args_t args;
+
+        args.mra_addr = addr;
+        args.mra_oldlen = oldlen;
+        args.mra_newlen = newlen;
+        args.mra_flags = flags;
+
+        return (void *) trap(SYS_mremap, (uint32_t) &args);
+}
+
 void sync(void)
 {
         trap(SYS_sync, 0);
@@ -211,6 +356,150 @@ int write(int fd, const void *buf, size_t nbytes)
         return trap(SYS_write, (uint32_t) &args);
 }
 
+int readv(int fd, const struct iovec *iov, int iovcnt)
+{
+        rwv_args_t args;
+
+        args.rwv_fd = fd;
+        args.rwv_iov = iov;
+        args.rwv_iovcnt = iovcnt;
+
+        return trap(SYS_readv, (uint32_t) &args);
+}
+
+int writev(int fd, const struct iovec *iov, int iovcnt)
+{
+        rwv_args_t args;
+
+        args.rwv_fd = fd;
+        args.rwv_iov = iov;
+        args.rwv_iovcnt = iovcnt;
+
+        return trap(SYS_writev, (uint32_t) &args);
+}
+
+int pread(int fd, void *buf, size_t nbytes, off_t offset)
+{
+        prw_args_t args;
+
+        args.prw_fd = fd;
+        args.prw_buf = buf;
+        args.prw_nbytes = nbytes;
+        args.prw_offset = offset;
+
+        return trap(SYS_pread, (uint32_t) &args);
+}
+
+int pwrite(int fd, const void *buf, size_t nbytes, off_t offset)
+{
+        prw_args_t args;
+
+        args.prw_fd = fd;
+        args.prw_buf = (void *) buf;
+        args.prw_nbytes = nbytes;
+        args.prw_offset = offset;
+
+        return trap(SYS_pwrite, (uint32_t) &args);
+}
+
+int splice(int in_fd, off_t *in_off, int out_fd, off_t *out_off, size_t count)
+{
+        splice_args_t args;
+
+        args.spa_in = in_fd;
+        args.spa_in_off = in_off;
+        args.spa_out = out_fd;
+        args.spa_out_off = out_off;
+        args.spa_count = count;
+
+        return trap(SYS_splice, (uint32_t) &args);
+}
+
+int sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+        return splice(in_fd, offset, out_fd, NULL, count);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+        poll_args_t args;
+
+        args.pa_fds = fds;
+        args.pa_nfds = nfds;
+        args.pa_timeout = timeout;
+
+        return trap(SYS_poll, (uint32_t) &args);
+}
+
+/* Asks poll() about each descriptor in any of the sets, then sets in
+ * them just those which are ready */
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+           struct timeval *timeout)
+{
+        struct pollfd *fds;
+        int fd, n = 0, ready = 0, ms = -1;
+
+        if (0 > nfds || FD_SETSIZE < nfds) {
+                errno = EINVAL;
+                return -1;
+        }
+        if (NULL == (fds = malloc(nfds * sizeof(*fds) + 1))) {
+                errno = ENOMEM;
+                return -1;
+        }
+        for (fd = 0; fd < nfds; fd++) {
+                fds[n].fd = fd;
+                fds[n].events = 0;
+                if (NULL != readfds && FD_ISSET(fd, readfds))
+                        fds[n].events |= POLLIN;
+                if (NULL != writefds && FD_ISSET(fd, writefds))
+                        fds[n].events |= POLLOUT;
+                if (NULL != exceptfds && FD_ISSET(fd, exceptfds))
+                        fds[n].events |= POLLPRI;
+                if (0 != fds[n].events)
+                        n++;
+        }
+        if (NULL != timeout)
+                ms = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+
+        if (0 > poll(fds, n, ms)) {
+                free(fds);
+                return -1;
+        }
+
+        if (NULL != readfds)
+                FD_ZERO(readfds);
+        if (NULL != writefds)
+                FD_ZERO(writefds);
+        if (NULL != exceptfds)
+                FD_ZERO(exceptfds);
+        for (fd = 0; fd < n; fd++) {
+                if (POLLNVAL & fds[fd].revents) {
+                        free(fds);
+                        errno = EBADF;
+                        return -1;
+                }
+                /* A hung up or broken descriptor is "ready", in that
+                 * using it will not block */
+                if (NULL != readfds && (fds[fd].events & POLLIN)
+                    && (fds[fd].revents & (POLLIN | POLLHUP | POLLERR))) {
+                        FD_SET(fds[fd].fd, readfds);
+                        ready++;
+                }
+                if (NULL != writefds && (fds[fd].events & POLLOUT)
+                    && (fds[fd].revents & (POLLOUT | POLLERR))) {
+                        FD_SET(fds[fd].fd, writefds);
+                        ready++;
+                }
+                if (NULL != exceptfds && (fds[fd].revents & POLLPRI)) {
+                        FD_SET(fds[fd].fd, exceptfds);
+                        ready++;
+                }
+        }
+        free(fds);
+        return ready;
+}
+
 int close(int fd)
 {
         return trap(SYS_close, (uint32_t) fd);
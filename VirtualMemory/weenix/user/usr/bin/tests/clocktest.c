@@ -0,0 +1,96 @@
+/*
+ * Checks clock_gettime and gettimeofday. clock_gettime normally reads the
+ * kernel's time page without a system call; this compares it against the
+ * system call itself, both for cost and for agreement, and checks that
+ * CLOCK_MONOTONIC never goes backwards.
+ *
+ * usage: clocktest [iterations]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "weenix/syscall.h"
+#include "weenix/trap.h"
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+static int sys_clock_gettime(clockid_t clock, struct timespec *tp)
+{
+        clock_gettime_args_t args;
+
+        args.cga_clock = clock;
+        args.cga_tp = tp;
+        return trap(SYS_clock_gettime, (uint32_t) &args);
+}
+
+static uint64_t ns(const struct timespec *ts)
+{
+        return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+        struct timespec a, b;
+        struct timeval tv;
+        uint64_t start, fast, slow;
+        int i, iters = 10000, failed = 0;
+
+        if (argc > 1)
+                iters = atoi(argv[1]);
+        if (iters <= 0) {
+                fprintf(stderr, "usage: clocktest [iterations]\n");
+                return 1;
+        }
+
+        if (0 != clock_gettime(CLOCK_MONOTONIC, &a)
+            || 0 != gettimeofday(&tv, NULL)) {
+                fprintf(stderr, "clocktest: reading the clock: %s\n", strerror(errno));
+                return 1;
+        }
+        printf("up %d.%09ld s, wall clock %d.%06ld s\n",
+               a.tv_sec, a.tv_nsec, tv.tv_sec, tv.tv_usec);
+
+        if (0 == sys_clock_gettime(-1, &a) || EINVAL != errno) {
+                fprintf(stderr, "clocktest: unknown clock was accepted\n");
+                failed = 1;
+        }
+
+        start = rdtsc();
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        for (i = 0; i < iters; i++) {
+                clock_gettime(CLOCK_MONOTONIC, &b);
+                if (ns(&b) < ns(&a)) {
+                        fprintf(stderr, "clocktest: clock went backwards\n");
+                        failed = 1;
+                }
+                a = b;
+        }
+        fast = rdtsc() - start;
+
+        start = rdtsc();
+        for (i = 0; i < iters; i++)
+                sys_clock_gettime(CLOCK_MONOTONIC, &b);
+        slow = rdtsc() - start;
+
+        /* The time page and the kernel should agree to within a call */
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        sys_clock_gettime(CLOCK_MONOTONIC, &b);
+        if (ns(&b) < ns(&a)) {
+                fprintf(stderr, "clocktest: system call is behind the time page\n");
+                failed = 1;
+        }
+
+        printf("clock_gettime: %u cycles, system call: %u cycles\n",
+               (unsigned)(fast / iters), (unsigned)(slow / iters));
+        return failed;
+}
@@ -0,0 +1,129 @@
+/*
+ * Fills a directory with thousands of entries (hard links to one file,
+ * so that no inodes are used up) and times listing it with getdents()
+ * asking for one entry per call, which is what every call used to
+ * amount to in the kernel, and asking for as many as fit in a page, as
+ * ls does. Checks that both see every entry once.
+ *
+ * usage: direntbench [entries [rounds]]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#define TESTDIR "/direntbench"
+#define TESTFILE "/direntbench.file"
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+static union {
+        struct dirent   dirent;
+        char            buf[4096];
+} dbuf;
+
+/* Lists TESTDIR with getdents() calls of bufsize bytes, returning the number
+ * of entries seen (not counting . and ..) and the number of calls */
+static int list(size_t bufsize, int *calls, int *sum)
+{
+        struct dirent *d;
+        int fd, nbytes, n = 0;
+
+        *calls = 0;
+        *sum = 0;
+        if (0 > (fd = open(TESTDIR, O_RDONLY, 0)))
+                return -1;
+        while ((nbytes = getdents(fd, &dbuf.dirent, bufsize)) > 0) {
+                (*calls)++;
+                for (d = &dbuf.dirent; nbytes > 0; d++, nbytes -= sizeof(*d)) {
+                        if (0 == strcmp(d->d_name, ".") || 0 == strcmp(d->d_name, ".."))
+                                continue;
+                        *sum += atoi(d->d_name);
+                        n++;
+                }
+        }
+        close(fd);
+        return nbytes < 0 ? -1 : n;
+}
+
+static void cleanup(int n)
+{
+        char name[64];
+        int i;
+
+        for (i = 0; i < n; i++) {
+                snprintf(name, sizeof(name), TESTDIR "/%d", i);
+                unlink(name);
+        }
+        rmdir(TESTDIR);
+        unlink(TESTFILE);
+}
+
+int main(int argc, char **argv)
+{
+        int n = 2000, rounds = 5, i, r, fd, seen, calls, sum, failed = 0;
+        uint64_t start, one, batch;
+        char name[64];
+
+        if (argc > 1)
+                n = atoi(argv[1]);
+        if (argc > 2)
+                rounds = atoi(argv[2]);
+        if (n <= 0 || rounds <= 0) {
+                fprintf(stderr, "usage: direntbench [entries [rounds]]\n");
+                return 1;
+        }
+
+        if (0 > mkdir(TESTDIR, 0) || 0 > (fd = open(TESTFILE, O_WRONLY | O_CREAT, 0))) {
+                fprintf(stderr, "direntbench: cannot create %s: %s\n", TESTDIR, strerror(errno));
+                return 1;
+        }
+        close(fd);
+        for (i = 0; i < n; i++) {
+                snprintf(name, sizeof(name), TESTDIR "/%d", i);
+                if (0 > link(TESTFILE, name)) {
+                        fprintf(stderr, "direntbench: link %s: %s\n", name, strerror(errno));
+                        cleanup(i);
+                        return 1;
+                }
+        }
+
+        one = batch = 0;
+        for (r = 0; r < rounds; r++) {
+                start = rdtsc();
+                seen = list(sizeof(struct dirent), &calls, &sum);
+                one += rdtsc() - start;
+                if (seen != n || sum != n * (n - 1) / 2) {
+                        printf("direntbench: one at a time saw %d entries, expected %d\n", seen, n);
+                        failed = 1;
+                }
+                if (0 == r)
+                        printf("one entry per call:  %5d calls", calls);
+
+                start = rdtsc();
+                seen = list(sizeof(dbuf), &calls, &sum);
+                batch += rdtsc() - start;
+                if (seen != n || sum != n * (n - 1) / 2) {
+                        printf("direntbench: batched saw %d entries, expected %d\n", seen, n);
+                        failed = 1;
+                }
+                if (0 == r)
+                        printf(", a page per call: %d calls\n", calls);
+        }
+
+        printf("%d entries: %u cycles per entry one at a time, %u batched\n", n,
+               (uint32_t)(one / rounds / n), (uint32_t)(batch / rounds / n));
+        cleanup(n);
+        if (!failed)
+                printf("direntbench: ok\n");
+        return failed;
+}
@@ -0,0 +1,151 @@
+/*
+ * Measures exec latency by launching /bin/ls and /usr/bin/hello in a loop.
+ * The first launch of each parses the binary; the rest should find its
+ * load plan in the kernel's exec image cache. Output from the programs is
+ * sent to /dev/null.
+ *
+ * Afterwards, checks that writing to a binary drops its cached plan: a copy
+ * of hello is run, its ELF header overwritten, and it must then fail to
+ * exec.
+ *
+ * usage: execbench [iterations]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <spawn.h>
+
+#define COPY "/tmp/execbench"
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+static char *child_envp[] = { NULL };
+
+/* Runs path to completion. Returns 0 on success, otherwise an errno value
+ * (or -1 if the program itself failed). */
+static int run(const char *path)
+{
+        posix_spawn_file_actions_t fa;
+        char *argv[] = { (char *)path, NULL };
+        int pid, status, err;
+
+        posix_spawn_file_actions_init(&fa);
+        posix_spawn_file_actions_addopen(&fa, 1, "/dev/null", O_WRONLY, 0);
+        err = posix_spawn(&pid, path, &fa, NULL, argv, child_envp);
+        posix_spawn_file_actions_destroy(&fa);
+        if (0 != err)
+                return err;
+        if (0 > waitpid(pid, 0, &status))
+                return errno;
+        return 0 == status ? 0 : -1;
+}
+
+static void bench(const char *path, int iters)
+{
+        uint64_t start, first, rest;
+        int i, err;
+
+        start = rdtsc();
+        if (0 != (err = run(path)))
+                goto fail;
+        first = rdtsc() - start;
+
+        start = rdtsc();
+        for (i = 1; i < iters; i++) {
+                if (0 != (err = run(path)))
+                        goto fail;
+        }
+        rest = rdtsc() - start;
+
+        printf("%-16s first %8u kcycles, then %8u kcycles/exec\n", path,
+               (unsigned)(first / 1000),
+               iters > 1 ? (unsigned)(rest / (iters - 1) / 1000) : 0);
+        return;
+
+fail:
+        fprintf(stderr, "execbench: %s failed: %s\n", path,
+                err > 0 ? strerror(err) : "bad exit status");
+        exit(1);
+}
+
+static int copy(const char *from, const char *to)
+{
+        char buf[512];
+        int in, out, n;
+
+        if (0 > (in = open(from, O_RDONLY, 0)))
+                return -1;
+        if (0 > (out = open(to, O_WRONLY | O_CREAT, 0))) {
+                close(in);
+                return -1;
+        }
+        while (0 < (n = read(in, buf, sizeof(buf)))) {
+                if (n != write(out, buf, n)) {
+                        n = -1;
+                        break;
+                }
+        }
+        close(in);
+        close(out);
+        return n;
+}
+
+static int check_invalidate(void)
+{
+        int fd, err;
+
+        if (0 > copy("/usr/bin/hello", COPY)) {
+                fprintf(stderr, "execbench: copying hello: %s\n", strerror(errno));
+                return 1;
+        }
+        if (0 != (err = run(COPY)) || 0 != (err = run(COPY))) {
+                fprintf(stderr, "execbench: running copy of hello failed\n");
+                goto fail;
+        }
+
+        /* Break the ELF magic number */
+        if (0 > (fd = open(COPY, O_WRONLY, 0)) || 4 != write(fd, "junk", 4)) {
+                fprintf(stderr, "execbench: overwriting copy: %s\n", strerror(errno));
+                goto fail;
+        }
+        close(fd);
+
+        if (ENOEXEC != (err = run(COPY))) {
+                fprintf(stderr, "execbench: exec of overwritten binary gave %s,"
+                        " expected ENOEXEC\n", err > 0 ? strerror(err) : "success");
+                goto fail;
+        }
+        unlink(COPY);
+        printf("writing a binary invalidates its cached image: ok\n");
+        return 0;
+
+fail:
+        unlink(COPY);
+        return 1;
+}
+
+int main(int argc, char **argv)
+{
+        int iters = 100;
+
+        if (argc > 1)
+                iters = atoi(argv[1]);
+        if (iters <= 0) {
+                fprintf(stderr, "usage: execbench [iterations]\n");
+                return 1;
+        }
+
+        printf("%d execs each\n", iters);
+        bench("/bin/ls", iters);
+        bench("/usr/bin/hello", iters);
+        return check_invalidate();
+}
@@ -0,0 +1,115 @@
+/*
+ * Opens thousands of file descriptors (with dup), timing how long each
+ * dup takes as the table fills up and how long a fork takes with few and
+ * with many descriptors open, then checks that:
+ * - the lowest free descriptor is always the one handed out,
+ * - dup2 works on a descriptor far beyond those open,
+ * - a forked child sees the same descriptors,
+ * - dup fails with EMFILE once NFILES are open.
+ *
+ * usage: fdbench [descriptors]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+static int failed;
+
+static uint32_t time_fork(void)
+{
+        uint64_t start = rdtsc();
+        int status, pid;
+
+        if (0 > (pid = fork())) {
+                printf("fdbench: fork: %s\n", strerror(errno));
+                failed = 1;
+                return 0;
+        } else if (0 == pid) {
+                exit(0);
+        }
+        waitpid(pid, 0, &status);
+        return (uint32_t)((rdtsc() - start) / 1000);
+}
+
+int main(int argc, char **argv)
+{
+        int n = 2000, i, fd, status, pid;
+        uint64_t start;
+
+        if (argc > 1)
+                n = atoi(argv[1]);
+        if (n < 64 || n >= NFILES) {
+                fprintf(stderr, "usage: fdbench [descriptors (64 to %d)]\n", NFILES - 1);
+                return 1;
+        }
+
+        printf("fork with few descriptors open:  %8u kcycles\n", time_fork());
+
+        /* 0, 1 and 2 are the tty */
+        start = rdtsc();
+        for (i = 3; i < n; i++) {
+                if (i != (fd = dup(0))) {
+                        printf("fdbench: dup gave %d, expected %d (%s)\n", fd, i,
+                               0 > fd ? strerror(errno) : "not the lowest");
+                        return 1;
+                }
+                if (0 == i % 512)
+                        printf("  %5d open, %6u cycles per dup so far\n", i,
+                               (uint32_t)((rdtsc() - start) / (i - 2)));
+        }
+        printf("%d descriptors open, %u cycles per dup\n", n,
+               (uint32_t)((rdtsc() - start) / (n - 3)));
+
+        printf("fork with %4d descriptors open: %8u kcycles\n", n, time_fork());
+
+        /* Holes are filled lowest first */
+        close(n / 2);
+        close(10);
+        if (10 != (fd = dup(0)) || n / 2 != (fd = dup(0))) {
+                printf("fdbench: dup gave %d after closing 10 and %d\n", fd, n / 2);
+                failed = 1;
+        }
+
+        if (NFILES - 1 != dup2(0, NFILES - 1)) {
+                printf("fdbench: dup2 to %d: %s\n", NFILES - 1, strerror(errno));
+                failed = 1;
+        }
+        if (0 == (pid = fork())) {
+                exit(0 == close(NFILES - 1) && 0 == close(n - 1) ? 0 : 1);
+        }
+        waitpid(pid, 0, &status);
+        if (0 != status) {
+                printf("fdbench: the child did not have the same descriptors\n");
+                failed = 1;
+        }
+        close(NFILES - 1);
+
+        for (i = n; i < NFILES; i++) {
+                if (i != (fd = dup(0))) {
+                        printf("fdbench: dup gave %d, expected %d (%s)\n", fd, i,
+                               0 > fd ? strerror(errno) : "not the lowest");
+                        return 1;
+                }
+        }
+        if (0 <= dup(0) || EMFILE != errno) {
+                printf("fdbench: dup with %d open should fail with EMFILE\n", NFILES);
+                failed = 1;
+        }
+
+        for (i = 3; i < NFILES; i++)
+                close(i);
+        if (!failed)
+                printf("fdbench: ok\n");
+        return failed;
+}
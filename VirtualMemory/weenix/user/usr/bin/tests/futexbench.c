@@ -0,0 +1,192 @@
+/*
+ * Measures what an uncontended pthread mutex costs (it should never enter
+ * the kernel) next to a system call, then checks futex-based locks under
+ * contention:
+ * - threads incrementing a counter under a pthread mutex (needs MTP=1 in
+ *   Config.mk, skipped otherwise),
+ * - processes incrementing a counter in a MAP_SHARED page under a lock in
+ *   the same page, which only works if the kernel finds their waiters by
+ *   the page rather than by the address.
+ *
+ * usage: futexbench [iterations [workers]]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <pthread/pthread.h>
+#include <weenix/syscall.h>
+
+#define COUNT 2000
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+/* The same lock as libc's, for use between processes: 0 free, 1 held,
+ * 2 held and maybe waited for */
+static void lock(volatile int *l)
+{
+        int c;
+
+        if (0 == (c = __sync_val_compare_and_swap(l, 0, 1)))
+                return;
+        if (2 != c)
+                c = __sync_lock_test_and_set(l, 2);
+        while (0 != c) {
+                futex((int *) l, FUTEX_WAIT, 2);
+                c = __sync_lock_test_and_set(l, 2);
+        }
+}
+
+static void unlock(volatile int *l)
+{
+        if (1 != __sync_fetch_and_sub(l, 1)) {
+                __sync_lock_release(l);
+                futex((int *) l, FUTEX_WAKE, 1);
+        }
+}
+
+static void uncontended(int iters)
+{
+        pthread_mutex_t mtx;
+        uint64_t start, locking, syscall;
+        int i;
+
+        pthread_mutex_init(&mtx, NULL);
+        start = rdtsc();
+        for (i = 0; i < iters; i++) {
+                pthread_mutex_lock(&mtx);
+                pthread_mutex_unlock(&mtx);
+        }
+        locking = rdtsc() - start;
+        pthread_mutex_destroy(&mtx);
+
+        start = rdtsc();
+        for (i = 0; i < iters; i++)
+                getpid();
+        syscall = rdtsc() - start;
+
+        printf("uncontended lock+unlock %6u cycles\n", (uint32_t)(locking / iters));
+        printf("getpid() for comparison %6u cycles\n", (uint32_t)(syscall / iters));
+}
+
+static pthread_mutex_t count_mtx;
+static int count;
+
+static void *counter(void *arg)
+{
+        int i;
+
+        for (i = 0; i < COUNT; i++) {
+                pthread_mutex_lock(&count_mtx);
+                count++;
+                /* Get preempted or yield with the lock held now and then,
+                 * so that the others have to sleep on it */
+                if (0 == i % 16)
+                        pthread_yield();
+                pthread_mutex_unlock(&count_mtx);
+        }
+        return NULL;
+}
+
+static int contended_threads(int nthr)
+{
+        pthread_t thr[16];
+        uint64_t start;
+        int i, n, err;
+
+        pthread_mutex_init(&count_mtx, NULL);
+        start = rdtsc();
+        for (n = 0; n < nthr; n++) {
+                if (0 != (err = pthread_create(&thr[n], NULL, counter, NULL)))
+                        break;
+        }
+        if (0 == n) {
+                printf("threads: skipped, pthread_create: %s\n", strerror(err));
+                pthread_mutex_destroy(&count_mtx);
+                return 0;
+        }
+        for (i = 0; i < n; i++)
+                pthread_join(thr[i], NULL);
+        pthread_mutex_destroy(&count_mtx);
+
+        printf("threads: %d counted to %d in %u kcycles\n", n, count,
+               (uint32_t)((rdtsc() - start) / 1000));
+        if (count != n * COUNT) {
+                printf("futexbench: expected %d\n", n * COUNT);
+                return 1;
+        }
+        return 0;
+}
+
+static int contended_processes(int nproc)
+{
+        volatile int *shared;
+        uint64_t start;
+        int i, j, status, failed = 0;
+
+        shared = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+        if (MAP_FAILED == shared) {
+                fprintf(stderr, "futexbench: mmap: %s\n", strerror(errno));
+                return 1;
+        }
+        shared[0] = 0;  /* the lock */
+        shared[1] = 0;  /* the count */
+
+        start = rdtsc();
+        for (i = 0; i < nproc; i++) {
+                int pid = fork();
+                if (0 > pid) {
+                        fprintf(stderr, "futexbench: fork: %s\n", strerror(errno));
+                        break;
+                } else if (0 == pid) {
+                        for (j = 0; j < COUNT; j++) {
+                                lock(&shared[0]);
+                                shared[1]++;
+                                if (0 == j % 16)
+                                        thr_yield();
+                                unlock(&shared[0]);
+                        }
+                        exit(0);
+                }
+        }
+        nproc = i;
+        for (i = 0; i < nproc; i++) {
+                if (0 > wait(&status) || 0 != status)
+                        failed = 1;
+        }
+
+        printf("processes: %d counted to %d in %u kcycles\n", nproc, shared[1],
+               (uint32_t)((rdtsc() - start) / 1000));
+        if (failed || shared[1] != nproc * COUNT) {
+                printf("futexbench: expected %d\n", nproc * COUNT);
+                return 1;
+        }
+        return 0;
+}
+
+int main(int argc, char **argv)
+{
+        int iters = 100000, workers = 4;
+
+        if (argc > 1)
+                iters = atoi(argv[1]);
+        if (argc > 2)
+                workers = atoi(argv[2]);
+        if (iters <= 0 || workers <= 0 || workers > 16) {
+                fprintf(stderr, "usage: futexbench [iterations [workers (at most 16)]]\n");
+                return 1;
+        }
+
+        uncontended(iters);
+        if (0 != contended_threads(workers))
+                return 1;
+        return contended_processes(workers);
+}
@@ -0,0 +1,146 @@
+/*
+ * A workload for the same-page merging daemon (KSMD=1 in Config.mk).
+ *
+ * The parent fills a table and forks a number of children. Each child then
+ * - rewrites the table with the values it already held,
+ * - allocates and zeroes a buffer of its own,
+ * - fills a scratch buffer with the same data as every other child (and,
+ *   after forking, the parent),
+ * which leaves every child with three buffers' worth of private pages which
+ * ksmd can merge. The parent then starts a kernel shell: "ksm scan" runs a
+ * merging pass and "ksm" shows the pages saved. When the shell exits the
+ * children check that their buffers still hold what they wrote, write to
+ * them again (breaking the sharing) and check them once more.
+ *
+ * usage: ksmtest [children [pages]]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "weenix/syscall.h"
+#include "weenix/trap.h"
+
+#define PAGE 4096
+#define DONE "/tmp/ksmtest.done"
+
+static int npages = 32;
+
+static void fill(uint32_t *buf, uint32_t seed)
+{
+        uint32_t i;
+        for (i = 0; i < npages * PAGE / sizeof(uint32_t); i++)
+                buf[i] = (i + seed) * 2654435761u;
+}
+
+static int check(const uint32_t *buf, uint32_t seed)
+{
+        uint32_t i;
+        for (i = 0; i < npages * PAGE / sizeof(uint32_t); i++) {
+                if (buf[i] != (i + seed) * 2654435761u)
+                        return 0;
+        }
+        return 1;
+}
+
+static int check_zero(const uint32_t *buf)
+{
+        uint32_t i;
+        for (i = 0; i < npages * PAGE / sizeof(uint32_t); i++) {
+                if (0 != buf[i])
+                        return 0;
+        }
+        return 1;
+}
+
+static int child(uint32_t *table, uint32_t *scratch)
+{
+        uint32_t *zero;
+        int fd;
+
+        fill(table, 1);
+        if (NULL == (zero = malloc(npages * PAGE)))
+                return 1;
+        memset(zero, 0, npages * PAGE);
+        fill(scratch, 2);
+
+        /* Wait (while ksmd merges our pages) for the parent to finish */
+        while (0 > (fd = open(DONE, O_RDONLY, 0)))
+                yield();
+        close(fd);
+
+        if (!check(table, 1) || !check_zero(zero) || !check(scratch, 2))
+                return 2;
+        fill(table, 3);
+        memset(zero, 0xff, npages * PAGE);
+        fill(scratch, 4);
+        if (!check(table, 3) || !check(scratch, 4))
+                return 3;
+        return 0;
+}
+
+int main(int argc, char **argv)
+{
+        uint32_t *table, *scratch;
+        int nchildren = 8;
+        int i, fd, status, failed = 0;
+
+        if (argc > 1)
+                nchildren = atoi(argv[1]);
+        if (argc > 2)
+                npages = atoi(argv[2]);
+        if (nchildren <= 0 || npages <= 0) {
+                fprintf(stderr, "usage: ksmtest [children [pages]]\n");
+                return 1;
+        }
+
+        unlink(DONE);
+        table = malloc(npages * PAGE);
+        scratch = malloc(npages * PAGE);
+        if (NULL == table || NULL == scratch) {
+                fprintf(stderr, "ksmtest: out of memory\n");
+                return 1;
+        }
+        fill(table, 1);
+
+        for (i = 0; i < nchildren; i++) {
+                int pid = fork();
+                if (0 == pid) {
+                        exit(child(table, scratch));
+                } else if (0 > pid) {
+                        fprintf(stderr, "ksmtest: fork: %s\n", strerror(errno));
+                        nchildren = i;
+                        break;
+                }
+        }
+        fill(scratch, 2);
+
+        /* Let every child get through its writes */
+        for (i = 0; i < nchildren; i++)
+                yield();
+
+        printf("%d children hold about %d mergeable pages each (%d in all).\n",
+               nchildren, 3 * npages, 3 * npages * nchildren);
+        printf("Run \"ksm scan\" (twice, for the pages to be seen unchanged)"
+               " and \"ksm\" to see\nthe pages saved, then \"exit\".\n");
+        trap(SYS_kshell, (uint32_t)0);
+
+        if (0 <= (fd = open(DONE, O_WRONLY | O_CREAT, 0)))
+                close(fd);
+        for (i = 0; i < nchildren; i++) {
+                if (0 > wait(&status) || 0 != status)
+                        failed++;
+        }
+        unlink(DONE);
+
+        if (failed) {
+                printf("ksmtest: %d children found their memory changed\n", failed);
+                return 1;
+        }
+        printf("ksmtest: all children found their memory intact\n");
+        return 0;
+}
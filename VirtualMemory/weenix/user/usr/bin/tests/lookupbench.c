@@ -0,0 +1,137 @@
+/*
+ * Measures path lookups: stat() of a path which exists and of one which
+ * does not, each many times over, and the search of a few PATH-like
+ * directories for a command the way sh does. Run "dcache reset" in the
+ * kshell beforehand and "dcache" afterwards for the hit counts.
+ *
+ * Then checks that names which are created, linked, renamed and removed
+ * are found (or not) right away, so that the cache is not left stale.
+ *
+ * usage: lookupbench [iterations [path]]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+static const char *search_path[] = { "/bin", "/sbin", "/usr/sbin", "/usr/bin" };
+
+static void bench(int iters, const char *path)
+{
+        struct stat st;
+        char buf[64];
+        uint64_t start;
+        int i, j;
+
+        start = rdtsc();
+        for (i = 0; i < iters; i++)
+                stat(path, &st);
+        printf("stat(\"%s\")%*s %8u cycles\n", path, (int)(24 - strlen(path)), "",
+               (uint32_t)((rdtsc() - start) / iters));
+
+        start = rdtsc();
+        for (i = 0; i < iters; i++)
+                stat("/usr/bin/no/such/file", &st);
+        printf("stat of a missing file         %8u cycles\n",
+               (uint32_t)((rdtsc() - start) / iters));
+
+        start = rdtsc();
+        for (i = 0; i < iters; i++) {
+                for (j = 0; j < 4; j++) {
+                        snprintf(buf, sizeof(buf), "%s/%s", search_path[j], "hello");
+                        if (0 == stat(buf, &st))
+                                break;
+                }
+        }
+        printf("PATH search for \"hello\"        %8u cycles\n",
+               (uint32_t)((rdtsc() - start) / iters));
+}
+
+static int failed;
+
+static void expect(const char *path, int exists)
+{
+        struct stat st;
+
+        if ((0 == stat(path, &st)) != exists) {
+                printf("lookupbench: %s %s\n", path,
+                       exists ? "should exist" : "should not exist");
+                failed = 1;
+        }
+}
+
+static void check(void)
+{
+        int fd;
+
+        expect("/tmp/lb", 0);
+        expect("/tmp/lb/f", 0);
+        if (0 > mkdir("/tmp/lb", 0)) {
+                printf("lookupbench: mkdir /tmp/lb: %s\n", strerror(errno));
+                failed = 1;
+                return;
+        }
+        expect("/tmp/lb", 1);
+        expect("/tmp/lb/f", 0);
+
+        if (0 > (fd = open("/tmp/lb/f", O_CREAT | O_WRONLY, 0))) {
+                printf("lookupbench: create /tmp/lb/f: %s\n", strerror(errno));
+                failed = 1;
+                return;
+        }
+        close(fd);
+        expect("/tmp/lb/f", 1);
+
+        expect("/tmp/lb/g", 0);
+        link("/tmp/lb/f", "/tmp/lb/g");
+        expect("/tmp/lb/g", 1);
+
+        expect("/tmp/lb/h", 0);
+        rename("/tmp/lb/g", "/tmp/lb/h");
+        expect("/tmp/lb/g", 0);
+        expect("/tmp/lb/h", 1);
+
+        unlink("/tmp/lb/f");
+        unlink("/tmp/lb/h");
+        expect("/tmp/lb/f", 0);
+        expect("/tmp/lb/h", 0);
+
+        /* A new directory in the old one's place starts out empty */
+        rmdir("/tmp/lb");
+        expect("/tmp/lb", 0);
+        mkdir("/tmp/lb", 0);
+        expect("/tmp/lb/f", 0);
+        rmdir("/tmp/lb");
+        expect("/tmp/lb", 0);
+}
+
+int main(int argc, char **argv)
+{
+        int iters = 10000;
+        const char *path = "/usr/bin/hello";
+
+        if (argc > 1)
+                iters = atoi(argv[1]);
+        if (argc > 2)
+                path = argv[2];
+        if (iters <= 0) {
+                fprintf(stderr, "usage: lookupbench [iterations [path]]\n");
+                return 1;
+        }
+
+        bench(iters, path);
+        check();
+        if (!failed)
+                printf("lookupbench: ok\n");
+        return failed;
+}
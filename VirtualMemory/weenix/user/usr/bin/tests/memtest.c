@@ -599,6 +599,113 @@ static int test_mmap_beyond(void)
         return 0;
 }
 
+static int test_mremap(void)
+{
+        char *addr, *addr2, *blocker;
+
+        printf("Testing mremap()\n");
+
+        /* Leave ourselves some room above the area */
+        test_assert(MAP_FAILED != (addr = mmap(NULL, PAGE_SIZE * 8,
+                                               PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0)), NULL);
+        test_assert(0 == munmap(addr + PAGE_SIZE * 4, PAGE_SIZE * 4), NULL);
+        *addr = '^';
+        *(addr + PAGE_SIZE * 3) = '$';
+
+        /* Bad arguments */
+        test_assert(MAP_FAILED == mremap(addr, 0, PAGE_SIZE, MREMAP_MAYMOVE), NULL);
+        test_assert(EINVAL == errno, NULL);
+        test_assert(MAP_FAILED == mremap(addr + 1, PAGE_SIZE, PAGE_SIZE * 2, MREMAP_MAYMOVE), NULL);
+        test_assert(EINVAL == errno, NULL);
+        test_assert(MAP_FAILED == mremap(addr, PAGE_SIZE * 5, PAGE_SIZE * 6, MREMAP_MAYMOVE), NULL);
+        test_assert(EFAULT == errno, NULL);
+
+        /* Shrink in place */
+        test_assert(addr == mremap(addr, PAGE_SIZE * 4, PAGE_SIZE * 2, 0), NULL);
+        test_assert('^' == *addr, NULL);
+        assert_fault(char foo = *(addr + PAGE_SIZE * 3), "");
+
+        /* Grow back in place, the old contents must not come back */
+        test_assert(addr == mremap(addr, PAGE_SIZE * 2, PAGE_SIZE * 4, 0), NULL);
+        test_assert('^' == *addr, NULL);
+        test_assert('\0' == *(addr + PAGE_SIZE * 3), NULL);
+        *(addr + PAGE_SIZE * 3) = '$';
+
+        /* Block growing in place */
+        test_assert(MAP_FAILED != (blocker = mmap(addr + PAGE_SIZE * 4, PAGE_SIZE,
+                                                  PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0)), NULL);
+        *blocker = '#';
+        test_assert(MAP_FAILED == mremap(addr, PAGE_SIZE * 4, PAGE_SIZE * 8, 0), NULL);
+        test_assert(ENOMEM == errno, NULL);
+
+        /* Move it, the contents should come along */
+        test_assert(MAP_FAILED != (addr2 = mremap(addr, PAGE_SIZE * 4, PAGE_SIZE * 8, MREMAP_MAYMOVE)), NULL);
+        test_assert(addr2 != addr, NULL);
+        test_assert('^' == *addr2, NULL);
+        test_assert('$' == *(addr2 + PAGE_SIZE * 3), NULL);
+        test_assert('\0' == *(addr2 + PAGE_SIZE * 7), NULL);
+        assert_nofault(*(addr2 + PAGE_SIZE * 7) = 'a', "");
+        assert_fault(char foo = *addr, "");
+        test_assert('#' == *blocker, NULL);
+
+        /* Moved pages stay private across fork */
+        assert_nofault(*addr2 = 'a', "");
+        test_assert('^' == *addr2, NULL);
+
+        /* Large realloc() goes through mremap() */
+        char *buf;
+        test_assert(NULL != (buf = malloc(PAGE_SIZE * 100)), NULL);
+        memset(buf, 'x', PAGE_SIZE * 100);
+        test_assert(NULL != (buf = realloc(buf, PAGE_SIZE * 300)), NULL);
+        test_assert('x' == buf[0] && 'x' == buf[PAGE_SIZE * 100 - 1], NULL);
+        buf[PAGE_SIZE * 300 - 1] = 'y';
+        test_assert(NULL != (buf = realloc(buf, 100)), NULL);
+        test_assert('x' == buf[99], NULL);
+        free(buf);
+
+        /* Grow the same block over and over (a moved block sits right
+         * below the next mapping, so most of these move), and after
+         * each growth shrink it and grow it back, which must never
+         * bring back what was there */
+        int i;
+        test_assert(MAP_FAILED != (addr = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                               MAP_PRIVATE | MAP_ANON, -1, 0)), NULL);
+        for (i = 1; i < 6; i++) {
+                addr[PAGE_SIZE * i - 1] = '0' + i;
+                test_assert(MAP_FAILED != (addr = mremap(addr, PAGE_SIZE * i, PAGE_SIZE * (i + 1),
+                                                         MREMAP_MAYMOVE)), NULL);
+                addr[PAGE_SIZE * (i + 1) - 1] = '#';
+                test_assert(addr == mremap(addr, PAGE_SIZE * (i + 1), PAGE_SIZE * i, 0), NULL);
+                test_assert(addr == mremap(addr, PAGE_SIZE * i, PAGE_SIZE * (i + 1), 0), NULL);
+                test_assert('\0' == addr[PAGE_SIZE * (i + 1) - 1], NULL);
+        }
+        for (i = 1; i < 6; i++) {
+                test_assert('0' + i == addr[PAGE_SIZE * i - 1], NULL);
+        }
+        test_assert(addr == mremap(addr, PAGE_SIZE * 6, PAGE_SIZE * 3, 0), NULL);
+        test_assert('3' == addr[PAGE_SIZE * 3 - 1], NULL);
+
+        /* Only the end of a mapping can grow */
+        test_assert(MAP_FAILED == mremap(addr, PAGE_SIZE, PAGE_SIZE * 2, MREMAP_MAYMOVE), NULL);
+        test_assert(EINVAL == errno, NULL);
+        test_assert(0 == munmap(addr, PAGE_SIZE * 3), NULL);
+
+        test_assert(NULL != (buf = malloc(PAGE_SIZE * 100)), NULL);
+        for (i = 1; i < 6; i++) {
+                buf[PAGE_SIZE * 100 * i - 1] = '0' + i;
+                test_assert(NULL != (buf = realloc(buf, PAGE_SIZE * 100 * (i + 1))), NULL);
+        }
+        for (i = 1; i < 6; i++) {
+                test_assert('0' + i == buf[PAGE_SIZE * 100 * i - 1], NULL);
+        }
+        free(buf);
+
+        test_assert(0 == munmap(addr2, PAGE_SIZE * 8), NULL);
+        test_assert(0 == munmap(blocker, PAGE_SIZE), NULL);
+
+        return 0;
+}
+
 /* TODO Figure out a way to not have these be repeated. */
 /* Copied from vfstest. Linking stuff prevents use of the same file. */
 static void
@@ -739,6 +846,7 @@ int main(int argc, char **argv)
         childtest(test_mmap_fill);
         childtest(test_mmap_repeat);
         childtest(test_mmap_beyond);
+        childtest(test_mremap);
         syscall_success(chdir(".."));
         destroy_rootdir();
         test_fini(NULL);
@@ -0,0 +1,245 @@
+/*
+ * Compares waiting for several pipes with poll() against busy-looping
+ * over them. A child writes a time-stamped token into one of the pipes
+ * now and then, and the parent waits for it either in poll(), asleep
+ * until a write wakes it, or by asking poll() with no timeout over and
+ * over, yielding in between (without UPREEMPT=1 userland is not
+ * preempted, so the child would never get to run otherwise). For each
+ * the time from the write to the read and the parent's CPU time are
+ * printed.
+ *
+ * Then checks that:
+ * - poll() times out with nothing to read, and select() too,
+ * - a pipe with data in it is readable, to poll() and to select(),
+ * - a pipe whose writers are gone has hung up, and reading it gives 0,
+ * - a pipe whose readers are gone is an error to write to (EPIPE),
+ * - a regular file is always ready and a closed descriptor is POLLNVAL.
+ *
+ * usage: pollbench [tokens [pipes]]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+
+#define MAX_PIPES 16
+#define FILE_PATH "/pollbench.tmp"
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+static uint32_t cpu_us(void)
+{
+        struct rusage ru;
+
+        getrusage(RUSAGE_SELF, &ru);
+        return ru.ru_time.tv_sec * 1000000 + ru.ru_time.tv_usec;
+}
+
+static uint32_t wall_ms(void)
+{
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/* Writes ntokens time stamps, each a tick or so after the last, round
+ * the pipes, then exits (which closes them) */
+static void writer(int *wfds, int npipes, int ntokens)
+{
+        struct timespec ts = { 0, 5000000 };
+        uint64_t stamp;
+        int i;
+
+        for (i = 0; i < ntokens; i++) {
+                nanosleep(&ts, NULL);
+                stamp = rdtsc();
+                if (sizeof(stamp) != write(wfds[(i * 7) % npipes], &stamp, sizeof(stamp)))
+                        exit(1);
+        }
+        exit(0);
+}
+
+/* Reads tokens until every pipe has hung up. With spin set it never
+ * sleeps in poll(). Returns the number of tokens. */
+static int reader(struct pollfd *fds, int npipes, int spin, uint64_t *latency,
+                  uint32_t *polls)
+{
+        uint64_t stamp;
+        int i, n, open = npipes, ntokens = 0;
+
+        while (0 < open) {
+                ++*polls;
+                if (0 > (n = poll(fds, npipes, spin ? 0 : -1))) {
+                        fprintf(stderr, "pollbench: poll: %s\n", strerror(errno));
+                        return -1;
+                }
+                if (0 == n) {
+                        thr_yield();
+                        continue;
+                }
+                for (i = 0; i < npipes; i++) {
+                        if (POLLIN & fds[i].revents) {
+                                if (sizeof(stamp) != read(fds[i].fd, &stamp, sizeof(stamp)))
+                                        return -1;
+                                *latency += rdtsc() - stamp;
+                                ntokens++;
+                        } else if (POLLHUP & fds[i].revents) {
+                                close(fds[i].fd);
+                                fds[i].fd = -1;
+                                open--;
+                        }
+                }
+        }
+        return ntokens;
+}
+
+static int run(const char *what, int ntokens, int npipes, int spin)
+{
+        struct pollfd fds[MAX_PIPES];
+        int wfds[MAX_PIPES], pipefd[2];
+        uint64_t latency = 0;
+        uint32_t polls = 0, cpu, wall;
+        int i, pid, status, got;
+
+        for (i = 0; i < npipes; i++) {
+                if (0 > pipe(pipefd)) {
+                        fprintf(stderr, "pollbench: pipe: %s\n", strerror(errno));
+                        return 1;
+                }
+                fds[i].fd = pipefd[0];
+                fds[i].events = POLLIN;
+                wfds[i] = pipefd[1];
+        }
+
+        cpu = cpu_us();
+        wall = wall_ms();
+        if (0 > (pid = fork())) {
+                fprintf(stderr, "pollbench: fork: %s\n", strerror(errno));
+                return 1;
+        } else if (0 == pid) {
+                for (i = 0; i < npipes; i++)
+                        close(fds[i].fd);
+                writer(wfds, npipes, ntokens);
+        }
+        for (i = 0; i < npipes; i++)
+                close(wfds[i]);
+
+        got = reader(fds, npipes, spin, &latency, &polls);
+        cpu = cpu_us() - cpu;
+        wall = wall_ms() - wall;
+        if (0 > waitpid(pid, 0, &status) || 0 != status || got != ntokens) {
+                fprintf(stderr, "pollbench: %s: got %d of %d tokens\n", what, got, ntokens);
+                return 1;
+        }
+
+        printf("%-12s latency %6u cycles  cpu %5u ms of %5u ms  %7u polls\n", what,
+               (uint32_t)(latency / ntokens), cpu / 1000, wall, polls);
+        return 0;
+}
+
+static int check(int ok, const char *what)
+{
+        if (!ok)
+                printf("pollbench: %s: failed\n", what);
+        return !ok;
+}
+
+static int checks(void)
+{
+        struct pollfd pfd[2];
+        struct timeval tv;
+        fd_set rset;
+        int p[2], fd, failed = 0;
+        uint32_t start;
+        char c = 'x';
+
+        if (0 > pipe(p)) {
+                fprintf(stderr, "pollbench: pipe: %s\n", strerror(errno));
+                return 1;
+        }
+        pfd[0].fd = p[0];
+        pfd[0].events = POLLIN;
+        pfd[1].fd = p[1];
+        pfd[1].events = POLLOUT;
+
+        start = wall_ms();
+        failed |= check(1 == poll(pfd, 2, 50) && 0 == pfd[0].revents
+                        && POLLOUT == pfd[1].revents, "empty pipe is writable only");
+        failed |= check(0 == poll(pfd, 1, 50) && wall_ms() - start >= 40, "poll timeout");
+        FD_ZERO(&rset);
+        FD_SET(p[0], &rset);
+        tv.tv_sec = 0;
+        tv.tv_usec = 0;
+        failed |= check(0 == select(p[0] + 1, &rset, NULL, NULL, &tv)
+                        && !FD_ISSET(p[0], &rset), "select timeout");
+
+        write(p[1], &c, 1);
+        failed |= check(1 == poll(pfd, 1, -1) && POLLIN == pfd[0].revents, "pipe readable");
+        FD_SET(p[0], &rset);
+        failed |= check(1 == select(p[0] + 1, &rset, NULL, NULL, NULL)
+                        && FD_ISSET(p[0], &rset), "select readable");
+
+        close(p[1]);
+        failed |= check(1 == poll(pfd, 1, 0) && (POLLIN | POLLHUP) == pfd[0].revents,
+                        "data and hang up");
+        read(p[0], &c, 1);
+        failed |= check(1 == poll(pfd, 1, 0) && POLLHUP == pfd[0].revents
+                        && 0 == read(p[0], &c, 1), "hung up");
+        close(p[0]);
+
+        pipe(p);
+        close(p[0]);
+        pfd[1].fd = p[1];
+        failed |= check(1 == poll(&pfd[1], 1, 0) && (POLLERR & pfd[1].revents)
+                        && 0 > write(p[1], &c, 1) && EPIPE == errno, "broken pipe");
+        close(p[1]);
+
+        unlink(FILE_PATH);
+        if (0 > (fd = open(FILE_PATH, O_RDWR | O_CREAT, 0))) {
+                fprintf(stderr, "pollbench: open: %s\n", strerror(errno));
+                return 1;
+        }
+        pfd[0].fd = fd;
+        pfd[0].events = POLLIN | POLLOUT;
+        failed |= check(1 == poll(pfd, 1, -1) && (POLLIN | POLLOUT) == pfd[0].revents,
+                        "regular file");
+        close(fd);
+        unlink(FILE_PATH);
+        failed |= check(1 == poll(pfd, 1, -1) && POLLNVAL == pfd[0].revents, "closed fd");
+
+        if (!failed)
+                printf("poll and select checks: ok\n");
+        return failed;
+}
+
+int main(int argc, char **argv)
+{
+        int ntokens = 100, npipes = 4;
+
+        if (argc > 1)
+                ntokens = atoi(argv[1]);
+        if (argc > 2)
+                npipes = atoi(argv[2]);
+        if (ntokens <= 0 || npipes <= 0 || npipes > MAX_PIPES) {
+                fprintf(stderr, "usage: pollbench [tokens [pipes (at most %d)]]\n", MAX_PIPES);
+                return 1;
+        }
+
+        printf("%d tokens over %d pipes\n", ntokens, npipes);
+        if (0 != run("poll", ntokens, npipes, 0) || 0 != run("busy loop", ntokens, npipes, 1))
+                return 1;
+        return checks();
+}
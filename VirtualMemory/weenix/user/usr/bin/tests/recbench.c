@@ -0,0 +1,218 @@
+/*
+ * Writes a file of fixed-size records, each a header and a payload kept in
+ * separate buffers, and then reads records back at random:
+ * - with write() per buffer, and lseek() and read() per record,
+ * - with writev() for a batch of records, and pread() per record,
+ * counting the system calls each way takes and the cycles they cost.
+ * The file is then checked with readv() into headers and payloads, and
+ * pread() is checked to leave the file position alone and to fail with
+ * ESPIPE on the terminal.
+ *
+ * usage: recbench [records [records per writev]]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define PAYLOAD 112
+#define FILENAME "/recbench.dat"
+
+struct header {
+        uint32_t        h_id;
+        uint32_t        h_len;
+        uint32_t        h_sum;
+        uint32_t        h_pad;
+};
+
+struct record {
+        struct header   r_hdr;
+        char            r_data[PAYLOAD];
+};
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+static struct header hdrs[IOV_MAX / 2];
+static char payloads[IOV_MAX / 2][PAYLOAD];
+
+static void make_record(int id, struct header *h, char *data)
+{
+        int i;
+
+        h->h_id = id;
+        h->h_len = PAYLOAD;
+        h->h_sum = 0;
+        h->h_pad = 0;
+        for (i = 0; i < PAYLOAD; i++) {
+                data[i] = (char)(id * 31 + i);
+                h->h_sum += (unsigned char) data[i];
+        }
+}
+
+static int check_record(int id, const struct record *r)
+{
+        struct header h;
+        char data[PAYLOAD];
+
+        make_record(id, &h, data);
+        return 0 == memcmp(&h, &r->r_hdr, sizeof(h)) && 0 == memcmp(data, r->r_data, PAYLOAD);
+}
+
+static void report(const char *what, int calls, uint64_t cycles)
+{
+        printf("  %-26s %7d calls %9u kcycles\n", what, calls, (uint32_t)(cycles / 1000));
+}
+
+/* One write() per buffer, and lseek() and read() to fetch a record */
+static int plain(int nrec)
+{
+        struct record r;
+        uint64_t start;
+        int fd, i, id, calls = 0;
+
+        if (0 > (fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC, 0))) {
+                printf("recbench: open: %s\n", strerror(errno));
+                return 1;
+        }
+        calls++;
+        start = rdtsc();
+        for (i = 0; i < nrec; i++) {
+                make_record(i, &hdrs[0], payloads[0]);
+                if (sizeof(hdrs[0]) != write(fd, &hdrs[0], sizeof(hdrs[0]))
+                    || PAYLOAD != write(fd, payloads[0], PAYLOAD)) {
+                        printf("recbench: write: %s\n", strerror(errno));
+                        return 1;
+                }
+                calls += 2;
+        }
+        report("write", calls, rdtsc() - start);
+
+        calls = 0;
+        start = rdtsc();
+        for (i = 0; i < nrec; i++) {
+                id = (i * 7919) % nrec;
+                lseek(fd, id * sizeof(r), SEEK_SET);
+                if (sizeof(r) != read(fd, &r, sizeof(r)) || !check_record(id, &r)) {
+                        printf("recbench: record %d read back wrong\n", id);
+                        return 1;
+                }
+                calls += 2;
+        }
+        report("lseek + read", calls, rdtsc() - start);
+        close(fd);
+        return 0;
+}
+
+/* writev() for a batch of records, and pread() to fetch one */
+static int vectored(int nrec, int batch)
+{
+        struct iovec iov[IOV_MAX];
+        struct record r;
+        uint64_t start;
+        int fd, i, j, n, id, calls = 0;
+
+        if (0 > (fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC, 0))) {
+                printf("recbench: open: %s\n", strerror(errno));
+                return 1;
+        }
+        start = rdtsc();
+        for (i = 0; i < nrec; i += n) {
+                n = nrec - i < batch ? nrec - i : batch;
+                for (j = 0; j < n; j++) {
+                        make_record(i + j, &hdrs[j], payloads[j]);
+                        iov[2 * j].iov_base = &hdrs[j];
+                        iov[2 * j].iov_len = sizeof(hdrs[j]);
+                        iov[2 * j + 1].iov_base = payloads[j];
+                        iov[2 * j + 1].iov_len = PAYLOAD;
+                }
+                if (n * (int) sizeof(r) != writev(fd, iov, 2 * n)) {
+                        printf("recbench: writev: %s\n", strerror(errno));
+                        return 1;
+                }
+                calls++;
+        }
+        report("writev", calls, rdtsc() - start);
+
+        calls = 0;
+        start = rdtsc();
+        for (i = 0; i < nrec; i++) {
+                id = (i * 7919) % nrec;
+                if (sizeof(r) != pread(fd, &r, sizeof(r), id * sizeof(r)) || !check_record(id, &r)) {
+                        printf("recbench: record %d read back wrong\n", id);
+                        return 1;
+                }
+                calls++;
+        }
+        report("pread", calls, rdtsc() - start);
+
+        /* pread must not have moved the position, which writev left at
+         * the end */
+        if (nrec * (int) sizeof(r) != lseek(fd, 0, SEEK_CUR)) {
+                printf("recbench: pread moved the file position\n");
+                return 1;
+        }
+
+        /* Scatter headers and payloads back into their own buffers */
+        lseek(fd, 0, SEEK_SET);
+        for (i = 0; i < nrec; i += n) {
+                n = nrec - i < batch ? nrec - i : batch;
+                for (j = 0; j < n; j++) {
+                        iov[2 * j].iov_base = &r.r_hdr;
+                        iov[2 * j].iov_len = sizeof(r.r_hdr);
+                        iov[2 * j + 1].iov_base = payloads[j];
+                        iov[2 * j + 1].iov_len = PAYLOAD;
+                }
+                if (n * (int) sizeof(r) != readv(fd, iov, 2 * n)) {
+                        printf("recbench: readv: %s\n", strerror(errno));
+                        return 1;
+                }
+                memcpy(r.r_data, payloads[n - 1], PAYLOAD);
+                if (!check_record(i + n - 1, &r)) {
+                        printf("recbench: readv got record %d wrong\n", i + n - 1);
+                        return 1;
+                }
+        }
+        if (0 != readv(fd, iov, 2)) {
+                printf("recbench: readv at the end of the file should return 0\n");
+                return 1;
+        }
+        close(fd);
+        return 0;
+}
+
+int main(int argc, char **argv)
+{
+        int nrec = 2000, batch = 16, ret;
+        char c;
+
+        if (argc > 1)
+                nrec = atoi(argv[1]);
+        if (argc > 2)
+                batch = atoi(argv[2]);
+        if (nrec <= 0 || batch <= 0 || batch > IOV_MAX / 2) {
+                fprintf(stderr, "usage: recbench [records [records per writev (at most %d)]]\n",
+                        IOV_MAX / 2);
+                return 1;
+        }
+
+        printf("%d records of %d bytes, %d per writev\n", nrec, (int) sizeof(struct record), batch);
+        ret = plain(nrec) || vectored(nrec, batch);
+
+        if (0 <= pread(0, &c, 1, 0) || ESPIPE != errno) {
+                printf("recbench: pread on the terminal should fail with ESPIPE\n");
+                ret = 1;
+        }
+        unlink(FILENAME);
+        if (!ret)
+                printf("recbench: ok\n");
+        return ret;
+}
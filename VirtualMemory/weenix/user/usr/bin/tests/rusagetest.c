@@ -0,0 +1,112 @@
+/*
+ * Checks that getrusage() counts what this process does: faults on pages
+ * it touches for the first time, bytes it reads and writes, time on the
+ * CPU, and the usage of the children it has waited for. Also prints
+ * get_free_mem() before and after touching the pages.
+ *
+ * usage: rusagetest [pages [file]]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+static void show(const char *what, struct rusage *ru)
+{
+        printf("%-10s %4u.%06u s  rss %5u  minflt %5u  majflt %4u  inblock %4u  "
+               "vcsw %4u  ivcsw %4u  read %u  written %u\n", what,
+               (uint32_t) ru->ru_time.tv_sec, (uint32_t) ru->ru_time.tv_usec,
+               ru->ru_rss, ru->ru_minflt, ru->ru_majflt, ru->ru_inblock,
+               ru->ru_nvcsw, ru->ru_nivcsw,
+               (uint32_t) ru->ru_rbytes, (uint32_t) ru->ru_wbytes);
+}
+
+int main(int argc, char **argv)
+{
+        struct rusage before, after, children;
+        const char *file = "/usr/bin/rusagetest";
+        char buf[512], *mem;
+        size_t freemem;
+        int pages = 64, fd, n, i, status, failed = 0;
+        uint32_t nread = 0;
+
+        if (argc > 1)
+                pages = atoi(argv[1]);
+        if (argc > 2)
+                file = argv[2];
+        if (pages <= 0) {
+                fprintf(stderr, "usage: rusagetest [pages [file]]\n");
+                return 1;
+        }
+
+        if (0 > getrusage(RUSAGE_SELF, &before)) {
+                fprintf(stderr, "rusagetest: getrusage: %s\n", strerror(errno));
+                return 1;
+        }
+        freemem = get_free_mem();
+
+        mem = mmap(NULL, pages * 4096, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (MAP_FAILED == mem) {
+                fprintf(stderr, "rusagetest: mmap: %s\n", strerror(errno));
+                return 1;
+        }
+        for (i = 0; i < pages; i++)
+                mem[i * 4096] = i;
+
+        if (0 > (fd = open(file, O_RDONLY, 0))) {
+                fprintf(stderr, "rusagetest: %s: %s\n", file, strerror(errno));
+                return 1;
+        }
+        while (0 < (n = read(fd, buf, sizeof(buf))))
+                nread += n;
+        close(fd);
+
+        getrusage(RUSAGE_SELF, &after);
+        printf("free memory %u KiB before, %u KiB after touching %d pages\n",
+               freemem / 1024, get_free_mem() / 1024, pages);
+        show("before", &before);
+        show("after", &after);
+
+        if (after.ru_minflt + after.ru_majflt - before.ru_minflt - before.ru_majflt
+            < (uint32_t) pages) {
+                printf("rusagetest: expected at least %d faults\n", pages);
+                failed = 1;
+        }
+        if (after.ru_rss < before.ru_rss + pages) {
+                printf("rusagetest: expected at least %d more resident pages\n", pages);
+                failed = 1;
+        }
+        if ((uint32_t)(after.ru_rbytes - before.ru_rbytes) != nread) {
+                printf("rusagetest: read %u bytes but was charged %u\n", nread,
+                       (uint32_t)(after.ru_rbytes - before.ru_rbytes));
+                failed = 1;
+        }
+
+        if (0 == fork()) {
+                for (i = 0; i < pages; i++)
+                        mem[i * 4096]++;
+                exit(0);
+        }
+        wait(&status);
+        getrusage(RUSAGE_CHILDREN, &children);
+        show("children", &children);
+        if (children.ru_minflt + children.ru_majflt < (uint32_t) pages) {
+                printf("rusagetest: expected the child's %d faults\n", pages);
+                failed = 1;
+        }
+
+        if (0 == getrusage(42, &after) || EINVAL != errno) {
+                printf("rusagetest: getrusage(42) should fail with EINVAL\n");
+                failed = 1;
+        }
+
+        if (!failed)
+                printf("rusagetest: ok\n");
+        return failed;
+}
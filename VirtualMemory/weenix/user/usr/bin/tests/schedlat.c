@@ -0,0 +1,113 @@
+/*
+ * Measures how long a woken thread waits to run while CPU-bound processes
+ * (like spin) compete with it. Each sample forks a child which exits right
+ * away with the low bits of the time stamp counter as its status; the time
+ * from then until the parent returns from waitpid is the latency of the
+ * parent's wakeup.
+ *
+ * Samples are taken first on an idle system and then with spinners running.
+ * Without preemption (UPREEMPT=0 in Config.mk) the parent does not run again
+ * until the spinners give up, which they do after a fixed number of cycles.
+ *
+ * usage: schedlat [spinners [samples [spin-limit in Mcycles]]]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+static volatile int *stop;
+
+static void spin(uint64_t limit)
+{
+        uint64_t end = rdtsc() + limit;
+        while (!*stop && rdtsc() < end)
+                ;
+        exit(0);
+}
+
+static int measure(const char *what, int samples)
+{
+        uint32_t lat, min = 0xffffffff, max = 0;
+        uint64_t total = 0;
+        int i, pid, status;
+
+        for (i = 0; i < samples; i++) {
+                if (0 > (pid = fork())) {
+                        fprintf(stderr, "schedlat: fork: %s\n", strerror(errno));
+                        return 1;
+                } else if (0 == pid) {
+                        exit((int)(uint32_t)rdtsc());
+                }
+                if (0 > waitpid(pid, 0, &status)) {
+                        fprintf(stderr, "schedlat: waitpid: %s\n", strerror(errno));
+                        return 1;
+                }
+                lat = (uint32_t)rdtsc() - (uint32_t)status;
+                total += lat;
+                if (lat < min)
+                        min = lat;
+                if (lat > max)
+                        max = lat;
+        }
+
+        printf("%-16s min %8u  avg %8u  max %8u kcycles\n", what,
+               min / 1000, (uint32_t)(total / samples) / 1000, max / 1000);
+        return 0;
+}
+
+int main(int argc, char **argv)
+{
+        int nspin = 2, samples = 20, limit = 5000;
+        int i, pid, failed;
+
+        if (argc > 1)
+                nspin = atoi(argv[1]);
+        if (argc > 2)
+                samples = atoi(argv[2]);
+        if (argc > 3)
+                limit = atoi(argv[3]);
+        if (nspin < 0 || samples <= 0 || limit <= 0) {
+                fprintf(stderr, "usage: schedlat [spinners [samples [spin-limit in Mcycles]]]\n");
+                return 1;
+        }
+
+        stop = mmap(NULL, sizeof(*stop), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANON, -1, 0);
+        if (MAP_FAILED == stop) {
+                fprintf(stderr, "schedlat: mmap: %s\n", strerror(errno));
+                return 1;
+        }
+        *stop = 0;
+
+        if (0 != measure("idle", samples))
+                return 1;
+
+        for (i = 0; i < nspin; i++) {
+                if (0 > (pid = fork())) {
+                        fprintf(stderr, "schedlat: fork: %s\n", strerror(errno));
+                        break;
+                } else if (0 == pid) {
+                        spin((uint64_t)limit * 1000000);
+                }
+        }
+        nspin = i;
+
+        printf("%d spinners running\n", nspin);
+        failed = measure("with spinners", samples);
+
+        *stop = 1;
+        for (i = 0; i < nspin; i++)
+                wait(NULL);
+        return failed;
+}
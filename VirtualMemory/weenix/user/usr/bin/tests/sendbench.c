@@ -0,0 +1,212 @@
+/*
+ * Measures how fast a file can be copied to another file, to a pipe and
+ * to /dev/null with read() and write() through a buffer here and with
+ * sendfile(), which moves the data without it leaving the kernel, then
+ * checks that:
+ * - the copies are the same as the original,
+ * - sendfile() at an offset leaves the file position alone,
+ * - splice() from a pipe gives back what was written to it,
+ * - sendfile() from a file to itself fails with EINVAL.
+ *
+ * usage: sendbench [KiB]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SRC "/sendbench.src"
+#define DST "/sendbench.dst"
+#define BUFSZ 4096
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+static char buf[BUFSZ], buf2[BUFSZ];
+
+static int copy_rw(int in, int out)
+{
+        int n;
+
+        while ((n = read(in, buf, BUFSZ)) > 0) {
+                if (n != write(out, buf, n))
+                        return -1;
+        }
+        return n;
+}
+
+static int copy_sendfile(int in, int out)
+{
+        int n;
+
+        while ((n = sendfile(out, in, NULL, 16 * BUFSZ)) > 0)
+                ;
+        return n;
+}
+
+static void report(const char *what, int kib, uint64_t cycles)
+{
+        printf("  %-28s %8u kcycles %6u bytes/kcycle\n", what, (uint32_t)(cycles / 1000),
+               (uint32_t)((uint64_t) kib * 1024 * 1000 / (cycles ? cycles : 1)));
+}
+
+/* Copies SRC to out_path, or to a pipe drained by a child if out_path is
+ * NULL, and reports how long it took */
+static int timed_copy(const char *what, const char *out_path, int kib,
+                      int (*copy)(int, int))
+{
+        uint64_t start;
+        int in, out, pipefd[2], pid = -1, status, ret;
+
+        if (0 > (in = open(SRC, O_RDONLY, 0)))
+                return -1;
+        if (NULL != out_path) {
+                out = open(out_path, O_WRONLY | O_CREAT, 0);
+        } else if (0 == pipe(pipefd)) {
+                if (0 == (pid = fork())) {
+                        close(pipefd[1]);
+                        while (0 < read(pipefd[0], buf2, BUFSZ))
+                                ;
+                        exit(0);
+                }
+                close(pipefd[0]);
+                out = pipefd[1];
+        } else {
+                out = -1;
+        }
+        if (out < 0) {
+                close(in);
+                return -1;
+        }
+
+        start = rdtsc();
+        ret = copy(in, out);
+        close(out);
+        if (pid > 0)
+                waitpid(pid, 0, &status);
+        report(what, kib, rdtsc() - start);
+        close(in);
+        return ret;
+}
+
+static int same_files(const char *a, const char *b)
+{
+        int fa, fb, na, nb, same = 1;
+
+        fa = open(a, O_RDONLY, 0);
+        fb = open(b, O_RDONLY, 0);
+        do {
+                na = read(fa, buf, BUFSZ);
+                nb = read(fb, buf2, BUFSZ);
+                if (na != nb || (na > 0 && 0 != memcmp(buf, buf2, na)))
+                        same = 0;
+        } while (same && na > 0);
+        close(fa);
+        close(fb);
+        return same;
+}
+
+static int checks(void)
+{
+        int fd, out, pipefd[2], n, failed = 0;
+        off_t off = 100;
+
+        /* sendfile at an offset, leaving f_pos at 0 */
+        fd = open(SRC, O_RDONLY, 0);
+        unlink(DST);
+        out = open(DST, O_WRONLY | O_CREAT, 0);
+        if (50 != sendfile(out, fd, &off, 50) || 150 != off || 0 != lseek(fd, 0, SEEK_CUR)) {
+                printf("sendbench: sendfile at an offset went wrong\n");
+                failed = 1;
+        }
+        close(out);
+        out = open(DST, O_RDONLY, 0);
+        pread(fd, buf, 50, 100);
+        if (50 != read(out, buf2, BUFSZ) || 0 != memcmp(buf, buf2, 50)) {
+                printf("sendbench: sendfile at an offset copied the wrong bytes\n");
+                failed = 1;
+        }
+        close(out);
+
+        if (0 <= sendfile(fd, fd, NULL, 10) || EINVAL != errno) {
+                printf("sendbench: sendfile from a file to itself should fail with EINVAL\n");
+                failed = 1;
+        }
+
+        /* splice from a pipe to a file */
+        pipe(pipefd);
+        write(pipefd[1], "spliced", 7);
+        close(pipefd[1]);
+        unlink(DST);
+        out = open(DST, O_RDWR | O_CREAT, 0);
+        off = 3;
+        if (7 != (n = splice(pipefd[0], NULL, out, &off, 100)) || 10 != off
+            || 0 != splice(pipefd[0], NULL, out, NULL, 100)
+            || 7 != pread(out, buf, 100, 3) || 0 != memcmp(buf, "spliced", 7)) {
+                printf("sendbench: splice from a pipe went wrong (%d)\n", n);
+                failed = 1;
+        }
+        close(out);
+        close(pipefd[0]);
+        close(fd);
+        return failed;
+}
+
+int main(int argc, char **argv)
+{
+        int kib = 512, fd, i, j, failed = 0;
+
+        if (argc > 1)
+                kib = atoi(argv[1]);
+        if (kib <= 0) {
+                fprintf(stderr, "usage: sendbench [KiB]\n");
+                return 1;
+        }
+
+        unlink(SRC);
+        unlink(DST);
+        if (0 > (fd = open(SRC, O_WRONLY | O_CREAT, 0))) {
+                fprintf(stderr, "sendbench: open: %s\n", strerror(errno));
+                return 1;
+        }
+        for (i = 0; i < kib / 4; i++) {
+                for (j = 0; j < BUFSZ; j++)
+                        buf[j] = (char)(i * 131 + j);
+                write(fd, buf, BUFSZ);
+        }
+        close(fd);
+        kib = kib / 4 * 4;
+        printf("copying %d KiB\n", kib);
+
+        if (0 > timed_copy("file to file, read+write", DST, kib, copy_rw)
+            || !same_files(SRC, DST)) {
+                printf("sendbench: read+write copy failed\n");
+                failed = 1;
+        }
+        if (0 > timed_copy("file to file, sendfile", DST, kib, copy_sendfile)
+            || !same_files(SRC, DST)) {
+                printf("sendbench: sendfile copy failed\n");
+                failed = 1;
+        }
+        if (0 > timed_copy("file to pipe, read+write", NULL, kib, copy_rw)
+            || 0 > timed_copy("file to pipe, sendfile", NULL, kib, copy_sendfile)
+            || 0 > timed_copy("file to /dev/null, read+write", "/dev/null", kib, copy_rw)
+            || 0 > timed_copy("file to /dev/null, sendfile", "/dev/null", kib, copy_sendfile)) {
+                printf("sendbench: copy failed: %s\n", strerror(errno));
+                failed = 1;
+        }
+
+        failed |= checks();
+        unlink(SRC);
+        unlink(DST);
+        if (!failed)
+                printf("sendbench: ok\n");
+        return failed;
+}
@@ -0,0 +1,77 @@
+/*
+ * Checks nanosleep and sleep against the time stamp counter. Each sleep
+ * should take at least as long as was asked for, and (on an idle system)
+ * not more than a couple of timer ticks longer. The counter is calibrated
+ * against sleep(1), so the reported times are only as good as that.
+ *
+ * usage: sleeptest [samples]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+int main(int argc, char **argv)
+{
+        static const long reqs[] = { 1000000, 10000000, 50000000, 200000000 };
+        struct timespec ts;
+        uint64_t start, per_sec, took;
+        unsigned int i, j, samples = 5;
+        int failed = 0;
+
+        if (argc > 1)
+                samples = atoi(argv[1]);
+        if (samples == 0) {
+                fprintf(stderr, "usage: sleeptest [samples]\n");
+                return 1;
+        }
+
+        start = rdtsc();
+        if (0 != sleep(1)) {
+                fprintf(stderr, "sleeptest: sleep(1) returned early\n");
+                return 1;
+        }
+        per_sec = rdtsc() - start;
+        printf("sleep(1) took %u Mcycles\n", (unsigned)(per_sec / 1000000));
+
+        ts.tv_sec = 0;
+        ts.tv_nsec = 1000000000;
+        if (0 == nanosleep(&ts, NULL) || EINVAL != errno) {
+                fprintf(stderr, "sleeptest: nanosleep accepted tv_nsec = 1e9\n");
+                failed = 1;
+        }
+
+        for (i = 0; i < sizeof(reqs) / sizeof(reqs[0]); i++) {
+                uint64_t min = (uint64_t) -1, max = 0;
+                for (j = 0; j < samples; j++) {
+                        ts.tv_sec = 0;
+                        ts.tv_nsec = reqs[i];
+                        start = rdtsc();
+                        if (0 != nanosleep(&ts, NULL)) {
+                                fprintf(stderr, "sleeptest: nanosleep: %s\n", strerror(errno));
+                                return 1;
+                        }
+                        took = rdtsc() - start;
+                        if (took < min)
+                                min = took;
+                        if (took > max)
+                                max = took;
+                }
+                /* Convert to microseconds using the calibration above */
+                printf("nanosleep %6ld us: min %8u us  max %8u us\n",
+                       reqs[i] / 1000,
+                       (unsigned)(min * 1000000 / per_sec),
+                       (unsigned)(max * 1000000 / per_sec));
+        }
+        return failed;
+}
@@ -0,0 +1,122 @@
+/*
+ * Compares the cost of starting a program with fork+execve, vfork+execve
+ * and posix_spawn. The program started is this one with "-child", which
+ * exits right away. The parent first dirties a number of heap pages, to
+ * show what fork pays for copying the address space that exec then
+ * throws away.
+ *
+ * usage: spawnbench [iterations [pages]]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <spawn.h>
+
+#define SELF "/usr/bin/spawnbench"
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+static char *child_argv[] = { SELF, "-child", NULL };
+static char *child_envp[] = { NULL };
+
+static int run_fork(void)
+{
+        int pid, status;
+
+        if (0 == (pid = fork())) {
+                execve(SELF, child_argv, child_envp);
+                exit(1);
+        }
+        if (0 > pid || 0 > waitpid(pid, 0, &status))
+                return -1;
+        return status;
+}
+
+static int run_vfork(void)
+{
+        int pid, status;
+
+        if (0 == (pid = vfork())) {
+                execve(SELF, child_argv, child_envp);
+                _exit(1);
+        }
+        if (0 > pid || 0 > waitpid(pid, 0, &status))
+                return -1;
+        return status;
+}
+
+static int run_spawn(void)
+{
+        int pid, status;
+
+        if (0 != posix_spawn(&pid, SELF, NULL, NULL, child_argv, child_envp))
+                return -1;
+        if (0 > waitpid(pid, 0, &status))
+                return -1;
+        return status;
+}
+
+static uint64_t bench(const char *name, int (*run)(void), int iters)
+{
+        uint64_t start, cycles;
+        int i;
+
+        start = rdtsc();
+        for (i = 0; i < iters; i++) {
+                if (0 != run()) {
+                        fprintf(stderr, "%s: iteration %d failed: %s\n",
+                                name, i, strerror(errno));
+                        exit(1);
+                }
+        }
+        cycles = rdtsc() - start;
+
+        printf("%-12s %8u kcycles/spawn\n", name,
+               (unsigned)(cycles / iters / 1000));
+        return cycles;
+}
+
+int main(int argc, char **argv)
+{
+        int iters = 100;
+        int pages = 256;
+        char *heap;
+        uint64_t forkc, vforkc, spawnc;
+
+        if (argc == 2 && !strcmp(argv[1], "-child"))
+                return 0;
+        if (argc > 1)
+                iters = atoi(argv[1]);
+        if (argc > 2)
+                pages = atoi(argv[2]);
+        if (iters <= 0 || pages < 0) {
+                fprintf(stderr, "usage: spawnbench [iterations [pages]]\n");
+                return 1;
+        }
+
+        /* Give fork something to copy */
+        if (pages > 0) {
+                if (NULL == (heap = malloc(pages * 4096))) {
+                        fprintf(stderr, "spawnbench: out of memory\n");
+                        return 1;
+                }
+                memset(heap, 'x', pages * 4096);
+        }
+
+        printf("%d spawns each, %d dirty heap pages in the parent\n", iters, pages);
+        forkc = bench("fork+execve", run_fork, iters);
+        vforkc = bench("vfork+execve", run_vfork, iters);
+        spawnc = bench("posix_spawn", run_spawn, iters);
+
+        printf("vfork+execve is %u%% of fork+execve\n", (unsigned)(vforkc * 100 / forkc));
+        printf("posix_spawn is %u%% of fork+execve\n", (unsigned)(spawnc * 100 / forkc));
+        return 0;
+}
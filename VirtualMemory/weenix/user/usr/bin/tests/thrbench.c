@@ -0,0 +1,193 @@
+/*
+ * Compares thread-per-request with fork-per-request. Each request sums a
+ * slice of a table; a batch of requests is started at once and then
+ * waited for. With threads each request is a pthread_create() and a
+ * pthread_join() and its result is stored straight into a shared array;
+ * with processes it is a fork(), which copies the address space, and a
+ * waitpid() for the result as an exit status.
+ *
+ * Afterwards, threads increment a counter under a mutex to check that
+ * they really share memory and that the mutex works.
+ *
+ * Threads need MTP=1 in Config.mk.
+ *
+ * usage: thrbench [requests [batch [table KiB]]]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread/pthread.h>
+
+#define MAX_BATCH 64
+#define SLICE 1024
+#define COUNT 1000
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+static uint32_t *table;
+static int nslices;
+static uint32_t results[MAX_BATCH];
+
+static uint32_t serve(int req)
+{
+        uint32_t *slice = table + (req % nslices) * SLICE;
+        uint32_t sum = 0;
+        int i;
+
+        for (i = 0; i < SLICE; i++)
+                sum += slice[i];
+        return sum & 0xff;
+}
+
+static void *thread_req(void *arg)
+{
+        int req = (int) arg;
+        results[req % MAX_BATCH] = serve(req);
+        return NULL;
+}
+
+static int by_threads(int nreq, int batch)
+{
+        pthread_t thr[MAX_BATCH];
+        int i, j, n, err;
+
+        for (i = 0; i < nreq; i += n) {
+                n = nreq - i < batch ? nreq - i : batch;
+                for (j = 0; j < n; j++) {
+                        if (0 != (err = pthread_create(&thr[j], NULL, thread_req, (void *)(i + j)))) {
+                                fprintf(stderr, "thrbench: pthread_create: %s\n", strerror(err));
+                                return 1;
+                        }
+                }
+                for (j = 0; j < n; j++) {
+                        pthread_join(thr[j], NULL);
+                        if (results[(i + j) % MAX_BATCH] != serve(i + j)) {
+                                fprintf(stderr, "thrbench: request %d got a wrong result\n", i + j);
+                                return 1;
+                        }
+                }
+        }
+        return 0;
+}
+
+static int by_processes(int nreq, int batch)
+{
+        int pid[MAX_BATCH];
+        int i, j, n, status;
+
+        for (i = 0; i < nreq; i += n) {
+                n = nreq - i < batch ? nreq - i : batch;
+                for (j = 0; j < n; j++) {
+                        if (0 > (pid[j] = fork())) {
+                                fprintf(stderr, "thrbench: fork: %s\n", strerror(errno));
+                                return 1;
+                        } else if (0 == pid[j]) {
+                                exit(serve(i + j));
+                        }
+                }
+                for (j = 0; j < n; j++) {
+                        if (0 > waitpid(pid[j], 0, &status) || (uint32_t)status != serve(i + j)) {
+                                fprintf(stderr, "thrbench: request %d got a wrong result\n", i + j);
+                                return 1;
+                        }
+                }
+        }
+        return 0;
+}
+
+static void report(const char *what, int nreq, uint64_t cycles)
+{
+        printf("%-24s %8u kcycles/request\n", what, (uint32_t)(cycles / nreq / 1000));
+}
+
+static pthread_mutex_t count_mtx;
+static int count;
+
+static void *counter(void *arg)
+{
+        int i;
+
+        for (i = 0; i < COUNT; i++) {
+                pthread_mutex_lock(&count_mtx);
+                count++;
+                if (0 == i % 64)
+                        pthread_yield();
+                pthread_mutex_unlock(&count_mtx);
+        }
+        return arg;
+}
+
+static int check_mutex(int nthr)
+{
+        pthread_t thr[MAX_BATCH];
+        void *ret;
+        int i, n, failed = 0;
+
+        pthread_mutex_init(&count_mtx, NULL);
+        for (n = 0; n < nthr; n++) {
+                if (0 != pthread_create(&thr[n], NULL, counter, (void *) n))
+                        break;
+        }
+        for (i = 0; i < n; i++) {
+                if (0 != pthread_join(thr[i], &ret) || (int) ret != i)
+                        failed = 1;
+        }
+        pthread_mutex_destroy(&count_mtx);
+
+        if (failed || count != n * COUNT) {
+                printf("thrbench: %d threads counted to %d, expected %d\n",
+                       n, count, n * COUNT);
+                return 1;
+        }
+        printf("%d threads counted to %d under a mutex: ok\n", n, count);
+        return 0;
+}
+
+int main(int argc, char **argv)
+{
+        int nreq = 200, batch = 4, kib = 256;
+        uint64_t start;
+        int i;
+
+        if (argc > 1)
+                nreq = atoi(argv[1]);
+        if (argc > 2)
+                batch = atoi(argv[2]);
+        if (argc > 3)
+                kib = atoi(argv[3]);
+        if (nreq <= 0 || batch <= 0 || batch > MAX_BATCH || kib < 4) {
+                fprintf(stderr, "usage: thrbench [requests [batch (at most %d) [table KiB]]]\n",
+                        MAX_BATCH);
+                return 1;
+        }
+
+        nslices = kib * 1024 / (SLICE * sizeof(uint32_t));
+        if (NULL == (table = malloc(nslices * SLICE * sizeof(uint32_t)))) {
+                fprintf(stderr, "thrbench: out of memory\n");
+                return 1;
+        }
+        for (i = 0; i < nslices * SLICE; i++)
+                table[i] = i * 2654435761u;
+
+        printf("%d requests, %d at a time, %d KiB table\n", nreq, batch, kib);
+
+        start = rdtsc();
+        if (0 != by_threads(nreq, batch))
+                return 1;
+        report("thread per request", nreq, rdtsc() - start);
+
+        start = rdtsc();
+        if (0 != by_processes(nreq, batch))
+                return 1;
+        report("process per request", nreq, rdtsc() - start);
+
+        return check_mutex(batch);
+}
@@ -0,0 +1,92 @@
+/*
+ * Walks a directory tree like "ls -R -l" does, reading every directory
+ * and stat()ing every entry, several times over, and prints how long each
+ * pass took. The first pass reads the inodes in; later ones should find
+ * their vnodes still in core. The "vnodes" kshell command shows how many
+ * lookups hit and how many inodes were read.
+ *
+ * usage: treebench [passes [dir]]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#define MAX_DEPTH 16
+
+static inline uint64_t rdtsc(void)
+{
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+static int nentries;
+
+static int walk(char *path, int depth)
+{
+        struct dirent d;
+        struct stat st;
+        size_t len = strlen(path);
+        int fd, n;
+
+        if (0 > (fd = open(path, O_RDONLY, 0))) {
+                fprintf(stderr, "treebench: %s: %s\n", path, strerror(errno));
+                return 1;
+        }
+        while (0 < (n = getdents(fd, &d, sizeof(d)))) {
+                if (!strcmp(d.d_name, ".") || !strcmp(d.d_name, ".."))
+                        continue;
+                if (len + strlen(d.d_name) + 2 > MAXPATHLEN)
+                        continue;
+                if (len > 0 && '/' != path[len - 1])
+                        strcat(path, "/");
+                strcat(path, d.d_name);
+                if (0 > stat(path, &st)) {
+                        fprintf(stderr, "treebench: %s: %s\n", path, strerror(errno));
+                        close(fd);
+                        return 1;
+                }
+                nentries++;
+                if (S_ISDIR(st.st_mode) && depth < MAX_DEPTH && 0 != walk(path, depth + 1)) {
+                        close(fd);
+                        return 1;
+                }
+                path[len] = '\0';
+        }
+        close(fd);
+        if (0 > n) {
+                fprintf(stderr, "treebench: %s: %s\n", path, strerror(errno));
+                return 1;
+        }
+        return 0;
+}
+
+int main(int argc, char **argv)
+{
+        static char path[MAXPATHLEN];
+        uint64_t start;
+        int passes = 3, i;
+
+        if (argc > 1)
+                passes = atoi(argv[1]);
+        strcpy(path, argc > 2 ? argv[2] : "/");
+        if (passes <= 0) {
+                fprintf(stderr, "usage: treebench [passes [dir]]\n");
+                return 1;
+        }
+
+        for (i = 0; i < passes; i++) {
+                nentries = 0;
+                start = rdtsc();
+                if (0 != walk(path, 0))
+                        return 1;
+                printf("pass %d: %d entries in %u kcycles\n", i + 1, nentries,
+                       (uint32_t)((rdtsc() - start) / 1000));
+        }
+        return 0;
+}